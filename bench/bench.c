@@ -0,0 +1,607 @@
+// Benchmarks for the filename, slug and frontmatter hot paths, and for
+// creating, renaming and indexing notes in synthetic vaults.
+//
+//   bin/bench [--json] [--filter <substring>] [--vault-sizes <n,n,...>]
+//
+// Results are printed one benchmark per line, as tab separated columns or as
+// JSON objects with --json, so runs can be diffed across releases. Inputs are
+// generated from a fixed seed and every benchmark reports the best of
+// BENCH_ROUNDS rounds, which keeps the numbers stable between runs.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fuzzy.h"
+#include "index.h"
+#include "store.h"
+#include "utils.h"
+
+#define BENCH_ROUNDS 5
+#define BENCH_SEED 0x636f6e6e6f7465ULL
+// Number of distinct inputs cycled through by the micro benchmarks
+#define BENCH_INPUTS 256
+#define BENCH_NEW_NOTES 1000
+#define BENCH_RENAMES 1000
+#define BENCH_DEFAULT_VAULT_SIZES "1000,100000"
+
+// Allocation counting. Defining malloc and friends here overrides the libc
+// versions for the whole program, including the allocations libc makes
+// internally, such as those of regcomp.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static atomic_size_t allocations;
+
+void *malloc(size_t size) {
+  atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+
+typedef struct {
+  bool json;
+  const char *filter;
+  const char *vault_sizes;
+} BenchOptions;
+
+typedef struct {
+  const char *name;
+  size_t ops;           // Operations per round
+  double ns_per_op;     // Best round
+  double allocs_per_op; // Allocations made by the best round
+} BenchResult;
+
+// A benchmark runs `ops` operations per call and is called once per round
+typedef void (*BenchFn)(void *ctx, size_t ops);
+
+static BenchOptions options = {.vault_sizes = BENCH_DEFAULT_VAULT_SIZES};
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64*, so inputs are the same on every run
+static uint64_t rng_state = BENCH_SEED;
+
+static uint64_t rng_next() {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static const char *words[] = {"meeting", "Notes",  "on",       "the",     "Quarterly", "review", "draft",
+                              "ideas",   "for",    "Project",  "Connote", "reading",   "list",   "Café",
+                              "week",    "plan",   "research", "summary", "A",         "of",     "2024"};
+static const char *keywords[] = {"work", "journal", "project", "reading", "idea", "todo", "meeting", "research"};
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+static void random_title(char *dest, size_t dest_size) {
+  size_t word_count = 2 + rng_next() % 6;
+  size_t pos = 0;
+  dest[0] = '\0';
+  for (size_t i = 0; i < word_count; i++) {
+    pos += snprintf(dest + pos, dest_size - pos, "%s%s", i > 0 ? " " : "", words[rng_next() % COUNT(words)]);
+    if (pos >= dest_size)
+      break;
+  }
+}
+
+static void random_sig(char *dest, size_t dest_size) {
+  snprintf(dest, dest_size, "%u%c=%u", (unsigned)(rng_next() % 100), (char)('a' + rng_next() % 26),
+           (unsigned)(rng_next() % 10));
+}
+
+// IDs a minute apart from a fixed start
+static void bench_id(size_t i, char *id) { u64_to_id(20240101000000ULL + (i / 60) * 100 + i % 60, id); }
+
+typedef struct {
+  char id[ID_LEN + 1];
+  char title[MAX_TITLE_LEN];
+  char sig[MAX_SIG_LEN];
+  char keywords[3][MAX_KW_LEN];
+  size_t kw_count;
+  char filename[MAX_PATH_LEN];
+} BenchInput;
+
+static BenchInput inputs[BENCH_INPUTS];
+
+static void make_inputs() {
+  for (size_t i = 0; i < BENCH_INPUTS; i++) {
+    BenchInput *input = &inputs[i];
+    bench_id(i, input->id);
+    random_title(input->title, MAX_TITLE_LEN);
+    random_sig(input->sig, MAX_SIG_LEN);
+    input->kw_count = 1 + rng_next() % 3;
+    for (size_t k = 0; k < input->kw_count; k++) {
+      snprintf(input->keywords[k], MAX_KW_LEN, "%s", keywords[rng_next() % COUNT(keywords)]);
+    }
+
+    // A filename built from copies, since format_file_name sluggifies in place
+    char title[MAX_TITLE_LEN], sig[MAX_SIG_LEN], kw[3][MAX_KW_LEN];
+    char *kw_ptrs[3] = {kw[0], kw[1], kw[2]};
+    strcpy(title, input->title);
+    strcpy(sig, input->sig);
+    for (size_t k = 0; k < input->kw_count; k++) {
+      strcpy(kw[k], input->keywords[k]);
+    }
+    char path[MAX_PATH_LEN];
+    format_file_name("./", input->id, sig, title, kw_ptrs, input->kw_count, ".md", path);
+    strcpy(input->filename, path + 2);
+  }
+}
+
+static void report(const BenchResult *result) {
+  double ops_per_sec = result->ns_per_op > 0 ? 1e9 / result->ns_per_op : 0;
+  if (options.json) {
+    printf("{\"benchmark\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.1f, \"ops_per_sec\": %.0f, \"allocs_per_op\": %.2f}\n",
+           result->name, result->ops, result->ns_per_op, ops_per_sec, result->allocs_per_op);
+  } else {
+    printf("%-28s\t%zu\t%.1f\t%.0f\t%.2f\n", result->name, result->ops, result->ns_per_op, ops_per_sec,
+           result->allocs_per_op);
+  }
+  fflush(stdout);
+}
+
+static bool selected(const char *name) { return options.filter == NULL || strstr(name, options.filter) != NULL; }
+
+// Run `fn` for BENCH_ROUNDS rounds of `ops` operations and report the best
+static void run_bench(const char *name, BenchFn fn, void *ctx, size_t ops) {
+  if (!selected(name))
+    return;
+
+  BenchResult result = {.name = name, .ops = ops, .ns_per_op = -1};
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    size_t allocs_before = atomic_load(&allocations);
+    uint64_t start = now_ns();
+    fn(ctx, ops);
+    uint64_t elapsed = now_ns() - start;
+    size_t allocs = atomic_load(&allocations) - allocs_before;
+
+    double ns_per_op = (double)elapsed / ops;
+    if (result.ns_per_op < 0 || ns_per_op < result.ns_per_op) {
+      result.ns_per_op = ns_per_op;
+      result.allocs_per_op = (double)allocs / ops;
+    }
+  }
+  report(&result);
+}
+
+// Keep the compiler from discarding results
+static volatile size_t sink;
+
+static void bench_format_file_name(void *ctx, size_t ops) {
+  char dest[MAX_PATH_LEN];
+  char title[MAX_TITLE_LEN], sig[MAX_SIG_LEN], kw[3][MAX_KW_LEN];
+  char *kw_ptrs[3] = {kw[0], kw[1], kw[2]};
+  for (size_t i = 0; i < ops; i++) {
+    // Copies, since format_file_name sluggifies in place and every call
+    // should see the raw inputs
+    BenchInput *input = &inputs[i % BENCH_INPUTS];
+    strcpy(title, input->title);
+    strcpy(sig, input->sig);
+    for (size_t k = 0; k < input->kw_count; k++) {
+      strcpy(kw[k], input->keywords[k]);
+    }
+    format_file_name("/vault/", input->id, sig, title, kw_ptrs, input->kw_count, ".md", dest);
+    sink += dest[20];
+  }
+}
+
+// Formatting alone, from components sluggified once up front as
+// `connote_file_at` does across ID collisions
+static void bench_format_file_name_parts(void *ctx, size_t ops) {
+  const FileNameParts *parts = ctx;
+  char dest[MAX_PATH_LEN];
+  for (size_t i = 0; i < ops; i++) {
+    format_file_name_parts(&parts[i % BENCH_INPUTS], dest, MAX_PATH_LEN);
+    sink += dest[20];
+  }
+}
+
+static void bench_parse_component(void *ctx, size_t ops) {
+  char *regex = ctx;
+  char component[MAX_TITLE_LEN];
+  for (size_t i = 0; i < ops; i++) {
+    component[0] = '\0';
+    try_match_and_write_component(inputs[i % BENCH_INPUTS].filename, component, regex, MAX_TITLE_LEN);
+    sink += component[0];
+  }
+}
+
+static void bench_read_id(void *ctx, size_t ops) {
+  char id[ID_LEN + 1];
+  for (size_t i = 0; i < ops; i++) {
+    const char *filename = inputs[i % BENCH_INPUTS].filename;
+    if (has_valid_id(filename))
+      read_id(filename, id);
+    sink += id[0];
+  }
+}
+
+typedef void (*SlugFn)(char *str);
+
+static void bench_sluggify(void *ctx, size_t ops) {
+  SlugFn fn = *(SlugFn *)ctx;
+  char buffer[MAX_TITLE_LEN];
+  for (size_t i = 0; i < ops; i++) {
+    // Titles make the longest inputs for every slug function
+    strcpy(buffer, inputs[i % BENCH_INPUTS].title);
+    fn(buffer);
+    sink += buffer[0];
+  }
+}
+
+static void bench_sluggify_keywords(void *ctx, size_t ops) {
+  char buffer[3][MAX_KW_LEN];
+  char *kw_ptrs[3] = {buffer[0], buffer[1], buffer[2]};
+  for (size_t i = 0; i < ops; i++) {
+    BenchInput *input = &inputs[i % BENCH_INPUTS];
+    for (size_t k = 0; k < input->kw_count; k++) {
+      strcpy(buffer[k], input->keywords[k]);
+    }
+    sluggify_keywords(kw_ptrs, input->kw_count);
+    sink += buffer[0][0];
+  }
+}
+
+static void bench_write_frontmatter(void *ctx, size_t ops) {
+  char buffer[2048];
+  for (size_t i = 0; i < ops; i++) {
+    BenchInput *input = &inputs[i % BENCH_INPUTS];
+    char *kw_ptrs[3] = {input->keywords[0], input->keywords[1], input->keywords[2]};
+    sink += write_frontmatter_to_buffer(buffer, sizeof(buffer), input->id, input->sig, input->title, kw_ptrs,
+                                        input->kw_count);
+  }
+}
+
+static void bench_read_frontmatter(void *ctx, size_t ops) {
+  char buffer[2048];
+  BenchInput *input = &inputs[0];
+  char *kw_ptrs[3] = {input->keywords[0], input->keywords[1], input->keywords[2]};
+  size_t length =
+      write_frontmatter_to_buffer(buffer, sizeof(buffer), input->id, input->sig, input->title, kw_ptrs, input->kw_count);
+  Frontmatter frontmatter;
+  for (size_t i = 0; i < ops; i++) {
+    read_frontmatter(buffer, length, &frontmatter);
+    sink += frontmatter.tag_count;
+  }
+}
+
+// Vault benchmarks
+
+typedef struct {
+  char dir[MAX_PATH_LEN - 1];  // Without a trailing slash
+  char dir_path[MAX_PATH_LEN]; // With a trailing slash
+  int dir_fd;
+  size_t size;
+  size_t next_id;   // Next ID for new notes
+  char **names;     // Notes to rename, updated as they are renamed
+  size_t name_count;
+  size_t generation; // Rename round, so each round changes every name
+} Vault;
+
+static int make_vault(Vault *vault, size_t size) {
+  memset(vault, 0, sizeof(*vault));
+  const char *tmp = getenv("TMPDIR");
+  snprintf(vault->dir, MAX_PATH_LEN, "%s/connote_bench_XXXXXX", tmp ? tmp : "/tmp");
+  if (mkdtemp(vault->dir) == NULL) {
+    fprintf(stderr, "ERROR: Could not create vault directory.\n");
+    return FAILURE;
+  }
+  snprintf(vault->dir_path, MAX_PATH_LEN, "%s/", vault->dir);
+  vault->dir_fd = open(vault->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  vault->size = size;
+
+  rng_state = BENCH_SEED;
+  for (size_t i = 0; i < size; i++) {
+    BenchInput *input = &inputs[i % BENCH_INPUTS];
+    char id[ID_LEN + 1];
+    bench_id(i, id);
+    char *kw_ptrs[3] = {input->keywords[0], input->keywords[1], input->keywords[2]};
+
+    // Link to an earlier note now and then, as real vaults do
+    char body[64];
+    size_t body_length = 0;
+    if (i > 0 && rng_next() % 4 == 0) {
+      char target[ID_LEN + 1];
+      bench_id(rng_next() % i, target);
+      body_length = snprintf(body, sizeof(body), "See [[denote:%s]].\n", target);
+    }
+
+    char dest[MAX_PATH_LEN];
+    if (connote_file_at(vault->dir_fd, vault->dir_path, id, input->sig, input->title, kw_ptrs, input->kw_count, ".md",
+                        body, body_length, FSYNC_NONE, dest) != SUCCESS)
+      return FAILURE;
+    if (i < BENCH_RENAMES) {
+      vault->names = realloc(vault->names, (vault->name_count + 1) * sizeof(char *));
+      vault->names[vault->name_count++] = strdup(dest);
+    }
+  }
+  vault->next_id = size;
+
+  return SUCCESS;
+}
+
+static void free_vault(Vault *vault) {
+  for (size_t i = 0; i < vault->name_count; i++) {
+    free(vault->names[i]);
+  }
+  free(vault->names);
+  close(vault->dir_fd);
+
+  char command[MAX_PATH_LEN + 16];
+  snprintf(command, sizeof(command), "rm -rf '%s'", vault->dir);
+  if (system(command) != 0)
+    fprintf(stderr, "ERROR: Could not remove %s\n", vault->dir);
+}
+
+static void bench_new(void *ctx, size_t ops) {
+  Vault *vault = ctx;
+  for (size_t i = 0; i < ops; i++) {
+    BenchInput *input = &inputs[i % BENCH_INPUTS];
+    char id[ID_LEN + 1];
+    bench_id(vault->next_id++, id);
+    char *kw_ptrs[3] = {input->keywords[0], input->keywords[1], input->keywords[2]};
+    char dest[MAX_PATH_LEN];
+    connote_file_at(vault->dir_fd, vault->dir_path, id, input->sig, input->title, kw_ptrs, input->kw_count, ".md",
+                    NULL, 0, FSYNC_NONE, dest);
+  }
+}
+
+// The steps of `connote rename --keywords <kw>`: read the ID and components
+// back from the filename, format the new name and rename
+static void bench_rename(void *ctx, size_t ops) {
+  Vault *vault = ctx;
+  char keyword[MAX_KW_LEN];
+  snprintf(keyword, MAX_KW_LEN, "round%zu", vault->generation++);
+
+  for (size_t i = 0; i < ops && i < vault->name_count; i++) {
+    char *path = vault->names[i];
+    char id[ID_LEN + 1];
+    read_id(path + strlen(vault->dir_path), id);
+
+    char sig[MAX_SIG_LEN] = {0};
+    char title[MAX_TITLE_LEN] = {0};
+    try_match_and_write_component(path, sig, SIG_REGEX, MAX_SIG_LEN);
+    try_match_and_write_component(path, title, TITLE_REGEX, MAX_TITLE_LEN);
+
+    char new_keyword[MAX_KW_LEN];
+    strcpy(new_keyword, keyword);
+    char *kw_ptrs[1] = {new_keyword};
+    char dest[MAX_PATH_LEN];
+    format_file_name(vault->dir_path, id, sig, title, kw_ptrs, 1, ".md", dest);
+
+    if (rename(path, dest) == 0) {
+      free(vault->names[i]);
+      vault->names[i] = strdup(dest);
+    }
+  }
+}
+
+static void bench_index_build(void *ctx, size_t ops) {
+  Vault *vault = ctx;
+  for (size_t i = 0; i < ops; i++) {
+    NoteIndex index;
+    if (index_build(&index, vault->dir) == SUCCESS) {
+      sink += index.count;
+      index_free(&index);
+    }
+  }
+}
+
+// Every note read and parsed, as on the first build of a vault
+static void bench_index_build_cold(void *ctx, size_t ops) {
+  Vault *vault = ctx;
+  for (size_t i = 0; i < ops; i++) {
+    unlinkat(vault->dir_fd, STORE_FILE_NAME, 0);
+    bench_index_build(ctx, 1);
+  }
+}
+
+typedef struct {
+  FuzzyIndex index;
+  char **titles;
+  size_t count;
+} FuzzyBench;
+
+static const char *fuzzy_typed = "meeting notes";
+
+static void bench_fuzzy_build(void *ctx, size_t ops) {
+  FuzzyBench *bench = ctx;
+  for (size_t i = 0; i < ops; i++) {
+    FuzzyIndex index;
+    if (fuzzy_index_build_titles(&index, (const char *const *)bench->titles, bench->count) == SUCCESS) {
+      sink += index.count;
+      fuzzy_index_free(&index);
+    }
+  }
+}
+
+// One picker session: type `fuzzy_typed` a character at a time, then delete
+// it again, one search per keystroke
+static void bench_fuzzy_keystrokes(void *ctx, size_t ops) {
+  FuzzyBench *bench = ctx;
+  FuzzySession session;
+  fuzzy_session_init(&session);
+  FuzzyMatch results[FUZZY_DEFAULT_LIMIT];
+  size_t length = strlen(fuzzy_typed);
+  for (size_t i = 0; i < ops; i++) {
+    size_t step = 1 + i % (2 * length - 1);
+    size_t prefix = step <= length ? step : 2 * length - step;
+    char query[FUZZY_MAX_QUERY_LEN];
+    snprintf(query, sizeof(query), "%.*s", (int)prefix, fuzzy_typed);
+    sink += fuzzy_search(&session, &bench->index, query, results, FUZZY_DEFAULT_LIMIT, NULL);
+  }
+  fuzzy_session_free(&session);
+}
+
+// The first keystroke, with nothing to narrow down from
+static void bench_fuzzy_first_keystroke(void *ctx, size_t ops) {
+  FuzzyBench *bench = ctx;
+  FuzzyMatch results[FUZZY_DEFAULT_LIMIT];
+  for (size_t i = 0; i < ops; i++) {
+    FuzzySession session;
+    fuzzy_session_init(&session);
+    char query[2] = {fuzzy_typed[i % strlen(fuzzy_typed)], '\0'};
+    sink += fuzzy_search(&session, &bench->index, query, results, FUZZY_DEFAULT_LIMIT, NULL);
+    fuzzy_session_free(&session);
+  }
+}
+
+// Title search needs no files, so it runs over titles held in memory
+static void run_fuzzy_benches(size_t size) {
+  char build_name[64], keystroke_name[64], first_name[64];
+  snprintf(build_name, sizeof(build_name), "fuzzy/%zu/build", size);
+  snprintf(keystroke_name, sizeof(keystroke_name), "fuzzy/%zu/keystroke", size);
+  snprintf(first_name, sizeof(first_name), "fuzzy/%zu/first_keystroke", size);
+  if (!selected(build_name) && !selected(keystroke_name) && !selected(first_name))
+    return;
+
+  FuzzyBench bench = {.count = size};
+  bench.titles = malloc(size * sizeof(char *));
+  rng_state = BENCH_SEED;
+  for (size_t i = 0; i < size; i++) {
+    char title[MAX_TITLE_LEN];
+    random_title(title, MAX_TITLE_LEN);
+    sluggify_title(title);
+    bench.titles[i] = strdup(title);
+  }
+
+  run_bench(build_name, bench_fuzzy_build, &bench, 1);
+  if (fuzzy_index_build_titles(&bench.index, (const char *const *)bench.titles, size) == SUCCESS) {
+    run_bench(keystroke_name, bench_fuzzy_keystrokes, &bench, 2 * strlen(fuzzy_typed) - 1);
+    run_bench(first_name, bench_fuzzy_first_keystroke, &bench, strlen(fuzzy_typed));
+    fuzzy_index_free(&bench.index);
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    free(bench.titles[i]);
+  }
+  free(bench.titles);
+}
+
+static void run_vault_benches(size_t size) {
+  char new_name[64], rename_name[64], index_name[64], cold_name[64];
+  snprintf(new_name, sizeof(new_name), "vault/%zu/new", size);
+  snprintf(rename_name, sizeof(rename_name), "vault/%zu/rename", size);
+  snprintf(index_name, sizeof(index_name), "vault/%zu/index_build", size);
+  snprintf(cold_name, sizeof(cold_name), "vault/%zu/index_build_cold", size);
+  if (!selected(new_name) && !selected(rename_name) && !selected(index_name) && !selected(cold_name))
+    return;
+
+  Vault vault;
+  if (make_vault(&vault, size) != SUCCESS) {
+    fprintf(stderr, "ERROR: Could not create a vault of %zu notes.\n", size);
+    return;
+  }
+
+  // Indexing first, while the vault holds exactly `size` notes
+  run_bench(cold_name, bench_index_build_cold, &vault, 1);
+  run_bench(index_name, bench_index_build, &vault, 1);
+  run_bench(rename_name, bench_rename, &vault, size < BENCH_RENAMES ? size : BENCH_RENAMES);
+  run_bench(new_name, bench_new, &vault, BENCH_NEW_NOTES);
+
+  free_vault(&vault);
+}
+
+static int parse_options(int argc, char *argv[]) {
+  static struct option long_options[] = {
+      {       "json",       no_argument, 0, 'j'},
+      {     "filter", required_argument, 0, 'f'},
+      {"vault-sizes", required_argument, 0, 'v'},
+      {            0,                 0, 0,   0}
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "jf:v:", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'j':
+      options.json = true;
+      break;
+    case 'f':
+      options.filter = optarg;
+      break;
+    case 'v':
+      options.vault_sizes = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: bench [--json] [--filter <substring>] [--vault-sizes <n,n,...>]\n");
+      return FAILURE;
+    }
+  }
+  return SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+  if (parse_options(argc, argv) != SUCCESS)
+    return EXIT_FAILURE;
+
+  make_inputs();
+
+  if (!options.json)
+    printf("# benchmark\tops\tns_per_op\tops_per_sec\tallocs_per_op\n");
+
+  run_bench("format_file_name", bench_format_file_name, NULL, 100000);
+  // The parts point into copies, as file_name_parts sluggifies in place
+  static FileNameParts parts[BENCH_INPUTS];
+  static BenchInput part_inputs[BENCH_INPUTS];
+  memcpy(part_inputs, inputs, sizeof(inputs));
+  for (size_t i = 0; i < BENCH_INPUTS; i++) {
+    BenchInput *input = &part_inputs[i];
+    char *kw_ptrs[3] = {input->keywords[0], input->keywords[1], input->keywords[2]};
+    file_name_parts(&parts[i], "/vault/", input->id, input->sig, input->title, kw_ptrs, input->kw_count, ".md");
+  }
+  run_bench("format_file_name/parts", bench_format_file_name_parts, parts, 1000000);
+  run_bench("parse/id", bench_read_id, NULL, 100000);
+  run_bench("parse/title", bench_parse_component, TITLE_REGEX, 10000);
+  run_bench("parse/signature", bench_parse_component, SIG_REGEX, 10000);
+  run_bench("parse/keywords", bench_parse_component, KW_REGEX, 10000);
+
+  SlugFn slug_title = sluggify_title, slug_signature = sluggify_signature, slug_keyword = sluggify_keyword;
+  run_bench("sluggify_title", bench_sluggify, &slug_title, 100000);
+  run_bench("sluggify_signature", bench_sluggify, &slug_signature, 100000);
+  run_bench("sluggify_keyword", bench_sluggify, &slug_keyword, 100000);
+  run_bench("sluggify_keywords", bench_sluggify_keywords, NULL, 100000);
+
+  run_bench("write_frontmatter_to_buffer", bench_write_frontmatter, NULL, 100000);
+  run_bench("read_frontmatter", bench_read_frontmatter, NULL, 100000);
+
+  // Vault sizes are given as a comma separated list
+  char sizes[256];
+  snprintf(sizes, sizeof(sizes), "%s", options.vault_sizes);
+  for (char *size = strtok(sizes, ","); size != NULL; size = strtok(NULL, ",")) {
+    size_t n = strtoull(size, NULL, 10);
+    if (n > 0) {
+      run_vault_benches(n);
+      run_fuzzy_benches(n);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
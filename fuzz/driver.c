@@ -0,0 +1,172 @@
+// Standalone driver for the fuzz targets, for builds without libFuzzer.
+//
+//   bin/fuzz_<target> [-runs=N] [-seed=S] [file-or-directory ...]
+//
+// Every file given, and every file in each directory given, is run once,
+// so the binary can replay a corpus or a crash, or be driven by AFL with
+// `afl-fuzz -i fuzz/corpus -o findings -- bin/fuzz_<target> @@`. With no
+// arguments the input is read from stdin. -runs=N then runs N more inputs,
+// mutated from the files read and from tokens common in filenames, using a
+// fixed seed unless -seed is given.
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define DRIVER_MAX_INPUT 4096
+#define DRIVER_MAX_SEEDS 1024
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+} Input;
+
+static Input seeds[DRIVER_MAX_SEEDS];
+static size_t seed_count;
+static int files;
+
+static const char *tokens[] = {"--", "==", "__", "@@", ".", "-", "=", "_", "@", "|", "\\", "/", " ", "\t",
+                               "T",  "0",  "9",  "a",  "Z", ".md", ".org", "20240908T123445", "\xe2\x80\x98",
+                               "\xc3\xa9", "\xff"};
+
+static uint64_t rng_state = 0x66757a7a;
+
+static uint64_t rng_next() {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static void run_input(const uint8_t *data, size_t size) {
+  // Copy so reads past the end show up under a sanitiser
+  uint8_t *copy = malloc(size ? size : 1);
+  memcpy(copy, data, size);
+  LLVMFuzzerTestOneInput(copy, size);
+  free(copy);
+}
+
+static int run_file(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "ERROR: Could not open %s\n", path);
+    return -1;
+  }
+  uint8_t *data = malloc(DRIVER_MAX_INPUT);
+  size_t size = fread(data, 1, DRIVER_MAX_INPUT, file);
+  fclose(file);
+
+  run_input(data, size);
+  files++;
+  if (seed_count < DRIVER_MAX_SEEDS) {
+    seeds[seed_count++] = (Input){.data = data, .size = size};
+  } else {
+    free(data);
+  }
+  return 0;
+}
+
+static int run_path(const char *path) {
+  struct stat st;
+  if (stat(path, &st) == -1) {
+    fprintf(stderr, "ERROR: Could not stat %s\n", path);
+    return -1;
+  }
+  if (!S_ISDIR(st.st_mode))
+    return run_file(path);
+
+  DIR *dir = opendir(path);
+  if (dir == NULL)
+    return -1;
+  struct dirent *entry;
+  int outcome = 0;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue;
+    char child[4096];
+    snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+    if (run_path(child) != 0)
+      outcome = -1;
+  }
+  closedir(dir);
+  return outcome;
+}
+
+// Build an input by splicing tokens into a seed, or from tokens alone
+static size_t generate(uint8_t *data) {
+  size_t size = 0;
+  if (seed_count > 0 && rng_next() % 2 == 0) {
+    Input *seed = &seeds[rng_next() % seed_count];
+    size = seed->size;
+    memcpy(data, seed->data, size);
+  }
+
+  size_t edits = 1 + rng_next() % 8;
+  for (size_t i = 0; i < edits; i++) {
+    const char *token = tokens[rng_next() % (sizeof(tokens) / sizeof(tokens[0]))];
+    size_t length = strlen(token);
+    if (size + length >= DRIVER_MAX_INPUT)
+      break;
+
+    size_t at = size > 0 ? rng_next() % (size + 1) : 0;
+    switch (rng_next() % 3) {
+    case 0: // Insert
+      memmove(data + at + length, data + at, size - at);
+      memcpy(data + at, token, length);
+      size += length;
+      break;
+    case 1: // Overwrite
+      if (at + length > size)
+        size = at + length;
+      memcpy(data + at, token, length);
+      break;
+    default: // Delete
+      if (size > 0) {
+        size_t count = 1 + rng_next() % 4;
+        if (at + count > size)
+          count = size - at;
+        memmove(data + at, data + at + count, size - at - count);
+        size -= count;
+      }
+    }
+  }
+  return size;
+}
+
+int main(int argc, char *argv[]) {
+  long runs = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "-runs=", 6) == 0) {
+      runs = strtol(argv[i] + 6, NULL, 10);
+    } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+      rng_state = strtoull(argv[i] + 6, NULL, 10) | 1;
+    } else if (run_path(argv[i]) != 0) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (argc == 1) {
+    uint8_t *data = malloc(DRIVER_MAX_INPUT);
+    size_t size = fread(data, 1, DRIVER_MAX_INPUT, stdin);
+    run_input(data, size);
+    free(data);
+  }
+
+  uint8_t data[DRIVER_MAX_INPUT];
+  for (long i = 0; i < runs; i++) {
+    size_t size = generate(data);
+    run_input(data, size);
+  }
+
+  for (size_t i = 0; i < seed_count; i++) {
+    free(seeds[i].data);
+  }
+  printf("Ran %d files and %ld generated inputs through %s.\n", files, runs, argv[0]);
+
+  return EXIT_SUCCESS;
+}
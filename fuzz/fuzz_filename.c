@@ -0,0 +1,53 @@
+// Differential fuzz target for the filename parsers: the hand-written
+// component matcher against the component regexes, and split_at_char
+// against its reference.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "reference.h"
+#include "utils.h"
+
+static void check_component(char *filename, char *regex, const char *what) {
+  char expected[MAX_PATH_LEN];
+  char actual[MAX_PATH_LEN];
+  int expected_outcome = reference_component(filename, regex, expected, sizeof(expected));
+  int actual_outcome = try_match_and_write_component(filename, actual, regex, sizeof(actual));
+  if (expected_outcome != actual_outcome || (actual_outcome == SUCCESS && strcmp(expected, actual) != 0))
+    fuzz_mismatch(what, filename);
+}
+
+static void check_split(char *str) {
+  // Small pieces and few of them, so the limits are exercised
+  char expected_pieces[4][8], actual_pieces[4][8];
+  char *expected[4], *actual[4];
+  for (int i = 0; i < 4; i++) {
+    expected[i] = expected_pieces[i];
+    actual[i] = actual_pieces[i];
+  }
+
+  int expected_count = reference_split_at_char(str, '_', expected, 4, 8);
+  int actual_count = split_at_char(str, '_', actual, 4, 8);
+  if (expected_count != actual_count)
+    fuzz_mismatch("split_at_char", str);
+  for (int i = 0; i < actual_count; i++) {
+    if (strcmp(expected[i], actual[i]) != 0)
+      fuzz_mismatch("split_at_char", str);
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  char filename[MAX_PATH_LEN];
+  if (size >= MAX_PATH_LEN)
+    size = MAX_PATH_LEN - 1;
+  memcpy(filename, data, size);
+  filename[size] = '\0';
+
+  check_component(filename, TITLE_REGEX, "title");
+  check_component(filename, SIG_REGEX, "signature");
+  check_component(filename, KW_REGEX, "keywords");
+  check_split(filename);
+
+  return 0;
+}
@@ -0,0 +1,90 @@
+// Differential fuzz target for the string helpers used on filenames:
+// trim_string and str_append_slice against their references, and the slug
+// functions, which must never grow their input and must be idempotent.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "reference.h"
+#include "utils.h"
+
+#define APPEND_DEST_LEN 64
+
+static void check_trim(const char *str) {
+  char expected[MAX_PATH_LEN];
+  char actual[MAX_PATH_LEN];
+  strcpy(actual, str);
+  trim_string(actual);
+
+  // The reference underflows on empty strings
+  if (str[0] == '\0') {
+    if (actual[0] != '\0')
+      fuzz_mismatch("trim_string", str);
+    return;
+  }
+
+  strcpy(expected, str);
+  reference_trim_string(expected);
+  if (strcmp(expected, actual) != 0)
+    fuzz_mismatch("trim_string", str);
+}
+
+static void check_append(const uint8_t *params, const char *str) {
+  size_t length = strlen(str);
+  size_t start = length > 0 ? params[0] % (length + 1) : 0;
+  size_t end = start + params[1] % (length - start + 1);
+  size_t dest_size = 1 + params[2] % APPEND_DEST_LEN;
+  size_t position = params[3] % dest_size;
+
+  // Both start from the same partly filled destination
+  char expected[APPEND_DEST_LEN], actual[APPEND_DEST_LEN];
+  memset(expected, 'x', sizeof(expected));
+  expected[position] = '\0';
+  memcpy(actual, expected, sizeof(actual));
+
+  size_t expected_position = position, actual_position = position;
+  int expected_outcome = reference_str_append_slice(str, start, end, expected, dest_size, &expected_position);
+  int actual_outcome = str_append_slice(str, start, end, actual, dest_size, &actual_position);
+  if (expected_outcome != actual_outcome || expected_position != actual_position || strcmp(expected, actual) != 0)
+    fuzz_mismatch("str_append_slice", str);
+}
+
+typedef void (*SlugFn)(char *str);
+
+static void check_slug(SlugFn slug, const char *str, const char *what) {
+  char once[MAX_PATH_LEN];
+  char twice[MAX_PATH_LEN];
+  strcpy(once, str);
+  slug(once);
+  if (strlen(once) > strlen(str))
+    fuzz_mismatch(what, str);
+
+  strcpy(twice, once);
+  slug(twice);
+  if (strcmp(once, twice) != 0)
+    fuzz_mismatch(what, str);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  // The first bytes choose the slice and destination for str_append_slice
+  uint8_t params[4] = {0};
+  size_t param_count = size < sizeof(params) ? size : sizeof(params);
+  memcpy(params, data, param_count);
+  data += param_count;
+  size -= param_count;
+
+  char str[MAX_PATH_LEN];
+  if (size >= MAX_PATH_LEN)
+    size = MAX_PATH_LEN - 1;
+  memcpy(str, data, size);
+  str[size] = '\0';
+
+  check_trim(str);
+  check_append(params, str);
+  check_slug(sluggify_title, str, "sluggify_title");
+  check_slug(sluggify_signature, str, "sluggify_signature");
+  check_slug(sluggify_keyword, str, "sluggify_keyword");
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reference.h"
+#include "utils.h"
+
+int reference_component(char *filename, char *regex, char *component, size_t component_len) {
+  size_t start = 0;
+  size_t end = 0;
+  if (match_pattern_against_str(filename, regex, &start, &end) != SUCCESS)
+    return FAILURE;
+  str_copy_slice(filename, start, end, component, component_len);
+  return SUCCESS;
+}
+
+// Only defined for non-empty strings
+void reference_trim_string(char *str) {
+  size_t start = 0;
+  size_t end = strlen(str) - 1;
+
+  while (isspace(str[start])) {
+    start++;
+  }
+
+  while (end > start && isspace(str[end])) {
+    end--;
+  }
+
+  if (start > 0 || end < (strlen(str) - 1)) {
+    memmove(str, str + start, end - start + 1);
+    str[end - start + 1] = '\0';
+  }
+}
+
+// Only defined while `*current_pos` is inside `dest`
+int reference_str_append_slice(const char *src, size_t start, size_t end, char *dest, size_t dest_size,
+                               size_t *current_pos) {
+  size_t length = end - start;
+  bool overflow = false;
+
+  if (*current_pos + length >= dest_size) {
+    length = dest_size - *current_pos - 1;
+    overflow = true;
+  }
+
+  snprintf(dest + *current_pos, dest_size - *current_pos, "%.*s", (int)length, src + start);
+  *current_pos += length;
+
+  return overflow ? FAILURE : SUCCESS;
+}
+
+int reference_split_at_char(char *str, char ch, char **array, size_t array_size, size_t max_str_len) {
+  if (str == NULL || array == NULL || array_size == 0 || max_str_len == 0) {
+    return -1;
+  }
+
+  size_t count = 0;
+  char *start = str;
+  char *end = NULL;
+
+  while ((end = strchr(start, ch)) != NULL) {
+    if (count >= array_size) {
+      return -1;
+    }
+
+    size_t length = end - start;
+    if (length >= max_str_len) {
+      length = max_str_len - 1;
+    }
+
+    strncpy(array[count], start, length);
+    array[count][length] = '\0';
+    count++;
+
+    start = end + 1;
+  }
+
+  if (count < array_size) {
+    size_t length = strlen(start);
+    if (length >= max_str_len) {
+      length = max_str_len - 1;
+    }
+
+    strncpy(array[count], start, length);
+    array[count][length] = '\0';
+    count++;
+  } else {
+    return -1;
+  }
+
+  return count;
+}
+
+void fuzz_mismatch(const char *what, const char *input) {
+  fprintf(stderr, "ERROR: %s differs from the reference for input \"", what);
+  for (const unsigned char *c = (const unsigned char *)input; *c != '\0'; c++) {
+    if (isprint(*c) && *c != '"' && *c != '\\')
+      fputc(*c, stderr);
+    else
+      fprintf(stderr, "\\x%02x", *c);
+  }
+  fprintf(stderr, "\"\n");
+  abort();
+}
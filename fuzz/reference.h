@@ -0,0 +1,20 @@
+#ifndef REFERENCE_H_
+#define REFERENCE_H_
+
+#include <stddef.h>
+
+// The implementations the fuzz targets compare against: the regex matcher
+// for filename components, and the string helpers as they were before being
+// rewritten. Keep these unchanged so every rewrite is checked against the
+// same behaviour.
+
+int reference_component(char *filename, char *regex, char *component, size_t component_len);
+void reference_trim_string(char *str);
+int reference_str_append_slice(const char *src, size_t start, size_t end, char *dest, size_t dest_size,
+                               size_t *current_pos);
+int reference_split_at_char(char *str, char ch, char **array, size_t array_size, size_t max_str_len);
+
+// Abort with a message when the implementations disagree
+void fuzz_mismatch(const char *what, const char *input);
+
+#endif // REFERENCE_H_
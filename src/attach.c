@@ -0,0 +1,211 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "attach.h"
+#include "duplicate.h"
+#include "index.h"
+#include "output.h"
+#include "stats.h"
+#include "utils.h"
+
+// The physical address of the first extent of `fd`, which two files only
+// share when one is a reflink of the other. 0 if the file system won't say.
+static uint64_t first_extent(int fd) {
+  struct {
+    struct fiemap map;
+    struct fiemap_extent extent;
+  } request = {.map = {.fm_length = FIEMAP_MAX_OFFSET, .fm_extent_count = 1}};
+  if (ioctl(fd, FS_IOC_FIEMAP, &request) == -1 || request.map.fm_mapped_extents == 0)
+    return 0;
+  return request.extent.fe_physical;
+}
+
+// Make `dest_name` in `dest_dir` a reflink of `src_fd`, or failing that a
+// hard link to `src_name` in `src_dir`. Sets `cloned` if it is a reflink.
+static int clone_or_link(int src_dir, const char *src_name, int src_fd, int dest_dir, const char *dest_name,
+                         const struct stat *src_st, bool *cloned) {
+  *cloned = false;
+  int fd = openat(dest_dir, dest_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, src_st->st_mode & 07777);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+  if (ioctl(fd, FICLONE, src_fd) == 0) {
+    // A clone is a new file, so it takes the times of the one it copies
+    struct timespec times[2] = {src_st->st_atim, src_st->st_mtim};
+    futimens(fd, times);
+    *cloned = close(fd) == 0;
+    if (*cloned)
+      return SUCCESS;
+  } else {
+    close(fd);
+  }
+  unlinkat(dest_dir, dest_name, 0);
+  return linkat(src_dir, src_name, dest_dir, dest_name, 0) == 0 ? SUCCESS : FAILURE;
+}
+
+// Whether the files open on `fd` and `other_fd` both hold the same `size`
+// bytes. Sizes are checked first: the store object may be a link to an
+// attachment truncated since, and reading a mapping past the end of its
+// file raises SIGBUS.
+static bool same_contents(int fd, int other_fd, size_t size) {
+  struct stat st, other_st;
+  STATS_SYSCALL(SYS_STAT, 2);
+  if (fstat(fd, &st) == -1 || fstat(other_fd, &other_st) == -1 || (size_t)st.st_size != size ||
+      (size_t)other_st.st_size != size)
+    return false;
+
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  void *other = mmap(NULL, size, PROT_READ, MAP_PRIVATE, other_fd, 0);
+  bool same = data != MAP_FAILED && other != MAP_FAILED && memcmp(data, other, size) == 0;
+  if (data != MAP_FAILED)
+    munmap(data, size);
+  if (other != MAP_FAILED)
+    munmap(other, size);
+  return same;
+}
+
+// Deduplicate the attachment `name` in `dir_fd` against the store in
+// `store_fd`. The first copy of some contents is added to the store; later
+// ones, once compared byte for byte, are replaced by a link to it. `size` is
+// set to the size of the attachment.
+int attach_dedupe(int dir_fd, int store_fd, const char *name, AttachOutcome *outcome, uint64_t *size) {
+  *outcome = ATTACH_SKIPPED;
+  *size = 0;
+  int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+  struct stat st;
+  STATS_SYSCALL(SYS_STAT, 1);
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size < ATTACH_MIN_SIZE) {
+    close(fd);
+    return SUCCESS;
+  }
+  *size = (uint64_t)st.st_size;
+
+  void *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return FAILURE;
+  }
+  char object[ATTACH_OBJECT_NAME_LEN + 1];
+  snprintf(object, sizeof(object), "%016llx-%llx", (unsigned long long)xxh64(data, *size, 0),
+           (unsigned long long)*size);
+  munmap(data, *size);
+
+  char temp_name[sizeof(ATTACH_TEMP_PREFIX) + MAX_PATH_LEN];
+  bool cloned;
+  int result = SUCCESS;
+  struct stat object_st;
+  STATS_SYSCALL(SYS_STAT, 1);
+  if (fstatat(store_fd, object, &object_st, 0) == -1) {
+    if (errno != ENOENT) {
+      close(fd);
+      return FAILURE;
+    }
+    // Kept under a temporary name until whole
+    snprintf(temp_name, sizeof(temp_name), "%s%s", ATTACH_TEMP_PREFIX, object);
+    unlinkat(store_fd, temp_name, 0);
+    result = clone_or_link(dir_fd, name, fd, store_fd, temp_name, &st, &cloned);
+    if (result == SUCCESS && renameat(store_fd, temp_name, store_fd, object) == -1) {
+      unlinkat(store_fd, temp_name, 0);
+      result = FAILURE;
+    }
+    STATS_SYSCALL(SYS_RENAME, 1);
+    if (result == SUCCESS)
+      *outcome = ATTACH_STORED;
+    close(fd);
+    return result;
+  }
+
+  if (object_st.st_dev == st.st_dev && object_st.st_ino == st.st_ino) {
+    *outcome = ATTACH_SHARED;
+    close(fd);
+    return SUCCESS;
+  }
+
+  int object_fd = openat(store_fd, object, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (object_fd == -1) {
+    close(fd);
+    return FAILURE;
+  }
+  uint64_t extent = first_extent(fd);
+  if (extent != 0 && extent == first_extent(object_fd)) {
+    *outcome = ATTACH_SHARED;
+  } else if (same_contents(fd, object_fd, *size)) {
+    // Hashes can collide, so only identical files are replaced
+    snprintf(temp_name, sizeof(temp_name), "%s%s", ATTACH_TEMP_PREFIX, name);
+    unlinkat(dir_fd, temp_name, 0);
+    result = clone_or_link(store_fd, object, object_fd, dir_fd, temp_name, &st, &cloned);
+    if (result == SUCCESS && renameat(dir_fd, temp_name, dir_fd, name) == -1) {
+      unlinkat(dir_fd, temp_name, 0);
+      result = FAILURE;
+    }
+    STATS_SYSCALL(SYS_RENAME, 1);
+    if (result == SUCCESS)
+      *outcome = cloned ? ATTACH_CLONED : ATTACH_LINKED;
+  }
+  close(object_fd);
+  close(fd);
+  return result;
+}
+
+// Deduplicate every attachment in the vault of `index`, writing those
+// replaced by links to `out`
+int attach_dedupe_vault(const NoteIndex *index, Output *out, AttachStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  int dir_fd = open(index->dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open %s\n", index->dir_path);
+    return FAILURE;
+  }
+  if (mkdirat(dir_fd, ATTACH_STORE_DIR, 0755) == -1 && errno != EEXIST) {
+    fprintf(stderr, "ERROR: Could not create %s%s\n", index->dir_path, ATTACH_STORE_DIR);
+    close(dir_fd);
+    return FAILURE;
+  }
+  int store_fd = openat(dir_fd, ATTACH_STORE_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (store_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open %s%s\n", index->dir_path, ATTACH_STORE_DIR);
+    close(dir_fd);
+    return FAILURE;
+  }
+
+  int result = SUCCESS;
+  char path[MAX_PATH_LEN];
+  for (size_t i = 0; i < index->count; i++) {
+    const NoteRecord *note = &index->notes[i];
+    if (!is_attachment(note->name))
+      continue;
+    AttachOutcome outcome;
+    uint64_t size;
+    if (attach_dedupe(dir_fd, store_fd, note->name, &outcome, &size) != SUCCESS) {
+      fprintf(stderr, "ERROR: Could not deduplicate %s%s\n", index->dir_path, note->name);
+      result = FAILURE;
+      continue;
+    }
+    if (outcome == ATTACH_STORED) {
+      stats->stored++;
+    } else if (outcome == ATTACH_CLONED || outcome == ATTACH_LINKED) {
+      stats->deduplicated++;
+      stats->bytes_saved += size;
+      index_note_path(index, note, path, MAX_PATH_LEN);
+      output_file(out, NULL, path);
+    }
+  }
+
+  close(store_fd);
+  close(dir_fd);
+  return result;
+}
@@ -0,0 +1,41 @@
+#ifndef ATTACH_H_
+#define ATTACH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "index.h"
+#include "output.h"
+
+// Large attachments are deduplicated through a content-addressed store in
+// the vault. Each distinct attachment is kept once under the XXH64 hash and
+// size of its contents, and copies of it are replaced by reflinks to that
+// object, which share its blocks until either is written. Where the file
+// system can't reflink, copies become hard links to the object instead.
+// Readdir skips the store and the temporary files, since their names have
+// no ID.
+#define ATTACH_STORE_DIR ".connote-objects"
+#define ATTACH_TEMP_PREFIX ".connote-attach-"
+// Smaller attachments take up too few blocks to be worth sharing
+#define ATTACH_MIN_SIZE (64 * 1024)
+// Object names: 16 hex digits of hash, a dash and the size in hex
+#define ATTACH_OBJECT_NAME_LEN 34
+
+typedef enum {
+  ATTACH_SKIPPED, // Too small, or not a regular file
+  ATTACH_STORED,  // The first copy, now kept in the store
+  ATTACH_SHARED,  // Already shares the stored copy
+  ATTACH_CLONED,  // Replaced by a reflink to the stored copy
+  ATTACH_LINKED,  // Replaced by a hard link to the stored copy
+} AttachOutcome;
+
+typedef struct {
+  size_t stored;
+  size_t deduplicated;
+  uint64_t bytes_saved;
+} AttachStats;
+
+int attach_dedupe(int dir_fd, int store_fd, const char *name, AttachOutcome *outcome, uint64_t *size);
+int attach_dedupe_vault(const NoteIndex *index, Output *out, AttachStats *stats);
+
+#endif // ATTACH_H_
@@ -2,8 +2,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "config.h"
+#include "stats.h"
 #include "utils.h"
 
 // Function to remove surrounding quotes from a string if present
@@ -48,6 +50,15 @@ int parse_connote_config(const char *filename, char *connote_path, size_t connot
   return connote_path != NULL && connote_path[0] != '\0' ? SUCCESS : FAILURE;
 }
 
+// True if the config file exists, for commands that only use the connote
+// directory when one is set up
+bool connote_config_exists(void) {
+  const char *home = getenv("HOME");
+  char config_path[MAX_PATH_LEN] = {0};
+  snprintf(config_path, MAX_PATH_LEN, "%s/.connote", home);
+  return access(config_path, F_OK) == 0;
+}
+
 int connote_dir(char *connote_path) {
 
   // Expand the home directory path
@@ -55,11 +66,25 @@ int connote_dir(char *connote_path) {
   char config_path[MAX_PATH_LEN] = {0};
   snprintf(config_path, MAX_PATH_LEN, "%s/.connote", home);
 
+  STATS_BEGIN(PHASE_CONFIG);
   int read_config_outcome = parse_connote_config(config_path, connote_path, MAX_PATH_LEN);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  STATS_END(PHASE_CONFIG);
   if (read_config_outcome != SUCCESS)
     return FAILURE;
 
-  printf("Config file successfully parsed:\n  connote_dir = %s\n", connote_path);
+  // Names are joined straight onto the directory, so it ends in a slash
+  size_t len = strlen(connote_path);
+  if (connote_path[len - 1] != '/') {
+    if (len + 1 >= MAX_PATH_LEN) {
+      fprintf(stderr, "ERROR: connote_path is too long.\n");
+      return FAILURE;
+    }
+    connote_path[len] = '/';
+    connote_path[len + 1] = '\0';
+  }
+
+  debug_printf("Config file successfully parsed:\n  connote_dir = %s\n", connote_path);
 
   // Make the config directory if it doesn't already exist
   int mkdir_outcome = make_directory_if_not_exists((const char *)connote_path);
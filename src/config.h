@@ -1,8 +1,11 @@
 #ifndef CONFIG_H_
 #define CONFIG_H_
 
+#include <stdbool.h>
+
 #define MAX_CONFIG_LINE_LENGTH 256
 
 int connote_dir(char *connote_path);
+bool connote_config_exists(void);
 
 #endif // CONFIG_H_
@@ -1,15 +1,60 @@
-#include <assert.h>
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "attach.h"
 #include "config.h"
+#include "daemon.h"
+#include "duplicate.h"
+#include "fuzzy.h"
+#include "import.h"
+#include "index.h"
+#include "keyword.h"
+#include "output.h"
+#include "query.h"
+#include "relink.h"
+#include "signature.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "store.h"
 #include "utils.h"
 
 // connote <cmd> --title <title> --keywords <kw1> <kw2> --sig <sig>
 
+#define MAX_RESULTS 4096
+#define JOURNAL_KEYWORD "journal"
+#define JOURNAL_TITLE_FORMAT "%A %e %B %Y"
+
+// Commands that a running daemon can answer on our behalf
+static const char *daemon_commands[] = {"new",       "rename",  "search", "pick",     "ls",  "keyword",
+                                        "backlinks", "journal", "dedupe", "snapshot", "diff"};
+
+typedef struct {
+  char *title;
+  char *sig;
+  char *keywords[MAX_KEYS];
+  int kw_count;
+  bool signature_set;
+  bool title_set;
+  bool keywords_set;
+  bool use_connote_dir;
+  bool from_yaml;
+  FsyncPolicy fsync_policy;
+  bool stats;
+  char *trace_path;
+  size_t limit;
+  bool by_signature;
+  char *format; // Checked when the command runs, as the daemon may run it
+  bool verbose;
+  size_t max_memory; // With --max-memory, search and doctor stream the vault rather than index all of it
+  char *cmd;
+} Arguments;
+
 void output_dir(bool use_connote_dir, char *dir_path) {
   if (use_connote_dir) {
     connote_dir(dir_path);
@@ -18,97 +63,760 @@ void output_dir(bool use_connote_dir, char *dir_path) {
   }
 }
 
+// Print the parsed arguments with -v
 void test_argument_parsing(char **argv, int argc, char *sig, char *title, int kw_count, char **keywords) {
-  printf("TITLE: %s\n", title ? title : "None");
-  printf("KEYWORDS: \n");
+  debug_printf("TITLE: %s\n", title ? title : "None");
+  debug_printf("KEYWORDS: \n");
   if (kw_count > 0) {
     for (int i = 0; i < kw_count; i++) {
-      printf("  kw[%d]: %s\n", i, keywords[i]);
+      debug_printf("  kw[%d]: %s\n", i, keywords[i]);
     }
   } else {
-    printf("None\n");
+    debug_printf("None\n");
   }
-  printf("SIGNATURE: %s\n", sig ? sig : "None");
+  debug_printf("SIGNATURE: %s\n", sig ? sig : "None");
 
   for (int index = optind; index < argc; index++) {
-    printf("NON-OPTION: %s\n", argv[index]);
+    debug_printf("NON-OPTION: %s\n", argv[index]);
   }
 }
 
 void print_usage() {
   printf("Usage: connote file --title <title> --keywords <kw1> <kw2> <kw3> "
          "--sig <signature>\n");
+  printf("       connote new --title <title> [--fsync[=none|file|dir]]\n");
+  printf("       connote serve\n");
+  printf("       connote search <query> [--title <title>] [--keywords <kw>] [--sig <sig>] [--max-memory <size>]\n");
+  printf("       connote pick [--limit <n>] <query>\n");
+  printf("       connote ls [--by-signature] [--sig <sig>]\n");
+  printf("       connote backlinks <file-or-id>\n");
+  printf("       connote doctor [--max-memory <size>]\n");
+  printf("       connote dedupe\n");
+  printf("       connote snapshot <file>\n");
+  printf("       connote diff <snapshot>\n");
+  printf("       connote journal [--keywords <kw>]\n");
+  printf("       connote keyword rename <kw> <new-kw>\n");
+  printf("       connote keyword merge <kw>... <into-kw>\n");
+  printf("       connote keyword resume|rollback\n");
+  printf("       connote import [--dir] [--fsync[=none|file|dir]] < manifest\n");
+  printf("Every command accepts --stats, to print where its time went, and --trace <file>, to write it as a Chrome\n"
+         "trace. --format=text|json|tsv|nul chooses how results are printed, and -v prints what connote is doing.\n");
 }
 
-int main(int argc, char *argv[]) {
-  // Expect at least three args: `connote <cmd> <arg>`
-  if (argc < 2) {
-    print_usage();
-    exit(EXIT_FAILURE);
-  }
-
-  // Initialise the filename data
-  char *title = NULL;
-  char *sig = NULL;
-  char *keywords[MAX_KEYS]; // Array to store keywords, assuming max 10
-  int kw_count = 0;
+// Parse the options in `argv` into `args`. On return `optind` points at the
+// command, which is NULL if none was given.
+int parse_arguments(int argc, char *argv[], Arguments *args) {
+  memset(args, 0, sizeof(*args));
+  args->limit = FUZZY_DEFAULT_LIMIT;
 
   // Define long options
   static struct option long_options[] = {
-      {    "title", required_argument, 0, 't'},
-      { "keywords", required_argument, 0, 'k'},
-      {      "sig", required_argument, 0, 's'},
-      {"from-yaml",       no_argument, 0, 'y'},
-      {      "dir",       no_argument, 0, 'd'},
-      {          0,                 0, 0,   0}  // End of options
+      {       "title", required_argument, 0, 't'},
+      {    "keywords", required_argument, 0, 'k'},
+      {         "sig", required_argument, 0, 's'},
+      {   "from-yaml",       no_argument, 0, 'y'},
+      {         "dir",       no_argument, 0, 'd'},
+      {       "fsync", optional_argument, 0, 'f'},
+      {       "stats",       no_argument, 0, 'S'},
+      {       "trace", required_argument, 0, 'T'},
+      {       "limit", required_argument, 0, 'l'},
+      {"by-signature",       no_argument, 0, 'B'},
+      {      "format", required_argument, 0, 'F'},
+      {     "verbose",       no_argument, 0, 'v'},
+      {  "max-memory", required_argument, 0, 'M'},
+      {             0,                 0, 0,   0}  // End of options
   };
 
-  // Parsing options
+  // Parsing options. Resetting `optind` to zero makes getopt reinitialise,
+  // which matters when the daemon parses many command lines in one process.
   int opt;
-  bool signature_set = false;
-  bool title_set = false;
-  bool keywords_set = false;
-  bool use_connote_dir = false;
+  optind = 0;
 
-  while ((opt = getopt_long(argc, argv, "t:k:s:yd", long_options, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "t:k:s:ydv", long_options, NULL)) != -1) {
     switch (opt) {
     case 't':
-      title = optarg; // Get title argument
-      title_set = true;
+      args->title = optarg; // Get title argument
+      args->title_set = true;
       break;
     case 'k':
       // Get keywords, assuming they are separated by spaces and provided as
       // multiple arguments
-      keywords[kw_count++] = optarg;
+      args->keywords[args->kw_count++] = optarg;
       while (optind < argc && argv[optind][0] != '-') {
-        keywords[kw_count++] = argv[optind++];
-        if (kw_count >= MAX_KEYS) {
-          printf("ERROR: Too many keywords, max allowed is %d.\n", MAX_KEYS);
+        if (args->kw_count >= MAX_KEYS) {
+          fprintf(stderr, "ERROR: Too many keywords, max allowed is %d.\n", MAX_KEYS);
           break;
         }
+        args->keywords[args->kw_count++] = argv[optind++];
       }
-      keywords_set = true;
+      args->keywords_set = true;
       break;
     case 's':
-      sig = optarg; // Get signature argument
-      signature_set = true;
+      args->sig = optarg; // Get signature argument
+      args->signature_set = true;
       break;
     case 'y':
       // This is reached when --from-yaml is encountered
-      printf("From YAML flag is set.\n");
+      args->from_yaml = true;
       break;
     case 'd':
       // This means write the file to the connote directory set in the config
       // file
-      printf("'Use connote directory' is set.\n");
-      use_connote_dir = true;
+      args->use_connote_dir = true;
+      break;
+    case 'f':
+      // --fsync on its own makes both the note and its directory entry durable
+      if (parse_fsync_policy(optarg, &args->fsync_policy) != SUCCESS)
+        return FAILURE;
+      break;
+    case 'S':
+      args->stats = true;
+      break;
+    case 'T':
+      args->trace_path = optarg;
+      break;
+    case 'l':
+      args->limit = strtoul(optarg, NULL, 10);
+      break;
+    case 'B':
+      args->by_signature = true;
+      break;
+    case 'F':
+      args->format = optarg;
+      break;
+    case 'v':
+      args->verbose = true;
+      break;
+    case 'M':
+      if (parse_size(optarg, &args->max_memory) != SUCCESS)
+        return FAILURE;
+      if (args->max_memory < INDEX_MIN_MEMORY)
+        args->max_memory = INDEX_MIN_MEMORY;
       break;
     default:
-      exit(EXIT_FAILURE);
+      return FAILURE;
+    }
+  }
+
+  args->cmd = optind < argc ? argv[optind] : NULL;
+
+  return SUCCESS;
+}
+
+// Returns the index to run a query against: the daemon's resident index if
+// there is one, otherwise the connote directory read into `local`
+NoteIndex *vault_index(NoteIndex *resident, NoteIndex *local) {
+  if (resident != NULL)
+    return resident;
+
+  char dir_path[MAX_PATH_LEN] = {0};
+  if (connote_dir(dir_path) != SUCCESS)
+    return NULL;
+  if (index_build(local, dir_path) != SUCCESS)
+    return NULL;
+
+  return local;
+}
+
+// Kept by the daemon like the title index
+static SignatureIndex resident_signatures;
+
+typedef struct {
+  const Query *query;
+  Output *out;
+} SearchStream;
+
+static int search_chunk(void *ctx, NoteIndex *chunk, size_t first) {
+  SearchStream *search = ctx;
+  for (size_t i = 0; i < chunk->count; i++) {
+    if (query_matches(search->query, chunk, &chunk->notes[i]))
+      output_note(search->out, chunk, &chunk->notes[i]);
+  }
+  return SUCCESS;
+}
+
+// Check every note against `query` a chunk at a time, within `max_memory`.
+// Chunks come in ID order, so the matches do too, as with `query_run`.
+static int search_stream(const Query *query, size_t max_memory, Output *out) {
+  char dir_path[MAX_PATH_LEN] = {0};
+  if (connote_dir(dir_path) != SUCCESS)
+    return EXIT_FAILURE;
+  SearchStream search = {.query = query, .out = out};
+  return index_stream(dir_path, max_memory, search_chunk, &search) == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Print the notes matching the query made of the remaining arguments and the
+// --title, --keywords and --sig filters, in ID order. See query.h.
+int cmd_search(int argc, char *argv[], Arguments *args, NoteIndex *resident, Output *out) {
+  char text[QUERY_MAX_LEN] = {0};
+  size_t pos = 0;
+  for (int i = optind + 1; i < argc && pos < sizeof(text); i++) {
+    pos += snprintf(text + pos, sizeof(text) - pos, "%s%s", pos > 0 ? " " : "", argv[i]);
+  }
+  if (pos >= sizeof(text)) {
+    fprintf(stderr, "ERROR: Query is too long.\n");
+    return EXIT_FAILURE;
+  }
+
+  Query query;
+  if (query_parse(&query, text) != SUCCESS)
+    return EXIT_FAILURE;
+  if (args->title_set && query_add(&query, "title", '~', args->title) != SUCCESS)
+    return EXIT_FAILURE;
+  for (int i = 0; i < args->kw_count; i++) {
+    if (query_add(&query, "kw", ':', args->keywords[i]) != SUCCESS)
+      return EXIT_FAILURE;
+  }
+  if (args->signature_set) {
+    char sig[MAX_SIG_LEN + 1];
+    snprintf(sig, sizeof(sig), "%.*s*", MAX_SIG_LEN - 1, args->sig);
+    if (query_add(&query, "sig", ':', sig) != SUCCESS)
+      return EXIT_FAILURE;
+  }
+
+  if (args->max_memory > 0 && resident == NULL)
+    return search_stream(&query, args->max_memory, out);
+
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  // Building a signature index costs more than the scan it saves, unless the
+  // daemon keeps it
+  SignatureIndex *sigs = NULL;
+  if (index == resident) {
+    sigs = &resident_signatures;
+    if (!signature_index_current(sigs, index)) {
+      signature_index_free(sigs);
+      if (signature_index_build(sigs, index) != SUCCESS)
+        return EXIT_FAILURE;
+    }
+  }
+
+  size_t *results, count;
+  int result = query_run(&query, index, sigs, &results, &count);
+  for (size_t i = 0; result == SUCCESS && i < count; i++) {
+    output_note(out, index, &index->notes[results[i]]);
+  }
+  free(results);
+
+  if (index == &local)
+    index_free(&local);
+
+  return result == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// The daemon keeps the title index and the picker's earlier queries between
+// requests, so each keystroke only narrows down the matches of the last one
+static FuzzyIndex resident_titles;
+static FuzzySession picker_session;
+
+// Print the notes whose titles best match the query, best first
+int cmd_pick(int argc, char *argv[], Arguments *args, NoteIndex *resident, Output *out) {
+  char query[FUZZY_MAX_QUERY_LEN] = {0};
+  size_t pos = 0;
+  for (int i = optind + 1; i < argc && pos < sizeof(query); i++) {
+    pos += snprintf(query + pos, sizeof(query) - pos, "%s%s", pos > 0 ? " " : "", argv[i]);
+  }
+  if (pos >= sizeof(query)) {
+    fprintf(stderr, "ERROR: Query is too long.\n");
+    return EXIT_FAILURE;
+  }
+
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  FuzzyIndex local_titles;
+  FuzzySession local_session;
+  FuzzyIndex *titles = &local_titles;
+  FuzzySession *session = &local_session;
+  if (index == resident) {
+    titles = &resident_titles;
+    session = &picker_session;
+    if (!fuzzy_index_current(titles, index)) {
+      fuzzy_index_free(titles);
+      if (fuzzy_index_build(titles, index) != SUCCESS)
+        return EXIT_FAILURE;
+    }
+  } else {
+    fuzzy_session_init(session);
+    if (fuzzy_index_build(titles, index) != SUCCESS) {
+      index_free(&local);
+      return EXIT_FAILURE;
+    }
+  }
+
+  int outcome = EXIT_SUCCESS;
+  FuzzyMatch *results = malloc((args->limit ? args->limit : 1) * sizeof(FuzzyMatch));
+  if (results != NULL) {
+    size_t found = fuzzy_search(session, titles, query, results, args->limit, NULL);
+    for (size_t i = 0; i < found; i++) {
+      output_note(out, index, &index->notes[results[i].note]);
+    }
+    free(results);
+  } else {
+    fprintf(stderr, "ERROR: Out of memory for %zu results.\n", args->limit);
+    outcome = EXIT_FAILURE;
+  }
+
+  if (index == &local) {
+    fuzzy_session_free(session);
+    fuzzy_index_free(titles);
+    index_free(&local);
+  }
+
+  return outcome;
+}
+
+// Print every note in ID order, or with --by-signature in sequence order,
+// followed by the notes without a signature. --sig lists only that signature
+// and its descendants, in sequence order.
+int cmd_ls(Arguments *args, NoteIndex *resident, Output *out) {
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  if (!args->by_signature && !args->signature_set) {
+    for (size_t i = 0; i < index->count; i++) {
+      output_note(out, index, &index->notes[i]);
+    }
+    if (index == &local)
+      index_free(&local);
+    return EXIT_SUCCESS;
+  }
+
+  SignatureIndex local_sigs;
+  SignatureIndex *sigs = &local_sigs;
+  if (index == resident) {
+    sigs = &resident_signatures;
+    if (!signature_index_current(sigs, index)) {
+      signature_index_free(sigs);
+      if (signature_index_build(sigs, index) != SUCCESS)
+        return EXIT_FAILURE;
+    }
+  } else if (signature_index_build(sigs, index) != SUCCESS) {
+    index_free(&local);
+    return EXIT_FAILURE;
+  }
+
+  size_t start = 0;
+  size_t end = sigs->count;
+  if (args->signature_set) {
+    char sig[MAX_SIG_LEN];
+    strncpy(sig, args->sig, MAX_SIG_LEN - 1);
+    sig[MAX_SIG_LEN - 1] = '\0';
+    sluggify_signature(sig);
+    signature_subtree(sigs, sig, &start, &end);
+  }
+  for (size_t i = start; i < end; i++) {
+    output_note(out, index, &index->notes[sigs->notes[i]]);
+  }
+  for (size_t i = 0; !args->signature_set && i < index->count; i++) {
+    if (index->notes[i].sig[0] == '\0')
+      output_note(out, index, &index->notes[i]);
+  }
+
+  if (index == &local) {
+    signature_index_free(sigs);
+    index_free(&local);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int cmd_backlinks(int argc, char *argv[], NoteIndex *resident, Output *out) {
+  if (optind + 1 >= argc) {
+    fprintf(stderr, "ERROR: backlinks expects a file or ID.\n");
+    return EXIT_FAILURE;
+  }
+
+  // Accept either a bare ID or a path to a note
+  const char *target = argv[optind + 1];
+  int last_slash = last_slash_pos(argv[optind + 1]);
+  if (last_slash != -1)
+    target += last_slash + 1;
+  if (!name_has_valid_id(target)) {
+    fprintf(stderr, "ERROR: No valid ID in %s\n", argv[optind + 1]);
+    return EXIT_FAILURE;
+  }
+
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  int outcome = EXIT_SUCCESS;
+  size_t *results = malloc(MAX_RESULTS * sizeof(size_t));
+  if (results != NULL) {
+    size_t found = index_backlinks(index, id_to_u64(target), results, MAX_RESULTS);
+    for (size_t i = 0; i < found; i++) {
+      output_note(out, index, &index->notes[results[i]]);
+    }
+    free(results);
+  } else {
+    fprintf(stderr, "ERROR: Out of memory for %d results.\n", MAX_RESULTS);
+    outcome = EXIT_FAILURE;
+  }
+
+  if (index == &local)
+    index_free(&local);
+
+  return outcome;
+}
+
+// Print a pair found by `connote doctor`, following on from `previous`
+static void print_pair(Output *out, const char *path, const char *other, const DuplicatePair *pair,
+                       const DuplicatePair *previous) {
+  if (out->format != FORMAT_TEXT) {
+    output_pair(out, path, other, pair->exact, pair->similarity);
+    return;
+  }
+
+  // Copies of one note follow each other, paired with the first of them
+  bool same_group = previous != NULL && pair->exact && previous->exact && pair->first == previous->first;
+  if (!same_group) {
+    if (pair->exact) {
+      output_printf(out, "Identical:\n");
+    } else {
+      output_printf(out, "Similar, %u%% alike:\n", pair->similarity);
+    }
+    output_printf(out, "  %s\n", path);
+  }
+  output_printf(out, "  %s\n", other);
+}
+
+typedef struct {
+  Output *out;
+  char dir_path[MAX_PATH_LEN];
+  Store store; // Written by the stream, to name notes by position
+  DuplicatePair previous;
+  bool any;
+} DoctorStream;
+
+static int doctor_pair(void *ctx, const DuplicatePair *pair) {
+  DoctorStream *doctor = ctx;
+  // Store positions are those of the stream, and the store was written by it
+  if (!doctor->any && store_open(&doctor->store, doctor->dir_path) != SUCCESS) {
+    fprintf(stderr, "ERROR: Could not read back the index of %s\n", doctor->dir_path);
+    return FAILURE;
+  }
+  char name[MAX_PATH_LEN], other_name[MAX_PATH_LEN];
+  char path[MAX_PATH_LEN], other[MAX_PATH_LEN];
+  if (store_name(&doctor->store, pair->first, name, MAX_PATH_LEN) != SUCCESS ||
+      store_name(&doctor->store, pair->second, other_name, MAX_PATH_LEN) != SUCCESS)
+    return FAILURE;
+  const char *slash = doctor->dir_path[strlen(doctor->dir_path) - 1] == '/' ? "" : "/";
+  int written = snprintf(path, MAX_PATH_LEN, "%s%s%s", doctor->dir_path, slash, name);
+  int other_written = snprintf(other, MAX_PATH_LEN, "%s%s%s", doctor->dir_path, slash, other_name);
+  if (written < 0 || written >= MAX_PATH_LEN || other_written < 0 || other_written >= MAX_PATH_LEN)
+    return FAILURE;
+  print_pair(doctor->out, path, other, pair, doctor->any ? &doctor->previous : NULL);
+  doctor->previous = *pair;
+  doctor->any = true;
+  return SUCCESS;
+}
+
+// Report notes whose bodies are copies of one another, identical or a few
+// words apart. With --max-memory the vault is streamed rather than indexed.
+int cmd_doctor(Arguments *args, NoteIndex *resident, Output *out) {
+  if (args->max_memory > 0 && resident == NULL) {
+    DoctorStream doctor = {.out = out};
+    size_t hashed;
+    int outcome = connote_dir(doctor.dir_path) == SUCCESS
+                      ? find_duplicates_bounded(doctor.dir_path, args->max_memory, doctor_pair, &doctor, &hashed)
+                      : FAILURE;
+    if (doctor.any)
+      store_close(&doctor.store);
+    return outcome == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  NoteSketch *sketches = malloc((index->count ? index->count : 1) * sizeof(NoteSketch));
+  size_t hashed;
+  if (sketches == NULL || sketch_notes(index, sketches, &hashed) != SUCCESS) {
+    free(sketches);
+    if (index == &local)
+      index_free(&local);
+    return EXIT_FAILURE;
+  }
+
+  DuplicatePair *pairs;
+  size_t found = find_duplicates(sketches, index->count, &pairs);
+  char path[MAX_PATH_LEN], other[MAX_PATH_LEN];
+  for (size_t i = 0; i < found; i++) {
+    index_note_path(index, &index->notes[pairs[i].first], path, MAX_PATH_LEN);
+    index_note_path(index, &index->notes[pairs[i].second], other, MAX_PATH_LEN);
+    print_pair(out, path, other, &pairs[i], i > 0 ? &pairs[i - 1] : NULL);
+  }
+  free(pairs);
+  free(sketches);
+
+  if (index == &local)
+    index_free(&local);
+
+  return EXIT_SUCCESS;
+}
+
+// Print today's journal entry, creating it first if there isn't one yet
+int cmd_journal(Arguments *args, NoteIndex *resident, Output *out) {
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  char id[ID_LEN + 1];
+  if (generate_timestamp_now(id) != SUCCESS)
+    return EXIT_FAILURE;
+  // IDs are ordered by date, so today's entries are within one day of IDs
+  uint64_t today = id_to_u64(id) / 1000000;
+
+  char path[MAX_PATH_LEN];
+  uint32_t journal;
+  if (keyword_lookup(&index->keywords, JOURNAL_KEYWORD, &journal)) {
+    for (size_t i = index_lower_bound(index, today * 1000000); i < index->count; i++) {
+      if (index->notes[i].id / 1000000 != today)
+        break;
+      if (note_has_keyword(&index->notes[i], journal)) {
+        output_note(out, index, &index->notes[i]);
+        if (index == &local)
+          index_free(&local);
+        return EXIT_SUCCESS;
+      }
     }
   }
 
-  // Output the parsed arguments for testing purposes
+  time_t now = time(NULL);
+  char title[MAX_TITLE_LEN];
+  strftime(title, MAX_TITLE_LEN, JOURNAL_TITLE_FORMAT, localtime(&now));
+
+  char journal_keyword[MAX_KW_LEN] = JOURNAL_KEYWORD;
+  char *keywords[MAX_KEYS] = {journal_keyword};
+  size_t kw_count = 1;
+  for (int i = 0; i < args->kw_count && kw_count < MAX_KEYS; i++) {
+    keywords[kw_count++] = args->keywords[i];
+  }
+
+  int outcome =
+      connote_file(index->dir_path, id, args->sig, title, keywords, kw_count, ".md", args->fsync_policy, path);
+  if (outcome == SUCCESS)
+    output_file(out, NULL, path);
+
+  if (index == &local)
+    index_free(&local);
+
+  return outcome == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// connote dedupe shares the contents of identical attachments through the
+// vault's content-addressed store and lists the files it replaced
+int cmd_dedupe(NoteIndex *resident, Output *out) {
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  AttachStats stats;
+  int outcome = attach_dedupe_vault(index, out, &stats);
+  fprintf(stderr, "Deduplicated %zu attachments, saving %llu bytes.\n", stats.deduplicated,
+          (unsigned long long)stats.bytes_saved);
+
+  if (index == &local)
+    index_free(&local);
+  return outcome == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// connote snapshot <file> records the state of the vault in <file>. Notes
+// unchanged since the snapshot already there are not read again.
+int cmd_snapshot(int argc, char *argv[], NoteIndex *resident) {
+  if (optind + 2 != argc) {
+    fprintf(stderr, "ERROR: snapshot expects the file to write.\n");
+    return EXIT_FAILURE;
+  }
+  const char *path = argv[optind + 1];
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  Snapshot previous, snapshot;
+  bool have_previous = snapshot_read(&previous, path) == SUCCESS;
+  size_t hashed;
+  int outcome = snapshot_build(&snapshot, index, have_previous ? &previous : NULL, &hashed);
+  if (outcome == SUCCESS) {
+    outcome = snapshot_write(&snapshot, path);
+    debug_printf("Hashed %zu of %zu notes.\n", hashed, snapshot.leaf_count);
+    snapshot_free(&snapshot);
+  }
+
+  if (have_previous)
+    snapshot_free(&previous);
+  if (index == &local)
+    index_free(&local);
+  return outcome == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// connote diff <snapshot> lists the notes added, removed, renamed and
+// modified since <snapshot> was taken
+int cmd_diff(int argc, char *argv[], NoteIndex *resident, Output *out) {
+  if (optind + 2 != argc) {
+    fprintf(stderr, "ERROR: diff expects a snapshot file.\n");
+    return EXIT_FAILURE;
+  }
+  Snapshot old;
+  if (snapshot_read(&old, argv[optind + 1]) != SUCCESS) {
+    fprintf(stderr, "ERROR: Could not read snapshot %s\n", argv[optind + 1]);
+    return EXIT_FAILURE;
+  }
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL) {
+    snapshot_free(&old);
+    return EXIT_FAILURE;
+  }
+
+  Snapshot current;
+  size_t hashed;
+  int outcome = snapshot_build(&current, index, &old, &hashed);
+  if (outcome == SUCCESS) {
+    debug_printf("Hashed %zu of %zu notes.\n", hashed, current.leaf_count);
+    SnapshotChange *changes;
+    size_t count = snapshot_diff(&old, &current, &changes);
+    static const char kinds[] = {[CHANGE_ADDED] = 'A', [CHANGE_REMOVED] = 'D', [CHANGE_RENAMED] = 'R',
+                                 [CHANGE_MODIFIED] = 'M'};
+    char path[2 * MAX_PATH_LEN], old_path[2 * MAX_PATH_LEN];
+    for (size_t i = 0; i < count; i++) {
+      const SnapshotChange *change = &changes[i];
+      bool removed = change->kind == CHANGE_REMOVED;
+      snprintf(path, sizeof(path), "%s%s", index->dir_path,
+               removed ? snapshot_name(&old, change->old_leaf) : snapshot_name(&current, change->new_leaf));
+      bool renamed = change->kind == CHANGE_RENAMED;
+      if (renamed)
+        snprintf(old_path, sizeof(old_path), "%s%s", index->dir_path, snapshot_name(&old, change->old_leaf));
+      output_change(out, kinds[change->kind], renamed ? old_path : NULL, path);
+    }
+    free(changes);
+    snapshot_free(&current);
+  }
+
+  snapshot_free(&old);
+  if (index == &local)
+    index_free(&local);
+  return outcome == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Rewrite the links to notes renamed inside the connote directory at
+// `vault_path`. The daemon's index learns of the renames here rather than
+// from its next inotify events; otherwise the directory is indexed afresh,
+// which reuses the cached index.
+static int relink_renamed(NoteIndex *resident, const char *vault_path, RelinkMove *moves, size_t move_count,
+                          FsyncPolicy fsync_policy) {
+  NoteIndex local;
+  NoteIndex *index = resident;
+  if (resident != NULL) {
+    for (size_t i = 0; i < move_count; i++) {
+      index_remove_note(resident, moves[i].old_name);
+      index_update_note(resident, moves[i].new_name);
+    }
+  } else if (index_build(&local, vault_path) == SUCCESS) {
+    index = &local;
+  } else {
+    return FAILURE;
+  }
+
+  size_t rewritten;
+  int outcome = relink_notes(index, moves, move_count, fsync_policy, &rewritten);
+  if (rewritten > 0)
+    fprintf(stderr, "Updated links in %zu notes.\n", rewritten);
+
+  if (index == &local)
+    index_free(&local);
+  return outcome;
+}
+
+// connote keyword rename <kw> <new-kw> renames a keyword on every note that
+// has it, and connote keyword merge <kw>... <into-kw> folds several into one.
+// An interrupted run is finished with resume or undone with rollback.
+int cmd_keyword(int argc, char *argv[], NoteIndex *resident, Output *out) {
+  int first = optind + 2;
+  const char *action = optind + 1 < argc ? argv[optind + 1] : "";
+
+  if (strcmp(action, "resume") == 0 || strcmp(action, "rollback") == 0) {
+    char dir_path[MAX_PATH_LEN] = {0};
+    if (resident != NULL) {
+      snprintf(dir_path, MAX_PATH_LEN, "%s", resident->dir_path);
+    } else if (connote_dir(dir_path) != SUCCESS) {
+      return EXIT_FAILURE;
+    }
+    int outcome = strcmp(action, "resume") == 0 ? keyword_resume(dir_path) : keyword_rollback(dir_path);
+    return outcome == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  bool rename_keyword = strcmp(action, "rename") == 0;
+  if ((!rename_keyword && strcmp(action, "merge") != 0) || argc - first < 2 || (rename_keyword && argc - first != 2)) {
+    fprintf(stderr, "ERROR: keyword expects rename <kw> <new-kw>, merge <kw>... <into-kw>, resume or rollback.\n");
+    return EXIT_FAILURE;
+  }
+
+  NoteIndex local;
+  NoteIndex *index = vault_index(resident, &local);
+  if (index == NULL)
+    return EXIT_FAILURE;
+
+  KeywordPlan plan;
+  const char *to = argv[argc - 1];
+  int outcome = keyword_plan(&plan, index, &argv[first], argc - first - 1, to);
+
+  // Renaming onto a keyword that is in use would merge the two unasked
+  const uint32_t *notes;
+  uint32_t handle;
+  if (outcome == SUCCESS && rename_keyword && keyword_lookup(&index->keywords, plan.to, &handle) &&
+      index_keyword_notes(index, handle, &notes) > 0) {
+    fprintf(stderr, "ERROR: Keyword %s is already in use, use keyword merge to fold %s into it.\n", plan.to,
+            plan.from[0]);
+    outcome = FAILURE;
+  }
+
+  if (outcome == SUCCESS)
+    outcome = keyword_apply(&plan);
+  if (outcome == SUCCESS) {
+    char old_path[2 * MAX_PATH_LEN], new_path[2 * MAX_PATH_LEN];
+    for (size_t i = 0; i < plan.count; i++) {
+      snprintf(old_path, sizeof(old_path), "%s%s", plan.dir_path, plan.moves[i].old_name);
+      snprintf(new_path, sizeof(new_path), "%s%s", plan.dir_path, plan.moves[i].new_name);
+      output_file(out, old_path, new_path);
+    }
+  }
+
+  keyword_plan_free(&plan);
+  if (index == &local)
+    index_free(&local);
+
+  return outcome == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int run_connote(int argc, char *argv[], NoteIndex *resident);
+
+// Run the command parsed into `args`
+static int run_command(int argc, char *argv[], Arguments *args, NoteIndex *resident, Output *out) {
+  if (args->from_yaml)
+    debug_printf("From YAML flag is set.\n");
+  if (args->use_connote_dir)
+    debug_printf("'Use connote directory' is set.\n");
+  char *title = args->title;
+  char *sig = args->sig;
+  char **keywords = args->keywords;
+  int kw_count = args->kw_count;
+  char *cmd = args->cmd;
+
+  // Output the parsed arguments with -v
   test_argument_parsing(argv, argc, sig, title, kw_count, keywords);
 
   // Where is the file going?
@@ -121,7 +829,6 @@ int main(int argc, char *argv[]) {
 
   // Count the non-option arguments
   int non_option_args = 0;
-  char *cmd = argv[optind];
   for (int index = optind; index < argc; index++) {
     non_option_args++;
   }
@@ -135,13 +842,18 @@ int main(int argc, char *argv[]) {
       return EXIT_FAILURE;
 
     // Get the directory in which the note will be written, save this to
-    // `dir_path`
-    output_dir(use_connote_dir, dir_path);
+    // `dir_path`. The daemon already knows the connote directory.
+    if (args->use_connote_dir && resident != NULL) {
+      snprintf(dir_path, MAX_PATH_LEN, "%s", resident->dir_path);
+    } else {
+      output_dir(args->use_connote_dir, dir_path);
+    }
 
     // Create new file with components and write frontmatter
-    connote_file(dir_path, id, sig, title, keywords, kw_count, ".md", new_file_name);
+    if (connote_file(dir_path, id, sig, title, keywords, kw_count, ".md", args->fsync_policy, new_file_name) != SUCCESS)
+      return EXIT_FAILURE;
     // Print the created file for the user
-    printf("%s\n", new_file_name);
+    output_file(out, NULL, new_file_name);
 
     return EXIT_SUCCESS;
   }
@@ -152,20 +864,43 @@ int main(int argc, char *argv[]) {
       return EXIT_FAILURE;
 
     optind++; // Increment past the <cmd> argument
+
+    // Notes renamed inside the connote directory have the links to them
+    // rewritten once all are renamed
+    char vault_path[MAX_PATH_LEN] = {0};
+    struct stat vault_st;
+    bool relink = false;
+    if (resident != NULL) {
+      snprintf(vault_path, MAX_PATH_LEN, "%s", resident->dir_path);
+      relink = true;
+    } else if (connote_config_exists()) {
+      relink = connote_dir(vault_path) == SUCCESS;
+    }
+    relink = relink && stat(vault_path, &vault_st) == 0;
+    RelinkMove *moves = relink ? calloc(argc - optind, sizeof(RelinkMove)) : NULL;
+    size_t move_count = 0;
+    bool failed = false;
+
     // Loop over input files and rename them
     for (int i = optind; i < argc; i++) {
 
-      printf("argv[%d]: %s\n", i, argv[i]);
+      debug_printf("argv[%d]: %s\n", i, argv[i]);
 
       // Check whether the file exists
-      if (!file_exists(argv[i])) {
+      STATS_BEGIN(PHASE_STAT);
+      bool exists = file_exists(argv[i]);
+      STATS_SYSCALL(SYS_STAT, 1);
+      STATS_END(PHASE_STAT);
+      if (!exists) {
         fprintf(stderr, "ERROR: File does not exist: %s\n", argv[i]);
         return EXIT_FAILURE;
       }
 
       // Attempt to read the creation date of the file for use as the file ID
-      if (has_valid_id(argv[i])) {
-        read_id(argv[i], id);
+      int last_slash = last_slash_pos(argv[i]);
+      const char *old_name = argv[i] + last_slash + 1;
+      if (name_has_valid_id(old_name)) {
+        read_id(old_name, id);
       } else {
         // Check whether extraction of creation timestamp is successful
         if (file_creation_timestamp(argv[i], id) != SUCCESS) {
@@ -174,17 +909,18 @@ int main(int argc, char *argv[]) {
         }
       }
 
+      STATS_BEGIN(PHASE_PARSE);
       char filename_sig[MAX_SIG_LEN] = {0};
-      if (!signature_set) {
+      if (!args->signature_set) {
         try_match_and_write_component(argv[i], filename_sig, SIG_REGEX, MAX_SIG_LEN);
       }
 
       char filename_title[MAX_TITLE_LEN] = {0};
-      if (!title_set) {
+      if (!args->title_set) {
         try_match_and_write_component(argv[i], filename_title, TITLE_REGEX, MAX_TITLE_LEN);
       }
 
-      if (!keywords_set) {
+      if (!args->keywords_set) {
         char matched_keywords[MAX_KEYS * MAX_KW_LEN] = {0};
         int outcome = try_match_and_write_component(argv[i], matched_keywords, KW_REGEX, MAX_KEYS * MAX_KW_LEN);
         if (outcome == SUCCESS) {
@@ -197,9 +933,9 @@ int main(int argc, char *argv[]) {
           kw_count = split_at_char(matched_keywords, '_', keywords, MAX_KEYS, MAX_KW_LEN);
         }
       }
+      STATS_END(PHASE_PARSE);
 
       // Construct new file name
-      int last_slash = last_slash_pos(argv[i]);
       if (last_slash != -1) {
         strncpy(dir_path, argv[i], last_slash+1);
         dir_path[last_slash+1] = '\0';
@@ -208,42 +944,180 @@ int main(int argc, char *argv[]) {
         dir_path[2] = '\0';
       }
 
-      printf("dir_path: %s\n", dir_path);
-      format_file_name(dir_path, id, sig ? sig : filename_sig, title ? title : filename_title, keywords, kw_count,
-                       ".md", new_file_name);
+      // Attachments and notes keep their extension, and files without one
+      // become markdown notes
+      char extension[MAX_PATH_LEN];
+      const char *old_extension = file_extension(old_name);
+      snprintf(extension, MAX_PATH_LEN, "%s", old_extension[0] != '\0' ? old_extension : ".md");
+
+      debug_printf("dir_path: %s\n", dir_path);
+      // A name that could not be made leaves `new_file_name` holding the
+      // previous file's, so nothing may be renamed to it
+      if (format_file_name(dir_path, id, sig ? sig : filename_sig, title ? title : filename_title, keywords, kw_count,
+                           extension, new_file_name) != SUCCESS) {
+        fprintf(stderr, "ERROR: Could not rename file %s\n", argv[i]);
+        failed = true;
+        continue;
+      }
 
       // Rename the file
-      if (rename(argv[i], new_file_name) == 0) {
-        printf("%s -> %s\n", argv[i], new_file_name);
+      STATS_BEGIN(PHASE_RENAME);
+      int renamed = rename(argv[i], new_file_name);
+      STATS_SYSCALL(SYS_RENAME, 1);
+      STATS_END(PHASE_RENAME);
+      if (renamed == 0) {
+        output_file(out, argv[i], new_file_name);
       } else {
         fprintf(stderr, "ERROR: Could not rename file %s\n", argv[i]);
+        failed = true;
       }
 
+      struct stat dir_st;
+      if (renamed == 0 && moves != NULL && stat(dir_path, &dir_st) == 0 && dir_st.st_dev == vault_st.st_dev &&
+          dir_st.st_ino == vault_st.st_ino && strcmp(old_name, new_file_name + strlen(dir_path)) != 0) {
+        snprintf(moves[move_count].old_name, MAX_PATH_LEN, "%s", old_name);
+        snprintf(moves[move_count].new_name, MAX_PATH_LEN, "%s", new_file_name + strlen(dir_path));
+        move_count++;
+      }
     }
 
-    return EXIT_SUCCESS;
+    int outcome = move_count > 0 ? relink_renamed(resident, vault_path, moves, move_count, args->fsync_policy)
+                                 : SUCCESS;
+    free(moves);
+    return outcome == SUCCESS && !failed ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
   if (strcmp(cmd, "backlinks") == 0) {
-    assert(false && "Not implemented yet");
-    return EXIT_SUCCESS;
+    return cmd_backlinks(argc, argv, resident, out);
   }
 
   if (strcmp(cmd, "search") == 0) {
-    assert(false && "Not implemented yet");
-    return EXIT_SUCCESS;
+    return cmd_search(argc, argv, args, resident, out);
+  }
+
+  if (strcmp(cmd, "pick") == 0) {
+    return cmd_pick(argc, argv, args, resident, out);
+  }
+
+  if (strcmp(cmd, "ls") == 0) {
+    return cmd_ls(args, resident, out);
+  }
+
+  if (strcmp(cmd, "keyword") == 0) {
+    return cmd_keyword(argc, argv, resident, out);
   }
 
   if (strcmp(cmd, "doctor") == 0) {
-    assert(false && "Not implemented yet");
-    return EXIT_SUCCESS;
+    return cmd_doctor(args, resident, out);
   }
 
   if (strcmp(cmd, "journal") == 0) {
-    assert(false && "Not implemented yet");
-    return EXIT_SUCCESS;
+    return cmd_journal(args, resident, out);
+  }
+
+  if (strcmp(cmd, "dedupe") == 0) {
+    return cmd_dedupe(resident, out);
+  }
+
+  if (strcmp(cmd, "snapshot") == 0) {
+    return cmd_snapshot(argc, argv, resident);
+  }
+
+  if (strcmp(cmd, "diff") == 0) {
+    return cmd_diff(argc, argv, resident, out);
+  }
+
+  // connote import < manifest
+  if (strcmp(cmd, "import") == 0) {
+    output_dir(args->use_connote_dir, dir_path);
+    size_t imported;
+    int outcome = import_notes(stdin, dir_path, args->fsync_policy, out, &imported);
+    fprintf(stderr, "Imported %zu notes.\n", imported);
+    return outcome == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  // connote serve
+  if (strcmp(cmd, "serve") == 0) {
+    if (resident != NULL) {
+      fprintf(stderr, "ERROR: The daemon is already running.\n");
+      return EXIT_FAILURE;
+    }
+    output_dir(true, dir_path);
+    return daemon_serve(dir_path, run_connote) == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
   // No command matched
   return EXIT_FAILURE;
 }
+
+// Run a single connote command. `resident` is the daemon's index when called
+// from `connote serve`, and NULL otherwise.
+int run_connote(int argc, char *argv[], NoteIndex *resident) {
+  // Initialise the filename data
+  Arguments args;
+  if (parse_arguments(argc, argv, &args) != SUCCESS) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+  if (args.cmd == NULL) {
+    fprintf(stderr, "ERROR: No command given.\n");
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  OutputFormat format = FORMAT_TEXT;
+  if (args.format != NULL && parse_output_format(args.format, &format) != SUCCESS)
+    return EXIT_FAILURE;
+
+  // Results go through one buffer, written out once the command is done
+  static Output out;
+  output_init(&out, STDOUT_FILENO, format);
+  connote_verbose = args.verbose;
+
+  stats_start(args.stats, args.trace_path);
+  int exit_code = run_command(argc, argv, &args, resident, &out);
+  stats_finish();
+  if (output_flush(&out) != SUCCESS && exit_code == EXIT_SUCCESS)
+    exit_code = EXIT_FAILURE;
+
+  return exit_code;
+}
+
+// Returns true if the command in `argv` can be handed to a running daemon
+bool is_daemon_command(int argc, char *argv[]) {
+  // Parse a copy, since getopt permutes the array it is given
+  char *argv_copy[argc + 1];
+  memcpy(argv_copy, argv, argc * sizeof(char *));
+  argv_copy[argc] = NULL;
+
+  Arguments args;
+  int saved_opterr = opterr;
+  opterr = 0; // Errors will be reported when the command is actually run
+  int outcome = parse_arguments(argc, argv_copy, &args);
+  opterr = saved_opterr;
+  // A bounded run is asked for so as not to rely on a resident index
+  if (outcome != SUCCESS || args.cmd == NULL || args.max_memory > 0)
+    return false;
+
+  for (size_t i = 0; i < sizeof(daemon_commands) / sizeof(daemon_commands[0]); i++) {
+    if (strcmp(args.cmd, daemon_commands[i]) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  // Expect at least three args: `connote <cmd> <arg>`
+  if (argc < 2) {
+    print_usage();
+    exit(EXIT_FAILURE);
+  }
+
+  // Let a running `connote serve` answer from its resident index if it can
+  int exit_code;
+  if (is_daemon_command(argc, argv) && daemon_forward(argc, argv, &exit_code) == SUCCESS)
+    return exit_code;
+
+  return run_connote(argc, argv, NULL);
+}
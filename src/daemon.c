@@ -0,0 +1,390 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "index.h"
+#include "utils.h"
+
+#define INOTIFY_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#define INOTIFY_BUFFER_SIZE 65536
+#define CLIENT_TIMEOUT_SECONDS 2
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int sig) { stop_requested = 1; }
+
+// The socket lives in $CONNOTE_SOCKET if set, otherwise in the user's runtime
+// directory, falling back to a per-user path in /tmp
+int daemon_socket_path(char *dest, size_t dest_size) {
+  const char *override = getenv("CONNOTE_SOCKET");
+  const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  int written;
+
+  if (override != NULL && override[0] != '\0') {
+    written = snprintf(dest, dest_size, "%s", override);
+  } else if (runtime_dir != NULL && runtime_dir[0] != '\0') {
+    written = snprintf(dest, dest_size, "%s/%s", runtime_dir, DAEMON_SOCKET_NAME);
+  } else {
+    written = snprintf(dest, dest_size, "/tmp/connote-%u.sock", (unsigned)getuid());
+  }
+
+  // sun_path is much shorter than MAX_PATH_LEN
+  if (written < 0 || (size_t)written >= dest_size || (size_t)written >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+    fprintf(stderr, "ERROR: Daemon socket path is too long.\n");
+    return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+static int socket_address(struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  return daemon_socket_path(addr->sun_path, sizeof(addr->sun_path));
+}
+
+// Anyone can create the socket path when it falls back to /tmp, so only a
+// socket owned by this user is trusted, or no file at all
+static bool socket_path_is_ours(const char *path) {
+  struct stat st;
+  if (lstat(path, &st) == -1)
+    return errno == ENOENT;
+  return S_ISSOCK(st.st_mode) && st.st_uid == getuid();
+}
+
+// Whether the process at the other end of `sock` runs as this user
+static bool peer_is_ours(int sock) {
+  struct ucred cred;
+  socklen_t length = sizeof(cred);
+  if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &length) == -1 || length != sizeof(cred))
+    return false;
+  return cred.uid == getuid();
+}
+
+static int read_full(int fd, void *buffer, size_t length) {
+  char *cursor = buffer;
+  while (length > 0) {
+    ssize_t n = read(fd, cursor, length);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FAILURE;
+    cursor += n;
+    length -= n;
+  }
+  return SUCCESS;
+}
+
+static int send_full(int fd, const void *buffer, size_t length) {
+  const char *cursor = buffer;
+  while (length > 0) {
+    ssize_t n = send(fd, cursor, length, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FAILURE;
+    cursor += n;
+    length -= n;
+  }
+  return SUCCESS;
+}
+
+// Apply all pending directory change events to the index
+static void drain_inotify(int inotify_fd, NoteIndex *index) {
+  char buffer[INOTIFY_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  ssize_t length;
+  while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+    for (char *ptr = buffer; ptr < buffer + length;) {
+      const struct inotify_event *event = (const struct inotify_event *)ptr;
+      ptr += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were lost, so start from scratch
+        char dir_path[MAX_PATH_LEN];
+        strncpy(dir_path, index->dir_path, MAX_PATH_LEN);
+        index_free(index);
+        index_build(index, dir_path);
+        continue;
+      }
+
+      if (event->len == 0 || !name_has_valid_id(event->name))
+        continue;
+
+      if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        index_remove_note(index, event->name);
+      } else {
+        index_update_note(index, event->name);
+      }
+    }
+  }
+}
+
+// Receive the request header along with the client's stdout and stderr
+static int receive_header(int client, DaemonRequestHeader *header, int *fds) {
+  char control[CMSG_SPACE(2 * sizeof(int))];
+  struct iovec iov = {.iov_base = header, .iov_len = sizeof(*header)};
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control,
+      .msg_controllen = sizeof(control),
+  };
+
+  ssize_t n = recvmsg(client, &msg, MSG_CMSG_CLOEXEC);
+  if (n != sizeof(*header))
+    return FAILURE;
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int)))
+    return FAILURE;
+  memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+
+  if (header->magic != DAEMON_MAGIC || header->length == 0 || header->length > MAX_REQUEST_LEN) {
+    close(fds[0]);
+    close(fds[1]);
+    return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+static void handle_client(int client, int inotify_fd, NoteIndex *index, DaemonHandler handler) {
+  struct timeval timeout = {.tv_sec = CLIENT_TIMEOUT_SECONDS};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  DaemonRequestHeader header;
+  int fds[2];
+  if (receive_header(client, &header, fds) != SUCCESS)
+    return;
+
+  char *payload = malloc(header.length + 1);
+  if (payload == NULL || read_full(client, payload, header.length) != SUCCESS) {
+    free(payload);
+    close(fds[0]);
+    close(fds[1]);
+    return;
+  }
+  payload[header.length] = '\0';
+
+  // Split the payload into the working directory and argv
+  char *cwd = payload;
+  char *argv[MAX_REQUEST_ARGS + 1];
+  int argc = 0;
+  for (char *ptr = cwd + strlen(cwd) + 1; ptr < payload + header.length && argc < MAX_REQUEST_ARGS;
+       ptr += strlen(ptr) + 1) {
+    argv[argc++] = ptr;
+  }
+  argv[argc] = NULL;
+
+  DaemonReply reply = {.magic = DAEMON_MAGIC, .exit_code = EXIT_FAILURE};
+  if (argc > 0 && chdir(cwd) == 0) {
+    // Make sure the index reflects anything the client did before asking
+    drain_inotify(inotify_fd, index);
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+
+    reply.exit_code = handler(argc, argv, index);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+  }
+
+  send_full(client, &reply, sizeof(reply));
+  free(payload);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Keep the index for `dir_path` resident and answer requests on the daemon
+// socket until interrupted
+int daemon_serve(const char *dir_path, DaemonHandler handler) {
+  struct sockaddr_un addr;
+  if (socket_address(&addr) != SUCCESS)
+    return FAILURE;
+
+  if (!socket_path_is_ours(addr.sun_path)) {
+    fprintf(stderr, "ERROR: Refusing to use %s, which is not a socket owned by you.\n", addr.sun_path);
+    return FAILURE;
+  }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener == -1) {
+    fprintf(stderr, "ERROR: Could not create daemon socket.\n");
+    return FAILURE;
+  }
+
+  // A socket that accepts connections belongs to a running daemon, anything
+  // else is left over from one that exited uncleanly
+  if (connect(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "ERROR: A connote daemon is already listening on %s\n", addr.sun_path);
+    close(listener);
+    return FAILURE;
+  }
+  close(listener);
+  unlink(addr.sun_path);
+
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  mode_t old_mask = umask(0077);
+  int bound = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+  umask(old_mask);
+  if (bound == -1 || listen(listener, SOMAXCONN) == -1) {
+    fprintf(stderr, "ERROR: Could not listen on %s\n", addr.sun_path);
+    close(listener);
+    return FAILURE;
+  }
+
+  NoteIndex index;
+  if (index_build(&index, dir_path) != SUCCESS) {
+    close(listener);
+    unlink(addr.sun_path);
+    return FAILURE;
+  }
+
+  int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd == -1 || inotify_add_watch(inotify_fd, index.dir_path, INOTIFY_MASK) == -1) {
+    fprintf(stderr, "ERROR: Could not watch %s for changes.\n", index.dir_path);
+    index_free(&index);
+    close(listener);
+    unlink(addr.sun_path);
+    return FAILURE;
+  }
+
+  struct sigaction action = {.sa_handler = handle_stop_signal};
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("Serving %zu notes from %s on %s\n", index.count, index.dir_path, addr.sun_path);
+  fflush(stdout);
+
+  struct pollfd fds[2] = {
+      {.fd = listener, .events = POLLIN},
+      {.fd = inotify_fd, .events = POLLIN},
+  };
+  while (!stop_requested) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (fds[1].revents & POLLIN)
+      drain_inotify(inotify_fd, &index);
+
+    if (fds[0].revents & POLLIN) {
+      int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+      // Requests run with our rights, so other users are turned away
+      if (client != -1 && peer_is_ours(client))
+        handle_client(client, inotify_fd, &index, handler);
+      if (client != -1)
+        close(client);
+    }
+  }
+
+  close(inotify_fd);
+  close(listener);
+  unlink(addr.sun_path);
+  index_free(&index);
+
+  return SUCCESS;
+}
+
+// Run the command described by `argv` in a running daemon. Returns FAILURE
+// without side effects if no daemon is reachable, in which case the caller
+// should run the command itself.
+int daemon_forward(int argc, char **argv, int *exit_code) {
+  const char *disabled = getenv("CONNOTE_NO_DAEMON");
+  if (disabled != NULL && disabled[0] != '\0')
+    return FAILURE;
+
+  struct sockaddr_un addr;
+  if (socket_address(&addr) != SUCCESS)
+    return FAILURE;
+
+  char payload[MAX_REQUEST_LEN];
+  if (getcwd(payload, MAX_REQUEST_LEN) == NULL)
+    return FAILURE;
+
+  size_t length = strlen(payload) + 1;
+  for (int i = 0; i < argc; i++) {
+    size_t arg_len = strlen(argv[i]) + 1;
+    if (length + arg_len > MAX_REQUEST_LEN)
+      return FAILURE;
+    memcpy(payload + length, argv[i], arg_len);
+    length += arg_len;
+  }
+
+  if (!socket_path_is_ours(addr.sun_path))
+    return FAILURE;
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock == -1)
+    return FAILURE;
+  // Our stdout and stderr must only go to a daemon of our own
+  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 || !peer_is_ours(sock)) {
+    close(sock);
+    return FAILURE;
+  }
+
+  // Hand our stdout and stderr to the daemon with the header
+  fflush(stdout);
+  fflush(stderr);
+  DaemonRequestHeader header = {.magic = DAEMON_MAGIC, .length = (uint32_t)length};
+  int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = control,
+      .msg_controllen = sizeof(control),
+  };
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(header)) {
+    close(sock);
+    return FAILURE;
+  }
+
+  // From here on the daemon may have started running the command, so it must
+  // not be retried locally
+  DaemonReply reply;
+  if (send_full(sock, payload, length) != SUCCESS || read_full(sock, &reply, sizeof(reply)) != SUCCESS ||
+      reply.magic != DAEMON_MAGIC) {
+    fprintf(stderr, "ERROR: Lost connection to the connote daemon.\n");
+    *exit_code = EXIT_FAILURE;
+  } else {
+    *exit_code = reply.exit_code;
+  }
+
+  close(sock);
+  return SUCCESS;
+}
@@ -0,0 +1,35 @@
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+#include <stdint.h>
+
+#include "index.h"
+
+// Requests are a fixed header followed by `length` bytes of payload. The
+// payload is the client's working directory followed by its argv, each
+// terminated by '\0'. The client's stdout and stderr are passed alongside the
+// header as SCM_RIGHTS, so the daemon writes command output straight to the
+// client's terminal or pipe. The reply is a single DaemonReply.
+#define DAEMON_MAGIC 0x434e5401 // "CNT" + protocol version 1
+#define DAEMON_SOCKET_NAME "connote.sock"
+#define MAX_REQUEST_LEN (64 * 1024)
+#define MAX_REQUEST_ARGS 256
+
+typedef struct {
+  uint32_t magic;
+  uint32_t length;
+} DaemonRequestHeader;
+
+typedef struct {
+  uint32_t magic;
+  int32_t exit_code;
+} DaemonReply;
+
+// Runs a single command against the resident index, exactly as `main` would
+typedef int (*DaemonHandler)(int argc, char **argv, NoteIndex *index);
+
+int daemon_socket_path(char *dest, size_t dest_size);
+int daemon_serve(const char *dir_path, DaemonHandler handler);
+int daemon_forward(int argc, char **argv, int *exit_code);
+
+#endif // DAEMON_H_
@@ -0,0 +1,874 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "duplicate.h"
+#include "index.h"
+#include "spill.h"
+#include "stats.h"
+#include "store.h"
+#include "utils.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t read64(const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh_merge_round(uint64_t acc, uint64_t value) {
+  acc ^= xxh_round(0, value);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+static inline uint64_t xxh_avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  return h ^ (h >> 32);
+}
+
+// XXH64, as specified by the xxHash project. Reads are unaligned and in host
+// byte order, so hashes are only comparable between hosts of the same order.
+uint64_t xxh64(const void *data, size_t length, uint64_t seed) {
+  const uint8_t *p = data;
+  const uint8_t *end = p + length;
+  uint64_t h;
+
+  if (length >= 32) {
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+    const uint8_t *limit = end - 32;
+    do {
+      v1 = xxh_round(v1, read64(p));
+      v2 = xxh_round(v2, read64(p + 8));
+      v3 = xxh_round(v3, read64(p + 16));
+      v4 = xxh_round(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxh_merge_round(h, v1);
+    h = xxh_merge_round(h, v2);
+    h = xxh_merge_round(h, v3);
+    h = xxh_merge_round(h, v4);
+  } else {
+    h = seed + PRIME64_5;
+  }
+
+  h += (uint64_t)length;
+  for (; p + 8 <= end; p += 8) {
+    h ^= xxh_round(0, read64(p));
+    h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t)read32(p) * PRIME64_1;
+    h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= *p * PRIME64_5;
+    h = rotl64(h, 11) * PRIME64_1;
+  }
+
+  return xxh_avalanche(h);
+}
+
+static inline bool is_word_char(unsigned char c) { return isalnum(c) || c >= 0x80; }
+
+// MinHash of the shingles of SKETCH_SHINGLE_WORDS consecutive words of
+// `data`. Words are runs of letters and digits, compared without case, so
+// reflowed or recapitalised copies hash alike. The SKETCH_MINHASHES hash
+// functions are derived from two halves of each shingle's hash.
+void minhash(const char *data, size_t length, uint32_t *dest, uint32_t *shingles) {
+  uint64_t words[SKETCH_SHINGLE_WORDS] = {0};
+  uint64_t word_count = 0;
+  *shingles = 0;
+  for (int k = 0; k < SKETCH_MINHASHES; k++) {
+    dest[k] = UINT32_MAX;
+  }
+
+  size_t i = 0;
+  while (i < length) {
+    while (i < length && !is_word_char((unsigned char)data[i])) {
+      i++;
+    }
+    if (i == length)
+      break;
+    uint64_t word = FNV_OFFSET;
+    while (i < length && is_word_char((unsigned char)data[i])) {
+      word = (word ^ (unsigned char)tolower((unsigned char)data[i])) * FNV_PRIME;
+      i++;
+    }
+    words[word_count++ % SKETCH_SHINGLE_WORDS] = word;
+    if (word_count < SKETCH_SHINGLE_WORDS)
+      continue;
+
+    // Mix the words in order, oldest first
+    uint64_t shingle = 0;
+    for (uint64_t w = word_count - SKETCH_SHINGLE_WORDS; w < word_count; w++) {
+      shingle = rotl64((shingle ^ words[w % SKETCH_SHINGLE_WORDS]) * PRIME64_1, 27);
+    }
+    shingle = xxh_avalanche(shingle);
+    uint32_t low = (uint32_t)shingle;
+    uint32_t high = (uint32_t)(shingle >> 32) | 1;
+    for (int k = 0; k < SKETCH_MINHASHES; k++) {
+      uint32_t value = low + (uint32_t)k * high;
+      value ^= value >> 15;
+      value *= 0x2c1b3c6dU;
+      value ^= value >> 12;
+      if (value < dest[k])
+        dest[k] = value;
+    }
+    (*shingles)++;
+  }
+}
+
+// The part of a note after its frontmatter, which differs between copies of
+// a note by its ID and date alone
+const char *note_body(const char *data, size_t length, size_t *body_length) {
+  const char *end = data + length;
+  const char *body = data;
+  if (length >= 4 && strncmp(data, "---\n", 4) == 0) {
+    body = end;
+    for (const char *line = data + 4; line < end;) {
+      const char *line_end = memchr(line, '\n', end - line);
+      if (line_end == NULL)
+        line_end = end;
+      if (line_end - line >= 3 && strncmp(line, "---", 3) == 0) {
+        body = line_end < end ? line_end + 1 : end;
+        break;
+      }
+      line = line_end + 1;
+    }
+  }
+  *body_length = end - body;
+  return body;
+}
+
+// Sketches read back from SKETCH_FILE_NAME, sorted by inode
+typedef struct {
+  const uint8_t *map;
+  size_t map_size;
+  const NoteSketch *sketches;
+  size_t count;
+  int64_t mtime_ns; // When the cache was written
+} SketchCache;
+
+static int sketch_cache_open(SketchCache *cache, int dir_fd) {
+  memset(cache, 0, sizeof(*cache));
+  int fd = openat(dir_fd, SKETCH_FILE_NAME, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(SketchHeader)) {
+    close(fd);
+    return FAILURE;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return FAILURE;
+  cache->map = map;
+  cache->map_size = (size_t)st.st_size;
+  cache->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+  SketchHeader header;
+  memcpy(&header, cache->map, sizeof(header));
+  size_t data_size = cache->map_size - sizeof(header);
+  if (memcmp(header.magic, SKETCH_MAGIC, sizeof(header.magic)) != 0 || header.version != SKETCH_VERSION ||
+      header.count != data_size / sizeof(NoteSketch) || data_size % sizeof(NoteSketch) != 0 ||
+      crc32c(0, cache->map + sizeof(header), data_size) != header.crc) {
+    munmap(map, cache->map_size);
+    memset(cache, 0, sizeof(*cache));
+    return FAILURE;
+  }
+  cache->sketches = (const NoteSketch *)(cache->map + sizeof(header));
+  cache->count = header.count;
+  return SUCCESS;
+}
+
+static void sketch_cache_close(SketchCache *cache) {
+  if (cache->map != NULL)
+    munmap((void *)cache->map, cache->map_size);
+  memset(cache, 0, sizeof(*cache));
+}
+
+// Returns the cached sketch of the file described by `st`, or NULL. As with
+// the store, files modified no earlier than the cache are read again, since
+// a change in the same clock tick would not show in their times.
+static const NoteSketch *sketch_cache_find(const SketchCache *cache, const struct stat *st) {
+  int64_t mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+  if (mtime_ns >= cache->mtime_ns)
+    return NULL;
+
+  size_t lo = 0;
+  size_t hi = cache->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cache->sketches[mid].inode < (uint64_t)st->st_ino) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  for (size_t i = lo; i < cache->count && cache->sketches[i].inode == (uint64_t)st->st_ino; i++) {
+    const NoteSketch *sketch = &cache->sketches[i];
+    if (sketch->mtime == st->st_mtim.tv_sec && sketch->mtime_nsec == (uint32_t)st->st_mtim.tv_nsec &&
+        sketch->size == (uint64_t)st->st_size)
+      return sketch;
+  }
+  return NULL;
+}
+
+static int compare_inodes(const void *a, const void *b) {
+  uint64_t x = ((const NoteSketch *)a)->inode;
+  uint64_t y = ((const NoteSketch *)b)->inode;
+  return (x > y) - (x < y);
+}
+
+static int write_bytes(int fd, const void *data, size_t length) {
+  for (size_t done = 0; done < length;) {
+    ssize_t n = write(fd, (const uint8_t *)data + done, length - done);
+    STATS_SYSCALL(SYS_WRITE, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FAILURE;
+    done += (size_t)n;
+  }
+  return SUCCESS;
+}
+
+// Start a new cache under a temporary name, with room for its header
+static int sketch_cache_create(int dir_fd, char *temp_name, size_t temp_size) {
+  snprintf(temp_name, temp_size, "%s.%ld", SKETCH_FILE_NAME, (long)getpid());
+  int fd = openat(dir_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  SketchHeader header = {0};
+  if (fd != -1 && write_bytes(fd, &header, sizeof(header)) != SUCCESS) {
+    close(fd);
+    unlinkat(dir_fd, temp_name, 0);
+    return -1;
+  }
+  return fd;
+}
+
+// Fill in the header of the new cache and rename it into place. Like the
+// store it is not fsynced.
+static int sketch_cache_commit(int dir_fd, int fd, const char *temp_name, uint64_t count, uint32_t crc,
+                               int outcome) {
+  SketchHeader header = {.magic = SKETCH_MAGIC, .version = SKETCH_VERSION, .count = count, .crc = crc};
+  if (outcome == SUCCESS && pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+    outcome = FAILURE;
+  STATS_SYSCALL(SYS_WRITE, 1);
+  close(fd);
+
+  if (outcome == SUCCESS && renameat(dir_fd, temp_name, dir_fd, SKETCH_FILE_NAME) == 0) {
+    STATS_SYSCALL(SYS_RENAME, 1);
+    return SUCCESS;
+  }
+  unlinkat(dir_fd, temp_name, 0);
+  return FAILURE;
+}
+
+// Replace the cache with `sketches`
+static int sketch_cache_write(int dir_fd, const NoteSketch *sketches, const bool *valid, size_t count) {
+  NoteSketch *sorted = malloc((count ? count : 1) * sizeof(NoteSketch));
+  if (sorted == NULL)
+    return FAILURE;
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (valid[i])
+      sorted[kept++] = sketches[i];
+  }
+  qsort(sorted, kept, sizeof(NoteSketch), compare_inodes);
+
+  char temp_name[64];
+  int fd = sketch_cache_create(dir_fd, temp_name, sizeof(temp_name));
+  if (fd == -1) {
+    free(sorted);
+    return FAILURE;
+  }
+  int outcome = write_bytes(fd, sorted, kept * sizeof(NoteSketch));
+  outcome = sketch_cache_commit(dir_fd, fd, temp_name, kept, crc32c(0, sorted, kept * sizeof(NoteSketch)), outcome);
+  free(sorted);
+  return outcome;
+}
+
+typedef struct {
+  const NoteRecord *notes;
+  size_t count;
+  const SketchCache *cache;
+  NoteSketch *sketches;
+  bool *valid;  // Whether the note could be sketched at all
+  bool *hashed; // Whether it had to be read
+  int dir_fd;
+  size_t next;
+  pthread_mutex_t lock;
+} SketchBatch;
+
+// Sketch one note from the cache, or failing that from its contents mapped
+// into memory
+static void sketch_note(SketchBatch *batch, size_t i) {
+  const char *name = batch->notes[i].name;
+  NoteSketch *sketch = &batch->sketches[i];
+  struct stat st;
+  STATS_SYSCALL(SYS_STAT, 1);
+  if (fstatat(batch->dir_fd, name, &st, 0) == -1 || !S_ISREG(st.st_mode))
+    return;
+
+  const NoteSketch *cached = sketch_cache_find(batch->cache, &st);
+  if (cached != NULL) {
+    *sketch = *cached;
+    batch->valid[i] = true;
+    return;
+  }
+
+  *sketch = (NoteSketch){.inode = st.st_ino,
+                         .mtime = st.st_mtim.tv_sec,
+                         .mtime_nsec = (uint32_t)st.st_mtim.tv_nsec,
+                         .size = (uint64_t)st.st_size};
+  if (st.st_size > 0) {
+    int fd = openat(batch->dir_fd, name, O_RDONLY | O_CLOEXEC);
+    STATS_SYSCALL(SYS_OPEN, 1);
+    if (fd == -1)
+      return;
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return;
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    size_t body_length;
+    const char *body = note_body(map, (size_t)st.st_size, &body_length);
+    sketch->hash = xxh64(body, body_length, 0);
+    minhash(body, body_length, sketch->minhash, &sketch->shingles);
+    munmap(map, (size_t)st.st_size);
+  }
+  batch->valid[i] = true;
+  batch->hashed[i] = true;
+}
+
+static void *sketch_worker(void *arg) {
+  SketchBatch *batch = arg;
+  for (;;) {
+    pthread_mutex_lock(&batch->lock);
+    size_t i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if (i >= batch->count)
+      break;
+    sketch_note(batch, i);
+  }
+  return NULL;
+}
+
+// Sketch every note of `batch` on up to SKETCH_MAX_THREADS threads. Notes
+// that could not be read get an empty sketch.
+static void sketch_batch_run(SketchBatch *batch) {
+  memset(batch->sketches, 0, batch->count * sizeof(NoteSketch));
+  memset(batch->valid, 0, batch->count * sizeof(bool));
+  memset(batch->hashed, 0, batch->count * sizeof(bool));
+  batch->next = 0;
+  pthread_mutex_init(&batch->lock, NULL);
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int thread_count = cores > 0 ? (int)cores : 1;
+  if (thread_count > SKETCH_MAX_THREADS)
+    thread_count = SKETCH_MAX_THREADS;
+  pthread_t threads[SKETCH_MAX_THREADS];
+  int started = 0;
+  STATS_BEGIN(PHASE_STAT);
+  for (int i = 0; i < thread_count && (size_t)i < batch->count; i++) {
+    if (pthread_create(&threads[i], NULL, sketch_worker, batch) != 0)
+      break;
+    started++;
+  }
+  // Without threads, do the work here
+  if (started == 0)
+    sketch_worker(batch);
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  STATS_END(PHASE_STAT);
+  pthread_mutex_destroy(&batch->lock);
+}
+
+// Write the sketch of every note of `index` to `sketches`, in index order.
+// Notes that could not be read get an empty sketch. `hashed` is set to the
+// number of notes that were not in the cache. The cache is rewritten when
+// anything in it changed.
+int sketch_notes(const NoteIndex *index, NoteSketch *sketches, size_t *hashed) {
+  *hashed = 0;
+  int dir_fd = open(index->dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open %s\n", index->dir_path);
+    return FAILURE;
+  }
+
+  SketchCache cache;
+  sketch_cache_open(&cache, dir_fd);
+  size_t count = index->count;
+  SketchBatch batch = {
+      .notes = index->notes, .count = count, .cache = &cache, .sketches = sketches, .dir_fd = dir_fd};
+  batch.valid = calloc(count ? count : 1, sizeof(bool));
+  batch.hashed = calloc(count ? count : 1, sizeof(bool));
+  if (batch.valid == NULL || batch.hashed == NULL) {
+    free(batch.valid);
+    free(batch.hashed);
+    sketch_cache_close(&cache);
+    close(dir_fd);
+    return FAILURE;
+  }
+  sketch_batch_run(&batch);
+
+  size_t valid_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    valid_count += batch.valid[i];
+    *hashed += batch.hashed[i];
+  }
+  // The cache is only a cache, so failing to save it is not an error
+  if (*hashed > 0 || valid_count != cache.count)
+    sketch_cache_write(dir_fd, sketches, batch.valid, count);
+
+  free(batch.valid);
+  free(batch.hashed);
+  sketch_cache_close(&cache);
+  close(dir_fd);
+  return SUCCESS;
+}
+
+static inline uint64_t sketch_band(const NoteSketch *sketch, int band) {
+  uint64_t key = 0;
+  for (int row = 0; row < SKETCH_BAND_ROWS; row++) {
+    key = key * PRIME64_1 + sketch->minhash[band * SKETCH_BAND_ROWS + row];
+  }
+  return key;
+}
+
+static int compare_by_hash(const void *a, const void *b, void *arg) {
+  const NoteSketch *sketches = arg;
+  uint64_t x = sketches[*(const size_t *)a].hash;
+  uint64_t y = sketches[*(const size_t *)b].hash;
+  if (x != y)
+    return (x > y) - (x < y);
+  return (*(const size_t *)a > *(const size_t *)b) - (*(const size_t *)a < *(const size_t *)b);
+}
+
+typedef struct {
+  const NoteSketch *sketches;
+  int band;
+} BandOrder;
+
+static int compare_by_band(const void *a, const void *b, void *arg) {
+  const BandOrder *order = arg;
+  uint64_t x = sketch_band(&order->sketches[*(const size_t *)a], order->band);
+  uint64_t y = sketch_band(&order->sketches[*(const size_t *)b], order->band);
+  return (x > y) - (x < y);
+}
+
+static int compare_pairs(const void *a, const void *b) {
+  const DuplicatePair *x = a, *y = b;
+  if (x->exact != y->exact)
+    return x->exact ? -1 : 1;
+  if (x->similarity != y->similarity)
+    return (x->similarity < y->similarity) - (x->similarity > y->similarity);
+  if (x->first != y->first)
+    return (x->first > y->first) - (x->first < y->first);
+  return (x->second > y->second) - (x->second < y->second);
+}
+
+// Whether `x` and `y`, which meet in `band`, are near duplicates first met
+// there, setting `matches` to the minimums they agree on
+static bool near_pair(const NoteSketch *x, const NoteSketch *y, int band, uint32_t *matches) {
+  if (x->hash == y->hash)
+    return false;
+  // Pairs meeting in an earlier band were compared there
+  for (int earlier = 0; earlier < band; earlier++) {
+    if (sketch_band(x, earlier) == sketch_band(y, earlier))
+      return false;
+  }
+  *matches = 0;
+  for (int k = 0; k < SKETCH_MINHASHES; k++) {
+    *matches += x->minhash[k] == y->minhash[k];
+  }
+  return *matches >= SKETCH_NEAR_MATCHES;
+}
+
+static bool add_pair(DuplicatePair **pairs, size_t *count, size_t *capacity, DuplicatePair pair) {
+  if (*count == *capacity) {
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    DuplicatePair *grown = realloc(*pairs, new_capacity * sizeof(DuplicatePair));
+    if (grown == NULL)
+      return false;
+    *pairs = grown;
+    *capacity = new_capacity;
+  }
+  (*pairs)[(*count)++] = pair;
+  return true;
+}
+
+// Find the notes whose bodies are identical, pairing each with the first of
+// its copies, and the pairs agreeing on at least SKETCH_NEAR_MATCHES of their
+// minimums. Candidates are only compared within runs that share a band, so
+// this stays close to linear. Pairs are allocated into `*pairs`, exact ones
+// first and then the most similar, and their number returned.
+size_t find_duplicates(const NoteSketch *sketches, size_t count, DuplicatePair **pairs) {
+  *pairs = NULL;
+  size_t pair_count = 0;
+  size_t capacity = 0;
+  size_t *order = malloc((count ? count : 1) * sizeof(size_t));
+  if (order == NULL)
+    return 0;
+
+  // Bodies of fewer than SKETCH_SHINGLE_WORDS words are not compared at all
+  size_t candidates = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (sketches[i].shingles > 0)
+      order[candidates++] = i;
+  }
+  qsort_r(order, candidates, sizeof(size_t), compare_by_hash, (void *)sketches);
+  for (size_t i = 1, first = 0; i < candidates; i++) {
+    if (sketches[order[i]].hash != sketches[order[first]].hash) {
+      first = i;
+    } else if (!add_pair(pairs, &pair_count, &capacity, (DuplicatePair){order[first], order[i], true, 100})) {
+      break;
+    }
+  }
+
+  size_t near = 0;
+  for (size_t i = 0; i < candidates; i++) {
+    if (sketches[order[i]].shingles >= SKETCH_MIN_SHINGLES)
+      order[near++] = order[i];
+  }
+  for (int band = 0; band < SKETCH_BANDS; band++) {
+    BandOrder by_band = {.sketches = sketches, .band = band};
+    qsort_r(order, near, sizeof(size_t), compare_by_band, &by_band);
+    for (size_t start = 0, end; start < near; start = end) {
+      uint64_t key = sketch_band(&sketches[order[start]], band);
+      for (end = start + 1; end < near && sketch_band(&sketches[order[end]], band) == key; end++)
+        ;
+      for (size_t a = start; a < end; a++) {
+        for (size_t b = a + 1; b < end; b++) {
+          uint32_t matches;
+          if (!near_pair(&sketches[order[a]], &sketches[order[b]], band, &matches))
+            continue;
+          size_t first = order[a] < order[b] ? order[a] : order[b];
+          size_t second = order[a] < order[b] ? order[b] : order[a];
+          DuplicatePair pair = {first, second, false, matches * 100 / SKETCH_MINHASHES};
+          if (!add_pair(pairs, &pair_count, &capacity, pair))
+            break;
+        }
+      }
+    }
+  }
+  free(order);
+
+  if (pair_count > 0)
+    qsort(*pairs, pair_count, sizeof(DuplicatePair), compare_pairs);
+  return pair_count;
+}
+
+// Bounded search
+
+// A sort key and the position of the note it belongs to
+typedef struct {
+  uint64_t key;
+  uint64_t position;
+} SketchKey;
+
+static int compare_sketch_keys(const void *a, size_t a_length, const void *b, size_t b_length, void *arg) {
+  SketchKey x, y;
+  memcpy(&x, a, sizeof(x));
+  memcpy(&y, b, sizeof(y));
+  if (x.key != y.key)
+    return (x.key > y.key) - (x.key < y.key);
+  return (x.position > y.position) - (x.position < y.position);
+}
+
+static int compare_spilled_sketches(const void *a, size_t a_length, const void *b, size_t b_length, void *arg) {
+  NoteSketch x, y;
+  memcpy(&x, a, sizeof(x));
+  memcpy(&y, b, sizeof(y));
+  return compare_inodes(&x, &y);
+}
+
+static int compare_spilled_pairs(const void *a, size_t a_length, const void *b, size_t b_length, void *arg) {
+  DuplicatePair x, y;
+  memcpy(&x, a, sizeof(x));
+  memcpy(&y, b, sizeof(y));
+  return compare_pairs(&x, &y);
+}
+
+// State of `find_duplicates_bounded` while the notes stream past
+typedef struct {
+  int dir_fd;
+  SketchCache cache;
+  int fd;         // Sketches by position, in an unlinked temporary file
+  Spill exact;    // Hash and position of every note with shingles
+  Spill by_inode; // Sketches to rewrite the cache with
+  SketchBatch batch;
+  size_t capacity; // Notes the batch arrays hold
+  size_t count;
+  size_t valid_count;
+  size_t hashed;
+} BoundedScan;
+
+// Sketch one chunk of notes and set its sketches aside
+static int sketch_chunk(void *ctx, NoteIndex *chunk, size_t first) {
+  BoundedScan *scan = ctx;
+  SketchBatch *batch = &scan->batch;
+  if (chunk->count > scan->capacity) {
+    free(batch->sketches);
+    free(batch->valid);
+    free(batch->hashed);
+    batch->sketches = malloc(chunk->count * sizeof(NoteSketch));
+    batch->valid = malloc(chunk->count * sizeof(bool));
+    batch->hashed = malloc(chunk->count * sizeof(bool));
+    scan->capacity = chunk->count;
+    if (batch->sketches == NULL || batch->valid == NULL || batch->hashed == NULL) {
+      scan->capacity = 0;
+      return FAILURE;
+    }
+  }
+  batch->notes = chunk->notes;
+  batch->count = chunk->count;
+  sketch_batch_run(batch);
+
+  int outcome = write_bytes(scan->fd, batch->sketches, chunk->count * sizeof(NoteSketch));
+  for (size_t i = 0; i < chunk->count && outcome == SUCCESS; i++) {
+    const NoteSketch *sketch = &batch->sketches[i];
+    SketchKey key = {.key = sketch->hash, .position = first + i};
+    if (sketch->shingles > 0)
+      outcome = spill_add(&scan->exact, &key, sizeof(key));
+    if (batch->valid[i] && outcome == SUCCESS)
+      outcome = spill_add(&scan->by_inode, sketch, sizeof(*sketch));
+    scan->valid_count += batch->valid[i];
+    scan->hashed += batch->hashed[i];
+  }
+  scan->count += chunk->count;
+  return outcome;
+}
+
+// Pair each note with the first with the same body
+static int spill_exact_pairs(Spill *exact, Spill *pairs) {
+  if (spill_sort(exact) != SUCCESS)
+    return FAILURE;
+  const void *record;
+  size_t length;
+  SketchKey first = {0};
+  bool any = false;
+  int outcome = SUCCESS;
+  while (outcome == SUCCESS && spill_next(exact, &record, &length)) {
+    SketchKey key;
+    memcpy(&key, record, sizeof(key));
+    if (!any || key.key != first.key) {
+      first = key;
+      any = true;
+      continue;
+    }
+    DuplicatePair pair = {first.position, key.position, true, 100};
+    outcome = spill_add(pairs, &pair, sizeof(pair));
+  }
+  return outcome;
+}
+
+// Compare the notes that agree on `band`, found by sorting their keys
+static int spill_band_pairs(const NoteSketch *sketches, size_t count, int band, const char *dir_path,
+                            size_t budget, Spill *pairs) {
+  Spill keys;
+  spill_init(&keys, dir_path, budget, compare_sketch_keys, NULL);
+  int outcome = SUCCESS;
+  for (size_t i = 0; i < count && outcome == SUCCESS; i++) {
+    SketchKey key = {.key = sketch_band(&sketches[i], band), .position = i};
+    if (sketches[i].shingles >= SKETCH_MIN_SHINGLES)
+      outcome = spill_add(&keys, &key, sizeof(key));
+  }
+  if (outcome == SUCCESS)
+    outcome = spill_sort(&keys);
+
+  // Each run of equal keys is gathered, then compared pairwise
+  size_t *group = NULL;
+  size_t group_count = 0, group_capacity = 0;
+  uint64_t group_key = 0;
+  const void *record;
+  size_t length;
+  for (bool more = outcome == SUCCESS; more && outcome == SUCCESS;) {
+    SketchKey key = {0};
+    more = spill_next(&keys, &record, &length);
+    if (more)
+      memcpy(&key, record, sizeof(key));
+    if (!more || (group_count > 0 && key.key != group_key)) {
+      for (size_t a = 0; a < group_count && outcome == SUCCESS; a++) {
+        for (size_t b = a + 1; b < group_count && outcome == SUCCESS; b++) {
+          uint32_t matches;
+          if (!near_pair(&sketches[group[a]], &sketches[group[b]], band, &matches))
+            continue;
+          DuplicatePair pair = {group[a], group[b], false, matches * 100 / SKETCH_MINHASHES};
+          outcome = spill_add(pairs, &pair, sizeof(pair));
+        }
+      }
+      group_count = 0;
+    }
+    if (!more)
+      break;
+    if (group_count == group_capacity) {
+      group_capacity = group_capacity ? group_capacity * 2 : 64;
+      size_t *grown = realloc(group, group_capacity * sizeof(size_t));
+      if (grown == NULL) {
+        outcome = FAILURE;
+        break;
+      }
+      group = grown;
+    }
+    group[group_count++] = (size_t)key.position;
+    group_key = key.key;
+  }
+  free(group);
+  spill_free(&keys);
+  return outcome;
+}
+
+// Rewrite the cache from the sketches sorted by inode
+static void sketch_cache_write_spill(int dir_fd, Spill *by_inode) {
+  char temp_name[64];
+  if (spill_sort(by_inode) != SUCCESS)
+    return;
+  int fd = sketch_cache_create(dir_fd, temp_name, sizeof(temp_name));
+  if (fd == -1)
+    return;
+
+  NoteSketch buffer[SKETCH_WRITE_BATCH];
+  size_t used = 0;
+  uint64_t count = 0;
+  uint32_t crc = 0;
+  int outcome = SUCCESS;
+  const void *record;
+  size_t length;
+  bool more = true;
+  while (more && outcome == SUCCESS) {
+    more = spill_next(by_inode, &record, &length);
+    if (more)
+      memcpy(&buffer[used++], record, sizeof(NoteSketch));
+    if (used == SKETCH_WRITE_BATCH || (!more && used > 0)) {
+      crc = crc32c(crc, buffer, used * sizeof(NoteSketch));
+      outcome = write_bytes(fd, buffer, used * sizeof(NoteSketch));
+      count += used;
+      used = 0;
+    }
+  }
+  sketch_cache_commit(dir_fd, fd, temp_name, count, crc, outcome);
+}
+
+// Find the same pairs as `find_duplicates` over the notes of `dir_path`,
+// using about `max_memory` bytes however large the vault. The notes are
+// streamed through `index_stream` and sketched a chunk at a time, and the
+// sketches kept by position in a temporary file. Notes with equal hashes,
+// and for each band notes with equal band keys, are brought together by
+// sorting through a Spill rather than in memory, and so are the pairs, which
+// are passed to `visit` in the same order `find_duplicates` returns them.
+// Positions are those of the notes in the store the stream writes.
+int find_duplicates_bounded(const char *dir_path, size_t max_memory, DuplicateVisit visit, void *ctx,
+                            size_t *hashed) {
+  *hashed = 0;
+  BoundedScan scan = {0};
+  scan.dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (scan.dir_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open %s\n", dir_path);
+    return FAILURE;
+  }
+  char path[MAX_PATH_LEN];
+  int written = snprintf(path, MAX_PATH_LEN, "%s/%sXXXXXX", dir_path, SPILL_DIR_PREFIX);
+  scan.fd = written >= 0 && written < MAX_PATH_LEN ? mkostemp(path, O_CLOEXEC) : -1;
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (scan.fd != -1)
+    unlink(path);
+  if (scan.fd == -1) {
+    fprintf(stderr, "ERROR: Could not create a file in %s for sketches.\n", dir_path);
+    close(scan.dir_fd);
+    return FAILURE;
+  }
+  sketch_cache_open(&scan.cache, scan.dir_fd);
+  scan.batch = (SketchBatch){.cache = &scan.cache, .dir_fd = scan.dir_fd};
+  // The stream takes three quarters of the budget, the rest is for sorting
+  spill_init(&scan.exact, dir_path, max_memory / 8, compare_sketch_keys, NULL);
+  spill_init(&scan.by_inode, dir_path, max_memory / 8, compare_spilled_sketches, NULL);
+  int outcome = index_stream(dir_path, max_memory, sketch_chunk, &scan);
+  free(scan.batch.sketches);
+  free(scan.batch.valid);
+  free(scan.batch.hashed);
+  *hashed = scan.hashed;
+
+  // The cache is only a cache, so failing to save it is not an error
+  if (outcome == SUCCESS && (scan.hashed > 0 || scan.valid_count != scan.cache.count))
+    sketch_cache_write_spill(scan.dir_fd, &scan.by_inode);
+  spill_free(&scan.by_inode);
+  sketch_cache_close(&scan.cache);
+
+  const NoteSketch *sketches = NULL;
+  size_t map_size = scan.count * sizeof(NoteSketch);
+  if (outcome == SUCCESS && map_size > 0) {
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, scan.fd, 0);
+    outcome = map == MAP_FAILED ? FAILURE : SUCCESS;
+    sketches = map == MAP_FAILED ? NULL : map;
+  }
+
+  Spill pairs;
+  spill_init(&pairs, dir_path, max_memory / 4, compare_spilled_pairs, NULL);
+  if (outcome == SUCCESS)
+    outcome = spill_exact_pairs(&scan.exact, &pairs);
+  spill_free(&scan.exact);
+  for (int band = 0; band < SKETCH_BANDS && outcome == SUCCESS && sketches != NULL; band++) {
+    outcome = spill_band_pairs(sketches, scan.count, band, dir_path, max_memory / 4, &pairs);
+  }
+  if (outcome == SUCCESS)
+    outcome = spill_sort(&pairs);
+
+  const void *record;
+  size_t length;
+  while (outcome == SUCCESS && spill_next(&pairs, &record, &length)) {
+    DuplicatePair pair;
+    memcpy(&pair, record, sizeof(pair));
+    outcome = visit(ctx, &pair);
+  }
+  spill_free(&pairs);
+
+  if (sketches != NULL)
+    munmap((void *)sketches, map_size);
+  close(scan.fd);
+  close(scan.dir_fd);
+  return outcome;
+}
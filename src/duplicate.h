@@ -0,0 +1,73 @@
+#ifndef DUPLICATE_H_
+#define DUPLICATE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "index.h"
+
+// Each note body is summarised by an XXH64 hash, which finds exact copies,
+// and a MinHash of its three word shingles, which finds notes that differ in
+// only a few words. The sketches are cached in the vault by inode,
+// modification time and size, so unchanged notes are not read again.
+#define SKETCH_FILE_NAME ".connote-sketches"
+#define SKETCH_MAGIC "CNSK"
+#define SKETCH_VERSION 1
+#define SKETCH_SHINGLE_WORDS 3
+// Shorter bodies give MinHashes too noisy to compare
+#define SKETCH_MIN_SHINGLES 8
+#define SKETCH_MINHASHES 32
+// Notes are only compared when all the minimums of one band agree. Two rows
+// per band find notes sharing 80% of their shingles with a chance of 1 - (1 -
+// 0.8^2)^16, better than 99.9%, while notes with little in common rarely meet.
+#define SKETCH_BANDS 16
+#define SKETCH_BAND_ROWS (SKETCH_MINHASHES / SKETCH_BANDS)
+// Near duplicates agree on at least this many of their minimums
+#define SKETCH_NEAR_MATCHES 24
+#define SKETCH_MAX_THREADS 16
+// Sketches written to the cache at a time by a bounded search
+#define SKETCH_WRITE_BATCH 256
+
+// One cached note, found by its inode, modification time and size
+typedef struct {
+  uint64_t inode;
+  int64_t mtime;
+  uint32_t mtime_nsec;
+  uint32_t shingles; // Shingles in the body, 0 with fewer than SKETCH_SHINGLE_WORDS words
+  uint64_t size;
+  uint64_t hash; // XXH64 of the body
+  uint32_t minhash[SKETCH_MINHASHES];
+} NoteSketch;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t count;
+  uint32_t crc; // CRC32C of the sketches that follow
+  uint32_t reserved;
+} SketchHeader;
+
+// Two notes, by position in the NoteIndex, with identical bodies or bodies
+// estimated to share `similarity` percent of their shingles
+typedef struct {
+  size_t first;
+  size_t second;
+  bool exact;
+  uint32_t similarity;
+} DuplicatePair;
+
+// Called by `find_duplicates_bounded` with each pair in turn. Returning
+// FAILURE stops the search.
+typedef int (*DuplicateVisit)(void *ctx, const DuplicatePair *pair);
+
+uint64_t xxh64(const void *data, size_t length, uint64_t seed);
+void minhash(const char *data, size_t length, uint32_t *dest, uint32_t *shingles);
+const char *note_body(const char *data, size_t length, size_t *body_length);
+
+int sketch_notes(const NoteIndex *index, NoteSketch *sketches, size_t *hashed);
+size_t find_duplicates(const NoteSketch *sketches, size_t count, DuplicatePair **pairs);
+int find_duplicates_bounded(const char *dir_path, size_t max_memory, DuplicateVisit visit, void *ctx,
+                            size_t *hashed);
+
+#endif // DUPLICATE_H_
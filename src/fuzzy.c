@@ -0,0 +1,603 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "fuzzy.h"
+#include "index.h"
+#include "utils.h"
+
+// Scores follow fzf: every matched character earns SCORE_MATCH, more at the
+// start of a word or right after the previous match, and gaps inside the
+// matched window cost a little, more for the first skipped character. A run
+// of matches is worth as much as jumping over a hyphen to the next word.
+#define SCORE_MATCH 16
+#define SCORE_GAP_START -3
+#define SCORE_GAP_EXTENSION -1
+#define BONUS_BOUNDARY 8
+#define BONUS_CONSECUTIVE (BONUS_BOUNDARY + SCORE_GAP_START)
+#define NO_MATCH INT32_MIN
+
+// Source of FuzzyIndex builds, so sessions can tell a rebuilt index from the
+// one they saw before even when it lives at the same address
+static uint64_t builds;
+
+// Codes from here on are shared by several characters
+#define FUZZY_SHARED_CODES 38
+
+// Titles are sluggified, so nearly all of their bytes are lowercase letters,
+// digits or hyphens, and those get a code of their own. Anything else shares
+// the remaining codes, which only lets a few extra candidates through to be
+// scored.
+static inline uint32_t char_code(unsigned char c) {
+  if (c >= 'a' && c <= 'z')
+    return 1 + (c - 'a');
+  if (c >= '0' && c <= '9')
+    return 27 + (c - '0');
+  if (c == '-')
+    return 37;
+  return FUZZY_SHARED_CODES + c % 26;
+}
+
+static inline uint32_t trigram(const char *str) {
+  return char_code(str[0]) << 12 | char_code(str[1]) << 6 | char_code(str[2]);
+}
+
+static uint64_t char_mask(const char *str, size_t length) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < length; i++) {
+    mask |= 1ULL << char_code(str[i]);
+  }
+  return mask;
+}
+
+int fuzzy_index_build_titles(FuzzyIndex *fuzzy, const char *const *titles, size_t count) {
+  memset(fuzzy, 0, sizeof(*fuzzy));
+  fuzzy->count = count;
+  fuzzy->starts = malloc((count + 1) * sizeof(uint32_t));
+  fuzzy->masks = malloc((count ? count : 1) * sizeof(uint64_t));
+  fuzzy->boundaries = malloc((count ? count : 1) * sizeof(uint64_t));
+  fuzzy->offsets = calloc(FUZZY_TRIGRAM_COUNT + 1, sizeof(uint32_t));
+  // The title each trigram was last seen in, plus one, so that a trigram
+  // repeated within a title is only posted once
+  uint32_t *seen = calloc(FUZZY_TRIGRAM_COUNT, sizeof(uint32_t));
+  uint32_t *fill = malloc(FUZZY_TRIGRAM_COUNT * sizeof(uint32_t));
+  if (fuzzy->starts == NULL || fuzzy->masks == NULL || fuzzy->boundaries == NULL || fuzzy->offsets == NULL || seen == NULL || fill == NULL)
+    goto fail;
+
+  // Titles are copied back to back, so that scanning them all reads memory
+  // in order rather than chasing a pointer per note
+  size_t text_length = 0;
+  for (size_t i = 0; i < count; i++) {
+    fuzzy->starts[i] = (uint32_t)text_length;
+    text_length += strnlen(titles[i], MAX_TITLE_LEN - 1);
+  }
+  fuzzy->starts[count] = (uint32_t)text_length;
+  fuzzy->text = malloc(text_length ? text_length : 1);
+  if (fuzzy->text == NULL)
+    goto fail;
+
+  // Count the postings of each trigram, then lay them out back to back
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    char *title = fuzzy->text + fuzzy->starts[i];
+    size_t length = fuzzy->starts[i + 1] - fuzzy->starts[i];
+    memcpy(title, titles[i], length);
+    fuzzy->masks[i] = char_mask(title, length);
+    fuzzy->boundaries[i] = 0;
+    for (size_t j = 0; j < length; j++) {
+      if (j == 0 || title[j - 1] == '-')
+        fuzzy->boundaries[i] |= 1ULL << char_code(title[j]);
+    }
+    for (size_t j = 0; j + 3 <= length; j++) {
+      uint32_t t = trigram(title + j);
+      if (seen[t] != i + 1) {
+        seen[t] = i + 1;
+        fuzzy->offsets[t + 1]++;
+        total++;
+      }
+    }
+  }
+  for (size_t t = 0; t < FUZZY_TRIGRAM_COUNT; t++) {
+    fuzzy->offsets[t + 1] += fuzzy->offsets[t];
+  }
+
+  fuzzy->postings = malloc((total ? total : 1) * sizeof(uint32_t));
+  if (fuzzy->postings == NULL)
+    goto fail;
+  memcpy(fill, fuzzy->offsets, FUZZY_TRIGRAM_COUNT * sizeof(uint32_t));
+  memset(seen, 0, FUZZY_TRIGRAM_COUNT * sizeof(uint32_t));
+
+  // Titles are visited in order, so every posting list comes out ascending
+  for (size_t i = 0; i < count; i++) {
+    const char *title = fuzzy->text + fuzzy->starts[i];
+    size_t length = fuzzy->starts[i + 1] - fuzzy->starts[i];
+    for (size_t j = 0; j + 3 <= length; j++) {
+      uint32_t t = trigram(title + j);
+      if (seen[t] != i + 1) {
+        seen[t] = i + 1;
+        fuzzy->postings[fill[t]++] = (uint32_t)i;
+      }
+    }
+  }
+  free(fill);
+  free(seen);
+  fuzzy->build = ++builds;
+
+  return SUCCESS;
+
+fail:
+  fprintf(stderr, "ERROR: Could not allocate the title index.\n");
+  free(fill);
+  free(seen);
+  fuzzy_index_free(fuzzy);
+  return FAILURE;
+}
+
+int fuzzy_index_build(FuzzyIndex *fuzzy, const NoteIndex *index) {
+  const char **titles = malloc((index->count ? index->count : 1) * sizeof(char *));
+  if (titles == NULL)
+    return FAILURE;
+  for (size_t i = 0; i < index->count; i++) {
+    titles[i] = index->notes[i].title;
+  }
+
+  int outcome = fuzzy_index_build_titles(fuzzy, titles, index->count);
+  free(titles);
+  fuzzy->source = index;
+  fuzzy->source_generation = index->generation;
+
+  return outcome;
+}
+
+// Returns true if `fuzzy` was built from `index` as it is now
+bool fuzzy_index_current(const FuzzyIndex *fuzzy, const NoteIndex *index) {
+  return fuzzy->build != 0 && fuzzy->source == index && fuzzy->source_generation == index->generation;
+}
+
+void fuzzy_index_free(FuzzyIndex *fuzzy) {
+  free(fuzzy->text);
+  free(fuzzy->starts);
+  free(fuzzy->masks);
+  free(fuzzy->boundaries);
+  free(fuzzy->offsets);
+  free(fuzzy->postings);
+  memset(fuzzy, 0, sizeof(*fuzzy));
+}
+
+// Score `word` as a subsequence of `title`, or NO_MATCH if it isn't one. As
+// in fzf's first algorithm, the earliest match is found going forwards and
+// then tightened going backwards, and only that window is scored.
+int32_t fuzzy_score(const char *title, size_t title_len, const char *word, size_t word_len) {
+  const char *found = title;
+  const char *title_end = title + title_len;
+  for (size_t w = 0; w < word_len; w++) {
+    found = memchr(found, word[w], title_end - found);
+    if (found == NULL)
+      return NO_MATCH;
+    found++;
+  }
+
+  size_t end = found - title;
+  size_t t = end, w = word_len;
+  while (w > 0) {
+    t--;
+    if (title[t] == word[w - 1])
+      w--;
+  }
+
+  int32_t score = 0;
+  bool consecutive = false;
+  bool in_gap = false;
+  for (; t < end; t++) {
+    if (w < word_len && title[t] == word[w]) {
+      score += SCORE_MATCH;
+      if (t == 0 || title[t - 1] == '-')
+        score += BONUS_BOUNDARY;
+      if (consecutive)
+        score += BONUS_CONSECUTIVE;
+      consecutive = true;
+      in_gap = false;
+      w++;
+    } else {
+      score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+      consecutive = false;
+      in_gap = true;
+    }
+  }
+
+  return score;
+}
+
+void fuzzy_session_init(FuzzySession *session) { memset(session, 0, sizeof(*session)); }
+
+void fuzzy_session_free(FuzzySession *session) {
+  for (int i = 0; i < FUZZY_HISTORY; i++) {
+    free(session->history[i].matches);
+  }
+  free(session->bits);
+  memset(session, 0, sizeof(*session));
+}
+
+typedef struct {
+  char text[FUZZY_MAX_QUERY_LEN]; // Sluggified words separated by single spaces
+  const char *words[FUZZY_MAX_WORDS];
+  size_t lengths[FUZZY_MAX_WORDS];
+  size_t word_count;
+  uint64_t mask;
+  // The best score, given which characters start a word in the title, is
+  // `base_score` plus `bonus[c]` for each character code c that does
+  int32_t base_score;
+  uint64_t bonus_mask;
+  int32_t bonus[64];
+} Query;
+
+// The most a word can score in a title depends only on which of its
+// characters start a word in the title. A character can only earn the
+// boundary bonus as well as the consecutive one right after a hyphen;
+// otherwise the boundary bonus means a gap before it, which costs at least
+// SCORE_GAP_START.
+static void add_score_bound(Query *query, const char *word, size_t length) {
+  const int32_t after_gap = BONUS_BOUNDARY + SCORE_GAP_START;
+  for (size_t j = 0; j < length; j++) {
+    uint32_t code = char_code(word[j]);
+    int32_t bonus = 0;
+    query->base_score += SCORE_MATCH;
+    if (j == 0) {
+      bonus = BONUS_BOUNDARY;
+    } else if (word[j - 1] == '-') {
+      query->base_score += BONUS_BOUNDARY + BONUS_CONSECUTIVE;
+    } else {
+      query->base_score += BONUS_CONSECUTIVE;
+      bonus = after_gap > BONUS_CONSECUTIVE ? after_gap - BONUS_CONSECUTIVE : 0;
+    }
+    query->bonus[code] += bonus;
+    if (bonus > 0)
+      query->bonus_mask |= 1ULL << code;
+  }
+}
+
+static inline int32_t score_bound(const Query *query, uint64_t boundaries) {
+  int32_t bound = query->base_score;
+  for (uint64_t hits = boundaries & query->bonus_mask; hits != 0; hits &= hits - 1) {
+    bound += query->bonus[__builtin_ctzll(hits)];
+  }
+  return bound;
+}
+
+// Split `query` at whitespace and sluggify each word the way titles are, so
+// "Meeting Notes" looks for "meeting" and "notes" anywhere in the title
+static void parse_query(const char *query, Query *parsed) {
+  memset(parsed, 0, sizeof(*parsed));
+  char copy[FUZZY_MAX_QUERY_LEN];
+  snprintf(copy, sizeof(copy), "%s", query);
+
+  size_t pos = 0;
+  char *save;
+  for (char *word = strtok_r(copy, " \t\n\v\f\r", &save); word != NULL && parsed->word_count < FUZZY_MAX_WORDS;
+       word = strtok_r(NULL, " \t\n\v\f\r", &save)) {
+    sluggify_title(word);
+    size_t length = strlen(word);
+    if (length == 0 || pos + length + 1 >= FUZZY_MAX_QUERY_LEN)
+      continue;
+    if (pos > 0)
+      parsed->text[pos++] = ' ';
+    memcpy(parsed->text + pos, word, length + 1);
+    parsed->words[parsed->word_count] = parsed->text + pos;
+    parsed->lengths[parsed->word_count++] = length;
+    parsed->mask |= char_mask(word, length);
+    add_score_bound(parsed, word, length);
+    pos += length;
+  }
+}
+
+// The smallest remembered candidate set that contains every match of
+// `query`. Adding characters to a word or adding words only removes matches,
+// so the candidates of any earlier query that `query` extends will do.
+static FuzzyHistoryEntry *history_lookup(FuzzySession *session, const Query *query) {
+  FuzzyHistoryEntry *best = NULL;
+  for (int i = 0; i < FUZZY_HISTORY; i++) {
+    FuzzyHistoryEntry *entry = &session->history[i];
+    if (entry->last_used == 0 || strncmp(entry->query, query->text, strlen(entry->query)) != 0)
+      continue;
+    if (best == NULL || entry->match_count < best->match_count)
+      best = entry;
+  }
+  if (best != NULL)
+    best->last_used = ++session->clock;
+  return best;
+}
+
+// Remember the candidates for `query`, taking ownership of them
+static void history_store(FuzzySession *session, const Query *query, uint32_t *matches, size_t match_count) {
+  FuzzyHistoryEntry *oldest = &session->history[0];
+  for (int i = 0; i < FUZZY_HISTORY; i++) {
+    FuzzyHistoryEntry *entry = &session->history[i];
+    if (entry->last_used != 0 && strcmp(entry->query, query->text) == 0) {
+      free(matches);
+      entry->last_used = ++session->clock;
+      return;
+    }
+    if (entry->last_used < oldest->last_used)
+      oldest = entry;
+  }
+
+  free(oldest->matches);
+  snprintf(oldest->query, FUZZY_MAX_QUERY_LEN, "%s", query->text);
+  oldest->matches = matches;
+  oldest->match_count = match_count;
+  oldest->last_used = ++session->clock;
+}
+
+// First position in `list` at or after `from` holding a value not less than
+// `value`, found by galloping so long lists are skipped through quickly
+static size_t gallop(const uint32_t *list, size_t from, size_t count, uint32_t value) {
+  size_t step = 1;
+  size_t hi = from;
+  while (hi < count && list[hi] < value) {
+    from = hi + 1;
+    hi += step;
+    step *= 2;
+  }
+  if (hi > count)
+    hi = count;
+  while (from < hi) {
+    size_t mid = from + (hi - from) / 2;
+    if (list[mid] < value) {
+      from = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return from;
+}
+
+// Keep the members of `set` that are in `list`. Returns the new count. Long
+// lists are galloped through; lists of about the same size as the set are
+// marked in the session's bitset instead, which avoids a search per member.
+static size_t intersect(FuzzySession *session, uint32_t *set, size_t set_count, const uint32_t *list,
+                        size_t list_count) {
+  size_t kept = 0;
+  if (list_count > set_count * FUZZY_GALLOP_RATIO) {
+    size_t pos = 0;
+    for (size_t i = 0; i < set_count && pos < list_count; i++) {
+      pos = gallop(list, pos, list_count, set[i]);
+      if (pos < list_count && list[pos] == set[i])
+        set[kept++] = set[i];
+    }
+    return kept;
+  }
+
+  uint64_t *bits = session->bits;
+  for (size_t i = 0; i < list_count; i++) {
+    bits[list[i] / 64] |= 1ULL << (list[i] % 64);
+  }
+  for (size_t i = 0; i < set_count; i++) {
+    if (bits[set[i] / 64] & 1ULL << (set[i] % 64))
+      set[kept++] = set[i];
+  }
+  // Leave the bitset clear for the next list
+  for (size_t i = 0; i < list_count; i++) {
+    bits[list[i] / 64] = 0;
+  }
+  return kept;
+}
+
+// Adds the trigrams of the words in `text` to `trigrams`, skipping those
+// already there. Returns the new count.
+static size_t add_trigrams(const char *text, uint32_t *trigrams, size_t count) {
+  for (size_t j = 0; text[j] != '\0' && text[j + 1] != '\0' && text[j + 2] != '\0'; j++) {
+    if (text[j] == ' ' || text[j + 1] == ' ' || text[j + 2] == ' ')
+      continue;
+    uint32_t t = trigram(text + j);
+    size_t k = 0;
+    while (k < count && trigrams[k] != t) {
+      k++;
+    }
+    if (k == count)
+      trigrams[count++] = t;
+  }
+  return count;
+}
+
+// Collect the candidates for `query`: the titles containing every trigram
+// of its words of three or more characters, within `base` if given. Only the
+// trigrams `base` was not already narrowed down by are looked up. Returns
+// NULL if no word has a trigram and there is no base, meaning every title is
+// a candidate.
+static uint32_t *trigram_candidates(FuzzySession *session, const FuzzyIndex *fuzzy, const Query *query,
+                                    const FuzzyHistoryEntry *base, size_t *count) {
+  uint32_t trigrams[FUZZY_MAX_QUERY_LEN];
+  size_t known = base != NULL ? add_trigrams(base->query, trigrams, 0) : 0;
+  size_t trigram_count = add_trigrams(query->text, trigrams, known);
+
+  const uint32_t *lists[FUZZY_MAX_QUERY_LEN];
+  size_t list_counts[FUZZY_MAX_QUERY_LEN];
+  size_t list_count = 0;
+  for (size_t i = known; i < trigram_count; i++) {
+    lists[list_count] = fuzzy->postings + fuzzy->offsets[trigrams[i]];
+    list_counts[list_count++] = fuzzy->offsets[trigrams[i] + 1] - fuzzy->offsets[trigrams[i]];
+  }
+
+  // Start from the smallest set, then drop what is missing from the others
+  ssize_t smallest = -1;
+  size_t smallest_count = base != NULL ? base->match_count : fuzzy->count;
+  for (size_t i = 0; i < list_count; i++) {
+    if (list_counts[i] < smallest_count) {
+      smallest = (ssize_t)i;
+      smallest_count = list_counts[i];
+    }
+  }
+  if (smallest == -1 && base == NULL) {
+    *count = fuzzy->count;
+    return NULL;
+  }
+
+  uint32_t *set = malloc((smallest_count ? smallest_count : 1) * sizeof(uint32_t));
+  if (session->bits == NULL)
+    session->bits = calloc(fuzzy->count / 64 + 1, sizeof(uint64_t));
+  if (set == NULL || session->bits == NULL) {
+    free(set);
+    *count = 0;
+    return NULL;
+  }
+  memcpy(set, smallest == -1 ? base->matches : lists[smallest], smallest_count * sizeof(uint32_t));
+  size_t set_count = smallest_count;
+  if (smallest != -1 && base != NULL)
+    set_count = intersect(session, set, set_count, base->matches, base->match_count);
+  for (size_t i = 0; i < list_count && set_count > 0; i++) {
+    if ((ssize_t)i != smallest)
+      set_count = intersect(session, set, set_count, lists[i], list_counts[i]);
+  }
+
+  *count = set_count;
+  return set;
+}
+
+// Ranks matches: higher scores first, then shorter titles, then newer notes
+static inline bool ranks_before(const FuzzyIndex *fuzzy, const FuzzyMatch *a, const FuzzyMatch *b) {
+  if (a->score != b->score)
+    return a->score > b->score;
+  uint32_t a_length = fuzzy->starts[a->note + 1] - fuzzy->starts[a->note];
+  uint32_t b_length = fuzzy->starts[b->note + 1] - fuzzy->starts[b->note];
+  if (a_length != b_length)
+    return a_length < b_length;
+  return a->note > b->note;
+}
+
+// The best `limit` matches are kept in a heap with the worst at the top
+static void heap_sift_down(const FuzzyIndex *fuzzy, FuzzyMatch *heap, size_t count, size_t i) {
+  for (;;) {
+    size_t worst = i;
+    size_t left = 2 * i + 1, right = left + 1;
+    if (left < count && ranks_before(fuzzy, &heap[worst], &heap[left]))
+      worst = left;
+    if (right < count && ranks_before(fuzzy, &heap[worst], &heap[right]))
+      worst = right;
+    if (worst == i)
+      return;
+    FuzzyMatch tmp = heap[i];
+    heap[i] = heap[worst];
+    heap[worst] = tmp;
+    i = worst;
+  }
+}
+
+static void heap_offer(const FuzzyIndex *fuzzy, FuzzyMatch *heap, size_t *count, size_t limit, FuzzyMatch match) {
+  if (*count < limit) {
+    size_t i = (*count)++;
+    heap[i] = match;
+    while (i > 0 && ranks_before(fuzzy, &heap[(i - 1) / 2], &heap[i])) {
+      FuzzyMatch tmp = heap[i];
+      heap[i] = heap[(i - 1) / 2];
+      heap[(i - 1) / 2] = tmp;
+      i = (i - 1) / 2;
+    }
+  } else if (limit > 0 && ranks_before(fuzzy, &match, &heap[0])) {
+    heap[0] = match;
+    heap_sift_down(fuzzy, heap, limit, 0);
+  }
+}
+
+// Search the titles in `fuzzy` for `query`, writing the best `limit`
+// matches to `results` best first. Every word of the query must be a
+// subsequence of the title, and words of three or more characters must also
+// have all of their trigrams in it.
+//
+// Only titles that could rank among the results are checked and scored; the
+// rest are known to pass the trigram and character filters, which is enough
+// to narrow the next keystroke down from. `total` is set to the number of
+// titles that may match: those ranked, plus those that pass the filters but
+// were never checked. `session` carries the candidates of earlier queries
+// over to the next keystroke, and is reset when the index is rebuilt.
+size_t fuzzy_search(FuzzySession *session, const FuzzyIndex *fuzzy, const char *query, FuzzyMatch *results,
+                    size_t limit, size_t *total) {
+  if (session->index != fuzzy || session->build != fuzzy->build) {
+    fuzzy_session_free(session);
+    session->index = fuzzy;
+    session->build = fuzzy->build;
+  }
+
+  Query parsed;
+  parse_query(query, &parsed);
+
+  // With nothing typed yet, offer the newest notes
+  if (parsed.word_count == 0) {
+    size_t found = fuzzy->count < limit ? fuzzy->count : limit;
+    for (size_t i = 0; i < found; i++) {
+      results[i] = (FuzzyMatch){.note = (uint32_t)(fuzzy->count - 1 - i), .score = 0};
+    }
+    if (total != NULL)
+      *total = fuzzy->count;
+    return found;
+  }
+
+  const FuzzyHistoryEntry *base = history_lookup(session, &parsed);
+  size_t candidate_count;
+  uint32_t *candidates = trigram_candidates(session, fuzzy, &parsed, base, &candidate_count);
+
+  uint32_t *matches = malloc((candidate_count ? candidate_count : 1) * sizeof(uint32_t));
+  if (matches == NULL) {
+    free(candidates);
+    return 0;
+  }
+
+  // Filter on the characters first, without branching, since most titles
+  // pass when the query is short
+  size_t match_count = 0;
+  for (size_t i = 0; i < candidate_count; i++) {
+    uint32_t note = candidates != NULL ? candidates[i] : (uint32_t)i;
+    matches[match_count] = note;
+    match_count += (fuzzy->masks[note] & parsed.mask) == parsed.mask;
+  }
+  free(candidates);
+
+  // Then rank newest first, so that once the results are full a title that
+  // can at best tie with the worst of them is passed over without reading
+  // it. Titles found not to match are dropped, packing the rest at the end.
+  size_t found = 0, kept = match_count;
+  for (size_t i = match_count; i-- > 0;) {
+    uint32_t note = matches[i];
+    FuzzyMatch match = {.note = note};
+    if (found == limit) {
+      match.score = score_bound(&parsed, fuzzy->boundaries[note]);
+      if (limit == 0 || match.score < results[0].score || !ranks_before(fuzzy, &match, &results[0])) {
+        matches[--kept] = note;
+        continue;
+      }
+    }
+
+    const char *title = fuzzy->text + fuzzy->starts[note];
+    size_t length = fuzzy->starts[note + 1] - fuzzy->starts[note];
+    match.score = 0;
+    bool matched = true;
+    for (size_t w = 0; w < parsed.word_count && matched; w++) {
+      int32_t word_score = fuzzy_score(title, length, parsed.words[w], parsed.lengths[w]);
+      matched = word_score != NO_MATCH;
+      match.score += matched ? word_score : 0;
+    }
+    if (!matched)
+      continue;
+
+    matches[--kept] = note;
+    heap_offer(fuzzy, results, &found, limit, match);
+  }
+  memmove(matches, matches + kept, (match_count - kept) * sizeof(uint32_t));
+  match_count -= kept;
+  history_store(session, &parsed, matches, match_count);
+
+  // Take the worst off the top of the heap until it is sorted best first
+  for (size_t n = found; n > 1; n--) {
+    FuzzyMatch tmp = results[0];
+    results[0] = results[n - 1];
+    results[n - 1] = tmp;
+    heap_sift_down(fuzzy, results, n - 1, 0);
+  }
+
+  if (total != NULL)
+    *total = match_count;
+  return found;
+}
@@ -0,0 +1,72 @@
+#ifndef FUZZY_H_
+#define FUZZY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "index.h"
+
+// Trigrams are packed from three 6 bit character codes
+#define FUZZY_TRIGRAM_BITS 18
+#define FUZZY_TRIGRAM_COUNT (1 << FUZZY_TRIGRAM_BITS)
+#define FUZZY_MAX_QUERY_LEN 256
+#define FUZZY_MAX_WORDS 16
+// Candidate sets kept from earlier queries, so typing and deleting
+// characters both start from a small set
+#define FUZZY_HISTORY 16
+#define FUZZY_DEFAULT_LIMIT 20
+// Lists this many times longer than the set they narrow are galloped through
+#define FUZZY_GALLOP_RATIO 32
+
+// Trigram index over the sluggified titles of a NoteIndex. Titles are found
+// by their position in the NoteIndex, so the index must be rebuilt whenever
+// the NoteIndex generation changes.
+typedef struct {
+  const NoteIndex *source;
+  uint64_t source_generation; // Generation of `source` when built
+  uint64_t build;             // Distinct for every build
+  size_t count;
+  char *text;       // Every title back to back, without terminators
+  uint32_t *starts; // Title i is text[starts[i]] up to text[starts[i + 1]]
+  uint64_t *masks;      // Characters present in each title, see char_mask
+  uint64_t *boundaries; // Characters starting a word in each title
+  uint32_t *offsets;  // FUZZY_TRIGRAM_COUNT + 1 offsets into `postings`
+  uint32_t *postings; // Positions of the titles containing each trigram, ascending
+} FuzzyIndex;
+
+// The notes that may match an earlier query, in ascending order
+typedef struct {
+  char query[FUZZY_MAX_QUERY_LEN];
+  uint32_t *matches;
+  size_t match_count;
+  uint64_t last_used;
+} FuzzyHistoryEntry;
+
+// State kept between the queries of one picker, one query per keystroke
+typedef struct {
+  const FuzzyIndex *index;
+  uint64_t build; // Build of `index` the history was collected from
+  FuzzyHistoryEntry history[FUZZY_HISTORY];
+  uint64_t clock;
+  uint64_t *bits; // One bit per title, clear between uses
+} FuzzySession;
+
+typedef struct {
+  uint32_t note; // Position of the note in the NoteIndex
+  int32_t score;
+} FuzzyMatch;
+
+int fuzzy_index_build(FuzzyIndex *fuzzy, const NoteIndex *index);
+int fuzzy_index_build_titles(FuzzyIndex *fuzzy, const char *const *titles, size_t count);
+bool fuzzy_index_current(const FuzzyIndex *fuzzy, const NoteIndex *index);
+void fuzzy_index_free(FuzzyIndex *fuzzy);
+
+int32_t fuzzy_score(const char *title, size_t title_len, const char *word, size_t word_len);
+
+void fuzzy_session_init(FuzzySession *session);
+void fuzzy_session_free(FuzzySession *session);
+size_t fuzzy_search(FuzzySession *session, const FuzzyIndex *fuzzy, const char *query, FuzzyMatch *results,
+                    size_t limit, size_t *total);
+
+#endif // FUZZY_H_
@@ -0,0 +1,639 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "import.h"
+#include "index.h"
+#include "utils.h"
+
+#define KEYWORD_SEPARATORS " ,\t"
+
+// Accepts an ID, "YYYY-MM-DD", or "YYYY-MM-DD HH:MM[:SS]" with a space or 'T'
+// between the date and the time
+int date_to_id(const char *date, char *id) {
+  if (name_has_valid_id(date) && date[ID_LEN] == '\0') {
+    memcpy(id, date, ID_LEN + 1);
+    return SUCCESS;
+  }
+
+  int year, month, day, hour = 0, minute = 0, second = 0;
+  char separator;
+  int fields = sscanf(date, "%4d-%2d-%2d%c%2d:%2d:%2d", &year, &month, &day, &separator, &hour, &minute, &second);
+  if (fields < 3 || (fields > 3 && separator != 'T' && separator != ' ') || fields == 4 || fields == 5)
+    return FAILURE;
+  if (year < 0 || year > 9999 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || hour > 23 ||
+      minute < 0 || minute > 59 || second < 0 || second > 59)
+    return FAILURE;
+
+  snprintf(id, ID_LEN + 1, "%04d%02d%02dT%02d%02d%02d", year, month, day, hour, minute, second);
+  return SUCCESS;
+}
+
+static const char *skip_whitespace(const char *ptr) {
+  while (isspace((unsigned char)*ptr)) {
+    ptr++;
+  }
+  return ptr;
+}
+
+// Append the UTF-8 encoding of `codepoint` to `dest`
+static void append_utf8(uint32_t codepoint, char *dest, size_t dest_size, size_t *pos) {
+  char bytes[4];
+  size_t length;
+  if (codepoint < 0x80) {
+    bytes[0] = (char)codepoint;
+    length = 1;
+  } else if (codepoint < 0x800) {
+    bytes[0] = (char)(0xc0 | (codepoint >> 6));
+    bytes[1] = (char)(0x80 | (codepoint & 0x3f));
+    length = 2;
+  } else if (codepoint < 0x10000) {
+    bytes[0] = (char)(0xe0 | (codepoint >> 12));
+    bytes[1] = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+    bytes[2] = (char)(0x80 | (codepoint & 0x3f));
+    length = 3;
+  } else {
+    bytes[0] = (char)(0xf0 | (codepoint >> 18));
+    bytes[1] = (char)(0x80 | ((codepoint >> 12) & 0x3f));
+    bytes[2] = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+    bytes[3] = (char)(0x80 | (codepoint & 0x3f));
+    length = 4;
+  }
+
+  if (*pos + length < dest_size) {
+    memcpy(dest + *pos, bytes, length);
+    *pos += length;
+  }
+}
+
+static bool read_hex4(const char *ptr, uint32_t *value) {
+  *value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = ptr[i];
+    uint32_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    *value = *value * 16 + digit;
+  }
+  return true;
+}
+
+// Parse the JSON string starting at the opening quote `ptr` into `dest`,
+// truncating if necessary. Returns the position after the closing quote, or
+// NULL if the string is malformed.
+static const char *parse_json_string(const char *ptr, char *dest, size_t dest_size) {
+  if (*ptr != '"')
+    return NULL;
+  ptr++;
+
+  size_t pos = 0;
+  while (*ptr != '"') {
+    if (*ptr == '\0')
+      return NULL;
+
+    if (*ptr != '\\') {
+      if (pos + 1 < dest_size)
+        dest[pos++] = *ptr;
+      ptr++;
+      continue;
+    }
+
+    ptr++;
+    char c = *ptr++;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      break;
+    case 'b':
+      c = '\b';
+      break;
+    case 'f':
+      c = '\f';
+      break;
+    case 'n':
+      c = '\n';
+      break;
+    case 'r':
+      c = '\r';
+      break;
+    case 't':
+      c = '\t';
+      break;
+    case 'u': {
+      uint32_t codepoint;
+      if (!read_hex4(ptr, &codepoint))
+        return NULL;
+      ptr += 4;
+      // Combine surrogate pairs
+      uint32_t low;
+      if (codepoint >= 0xd800 && codepoint < 0xdc00 && ptr[0] == '\\' && ptr[1] == 'u' && read_hex4(ptr + 2, &low) &&
+          low >= 0xdc00 && low < 0xe000) {
+        codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+        ptr += 6;
+      }
+      append_utf8(codepoint, dest, dest_size, &pos);
+      continue;
+    }
+    default:
+      return NULL;
+    }
+    if (pos + 1 < dest_size)
+      dest[pos++] = c;
+  }
+
+  if (dest_size > 0)
+    dest[pos] = '\0';
+  return ptr + 1;
+}
+
+// Skip over a JSON value we don't use. Nested objects are not supported.
+static const char *skip_json_value(const char *ptr) {
+  char scratch[2];
+  if (*ptr == '"')
+    return parse_json_string(ptr, scratch, sizeof(scratch));
+
+  if (*ptr == '[') {
+    ptr = skip_whitespace(ptr + 1);
+    while (*ptr != ']') {
+      ptr = skip_json_value(ptr);
+      if (ptr == NULL)
+        return NULL;
+      ptr = skip_whitespace(ptr);
+      if (*ptr == ',')
+        ptr = skip_whitespace(ptr + 1);
+      else if (*ptr != ']')
+        return NULL;
+    }
+    return ptr + 1;
+  }
+
+  // Numbers and literals
+  const char *start = ptr;
+  while (*ptr != '\0' && *ptr != ',' && *ptr != '}' && *ptr != ']' && !isspace((unsigned char)*ptr)) {
+    ptr++;
+  }
+  return ptr == start ? NULL : ptr;
+}
+
+// Split `str` on spaces and commas into the entry's keywords
+static void add_keywords(ImportEntry *entry, const char *str) {
+  while (*str != '\0' && entry->kw_count < MAX_KEYS) {
+    str += strspn(str, KEYWORD_SEPARATORS);
+    size_t length = strcspn(str, KEYWORD_SEPARATORS);
+    if (length == 0)
+      break;
+    str_copy_slice(str, 0, length, entry->keywords[entry->kw_count++], MAX_KW_LEN);
+    str += length;
+  }
+}
+
+static int parse_manifest_json(const char *line, ImportEntry *entry) {
+  const char *ptr = skip_whitespace(line);
+  if (*ptr != '{')
+    return FAILURE;
+  ptr = skip_whitespace(ptr + 1);
+
+  while (*ptr != '}') {
+    char key[32];
+    ptr = parse_json_string(ptr, key, sizeof(key));
+    if (ptr == NULL)
+      return FAILURE;
+    ptr = skip_whitespace(ptr);
+    if (*ptr != ':')
+      return FAILURE;
+    ptr = skip_whitespace(ptr + 1);
+
+    char value[MAX_PATH_LEN];
+    bool is_keywords = strcmp(key, "keywords") == 0 || strcmp(key, "tags") == 0;
+    if (is_keywords && *ptr == '[') {
+      ptr = skip_whitespace(ptr + 1);
+      while (*ptr != ']') {
+        ptr = parse_json_string(ptr, value, MAX_KW_LEN);
+        if (ptr == NULL)
+          return FAILURE;
+        if (value[0] != '\0' && entry->kw_count < MAX_KEYS)
+          str_copy_slice(value, 0, strlen(value), entry->keywords[entry->kw_count++], MAX_KW_LEN);
+        ptr = skip_whitespace(ptr);
+        if (*ptr == ',')
+          ptr = skip_whitespace(ptr + 1);
+        else if (*ptr != ']')
+          return FAILURE;
+      }
+      ptr++;
+    } else if (*ptr == '"') {
+      ptr = parse_json_string(ptr, value, sizeof(value));
+      if (ptr == NULL)
+        return FAILURE;
+      if (strcmp(key, "title") == 0) {
+        str_copy_slice(value, 0, strlen(value), entry->title, MAX_TITLE_LEN);
+      } else if (is_keywords) {
+        add_keywords(entry, value);
+      } else if (strcmp(key, "signature") == 0 || strcmp(key, "sig") == 0) {
+        str_copy_slice(value, 0, strlen(value), entry->sig, MAX_SIG_LEN);
+      } else if (strcmp(key, "date") == 0) {
+        str_copy_slice(value, 0, strlen(value), entry->date, sizeof(entry->date));
+      } else if (strcmp(key, "body") == 0 || strcmp(key, "body_path") == 0) {
+        str_copy_slice(value, 0, strlen(value), entry->body_path, MAX_PATH_LEN);
+      }
+    } else {
+      ptr = skip_json_value(ptr);
+      if (ptr == NULL)
+        return FAILURE;
+    }
+
+    ptr = skip_whitespace(ptr);
+    if (*ptr == ',')
+      ptr = skip_whitespace(ptr + 1);
+    else if (*ptr != '}')
+      return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+static int parse_manifest_tsv(const char *line, ImportEntry *entry) {
+  // Copy each tab separated field into place, in order
+  char *fields[] = {entry->title, NULL, entry->sig, entry->date, entry->body_path};
+  size_t sizes[] = {MAX_TITLE_LEN, 0, MAX_SIG_LEN, sizeof(entry->date), MAX_PATH_LEN};
+
+  for (size_t i = 0; i < 5 && *line != '\0'; i++) {
+    size_t length = strcspn(line, "\t\r\n");
+    if (i == 1) {
+      char keywords[MAX_KEYS * MAX_KW_LEN];
+      str_copy_slice(line, 0, length, keywords, sizeof(keywords));
+      add_keywords(entry, keywords);
+    } else {
+      str_copy_slice(line, 0, length, fields[i], sizes[i]);
+    }
+    line += length;
+    if (*line != '\t')
+      break;
+    line++;
+  }
+
+  return SUCCESS;
+}
+
+// Parse one manifest line into `entry`. Returns FAILURE for malformed lines.
+int parse_manifest_line(const char *line, ImportEntry *entry) {
+  size_t number = entry->line;
+  memset(entry, 0, sizeof(*entry));
+  entry->line = number;
+
+  if (*skip_whitespace(line) == '{')
+    return parse_manifest_json(line, entry);
+  return parse_manifest_tsv(line, entry);
+}
+
+static uint64_t hash_id(uint64_t id) {
+  // splitmix64 finaliser
+  id ^= id >> 30;
+  id *= 0xbf58476d1ce4e5b9ULL;
+  id ^= id >> 27;
+  id *= 0x94d049bb133111ebULL;
+  return id ^ (id >> 31);
+}
+
+#define ID_SET_EMPTY ((size_t)-1)
+
+static size_t id_set_find(const IdSet *set, uint64_t id) {
+  if (set->capacity == 0)
+    return ID_SET_EMPTY;
+  for (size_t slot = hash_id(id) & (set->capacity - 1); set->slots[slot] != 0; slot = (slot + 1) & (set->capacity - 1)) {
+    if (set->slots[slot] == id)
+      return slot;
+  }
+  return ID_SET_EMPTY;
+}
+
+bool id_set_contains(const IdSet *set, uint64_t id) { return id_set_find(set, id) != ID_SET_EMPTY; }
+
+static int id_set_grow(IdSet *set) {
+  size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+  uint64_t *slots = calloc(capacity, sizeof(uint64_t));
+  uint64_t *next = calloc(capacity, sizeof(uint64_t));
+  if (slots == NULL || next == NULL) {
+    fprintf(stderr, "ERROR: Out of memory growing ID set.\n");
+    free(slots);
+    free(next);
+    return FAILURE;
+  }
+  for (size_t i = 0; i < set->capacity; i++) {
+    if (set->slots[i] == 0)
+      continue;
+    size_t slot = hash_id(set->slots[i]) & (capacity - 1);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    slots[slot] = set->slots[i];
+    next[slot] = set->next[i];
+  }
+  free(set->slots);
+  free(set->next);
+  set->slots = slots;
+  set->next = next;
+  set->capacity = capacity;
+
+  return SUCCESS;
+}
+
+// Returns the slot holding `id`, inserting it if needed, or ID_SET_EMPTY if
+// the set could not grow
+static size_t id_set_insert(IdSet *set, uint64_t id) {
+  size_t slot = id_set_find(set, id);
+  if (slot != ID_SET_EMPTY)
+    return slot;
+
+  if ((set->count + 1) * 2 > set->capacity && id_set_grow(set) != SUCCESS)
+    return ID_SET_EMPTY;
+
+  slot = hash_id(id) & (set->capacity - 1);
+  while (set->slots[slot] != 0) {
+    slot = (slot + 1) & (set->capacity - 1);
+  }
+  set->slots[slot] = id;
+  set->count++;
+  return slot;
+}
+
+int id_set_add(IdSet *set, uint64_t id) { return id_set_insert(set, id) != ID_SET_EMPTY ? SUCCESS : FAILURE; }
+
+void id_set_free(IdSet *set) {
+  free(set->slots);
+  free(set->next);
+  memset(set, 0, sizeof(*set));
+}
+
+// Pick the ID for a note: from `date` if given, otherwise the next ID of
+// `sequence`, advancing a second at a time past any ID already in `used`
+int allocate_id(IdSet *used, const char *date, char *sequence, char *id) {
+  bool dated = date != NULL && date[0] != '\0';
+  if (dated) {
+    if (date_to_id(date, id) != SUCCESS)
+      return FAILURE;
+  } else {
+    memcpy(id, sequence, ID_LEN + 1);
+  }
+
+  // Many notes often share a date, so resume from the last ID handed out for
+  // it rather than walking the taken IDs again
+  uint64_t requested = id_to_u64(id);
+  size_t slot = id_set_find(used, requested);
+  if (slot != ID_SET_EMPTY && used->next[slot] != 0)
+    u64_to_id(used->next[slot], id);
+
+  while (id_set_contains(used, id_to_u64(id))) {
+    if (increment_id(id) != SUCCESS)
+      return FAILURE;
+  }
+  uint64_t allocated = id_to_u64(id);
+  if (id_set_add(used, allocated) != SUCCESS || (slot = id_set_insert(used, requested)) == ID_SET_EMPTY)
+    return FAILURE;
+  used->next[slot] = allocated;
+
+  if (!dated) {
+    memcpy(sequence, id, ID_LEN + 1);
+    increment_id(sequence);
+  }
+
+  return SUCCESS;
+}
+
+// Record the IDs of the notes already in `dir_path`
+static int read_existing_ids(const char *dir_path, IdSet *used) {
+  DIR *dir = opendir(dir_path);
+  if (dir == NULL)
+    return SUCCESS;
+
+  int outcome = SUCCESS;
+  struct dirent *entry;
+  while (outcome == SUCCESS && (entry = readdir(dir)) != NULL) {
+    if (name_has_valid_id(entry->d_name))
+      outcome = id_set_add(used, id_to_u64(entry->d_name));
+  }
+  closedir(dir);
+
+  return outcome;
+}
+
+static char *read_body(const char *path, size_t *length) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  char *body = malloc((size_t)st.st_size + 1);
+  size_t read_total = 0;
+  while (body != NULL && read_total < (size_t)st.st_size) {
+    ssize_t n = read(fd, body + read_total, (size_t)st.st_size - read_total);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    read_total += (size_t)n;
+  }
+  close(fd);
+
+  *length = read_total;
+  return body;
+}
+
+typedef struct {
+  ImportEntry *entries;
+  size_t count;
+  size_t next;
+  pthread_mutex_t lock;
+  int dir_fd;
+  char *dir_path;
+  FsyncPolicy fsync_policy;
+  Output *out; // Where to list the notes created, or NULL
+} ImportBatch;
+
+static void write_entry(ImportBatch *batch, ImportEntry *entry) {
+  size_t body_length = 0;
+  char *body = NULL;
+  if (entry->body_path[0] != '\0') {
+    body = read_body(entry->body_path, &body_length);
+    if (body == NULL) {
+      fprintf(stderr, "ERROR: line %zu: Could not read %s\n", entry->line, entry->body_path);
+      entry->outcome = FAILURE;
+      return;
+    }
+  }
+
+  char *keywords[MAX_KEYS];
+  for (size_t i = 0; i < entry->kw_count; i++) {
+    keywords[i] = entry->keywords[i];
+  }
+
+  entry->outcome = connote_file_at(batch->dir_fd, batch->dir_path, entry->id, entry->sig, entry->title, keywords,
+                                   entry->kw_count, ".md", body, body_length, batch->fsync_policy,
+                                   entry->dest_filename);
+  if (entry->outcome != SUCCESS)
+    connote_file_error(entry->dest_filename);
+  free(body);
+}
+
+static void *import_worker(void *arg) {
+  ImportBatch *batch = arg;
+  for (;;) {
+    pthread_mutex_lock(&batch->lock);
+    size_t i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if (i >= batch->count)
+      break;
+    write_entry(batch, &batch->entries[i]);
+  }
+  return NULL;
+}
+
+// Write a batch of entries in parallel and report them in manifest order
+static size_t write_batch(ImportBatch *batch, int thread_count) {
+  pthread_t threads[IMPORT_MAX_THREADS];
+  int started = 0;
+  batch->next = 0;
+  for (int i = 0; i < thread_count && (size_t)i < batch->count; i++) {
+    if (pthread_create(&threads[i], NULL, import_worker, batch) != 0)
+      break;
+    started++;
+  }
+  // Without threads, do the work here
+  if (started == 0)
+    import_worker(batch);
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  size_t written = 0;
+  for (size_t i = 0; i < batch->count; i++) {
+    if (batch->entries[i].outcome == SUCCESS) {
+      if (batch->out != NULL)
+        output_file(batch->out, NULL, batch->entries[i].dest_filename);
+      written++;
+    }
+  }
+  return written;
+}
+
+// Create a note in `dir_path` for every line of `manifest`. IDs are
+// allocated up front so notes can be written in parallel without colliding.
+// The notes created are listed to `out`, if given. A line that cannot be
+// imported is reported and skipped, and the rest of the manifest is still
+// imported. Returns FAILURE if any line was skipped.
+int import_notes(FILE *manifest, char *dir_path, FsyncPolicy fsync_policy, Output *out, size_t *imported) {
+  *imported = 0;
+
+  ImportBatch batch = {.dir_path = dir_path, .fsync_policy = fsync_policy, .out = out};
+  batch.dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (batch.dir_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open directory %s\n", dir_path);
+    return FAILURE;
+  }
+  batch.entries = malloc(IMPORT_BATCH_SIZE * sizeof(ImportEntry));
+  if (batch.entries == NULL) {
+    fprintf(stderr, "ERROR: Out of memory starting import.\n");
+    close(batch.dir_fd);
+    return FAILURE;
+  }
+  pthread_mutex_init(&batch.lock, NULL);
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int thread_count = cores > 0 ? (int)cores : 1;
+  if (thread_count > IMPORT_MAX_THREADS)
+    thread_count = IMPORT_MAX_THREADS;
+
+  IdSet used = {0};
+  int outcome = read_existing_ids(dir_path, &used);
+
+  // One timestamp for the whole import, undated notes count up from it
+  char sequence[ID_LEN + 1];
+  if (outcome == SUCCESS)
+    outcome = generate_timestamp_now(sequence);
+
+  // Lines are read whole, so a long one is never split into two entries
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t line_length;
+  size_t line_number = 0;
+  bool failed = false;
+  while (outcome == SUCCESS) {
+    batch.count = 0;
+    while (batch.count < IMPORT_BATCH_SIZE && (line_length = getline(&line, &line_size, manifest)) != -1) {
+      line_number++;
+      if (line_length >= MAX_MANIFEST_LINE_LEN) {
+        fprintf(stderr, "ERROR: line %zu: Manifest entry longer than %d bytes.\n", line_number, MAX_MANIFEST_LINE_LEN);
+        failed = true;
+        continue;
+      }
+      const char *start = skip_whitespace(line);
+      if (*start == '\0' || *start == '#')
+        continue;
+
+      ImportEntry *entry = &batch.entries[batch.count];
+      entry->line = line_number;
+      if (parse_manifest_line(line, entry) != SUCCESS) {
+        fprintf(stderr, "ERROR: line %zu: Could not parse manifest entry.\n", line_number);
+        failed = true;
+        continue;
+      }
+      if (entry->date[0] != '\0' && date_to_id(entry->date, entry->id) != SUCCESS) {
+        fprintf(stderr, "ERROR: line %zu: Invalid date %s\n", line_number, entry->date);
+        failed = true;
+        continue;
+      }
+      // Running out of IDs or memory stops the import
+      if (allocate_id(&used, entry->date, sequence, entry->id) != SUCCESS) {
+        fprintf(stderr, "ERROR: line %zu: Could not allocate an ID.\n", line_number);
+        outcome = FAILURE;
+        break;
+      }
+      batch.count++;
+    }
+
+    if (batch.count == 0)
+      break;
+
+    size_t written = write_batch(&batch, thread_count);
+    failed |= written != batch.count;
+    *imported += written;
+  }
+
+  if (failed)
+    outcome = FAILURE;
+
+  // One directory sync covers every note created
+  if (fsync_policy == FSYNC_DIR && fsync(batch.dir_fd) == -1) {
+    fprintf(stderr, "ERROR: Could not sync directory %s\n", dir_path);
+    outcome = FAILURE;
+  }
+
+  id_set_free(&used);
+  pthread_mutex_destroy(&batch.lock);
+  free(batch.entries);
+  free(line);
+  close(batch.dir_fd);
+
+  return outcome;
+}
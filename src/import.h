@@ -0,0 +1,53 @@
+#ifndef IMPORT_H_
+#define IMPORT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "output.h"
+#include "utils.h"
+
+// Notes are read from the manifest and written this many at a time
+#define IMPORT_BATCH_SIZE 1024
+#define IMPORT_MAX_THREADS 16
+#define MAX_MANIFEST_LINE_LEN 65536
+
+// One line of the manifest. Lines are either JSON objects:
+//   {"title": "...", "keywords": ["kw1", "kw2"], "signature": "1a", "date": "2024-09-16", "body": "path"}
+// or tab separated fields in the order title, keywords, signature, date and
+// body path, where trailing fields may be left out. Keywords in TSV, or given
+// as a single JSON string, are separated by spaces or commas. A line that
+// cannot be parsed, is longer than MAX_MANIFEST_LINE_LEN or whose note cannot
+// be written is reported and skipped; `import_notes` carries on with the rest
+// of the manifest and returns FAILURE at the end.
+typedef struct {
+  size_t line;
+  char id[ID_LEN + 1];
+  char title[MAX_TITLE_LEN];
+  char sig[MAX_SIG_LEN];
+  char keywords[MAX_KEYS][MAX_KW_LEN];
+  size_t kw_count;
+  char date[32];
+  char body_path[MAX_PATH_LEN];
+  char dest_filename[MAX_PATH_LEN];
+  int outcome;
+} ImportEntry;
+
+// IDs already in use, so that every imported note gets a distinct one
+typedef struct {
+  uint64_t *slots; // 0 marks an empty slot
+  uint64_t *next;  // Last ID allocated when the ID in the slot was requested
+  size_t count;
+  size_t capacity;
+} IdSet;
+
+int date_to_id(const char *date, char *id);
+int parse_manifest_line(const char *line, ImportEntry *entry);
+bool id_set_contains(const IdSet *set, uint64_t id);
+int id_set_add(IdSet *set, uint64_t id);
+void id_set_free(IdSet *set);
+int allocate_id(IdSet *used, const char *date, char *sequence, char *id);
+int import_notes(FILE *manifest, char *dir_path, FsyncPolicy fsync_policy, Output *out, size_t *imported);
+
+#endif // IMPORT_H_
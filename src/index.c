@@ -0,0 +1,1056 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "index.h"
+#include "io.h"
+#include "spill.h"
+#include "stats.h"
+#include "store.h"
+#include "utils.h"
+
+#define INITIAL_NOTE_CAPACITY 256
+#define INITIAL_KEYWORD_SLOTS 256
+
+// Source of NoteIndex generations. Shared by every index so that an index
+// rebuilt in place never repeats a generation it had before.
+static uint64_t generations;
+
+// Converts an ID like "20240908T123445" into the number 20240908123445, which
+// preserves the chronological ordering of IDs
+uint64_t id_to_u64(const char *id) {
+  uint64_t value = 0;
+  for (int i = 0; i < ID_LEN; i++) {
+    if (i == 8)
+      continue; // Skip the 'T'
+    value = value * 10 + (uint64_t)(id[i] - '0');
+  }
+  return value;
+}
+
+// Inverse of `id_to_u64`, `dest` must hold at least ID_LEN + 1 chars
+void u64_to_id(uint64_t value, char *dest) {
+  for (int i = ID_LEN - 1; i >= 0; i--) {
+    if (i == 8) {
+      dest[i] = 'T';
+      continue;
+    }
+    dest[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+  dest[ID_LEN] = '\0';
+}
+
+// Like `has_valid_id`, but safe to call on strings shorter than an ID
+bool name_has_valid_id(const char *name) { return strnlen(name, ID_LEN) == ID_LEN && has_valid_id(name); }
+
+// FNV-1a
+static uint32_t hash_string(const char *str) {
+  uint32_t hash = 2166136261u;
+  for (; *str; str++) {
+    hash ^= (unsigned char)*str;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static int keyword_table_grow(KeywordTable *table) {
+  uint32_t slot_count = table->slot_count ? table->slot_count * 2 : INITIAL_KEYWORD_SLOTS;
+  uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+  if (slots == NULL) {
+    fprintf(stderr, "ERROR: Out of memory growing keyword table.\n");
+    return FAILURE;
+  }
+
+  // Rehash existing handles into the new table
+  for (uint32_t handle = 0; handle < table->count; handle++) {
+    uint32_t slot = hash_string(table->names[handle]) & (slot_count - 1);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    slots[slot] = handle + 1;
+  }
+
+  free(table->slots);
+  table->slots = slots;
+  table->slot_count = slot_count;
+
+  return SUCCESS;
+}
+
+bool keyword_lookup(const KeywordTable *table, const char *keyword, uint32_t *handle) {
+  if (table->slot_count == 0)
+    return false;
+
+  uint32_t slot = hash_string(keyword) & (table->slot_count - 1);
+  while (table->slots[slot] != 0) {
+    uint32_t candidate = table->slots[slot] - 1;
+    if (strcmp(table->names[candidate], keyword) == 0) {
+      *handle = candidate;
+      return true;
+    }
+    slot = (slot + 1) & (table->slot_count - 1);
+  }
+
+  return false;
+}
+
+// Find the handle for `keyword`, adding it to the table if necessary
+int keyword_intern(KeywordTable *table, const char *keyword, uint32_t *handle) {
+  if (keyword_lookup(table, keyword, handle))
+    return SUCCESS;
+
+  // Keep the load factor under a half
+  if ((table->count + 1) * 2 > table->slot_count && keyword_table_grow(table) != SUCCESS)
+    return FAILURE;
+
+  if (table->count == table->capacity) {
+    uint32_t capacity = table->capacity ? table->capacity * 2 : 64;
+    char **names = realloc(table->names, capacity * sizeof(char *));
+    if (names == NULL) {
+      fprintf(stderr, "ERROR: Out of memory growing keyword table.\n");
+      return FAILURE;
+    }
+    table->names = names;
+    table->capacity = capacity;
+  }
+
+  char *name = strdup(keyword);
+  if (name == NULL) {
+    fprintf(stderr, "ERROR: Out of memory growing keyword table.\n");
+    return FAILURE;
+  }
+  *handle = table->count++;
+  table->names[*handle] = name;
+
+  uint32_t slot = hash_string(keyword) & (table->slot_count - 1);
+  while (table->slots[slot] != 0) {
+    slot = (slot + 1) & (table->slot_count - 1);
+  }
+  table->slots[slot] = *handle + 1;
+
+  return SUCCESS;
+}
+
+static void keyword_table_free(KeywordTable *table) {
+  for (uint32_t i = 0; i < table->count; i++) {
+    free(table->names[i]);
+  }
+  free(table->names);
+  free(table->slots);
+  memset(table, 0, sizeof(*table));
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int compare_notes(const void *a, const void *b) {
+  const NoteRecord *x = a;
+  const NoteRecord *y = b;
+  if (x->id != y->id)
+    return (x->id > y->id) - (x->id < y->id);
+  return strcmp(x->name, y->name);
+}
+
+static int compare_edges(const void *a, const void *b) {
+  const LinkEdge *x = a;
+  const LinkEdge *y = b;
+  if (x->target != y->target)
+    return (x->target > y->target) - (x->target < y->target);
+  return (x->source > y->source) - (x->source < y->source);
+}
+
+// Find the next link to a file in `data` from `*cursor` on: `](target)` in
+// markdown, where the target may be wrapped in <>, or `[[file:target]` in
+// org. The file's name, the part of the target after its last slash, is
+// [name_start, name_end). Targets with a scheme, such as URLs and
+// `denote:` links, are skipped.
+bool next_file_link(const char *data, size_t length, size_t *cursor, size_t *name_start, size_t *name_end) {
+  for (size_t i = *cursor; i + 1 < length; i++) {
+    bool markdown = data[i] == ']' && data[i + 1] == '(';
+    bool org = !markdown && data[i] == '[' && length - i >= 7 && memcmp(data + i, "[[file:", 7) == 0;
+    if (!markdown && !org)
+      continue;
+
+    size_t start = i + (markdown ? 2 : 7);
+    bool angle = markdown && start < length && data[start] == '<';
+    if (angle)
+      start++;
+    size_t end = start;
+    bool scheme = false;
+    for (; end < length && data[end] != '\n'; end++) {
+      char c = data[end];
+      char next = end + 1 < length ? data[end + 1] : '\0';
+      // Anchors, link titles and org search options follow the target
+      if (angle && c == '>')
+        break;
+      if (markdown && !angle && (c == ')' || c == '#' || (c == ' ' && next == '"')))
+        break;
+      if (org && (c == ']' || (c == ':' && next == ':')))
+        break;
+      scheme |= c == ':';
+    }
+    i = end - 1;
+    if (scheme || end == start || end == length || data[end] == '\n')
+      continue;
+
+    size_t name = end;
+    while (name > start && data[name - 1] != '/') {
+      name--;
+    }
+    if (name == end)
+      continue;
+
+    *name_start = name;
+    *name_end = end;
+    *cursor = end;
+    return true;
+  }
+
+  *cursor = length;
+  return false;
+}
+
+// Percent-decode the link target `src` into `dest`, returning its length, or
+// 0 if it doesn't fit
+size_t decode_link_name(const char *src, size_t length, char *dest, size_t dest_size) {
+  size_t written = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (written + 1 >= dest_size)
+      return 0;
+    char c = src[i];
+    if (c == '%' && i + 2 < length && isxdigit((unsigned char)src[i + 1]) &&
+        isxdigit((unsigned char)src[i + 2])) {
+      char hex[3] = {src[i + 1], src[i + 2], '\0'};
+      c = (char)strtol(hex, NULL, 16);
+      i += 2;
+    }
+    dest[written++] = c;
+  }
+  dest[written] = '\0';
+  return written;
+}
+
+// The link key of a file name: its FNV-1a hash with LINK_NAME_FLAG set
+uint64_t link_name_key(const char *name, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)name[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash | LINK_NAME_FLAG;
+}
+
+static void add_link(NoteRecord *note, uint32_t *capacity, uint64_t link) {
+  if (note->link_count == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 8;
+    note->links = realloc(note->links, *capacity * sizeof(uint64_t));
+  }
+  note->links[note->link_count++] = link;
+}
+
+// Scan note contents for `denote:<ID>` links and links to files by name, and
+// store the unique links in the record
+static void scan_note_links(const char *data, size_t length, NoteRecord *note) {
+  note->links = NULL;
+  note->link_count = 0;
+
+  uint32_t capacity = 0;
+  const char *cursor = data;
+  const char *end = data + length;
+  while ((cursor = memmem(cursor, end - cursor, LINK_PREFIX, LINK_PREFIX_LEN)) != NULL) {
+    cursor += LINK_PREFIX_LEN;
+    if (end - cursor < ID_LEN)
+      break;
+
+    char id[ID_LEN + 1];
+    memcpy(id, cursor, ID_LEN);
+    id[ID_LEN] = '\0';
+    if (!has_valid_id(id))
+      continue;
+
+    add_link(note, &capacity, id_to_u64(id));
+    cursor += ID_LEN;
+  }
+
+  size_t position = 0, name_start, name_end;
+  char name[MAX_PATH_LEN];
+  while (next_file_link(data, length, &position, &name_start, &name_end)) {
+    size_t name_length = decode_link_name(data + name_start, name_end - name_start, name, MAX_PATH_LEN);
+    if (name_length > 0)
+      add_link(note, &capacity, link_name_key(name, name_length));
+  }
+
+  // Remove duplicate links
+  if (note->link_count > 1) {
+    qsort(note->links, note->link_count, sizeof(uint64_t), compare_u64);
+    uint32_t unique = 1;
+    for (uint32_t i = 1; i < note->link_count; i++) {
+      if (note->links[i] != note->links[unique - 1])
+        note->links[unique++] = note->links[i];
+    }
+    note->link_count = unique;
+  }
+}
+
+// Read up to MAX_LINK_SCAN_BYTES of the note at `path` into a new buffer
+static char *read_note_contents(const char *path, size_t *length) {
+  FILE *f = fopen(path, "r");
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (f == NULL)
+    return NULL;
+
+  char *buffer = malloc(MAX_LINK_SCAN_BYTES);
+  if (buffer != NULL) {
+    *length = fread(buffer, 1, MAX_LINK_SCAN_BYTES, f);
+    STATS_SYSCALL(SYS_READ, 1);
+  }
+  fclose(f);
+
+  return buffer;
+}
+
+// Copy the strings of a note into the single allocation owned by `name`
+static int note_set_strings(NoteRecord *note, const char *name, const char *sig, const char *title,
+                            const char *full_title) {
+  size_t name_len = strlen(name);
+  size_t sig_len = strlen(sig);
+  size_t title_len = strlen(title);
+  size_t full_title_len = strlen(full_title);
+  note->name = malloc(name_len + sig_len + title_len + full_title_len + 4);
+  if (note->name == NULL)
+    return FAILURE;
+  memcpy(note->name, name, name_len + 1);
+  note->sig = note->name + name_len + 1;
+  memcpy(note->sig, sig, sig_len + 1);
+  note->title = note->sig + sig_len + 1;
+  memcpy(note->title, title, title_len + 1);
+  note->full_title = note->title + title_len + 1;
+  memcpy(note->full_title, full_title, full_title_len + 1);
+
+  return SUCCESS;
+}
+
+// Parse the filename components of `name` and the frontmatter and links in
+// `data` into `note`. Returns FAILURE if the name is not a denote filename.
+static int parse_note(NoteIndex *index, const char *name, const char *data, size_t length, NoteRecord *note) {
+  if (!name_has_valid_id(name))
+    return FAILURE;
+
+  // The regex helpers expect mutable strings
+  char filename[MAX_PATH_LEN];
+  strncpy(filename, name, MAX_PATH_LEN - 1);
+  filename[MAX_PATH_LEN - 1] = '\0';
+
+  char sig[MAX_SIG_LEN] = {0};
+  try_match_and_write_component(filename, sig, SIG_REGEX, MAX_SIG_LEN);
+  char title[MAX_TITLE_LEN] = {0};
+  try_match_and_write_component(filename, title, TITLE_REGEX, MAX_TITLE_LEN);
+
+  note->kw_count = 0;
+  char matched_keywords[MAX_KEYS * MAX_KW_LEN] = {0};
+  if (try_match_and_write_component(filename, matched_keywords, KW_REGEX, MAX_KEYS * MAX_KW_LEN) == SUCCESS) {
+    char keywords_array[MAX_KEYS][MAX_KW_LEN];
+    char *keywords[MAX_KEYS];
+    for (int i = 0; i < MAX_KEYS; i++) {
+      keywords[i] = keywords_array[i];
+    }
+    int kw_count = split_at_char(matched_keywords, '_', keywords, MAX_KEYS, MAX_KW_LEN);
+    for (int i = 0; i < kw_count; i++) {
+      if (keywords[i][0] == '\0')
+        continue;
+      if (keyword_intern(&index->keywords, keywords[i], &note->kw[note->kw_count]) != SUCCESS)
+        return FAILURE;
+      note->kw_count++;
+    }
+  }
+
+  Frontmatter frontmatter;
+  read_frontmatter(data, length, &frontmatter);
+
+  if (note_set_strings(note, name, sig, title, frontmatter.title) != SUCCESS)
+    return FAILURE;
+
+  note->id = id_to_u64(name);
+  scan_note_links(data, length, note);
+
+  return SUCCESS;
+}
+
+// Read and parse a single note synchronously
+static int load_note(NoteIndex *index, const char *name, NoteRecord *note) {
+  if (!name_has_valid_id(name))
+    return FAILURE;
+
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s%s", index->dir_path, name);
+
+  STATS_BEGIN(PHASE_STAT);
+  struct stat st;
+  int stat_outcome = stat(path, &st);
+  STATS_SYSCALL(SYS_STAT, 1);
+  STATS_END(PHASE_STAT);
+  if (stat_outcome == -1 || !S_ISREG(st.st_mode))
+    return FAILURE;
+
+  // Attachments have no frontmatter or links to read
+  size_t length = 0;
+  char *data = is_attachment(name) ? NULL : read_note_contents(path, &length);
+  STATS_BEGIN(PHASE_PARSE);
+  int outcome = parse_note(index, name, data ? data : "", data ? length : 0, note);
+  STATS_END(PHASE_PARSE);
+  free(data);
+  note->mtime = st.st_mtime;
+  note->mtime_nsec = (uint32_t)st.st_mtim.tv_nsec;
+  note->size = (uint64_t)st.st_size;
+
+  return outcome;
+}
+
+static void note_free(NoteRecord *note) {
+  free(note->name);
+  free(note->links);
+}
+
+static int index_reserve(NoteIndex *index, size_t capacity) {
+  if (capacity <= index->capacity)
+    return SUCCESS;
+
+  size_t new_capacity = index->capacity ? index->capacity : INITIAL_NOTE_CAPACITY;
+  while (new_capacity < capacity) {
+    new_capacity *= 2;
+  }
+
+  NoteRecord *notes = realloc(index->notes, new_capacity * sizeof(NoteRecord));
+  if (notes == NULL) {
+    fprintf(stderr, "ERROR: Out of memory growing note index.\n");
+    return FAILURE;
+  }
+  index->notes = notes;
+  index->capacity = new_capacity;
+
+  return SUCCESS;
+}
+
+void index_init(NoteIndex *index, const char *dir_path) {
+  memset(index, 0, sizeof(*index));
+  // Directory paths are always stored with a trailing slash
+  size_t len = strlen(dir_path);
+  snprintf(index->dir_path, MAX_PATH_LEN, "%s%s", dir_path, len > 0 && dir_path[len - 1] == '/' ? "" : "/");
+}
+
+static int compare_names(const void *a, const void *b) { return strcmp(*(char *const *)a, *(char *const *)b); }
+
+// Rebuild the note under `cursor` from the store. The signature and title
+// are taken from the name as `parse_note` takes them, and keywords are
+// interned on first use through `handles`, which maps store handles to ours.
+static int restore_note(NoteIndex *index, const Store *store, const StoreCursor *cursor, uint32_t *handles,
+                        NoteRecord *note) {
+  char filename[MAX_PATH_LEN];
+  snprintf(filename, MAX_PATH_LEN, "%s", cursor->name);
+  char sig[MAX_SIG_LEN] = {0};
+  try_match_and_write_component(filename, sig, SIG_REGEX, MAX_SIG_LEN);
+  char title[MAX_TITLE_LEN] = {0};
+  try_match_and_write_component(filename, title, TITLE_REGEX, MAX_TITLE_LEN);
+  if (note_set_strings(note, cursor->name, sig, title, store_full_title(store, cursor->position)) != SUCCESS)
+    return FAILURE;
+
+  note->kw_count = 0;
+  for (uint32_t k = 0; k < cursor->kw_count; k++) {
+    uint32_t handle = cursor->kw[k];
+    if (handles[handle] == UINT32_MAX &&
+        keyword_intern(&index->keywords, store_keyword(store, handle), &handles[handle]) != SUCCESS) {
+      free(note->name);
+      return FAILURE;
+    }
+    note->kw[note->kw_count++] = handles[handle];
+  }
+
+  note->links = NULL;
+  note->link_count = cursor->link_count;
+  if (note->link_count > 0) {
+    note->links = malloc(note->link_count * sizeof(uint64_t));
+    if (note->links == NULL) {
+      free(note->name);
+      return FAILURE;
+    }
+    memcpy(note->links, cursor->links, note->link_count * sizeof(uint64_t));
+  }
+
+  note->id = id_to_u64(cursor->name);
+  int64_t seconds = cursor->mtime_ns / 1000000000;
+  int64_t nsec = cursor->mtime_ns % 1000000000;
+  if (nsec < 0) {
+    seconds--;
+    nsec += 1000000000;
+  }
+  note->mtime = (time_t)seconds;
+  note->mtime_nsec = (uint32_t)nsec;
+  note->size = cursor->size;
+
+  return SUCCESS;
+}
+
+// The store being merged with the names of a directory, both in name order
+typedef struct {
+  Store store;
+  StoreCursor cursor;
+  uint32_t *handles; // Store keyword handles to ours, UINT32_MAX until interned
+  bool open;
+  bool more;       // Whether the cursor is on a note
+  size_t restored; // Notes restored so far
+} Restore;
+
+static void restore_begin(Restore *restore, const NoteIndex *index) {
+  memset(restore, 0, sizeof(*restore));
+  if (store_open(&restore->store, index->dir_path) != SUCCESS)
+    return;
+
+  size_t count = restore->store.keyword_count ? restore->store.keyword_count : 1;
+  restore->handles = malloc(count * sizeof(uint32_t));
+  if (restore->handles == NULL) {
+    store_close(&restore->store);
+    return;
+  }
+  memset(restore->handles, 0xff, count * sizeof(uint32_t));
+  store_cursor_init(&restore->cursor, &restore->store);
+  restore->more = store_cursor_next(&restore->cursor);
+  restore->open = true;
+}
+
+// Restore every note of the sorted `names` whose size and mtime match the
+// store, and move the names of the others to the front of `names` to be
+// read. Returns how many are left to read. Later calls must pass later names.
+static size_t restore_names(Restore *restore, NoteIndex *index, int dir_fd, char **names, size_t name_count) {
+  StoreCursor *cursor = &restore->cursor;
+  size_t unread = 0;
+  for (size_t i = 0; i < name_count; i++) {
+    while (restore->more && strcmp(cursor->name, names[i]) < 0) {
+      restore->more = store_cursor_next(cursor);
+    }
+
+    bool unchanged = false;
+    struct stat st;
+    if (restore->more && strcmp(cursor->name, names[i]) == 0) {
+      STATS_SYSCALL(SYS_STAT, 1);
+      if (fstatat(dir_fd, names[i], &st, 0) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size == cursor->size) {
+        int64_t mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        // A note written in the same clock tick as the store may have
+        // changed again without its mtime moving, so it is read anyway
+        unchanged = mtime_ns == cursor->mtime_ns && mtime_ns < restore->store.mtime_ns;
+      }
+    }
+
+    if (unchanged &&
+        restore_note(index, &restore->store, cursor, restore->handles, &index->notes[index->count]) == SUCCESS) {
+      index->count++;
+      restore->restored++;
+      free(names[i]);
+    } else {
+      names[unread++] = names[i];
+    }
+  }
+
+  return unread;
+}
+
+static void restore_end(Restore *restore) {
+  if (restore->open) {
+    store_cursor_free(&restore->cursor);
+    free(restore->handles);
+    store_close(&restore->store);
+  }
+  memset(restore, 0, sizeof(*restore));
+}
+
+// Restore every note whose size and mtime match the store, and move the
+// names of the others to the front of `names` to be read. Returns how many
+// are left to read, and sets `store_current` when the store already matches
+// the directory.
+static size_t index_restore(NoteIndex *index, int dir_fd, char **names, size_t name_count, bool *store_current) {
+  *store_current = false;
+  Restore restore;
+  restore_begin(&restore, index);
+  if (!restore.open)
+    return name_count;
+
+  // Both sides in name order, so they can be merged
+  qsort(names, name_count, sizeof(char *), compare_names);
+  size_t unread = restore_names(&restore, index, dir_fd, names, name_count);
+  *store_current = unread == 0 && restore.restored == restore.store.count;
+  restore_end(&restore);
+
+  return unread;
+}
+
+// Add the attachments among the first `count` of `names` to the index from
+// a stat alone, as they have no frontmatter or links to read, and move the
+// names of the notes left to read to the front. Returns how many are left.
+static size_t index_add_attachments(NoteIndex *index, int dir_fd, char **names, size_t count) {
+  size_t unread = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (!is_attachment(names[i])) {
+      names[unread++] = names[i];
+      continue;
+    }
+    struct stat st;
+    STATS_SYSCALL(SYS_STAT, 1);
+    NoteRecord *note = &index->notes[index->count];
+    if (fstatat(dir_fd, names[i], &st, 0) == 0 && S_ISREG(st.st_mode) &&
+        parse_note(index, names[i], "", 0, note) == SUCCESS) {
+      note->mtime = st.st_mtime;
+      note->mtime_nsec = (uint32_t)st.st_mtim.tv_nsec;
+      note->size = (uint64_t)st.st_size;
+      index->count++;
+    }
+    free(names[i]);
+  }
+  return unread;
+}
+
+typedef struct {
+  NoteIndex *index;
+  char **names;
+} BuildContext;
+
+// Completion callback for the I/O engine, adds one note to the index
+static void index_add_loaded_note(void *ctx, size_t i, const IoFileInfo *info, const char *data, size_t length,
+                                  int error) {
+  BuildContext *build = ctx;
+  NoteIndex *index = build->index;
+  if (error != 0 || !S_ISREG(info->mode))
+    return;
+
+  NoteRecord *note = &index->notes[index->count];
+  STATS_BEGIN(PHASE_PARSE);
+  int outcome = parse_note(index, build->names[i], data, length, note);
+  STATS_END(PHASE_PARSE);
+
+  if (outcome == SUCCESS) {
+    note->mtime = info->mtime;
+    note->mtime_nsec = info->mtime_nsec;
+    note->size = info->size;
+    index->count++;
+  }
+}
+
+// Read every denote file in `dir_path` into a freshly initialised index.
+// Notes unchanged since the last build are restored from the directory's
+// store, the rest are read in batches through the I/O engine.
+int index_build(NoteIndex *index, const char *dir_path) {
+  index_init(index, dir_path);
+
+  STATS_BEGIN(PHASE_DIR_WALK);
+  DIR *dir = opendir(index->dir_path);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (dir == NULL) {
+    fprintf(stderr, "ERROR: Could not open directory %s\n", index->dir_path);
+    return FAILURE;
+  }
+
+  // Collect the candidate names first so they can be read in one batch
+  size_t name_count = 0;
+  size_t name_capacity = 0;
+  char **names = NULL;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    STATS_SYSCALL(SYS_READDIR, 1);
+    if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+      continue;
+    if (!name_has_valid_id(entry->d_name))
+      continue;
+    if (name_count == name_capacity) {
+      name_capacity = name_capacity ? name_capacity * 2 : INITIAL_NOTE_CAPACITY;
+      names = realloc(names, name_capacity * sizeof(char *));
+      if (names == NULL) {
+        fprintf(stderr, "ERROR: Out of memory reading directory.\n");
+        closedir(dir);
+        return FAILURE;
+      }
+    }
+    names[name_count++] = strdup(entry->d_name);
+  }
+  STATS_END(PHASE_DIR_WALK);
+
+  int outcome = index_reserve(index, name_count);
+  size_t unread = name_count;
+  bool store_current = false;
+  if (outcome == SUCCESS) {
+    STATS_BEGIN(PHASE_STAT);
+    unread = index_restore(index, dirfd(dir), names, name_count, &store_current);
+    unread = index_add_attachments(index, dirfd(dir), names, unread);
+    STATS_END(PHASE_STAT);
+  }
+  closedir(dir);
+
+  IoEngine engine;
+  if (outcome == SUCCESS && unread > 0)
+    outcome = io_engine_init(&engine, index->dir_path);
+  if (outcome == SUCCESS && unread > 0) {
+    BuildContext build = {.index = index, .names = names};
+    STATS_BEGIN(PHASE_STAT);
+    outcome = io_engine_read(&engine, names, unread, index_add_loaded_note, &build);
+    STATS_END(PHASE_STAT);
+    io_engine_free(&engine);
+  }
+
+  for (size_t i = 0; i < unread; i++) {
+    free(names[i]);
+  }
+  free(names);
+
+  qsort(index->notes, index->count, sizeof(NoteRecord), compare_notes);
+  index->edges_dirty = true;
+  index->keyword_notes_dirty = true;
+  index->generation = ++generations;
+
+  // The store is only a cache, so failing to save it is not an error
+  if (outcome == SUCCESS && !store_current)
+    store_write(index);
+
+  return outcome;
+}
+
+// Names spilled while streaming sort like `compare_names`
+static int compare_spilled_names(const void *a, size_t a_length, const void *b, size_t b_length, void *arg) {
+  int order = memcmp(a, b, a_length < b_length ? a_length : b_length);
+  return order != 0 ? order : (a_length > b_length) - (a_length < b_length);
+}
+
+// Index the vault of `dir_path` in about `max_memory` bytes, however many
+// notes it holds. The names from the directory are sorted through a Spill,
+// then restored or read a chunk at a time into one NoteIndex, which is
+// passed to `visit` with the position of its first note before the next
+// chunk replaces it. Chunks follow each other in ID order, and the keyword
+// handles they use stay the same throughout. The store is written as the
+// notes go past, from sections gathered in temporary files.
+//
+// A quarter of the budget goes to sorting names and half to the notes of a
+// chunk. The I/O engine's buffers and the keyword table come on top.
+int index_stream(const char *dir_path, size_t max_memory, IndexChunkVisit visit, void *ctx) {
+  NoteIndex chunk;
+  index_init(&chunk, dir_path);
+
+  STATS_BEGIN(PHASE_DIR_WALK);
+  DIR *dir = opendir(chunk.dir_path);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (dir == NULL) {
+    fprintf(stderr, "ERROR: Could not open directory %s\n", chunk.dir_path);
+    return FAILURE;
+  }
+  Spill names;
+  spill_init(&names, chunk.dir_path, max_memory / 4, compare_spilled_names, NULL);
+  int outcome = SUCCESS;
+  struct dirent *entry;
+  while (outcome == SUCCESS && (entry = readdir(dir)) != NULL) {
+    STATS_SYSCALL(SYS_READDIR, 1);
+    if ((entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) && name_has_valid_id(entry->d_name))
+      outcome = spill_add(&names, entry->d_name, strlen(entry->d_name));
+  }
+  if (outcome == SUCCESS)
+    outcome = spill_sort(&names);
+  STATS_END(PHASE_DIR_WALK);
+
+  size_t chunk_size = max_memory / 2 / INDEX_NOTE_BYTES;
+  if (chunk_size == 0)
+    chunk_size = 1;
+  char **batch = malloc(chunk_size * sizeof(char *));
+  if (outcome == SUCCESS && (batch == NULL || index_reserve(&chunk, chunk_size) != SUCCESS))
+    outcome = FAILURE;
+  StoreWriter writer;
+  bool writing = outcome == SUCCESS && store_writer_init(&writer, chunk.dir_path) == SUCCESS;
+  Restore restore;
+  restore_begin(&restore, &chunk);
+  bool store_current = restore.open;
+  IoEngine engine;
+  bool engine_open = false;
+
+  size_t position = 0;
+  while (outcome == SUCCESS) {
+    size_t count = 0;
+    const void *record;
+    size_t length;
+    while (count < chunk_size && spill_next(&names, &record, &length)) {
+      batch[count] = strndup(record, length);
+      if (batch[count] == NULL) {
+        outcome = FAILURE;
+        break;
+      }
+      count++;
+    }
+    if (count == 0)
+      break;
+
+    STATS_BEGIN(PHASE_STAT);
+    size_t unread = restore.open ? restore_names(&restore, &chunk, dirfd(dir), batch, count) : count;
+    if (unread > 0)
+      store_current = false;
+    unread = index_add_attachments(&chunk, dirfd(dir), batch, unread);
+    STATS_END(PHASE_STAT);
+    if (unread > 0) {
+      if (!engine_open)
+        engine_open = io_engine_init(&engine, chunk.dir_path) == SUCCESS;
+      BuildContext build = {.index = &chunk, .names = batch};
+      STATS_BEGIN(PHASE_STAT);
+      outcome = engine_open ? io_engine_read(&engine, batch, unread, index_add_loaded_note, &build) : FAILURE;
+      STATS_END(PHASE_STAT);
+    }
+    for (size_t i = 0; i < unread; i++) {
+      free(batch[i]);
+    }
+
+    qsort(chunk.notes, chunk.count, sizeof(NoteRecord), compare_notes);
+    chunk.edges_dirty = true;
+    chunk.keyword_notes_dirty = true;
+    chunk.generation = ++generations;
+    for (size_t i = 0; i < chunk.count && writing; i++) {
+      writing = store_writer_add(&writer, &chunk.notes[i]) == SUCCESS;
+    }
+    if (outcome == SUCCESS && visit != NULL)
+      outcome = visit(ctx, &chunk, position);
+    position += chunk.count;
+
+    for (size_t i = 0; i < chunk.count; i++) {
+      note_free(&chunk.notes[i]);
+    }
+    chunk.count = 0;
+  }
+  store_current = store_current && restore.restored == restore.store.count;
+  restore_end(&restore);
+  if (engine_open)
+    io_engine_free(&engine);
+  closedir(dir);
+
+  // As with `index_build`, the store is only a cache
+  if (writing && outcome == SUCCESS && !store_current)
+    store_writer_finish(&writer, chunk.dir_path, &chunk.keywords);
+  if (writing)
+    store_writer_free(&writer);
+  free(batch);
+  spill_free(&names);
+  index_free(&chunk);
+
+  return outcome;
+}
+
+void index_free(NoteIndex *index) {
+  for (size_t i = 0; i < index->count; i++) {
+    note_free(&index->notes[i]);
+  }
+  free(index->notes);
+  free(index->edges);
+  free(index->keyword_note_starts);
+  free(index->keyword_notes);
+  keyword_table_free(&index->keywords);
+  memset(index, 0, sizeof(*index));
+}
+
+// Returns the position of the first note with an ID not less than `id`
+size_t index_lower_bound(const NoteIndex *index, uint64_t id) {
+  size_t lo = 0;
+  size_t hi = index->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (index->notes[mid].id < id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+// Returns the position of the first note with ID `id`, or NOT_FOUND
+size_t index_find_id(const NoteIndex *index, uint64_t id) {
+  size_t pos = index_lower_bound(index, id);
+  return pos < index->count && index->notes[pos].id == id ? pos : NOT_FOUND;
+}
+
+size_t index_find_name(const NoteIndex *index, const char *name) {
+  if (!name_has_valid_id(name))
+    return NOT_FOUND;
+
+  size_t pos = index_find_id(index, id_to_u64(name));
+  if (pos == NOT_FOUND)
+    return NOT_FOUND;
+
+  // Several files may share an ID, so check each of them
+  for (; pos < index->count && index->notes[pos].id == id_to_u64(name); pos++) {
+    if (strcmp(index->notes[pos].name, name) == 0)
+      return pos;
+  }
+
+  return NOT_FOUND;
+}
+
+int index_remove_note(NoteIndex *index, const char *name) {
+  size_t pos = index_find_name(index, name);
+  if (pos == NOT_FOUND)
+    return FAILURE;
+
+  note_free(&index->notes[pos]);
+  memmove(&index->notes[pos], &index->notes[pos + 1], (index->count - pos - 1) * sizeof(NoteRecord));
+  index->count--;
+  index->edges_dirty = true;
+  index->keyword_notes_dirty = true;
+  index->generation = ++generations;
+
+  return SUCCESS;
+}
+
+// Re-read a single note after it has been created or modified. Notes that no
+// longer exist are removed from the index.
+int index_update_note(NoteIndex *index, const char *name) {
+  NoteRecord note = {0};
+  if (load_note(index, name, &note) != SUCCESS) {
+    index_remove_note(index, name);
+    return FAILURE;
+  }
+
+  size_t pos = index_find_name(index, name);
+  if (pos != NOT_FOUND) {
+    note_free(&index->notes[pos]);
+    index->notes[pos] = note;
+  } else {
+    if (index_reserve(index, index->count + 1) != SUCCESS) {
+      note_free(&note);
+      return FAILURE;
+    }
+
+    // Insert in sorted position
+    pos = index->count;
+    while (pos > 0 && compare_notes(&index->notes[pos - 1], &note) > 0) {
+      pos--;
+    }
+    memmove(&index->notes[pos + 1], &index->notes[pos], (index->count - pos) * sizeof(NoteRecord));
+    index->notes[pos] = note;
+    index->count++;
+  }
+  index->edges_dirty = true;
+  index->keyword_notes_dirty = true;
+  index->generation = ++generations;
+
+  return SUCCESS;
+}
+
+bool note_has_keyword(const NoteRecord *note, uint32_t handle) {
+  for (uint32_t i = 0; i < note->kw_count; i++) {
+    if (note->kw[i] == handle)
+      return true;
+  }
+  return false;
+}
+
+static void index_rebuild_keyword_notes(NoteIndex *index) {
+  free(index->keyword_note_starts);
+  free(index->keyword_notes);
+  index->keyword_note_starts = calloc(index->keywords.count + 2, sizeof(uint32_t));
+  size_t total = 0;
+  for (size_t i = 0; i < index->count; i++) {
+    total += index->notes[i].kw_count;
+  }
+  index->keyword_notes = malloc((total ? total : 1) * sizeof(uint32_t));
+  if (index->keyword_note_starts == NULL || index->keyword_notes == NULL) {
+    free(index->keyword_note_starts);
+    free(index->keyword_notes);
+    index->keyword_note_starts = NULL;
+    index->keyword_notes = NULL;
+    return;
+  }
+
+  // Counting sort by keyword, counted two slots up so that placing the notes
+  // leaves each start where it belongs
+  uint32_t *starts = index->keyword_note_starts;
+  for (size_t i = 0; i < index->count; i++) {
+    for (uint32_t k = 0; k < index->notes[i].kw_count; k++) {
+      starts[index->notes[i].kw[k] + 2]++;
+    }
+  }
+  for (uint32_t h = 2; h < index->keywords.count + 2; h++) {
+    starts[h] += starts[h - 1];
+  }
+  for (size_t i = 0; i < index->count; i++) {
+    for (uint32_t k = 0; k < index->notes[i].kw_count; k++) {
+      index->keyword_notes[starts[index->notes[i].kw[k] + 1]++] = (uint32_t)i;
+    }
+  }
+  index->keyword_notes_dirty = false;
+}
+
+// Point `notes` at the positions of the notes with keyword `handle`, in ID
+// order, and return how many there are
+size_t index_keyword_notes(NoteIndex *index, uint32_t handle, const uint32_t **notes) {
+  if (index->keyword_notes_dirty || index->keyword_note_starts == NULL)
+    index_rebuild_keyword_notes(index);
+  if (index->keyword_note_starts == NULL || handle >= index->keywords.count)
+    return 0;
+
+  *notes = &index->keyword_notes[index->keyword_note_starts[handle]];
+  return index->keyword_note_starts[handle + 1] - index->keyword_note_starts[handle];
+}
+
+static void index_rebuild_edges(NoteIndex *index) {
+  size_t edge_count = 0;
+  for (size_t i = 0; i < index->count; i++) {
+    edge_count += index->notes[i].link_count;
+  }
+
+  free(index->edges);
+  index->edges = malloc((edge_count ? edge_count : 1) * sizeof(LinkEdge));
+  index->edge_count = 0;
+  if (index->edges == NULL)
+    return;
+
+  for (size_t i = 0; i < index->count; i++) {
+    const NoteRecord *note = &index->notes[i];
+    for (uint32_t j = 0; j < note->link_count; j++) {
+      index->edges[index->edge_count++] = (LinkEdge){.target = note->links[j], .source = i};
+    }
+  }
+
+  qsort(index->edges, index->edge_count, sizeof(LinkEdge), compare_edges);
+  index->edges_dirty = false;
+}
+
+// Write the positions of notes linking to `id` into `dest` and return how
+// many were found
+size_t index_backlinks(NoteIndex *index, uint64_t id, size_t *dest, size_t dest_size) {
+  if (index->edges_dirty)
+    index_rebuild_edges(index);
+
+  // Lower bound of `id` in the target-sorted edge list
+  size_t lo = 0;
+  size_t hi = index->edge_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (index->edges[mid].target < id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  size_t found = 0;
+  for (size_t i = lo; i < index->edge_count && index->edges[i].target == id && found < dest_size; i++) {
+    size_t pos = index->edges[i].source;
+    if (index->notes[pos].id == id)
+      continue; // Ignore links from a note to itself
+    dest[found++] = pos;
+  }
+
+  return found;
+}
+
+void index_note_path(const NoteIndex *index, const NoteRecord *note, char *dest, size_t dest_size) {
+  snprintf(dest, dest_size, "%s%s", index->dir_path, note->name);
+}
@@ -0,0 +1,110 @@
+#ifndef INDEX_H_
+#define INDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "utils.h"
+
+// Links to other notes are written as `denote:<ID>` in note bodies
+#define LINK_PREFIX "denote:"
+#define LINK_PREFIX_LEN 7
+// Links to files by name, `](name.md)` in markdown or `[[file:name.md]` in
+// org, are kept among the links as a hash of the file's name with the top
+// bit set, which no ID has, so they break when the file is renamed
+#define LINK_NAME_FLAG (1ULL << 63)
+// Only the beginning of large files is scanned for links
+#define MAX_LINK_SCAN_BYTES (1 << 20)
+#define NOT_FOUND ((size_t)-1)
+// Smallest memory budget the command line accepts for a streamed build
+#define INDEX_MIN_MEMORY (16 << 20)
+// Memory a note takes in a chunk of a streamed build, counting its strings
+// and links along with the record
+#define INDEX_NOTE_BYTES 512
+
+// A single note in the vault, parsed from its filename and frontmatter. The
+// strings share a single allocation owned by `name`.
+typedef struct {
+  uint64_t id; // Numeric form of the ID, used for ordering and lookup
+  char *name;  // Basename of the file
+  char *sig;   // Signature component, "" if absent
+  char *title; // Sluggified title component, "" if absent
+  char *full_title; // Title as written in the frontmatter, "" if absent
+  uint32_t kw[MAX_KEYS];
+  uint32_t kw_count;
+  uint64_t *links; // IDs of notes this note links to
+  uint32_t link_count;
+  time_t mtime;
+  uint32_t mtime_nsec;
+  uint64_t size; // Size of the file, with the mtime tells whether it changed
+} NoteRecord;
+
+// Keywords are interned so that records only hold small integer handles
+typedef struct {
+  char **names; // Keyword strings by handle
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t *slots; // Open addressing table of handle + 1, 0 marks an empty slot
+  uint32_t slot_count;
+} KeywordTable;
+
+typedef struct {
+  uint64_t target;
+  size_t source; // Position of the linking note, as IDs need not be unique
+} LinkEdge;
+
+typedef struct {
+  char dir_path[MAX_PATH_LEN];
+  NoteRecord *notes; // Sorted by `id`
+  size_t count;
+  size_t capacity;
+  KeywordTable keywords;
+  LinkEdge *edges; // Link graph sorted by target, rebuilt lazily when dirty
+  size_t edge_count;
+  bool edges_dirty;
+  // Inverted keyword map, also rebuilt lazily: the notes with keyword h are
+  // positions keyword_notes[keyword_note_starts[h]] up to keyword_note_starts[h + 1]
+  uint32_t *keyword_note_starts;
+  uint32_t *keyword_notes;
+  bool keyword_notes_dirty;
+  uint64_t generation; // Changes whenever notes do, so derived indexes know to rebuild
+} NoteIndex;
+
+// Called by `index_stream` with each chunk of notes and the position of its
+// first note in the vault. Returning FAILURE stops the build.
+typedef int (*IndexChunkVisit)(void *ctx, NoteIndex *chunk, size_t first);
+
+// IDs
+uint64_t id_to_u64(const char *id);
+void u64_to_id(uint64_t value, char *dest);
+bool name_has_valid_id(const char *name);
+
+// Links
+bool next_file_link(const char *data, size_t length, size_t *cursor, size_t *name_start, size_t *name_end);
+size_t decode_link_name(const char *src, size_t length, char *dest, size_t dest_size);
+uint64_t link_name_key(const char *name, size_t length);
+
+// Keyword table
+int keyword_intern(KeywordTable *table, const char *keyword, uint32_t *handle);
+bool keyword_lookup(const KeywordTable *table, const char *keyword, uint32_t *handle);
+
+// Building and maintaining the index
+void index_init(NoteIndex *index, const char *dir_path);
+int index_build(NoteIndex *index, const char *dir_path);
+int index_stream(const char *dir_path, size_t max_memory, IndexChunkVisit visit, void *ctx);
+int index_update_note(NoteIndex *index, const char *name);
+int index_remove_note(NoteIndex *index, const char *name);
+void index_free(NoteIndex *index);
+
+// Queries
+size_t index_lower_bound(const NoteIndex *index, uint64_t id);
+size_t index_find_id(const NoteIndex *index, uint64_t id);
+size_t index_find_name(const NoteIndex *index, const char *name);
+bool note_has_keyword(const NoteRecord *note, uint32_t handle);
+size_t index_keyword_notes(NoteIndex *index, uint32_t handle, const uint32_t **notes);
+size_t index_backlinks(NoteIndex *index, uint64_t id, size_t *dest, size_t dest_size);
+void index_note_path(const NoteIndex *index, const NoteRecord *note, char *dest, size_t dest_size);
+
+#endif // INDEX_H_
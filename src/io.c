@@ -0,0 +1,579 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "io.h"
+#include "stats.h"
+#include "utils.h"
+
+// Every file is an open -> read -> close chain plus an independent statx,
+// identified in completions by the slot number and the operation
+#define OP_OPEN 0
+#define OP_READ 1
+#define OP_CLOSE 2
+#define OP_STATX 3
+#define OPS_PER_FILE 4
+#define STATX_MASK (STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME)
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void fill_info(const struct statx *stx, IoFileInfo *info) {
+  info->size = stx->stx_size;
+  info->ino = stx->stx_ino;
+  info->mtime = (time_t)stx->stx_mtime.tv_sec;
+  info->mtime_nsec = stx->stx_mtime.tv_nsec;
+  info->mode = stx->stx_mode;
+}
+
+static void uring_free(IoUring *ring) {
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED)
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  if (ring->fd >= 0)
+    close(ring->fd);
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+// Set up the rings, register the read buffers and an empty table of direct
+// descriptors. Returns FAILURE if the kernel can't do what we need, in which
+// case the caller falls back to the thread pool.
+static int uring_init(IoEngine *engine) {
+  IoUring *ring = &engine->ring;
+  struct io_uring_params params = {0};
+
+  ring->fd = io_uring_setup(engine->depth * OPS_PER_FILE, &params);
+  if (ring->fd < 0) {
+    ring->fd = -1;
+    return FAILURE;
+  }
+
+  // Reads that use a direct descriptor opened earlier in the same chain need
+  // IORING_FEAT_LINKED_FILE (Linux 6.0)
+  if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_LINKED_FILE)) {
+    uring_free(ring);
+    return FAILURE;
+  }
+
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_ring_size > ring->sq_ring_size)
+      ring->sq_ring_size = ring->cq_ring_size;
+    ring->cq_ring_size = ring->sq_ring_size;
+  }
+
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                       IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED) {
+    uring_free(ring);
+    return FAILURE;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED) {
+      uring_free(ring);
+      return FAILURE;
+    }
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    uring_free(ring);
+    return FAILURE;
+  }
+
+  char *sq = ring->sq_ring;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  ring->sq_entries = params.sq_entries;
+
+  char *cq = ring->cq_ring;
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  // Registered buffers save the kernel pinning pages on every read
+  struct iovec iovs[IO_QUEUE_DEPTH];
+  for (unsigned i = 0; i < engine->depth; i++) {
+    iovs[i].iov_base = engine->buffers + (size_t)i * IO_READ_SIZE;
+    iovs[i].iov_len = IO_READ_SIZE;
+  }
+  if (io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iovs, engine->depth) < 0) {
+    uring_free(ring);
+    return FAILURE;
+  }
+
+  // Files are opened straight into these slots, so no descriptor ever
+  // reaches the process file table
+  int files[IO_QUEUE_DEPTH];
+  for (unsigned i = 0; i < engine->depth; i++) {
+    files[i] = -1;
+  }
+  if (io_uring_register(ring->fd, IORING_REGISTER_FILES, files, engine->depth) < 0) {
+    uring_free(ring);
+    return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+static struct io_uring_sqe *uring_get_sqe(IoUring *ring, unsigned *tail) {
+  unsigned index = *tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  ring->sq_array[index] = index;
+  (*tail)++;
+  return sqe;
+}
+
+// Queue the statx and open/read/close chain for `name` in `slot`
+static void uring_queue_file(IoEngine *engine, unsigned slot, size_t file, const char *name, unsigned *tail) {
+  IoSlot *s = &engine->slots[slot];
+  s->file = file;
+  s->pending = OPS_PER_FILE;
+  s->error = 0;
+  s->length = 0;
+  s->large = NULL;
+
+  struct io_uring_sqe *sqe = uring_get_sqe(&engine->ring, tail);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = engine->dir_fd;
+  sqe->addr = (uintptr_t)name;
+  sqe->open_flags = O_RDONLY; // Direct descriptors reject O_CLOEXEC
+  sqe->file_index = slot + 1;  // Zero means a normal descriptor
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = ((uint64_t)slot << 2) | OP_OPEN;
+
+  sqe = uring_get_sqe(&engine->ring, tail);
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = (int)slot;
+  sqe->addr = (uintptr_t)(engine->buffers + (size_t)slot * IO_READ_SIZE);
+  sqe->len = IO_READ_SIZE;
+  sqe->off = 0;
+  sqe->buf_index = (uint16_t)slot;
+  // A hard link closes the file even if the read fails
+  sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+  sqe->user_data = ((uint64_t)slot << 2) | OP_READ;
+
+  sqe = uring_get_sqe(&engine->ring, tail);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->file_index = slot + 1;
+  sqe->user_data = ((uint64_t)slot << 2) | OP_CLOSE;
+
+  sqe = uring_get_sqe(&engine->ring, tail);
+  sqe->opcode = IORING_OP_STATX;
+  sqe->fd = engine->dir_fd;
+  sqe->addr = (uintptr_t)name;
+  sqe->len = STATX_MASK;
+  sqe->off = (uintptr_t)&s->stx;
+  sqe->user_data = ((uint64_t)slot << 2) | OP_STATX;
+}
+
+// Once the start of a file longer than the slot's buffer is in, queue a
+// second open/read/close chain for the rest of it, up to IO_MAX_READ_SIZE,
+// into a buffer of its own. Returns false if there is nothing more to read.
+static bool uring_queue_rest(IoEngine *engine, unsigned slot, const char *name, unsigned *tail) {
+  IoSlot *s = &engine->slots[slot];
+  if (s->error != 0 || s->large != NULL || s->length < IO_READ_SIZE || s->stx.stx_size <= IO_READ_SIZE)
+    return false;
+
+  size_t total = s->stx.stx_size < IO_MAX_READ_SIZE ? (size_t)s->stx.stx_size : IO_MAX_READ_SIZE;
+  s->large = malloc(total);
+  // Without memory for the rest, the start of the file has to do
+  if (s->large == NULL)
+    return false;
+  memcpy(s->large, engine->buffers + (size_t)slot * IO_READ_SIZE, IO_READ_SIZE);
+  s->pending = OPS_PER_FILE - 1;
+
+  struct io_uring_sqe *sqe = uring_get_sqe(&engine->ring, tail);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = engine->dir_fd;
+  sqe->addr = (uintptr_t)name;
+  sqe->open_flags = O_RDONLY;
+  sqe->file_index = slot + 1;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = ((uint64_t)slot << 2) | OP_OPEN;
+
+  sqe = uring_get_sqe(&engine->ring, tail);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = (int)slot;
+  sqe->addr = (uintptr_t)(s->large + IO_READ_SIZE);
+  sqe->len = (unsigned)(total - IO_READ_SIZE);
+  sqe->off = IO_READ_SIZE;
+  sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+  sqe->user_data = ((uint64_t)slot << 2) | OP_READ;
+
+  sqe = uring_get_sqe(&engine->ring, tail);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->file_index = slot + 1;
+  sqe->user_data = ((uint64_t)slot << 2) | OP_CLOSE;
+
+  return true;
+}
+
+// Record the result `res` of operation `op` on `s`. Returns true once every
+// operation queued for the slot is done.
+static bool uring_complete(IoSlot *s, unsigned op, int res) {
+  switch (op) {
+  case OP_OPEN:
+    if (res < 0 && s->error == 0)
+      s->error = res;
+    break;
+  case OP_READ:
+    // The read of the rest of a large file carries on from the first
+    if (res >= 0)
+      s->length += (size_t)res;
+    else if (s->error == 0)
+      s->error = res;
+    break;
+  case OP_STATX:
+    if (res < 0 && s->error == 0)
+      s->error = res;
+    break;
+  default:
+    break;
+  }
+
+  return --s->pending == 0;
+}
+
+// Take back the entries the kernel has not consumed, as though they had
+// completed with -ECANCELED. Returns the number of slots this finishes.
+static size_t uring_retract(IoEngine *engine, unsigned *tail) {
+  IoUring *ring = &engine->ring;
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  size_t finished = 0;
+
+  for (unsigned i = head; i != *tail; i++) {
+    const struct io_uring_sqe *sqe = &ring->sqes[ring->sq_array[i & *ring->sq_mask]];
+    IoSlot *s = &engine->slots[sqe->user_data >> 2];
+    if (uring_complete(s, (unsigned)(sqe->user_data & 3), -ECANCELED)) {
+      free(s->large);
+      s->large = NULL;
+      finished++;
+    }
+  }
+
+  *tail = head;
+  __atomic_store_n(ring->sq_tail, head, __ATOMIC_RELEASE);
+  return finished;
+}
+
+static int uring_read(IoEngine *engine, char **names, size_t count, IoCallback callback, void *ctx) {
+  IoUring *ring = &engine->ring;
+  unsigned tail = *ring->sq_tail;
+  unsigned to_submit = 0;
+  size_t next = 0;
+  size_t in_flight = 0;
+  int outcome = SUCCESS;
+
+  for (unsigned slot = 0; slot < engine->depth && next < count; slot++) {
+    uring_queue_file(engine, slot, next, names[next], &tail);
+    next++;
+    in_flight++;
+    to_submit += OPS_PER_FILE;
+  }
+
+  while (in_flight > 0) {
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    // The opens, reads and stats queued on the ring are not system calls of
+    // their own, only entering the ring is
+    int submitted = io_uring_enter(ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+    STATS_SYSCALL(SYS_URING_ENTER, 1);
+    if (submitted < 0) {
+      if (errno == EINTR || (outcome == FAILURE && (errno == EAGAIN || errno == EBUSY)))
+        continue;
+      fprintf(stderr, "ERROR: io_uring_enter failed: %s\n", strerror(errno));
+      if (outcome == FAILURE) {
+        // With no way to wait for the operations in flight, the kernel may
+        // still write to their buffers, so they are leaked rather than freed
+        engine->buffers = NULL;
+        return FAILURE;
+      }
+      // Nothing more is queued or passed to `callback`, but whatever the
+      // kernel has taken must complete before its buffers can be freed
+      outcome = FAILURE;
+      in_flight -= uring_retract(engine, &tail);
+      to_submit = 0;
+      continue;
+    }
+    to_submit -= (unsigned)submitted;
+
+    unsigned head = *ring->cq_head;
+    unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != cq_tail; head++) {
+      const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+      unsigned slot = (unsigned)(cqe->user_data >> 2);
+      IoSlot *s = &engine->slots[slot];
+      if (!uring_complete(s, (unsigned)(cqe->user_data & 3), cqe->res))
+        continue;
+
+      if (outcome == SUCCESS && uring_queue_rest(engine, slot, names[s->file], &tail)) {
+        to_submit += OPS_PER_FILE - 1;
+        continue;
+      }
+
+      // Every operation for this file is done
+      if (outcome == SUCCESS) {
+        IoFileInfo info;
+        fill_info(&s->stx, &info);
+        const char *data = s->large != NULL ? s->large : engine->buffers + (size_t)slot * IO_READ_SIZE;
+        callback(ctx, s->file, &info, data, s->length, s->error);
+      }
+      free(s->large);
+      s->large = NULL;
+
+      if (outcome == SUCCESS && next < count) {
+        uring_queue_file(engine, slot, next, names[next], &tail);
+        next++;
+        to_submit += OPS_PER_FILE;
+      } else {
+        in_flight--;
+      }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  return outcome;
+}
+
+// Blocking equivalent of the io_uring chain, used by the thread pool
+static void read_file_sync(int dir_fd, const char *name, IoSlot *slot, char *buffer) {
+  slot->error = 0;
+  slot->length = 0;
+  slot->large = NULL;
+
+  STATS_SYSCALL(SYS_STAT, 1);
+  if (statx(dir_fd, name, 0, STATX_MASK, &slot->stx) == -1) {
+    slot->error = -errno;
+    return;
+  }
+
+  int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1) {
+    slot->error = -errno;
+    return;
+  }
+
+  while (slot->length < IO_READ_SIZE) {
+    ssize_t n = pread(fd, buffer + slot->length, IO_READ_SIZE - slot->length, (off_t)slot->length);
+    STATS_SYSCALL(SYS_READ, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      slot->error = -errno;
+    if (n <= 0)
+      break;
+    slot->length += (size_t)n;
+  }
+
+  // Read on into a buffer of its own, as the io_uring chain does, unless
+  // there is no memory for it and the start has to do
+  size_t total = slot->stx.stx_size < IO_MAX_READ_SIZE ? (size_t)slot->stx.stx_size : IO_MAX_READ_SIZE;
+  if (slot->error == 0 && slot->length == IO_READ_SIZE && total > IO_READ_SIZE) {
+    slot->large = malloc(total);
+    if (slot->large != NULL)
+      memcpy(slot->large, buffer, IO_READ_SIZE);
+  }
+  while (slot->large != NULL && slot->length < total) {
+    ssize_t n = pread(fd, slot->large + slot->length, total - slot->length, (off_t)slot->length);
+    STATS_SYSCALL(SYS_READ, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      slot->error = -errno;
+    if (n <= 0)
+      break;
+    slot->length += (size_t)n;
+  }
+  close(fd);
+}
+
+static void *pool_worker(void *arg) {
+  IoEngine *engine = arg;
+  IoThreadPool *pool = &engine->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->shutdown && pool->next >= pool->window) {
+      pthread_cond_wait(&pool->work_ready, &pool->lock);
+    }
+    if (pool->shutdown)
+      break;
+
+    size_t i = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+
+    read_file_sync(engine->dir_fd, pool->names[i], &engine->slots[i], engine->buffers + i * IO_READ_SIZE);
+
+    pthread_mutex_lock(&pool->lock);
+    if (++pool->completed == pool->window)
+      pthread_cond_signal(&pool->work_done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+static int pool_init(IoEngine *engine) {
+  IoThreadPool *pool = &engine->pool;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_ready, NULL);
+  pthread_cond_init(&pool->work_done, NULL);
+
+  // The work is I/O bound, so use more threads than cores
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int threads = cores > 0 ? (int)cores * 2 : 4;
+  if (threads > IO_MAX_THREADS)
+    threads = IO_MAX_THREADS;
+
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, pool_worker, engine) != 0)
+      break;
+    pool->thread_count++;
+  }
+
+  return pool->thread_count > 0 ? SUCCESS : FAILURE;
+}
+
+static void pool_free(IoThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->thread_count; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work_ready);
+  pthread_cond_destroy(&pool->work_done);
+}
+
+// Read files a window of `depth` at a time. Callbacks run on this thread once
+// the whole window is done, in order.
+static int pool_read(IoEngine *engine, char **names, size_t count, IoCallback callback, void *ctx) {
+  IoThreadPool *pool = &engine->pool;
+
+  for (size_t start = 0; start < count; start += engine->depth) {
+    size_t window = count - start < engine->depth ? count - start : engine->depth;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->names = names + start;
+    pool->window = window;
+    pool->next = 0;
+    pool->completed = 0;
+    pthread_cond_broadcast(&pool->work_ready);
+    while (pool->completed < pool->window) {
+      pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < window; i++) {
+      IoSlot *s = &engine->slots[i];
+      IoFileInfo info;
+      fill_info(&s->stx, &info);
+      callback(ctx, start + i, &info, s->large != NULL ? s->large : engine->buffers + i * IO_READ_SIZE, s->length,
+               s->error);
+      free(s->large);
+      s->large = NULL;
+    }
+  }
+
+  return SUCCESS;
+}
+
+// Prepare to read files in `dir_path`. io_uring is used when the kernel
+// supports it and CONNOTE_IO isn't set to "threads", otherwise a pool of
+// threads doing blocking reads.
+int io_engine_init(IoEngine *engine, const char *dir_path) {
+  memset(engine, 0, sizeof(*engine));
+  engine->ring.fd = -1;
+  engine->depth = IO_QUEUE_DEPTH;
+
+  engine->dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (engine->dir_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open directory %s\n", dir_path);
+    return FAILURE;
+  }
+
+  engine->buffers = aligned_alloc(4096, (size_t)engine->depth * IO_READ_SIZE);
+  if (engine->buffers == NULL) {
+    fprintf(stderr, "ERROR: Out of memory allocating I/O buffers.\n");
+    close(engine->dir_fd);
+    return FAILURE;
+  }
+
+  const char *backend = getenv("CONNOTE_IO");
+  bool force_threads = backend != NULL && strcmp(backend, "threads") == 0;
+  if (!force_threads && uring_init(engine) == SUCCESS) {
+    engine->backend = IO_BACKEND_URING;
+    return SUCCESS;
+  }
+
+  engine->backend = IO_BACKEND_THREADS;
+  if (pool_init(engine) != SUCCESS) {
+    fprintf(stderr, "ERROR: Could not start I/O threads.\n");
+    free(engine->buffers);
+    close(engine->dir_fd);
+    return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+// Stat and read up to IO_MAX_READ_SIZE bytes of every file in `names`, which
+// are relative to the engine's directory, calling `callback` for each
+int io_engine_read(IoEngine *engine, char **names, size_t count, IoCallback callback, void *ctx) {
+  if (engine->buffers == NULL)
+    return FAILURE;
+  if (engine->backend == IO_BACKEND_URING)
+    return uring_read(engine, names, count, callback, ctx);
+  return pool_read(engine, names, count, callback, ctx);
+}
+
+void io_engine_free(IoEngine *engine) {
+  if (engine->backend == IO_BACKEND_URING) {
+    uring_free(&engine->ring);
+  } else {
+    pool_free(&engine->pool);
+  }
+  free(engine->buffers);
+  close(engine->dir_fd);
+}
+
+const char *io_backend_name(const IoEngine *engine) {
+  return engine->backend == IO_BACKEND_URING ? "io_uring" : "threads";
+}
@@ -0,0 +1,98 @@
+#ifndef IO_H_
+#define IO_H_
+
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Number of files in flight at once
+#define IO_QUEUE_DEPTH 128
+// Bytes read from the start of each file, enough for frontmatter and the
+// links of almost every note
+#define IO_READ_SIZE (64 * 1024)
+// Longer files are read on into a buffer of their own, up to this many bytes
+// in all, as much as is scanned for links
+#define IO_MAX_READ_SIZE (1 << 20)
+#define IO_MAX_THREADS 16
+
+typedef struct {
+  uint64_t size;
+  uint64_t ino;
+  time_t mtime;
+  uint32_t mtime_nsec;
+  mode_t mode;
+} IoFileInfo;
+
+// Called once per file, always on the thread that called `io_engine_read`.
+// `error` is 0 or a negative errno, in which case `info` and `data` are
+// undefined. `data` holds the first `length` bytes of the file, at most
+// IO_MAX_READ_SIZE, and is only valid for the duration of the call.
+typedef void (*IoCallback)(void *ctx, size_t i, const IoFileInfo *info, const char *data, size_t length, int error);
+
+typedef enum { IO_BACKEND_URING, IO_BACKEND_THREADS } IoBackend;
+
+// Per-file state for one slot of the queue
+typedef struct {
+  size_t file;       // Position of the file in the current batch
+  int pending;       // Completions still expected for this slot
+  int error;         // First error seen
+  size_t length;     // Bytes read
+  char *large;       // Whole read of a file longer than IO_READ_SIZE, or NULL
+  struct statx stx;  // Metadata
+} IoSlot;
+
+typedef struct {
+  // Submission ring
+  int fd;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned sq_entries;
+  // Completion ring
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+  // Mappings to release
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  size_t sqes_size;
+} IoUring;
+
+typedef struct {
+  pthread_t threads[IO_MAX_THREADS];
+  int thread_count;
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready;
+  pthread_cond_t work_done;
+  char **names;      // Files of the current window
+  size_t window;     // Number of files in the window
+  size_t next;       // Next file to claim
+  size_t completed;  // Files finished
+  bool shutdown;
+} IoThreadPool;
+
+typedef struct {
+  IoBackend backend;
+  int dir_fd;
+  unsigned depth;
+  char *buffers; // `depth` buffers of IO_READ_SIZE bytes, registered with the ring
+  IoSlot slots[IO_QUEUE_DEPTH];
+  IoUring ring;
+  IoThreadPool pool;
+} IoEngine;
+
+int io_engine_init(IoEngine *engine, const char *dir_path);
+int io_engine_read(IoEngine *engine, char **names, size_t count, IoCallback callback, void *ctx);
+void io_engine_free(IoEngine *engine);
+const char *io_backend_name(const IoEngine *engine);
+
+#endif // IO_H_
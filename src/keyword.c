@@ -0,0 +1,623 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "keyword.h"
+#include "stats.h"
+#include "utils.h"
+
+#define TEMP_SUFFIX ".tmp"
+
+// Replace the keywords being renamed in `keywords`, dropping any that then
+// appear twice, and return how many are left. Tags are kept as they were
+// typed, so each is compared by its slug.
+static size_t map_keywords(const KeywordPlan *plan, char keywords[][MAX_KW_LEN], size_t count) {
+  char slugs[MAX_KEYS][MAX_KW_LEN];
+  size_t kept = 0;
+  for (size_t i = 0; i < count && i < MAX_KEYS; i++) {
+    const char *keyword = keywords[i];
+    snprintf(slugs[kept], MAX_KW_LEN, "%s", keyword);
+    sluggify_keyword(slugs[kept]);
+    for (size_t f = 0; f < plan->from_count; f++) {
+      if (strcmp(slugs[kept], plan->from[f]) == 0) {
+        keyword = plan->to;
+        snprintf(slugs[kept], MAX_KW_LEN, "%s", plan->to);
+      }
+    }
+
+    bool seen = false;
+    for (size_t j = 0; j < kept && !seen; j++) {
+      seen = strcmp(slugs[j], slugs[kept]) == 0;
+    }
+    if (seen)
+      continue;
+    if (keyword != keywords[kept])
+      memmove(keywords[kept], keyword, strlen(keyword) + 1);
+    kept++;
+  }
+  return kept;
+}
+
+// Find the `tags:` line of the frontmatter at the start of `data`, the way
+// `read_frontmatter` reads it
+static bool find_tags_line(const char *data, size_t length, size_t *start, size_t *end) {
+  const char *limit = data + length;
+  if (length < 4 || strncmp(data, "---\n", 4) != 0)
+    return false;
+
+  const char *line = data + 4;
+  while (line < limit) {
+    const char *line_end = memchr(line, '\n', limit - line);
+    if (line_end == NULL)
+      line_end = limit;
+    if (line_end - line >= 3 && strncmp(line, "---", 3) == 0)
+      return false;
+    if (line_end - line >= 5 && strncmp(line, "tags:", 5) == 0) {
+      *start = line - data;
+      *end = line_end - data;
+      return true;
+    }
+    line = line_end + 1;
+  }
+  return false;
+}
+
+// Write `data` to `dest` with the renamed keywords replaced in its `tags:`
+// line. Notes without one are copied unchanged. `dest` must hold at least
+// `length` + KEYWORD_TAGS_LINE_LEN bytes. Returns the length written, or 0 if it
+// would not fit.
+size_t keyword_rewrite_tags(const KeywordPlan *plan, const char *data, size_t length, char *dest, size_t dest_size) {
+  size_t start, end;
+  Frontmatter frontmatter;
+  if (!find_tags_line(data, length, &start, &end) || read_frontmatter(data, length, &frontmatter) != SUCCESS ||
+      frontmatter.tag_count == 0) {
+    if (length > dest_size)
+      return 0;
+    memcpy(dest, data, length);
+    return length;
+  }
+
+  size_t tag_count = map_keywords(plan, frontmatter.tags, frontmatter.tag_count);
+  char line[KEYWORD_TAGS_LINE_LEN];
+  size_t line_length = 0;
+  str_append_slice("tags: [", 0, 7, line, KEYWORD_TAGS_LINE_LEN, &line_length);
+  for (size_t i = 0; i < tag_count; i++) {
+    if (i > 0)
+      str_append_slice(", ", 0, 2, line, KEYWORD_TAGS_LINE_LEN, &line_length);
+    str_append_slice(frontmatter.tags[i], 0, strlen(frontmatter.tags[i]), line, KEYWORD_TAGS_LINE_LEN, &line_length);
+  }
+  str_append_slice("]", 0, 1, line, KEYWORD_TAGS_LINE_LEN, &line_length);
+
+  size_t new_length = start + line_length + (length - end);
+  if (new_length > dest_size)
+    return 0;
+  memcpy(dest, data, start);
+  memcpy(dest + start, line, line_length);
+  memcpy(dest + start + line_length, data + end, length - end);
+  return new_length;
+}
+
+static int compare_new_names(const void *a, const void *b) {
+  return strcmp((*(KeywordMove *const *)a)->new_name, (*(KeywordMove *const *)b)->new_name);
+}
+
+// Work out the new name of every note with one of the keywords in `from`,
+// which become `to`. Names are taken from `index`, so no note is read. Fails
+// without touching anything if a new name is already taken.
+int keyword_plan(KeywordPlan *plan, NoteIndex *index, char **from, size_t from_count, const char *to) {
+  memset(plan, 0, sizeof(*plan));
+  snprintf(plan->dir_path, MAX_PATH_LEN, "%s", index->dir_path);
+  snprintf(plan->to, MAX_KW_LEN, "%s", to);
+  sluggify_keyword(plan->to);
+  if (plan->to[0] == '\0') {
+    fprintf(stderr, "ERROR: No keyword to rename to.\n");
+    return FAILURE;
+  }
+  if (from_count > MAX_KEYS) {
+    fprintf(stderr, "ERROR: Too many keywords, max allowed is %d.\n", MAX_KEYS);
+    return FAILURE;
+  }
+
+  // Mark the affected notes, once each however many of the keywords they have
+  bool *affected = calloc(index->count ? index->count : 1, sizeof(bool));
+  if (affected == NULL)
+    return FAILURE;
+  size_t affected_count = 0;
+  for (size_t f = 0; f < from_count; f++) {
+    snprintf(plan->from[plan->from_count], MAX_KW_LEN, "%s", from[f]);
+    sluggify_keyword(plan->from[plan->from_count]);
+    uint32_t handle;
+    if (!keyword_lookup(&index->keywords, plan->from[plan->from_count++], &handle))
+      continue;
+    const uint32_t *notes;
+    size_t count = index_keyword_notes(index, handle, &notes);
+    for (size_t i = 0; i < count; i++) {
+      affected_count += !affected[notes[i]];
+      affected[notes[i]] = true;
+    }
+  }
+
+  plan->moves = malloc((affected_count ? affected_count : 1) * sizeof(KeywordMove));
+  if (plan->moves == NULL) {
+    free(affected);
+    return FAILURE;
+  }
+
+  int outcome = SUCCESS;
+  for (size_t i = 0; i < index->count && outcome == SUCCESS; i++) {
+    if (!affected[i])
+      continue;
+    const NoteRecord *note = &index->notes[i];
+    char keywords[MAX_KEYS][MAX_KW_LEN];
+    char *keyword_ptrs[MAX_KEYS];
+    for (uint32_t k = 0; k < note->kw_count; k++) {
+      snprintf(keywords[k], MAX_KW_LEN, "%s", index->keywords.names[note->kw[k]]);
+      keyword_ptrs[k] = keywords[k];
+    }
+    size_t kw_count = map_keywords(plan, keywords, note->kw_count);
+
+    // The other components are already slugs, so formatting leaves them be
+    char id[ID_LEN + 1], sig[MAX_SIG_LEN], title[MAX_TITLE_LEN], extension[MAX_PATH_LEN];
+    u64_to_id(note->id, id);
+    snprintf(sig, MAX_SIG_LEN, "%s", note->sig);
+    snprintf(title, MAX_TITLE_LEN, "%s", note->title);
+    const char *dot = strchr(note->name + ID_LEN, '.');
+    snprintf(extension, MAX_PATH_LEN, "%s", dot ? dot : "");
+
+    char path[MAX_PATH_LEN];
+    KeywordMove *move = &plan->moves[plan->count];
+    if (format_file_name(plan->dir_path, id, sig, title, keyword_ptrs, kw_count, extension, path) != SUCCESS) {
+      outcome = FAILURE;
+      break;
+    }
+    snprintf(move->old_name, MAX_PATH_LEN, "%s", note->name);
+    snprintf(move->new_name, MAX_PATH_LEN, "%s", path + strlen(plan->dir_path));
+    move->outcome = FAILURE;
+    if (strcmp(move->old_name, move->new_name) == 0)
+      continue;
+
+    // The journal is line and tab separated
+    if (strpbrk(move->old_name, "\t\n") != NULL) {
+      fprintf(stderr, "ERROR: Cannot rename %s%s\n", plan->dir_path, move->old_name);
+      outcome = FAILURE;
+    } else if (index_find_name(index, move->new_name) != NOT_FOUND) {
+      fprintf(stderr, "ERROR: %s%s would be renamed to %s, which already exists.\n", plan->dir_path, move->old_name,
+              move->new_name);
+      outcome = FAILURE;
+    }
+    plan->count++;
+  }
+  free(affected);
+
+  // Two notes may also be renamed onto one another
+  KeywordMove **sorted = malloc((plan->count ? plan->count : 1) * sizeof(KeywordMove *));
+  if (sorted == NULL)
+    return FAILURE;
+  for (size_t i = 0; i < plan->count; i++) {
+    sorted[i] = &plan->moves[i];
+  }
+  qsort(sorted, plan->count, sizeof(KeywordMove *), compare_new_names);
+  for (size_t i = 1; i < plan->count && outcome == SUCCESS; i++) {
+    if (strcmp(sorted[i - 1]->new_name, sorted[i]->new_name) == 0) {
+      fprintf(stderr, "ERROR: %s and %s would both be renamed to %s\n", sorted[i - 1]->old_name, sorted[i]->old_name,
+              sorted[i]->new_name);
+      outcome = FAILURE;
+    }
+  }
+  free(sorted);
+
+  return outcome;
+}
+
+void keyword_plan_free(KeywordPlan *plan) {
+  free(plan->moves);
+  plan->moves = NULL;
+  plan->count = 0;
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    STATS_SYSCALL(SYS_WRITE, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FAILURE;
+    data += n;
+    length -= (size_t)n;
+  }
+  return SUCCESS;
+}
+
+// Record `plan` in a new journal directory. The plan is fsynced and renamed
+// into place before any note is touched, so a journal is always complete.
+static int write_journal(const KeywordPlan *plan, int dir_fd, int *journal_fd) {
+  if (mkdirat(dir_fd, KEYWORD_JOURNAL_DIR, 0700) == -1) {
+    if (errno == EEXIST) {
+      fprintf(stderr, "ERROR: An unfinished keyword change is in %s%s, run connote keyword resume or rollback.\n",
+              plan->dir_path, KEYWORD_JOURNAL_DIR);
+    } else {
+      fprintf(stderr, "ERROR: Could not create %s%s\n", plan->dir_path, KEYWORD_JOURNAL_DIR);
+    }
+    return FAILURE;
+  }
+  *journal_fd = openat(dir_fd, KEYWORD_JOURNAL_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (*journal_fd == -1)
+    return FAILURE;
+
+  int fd = openat(*journal_fd, KEYWORD_JOURNAL_FILE TEMP_SUFFIX, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  FILE *journal = fd == -1 ? NULL : fdopen(fd, "w");
+  if (journal == NULL) {
+    if (fd != -1)
+      close(fd);
+    fprintf(stderr, "ERROR: Could not write the keyword journal.\n");
+    return FAILURE;
+  }
+
+  fprintf(journal, "%s\nto\t%s\n", KEYWORD_JOURNAL_MAGIC, plan->to);
+  for (size_t f = 0; f < plan->from_count; f++) {
+    fprintf(journal, "from\t%s\n", plan->from[f]);
+  }
+  for (size_t i = 0; i < plan->count; i++) {
+    fprintf(journal, "move\t%s\t%s\n", plan->moves[i].old_name, plan->moves[i].new_name);
+  }
+
+  int outcome = fflush(journal) == 0 && fsync(fd) == 0 ? SUCCESS : FAILURE;
+  STATS_SYSCALL(SYS_FSYNC, 1);
+  fclose(journal);
+  if (outcome == SUCCESS)
+    outcome = renameat(*journal_fd, KEYWORD_JOURNAL_FILE TEMP_SUFFIX, *journal_fd, KEYWORD_JOURNAL_FILE);
+  if (outcome == SUCCESS)
+    outcome = fsync(*journal_fd) == 0 && fsync(dir_fd) == 0 ? SUCCESS : FAILURE;
+  STATS_SYSCALL(SYS_FSYNC, 2);
+  if (outcome != SUCCESS)
+    fprintf(stderr, "ERROR: Could not write the keyword journal.\n");
+  return outcome;
+}
+
+// Read back the plan of an unfinished keyword change in `dir_path`
+static int read_journal(KeywordPlan *plan, const char *dir_path, int journal_fd) {
+  memset(plan, 0, sizeof(*plan));
+  size_t len = strlen(dir_path);
+  snprintf(plan->dir_path, MAX_PATH_LEN, "%s%s", dir_path, len > 0 && dir_path[len - 1] == '/' ? "" : "/");
+
+  int fd = openat(journal_fd, KEYWORD_JOURNAL_FILE, O_RDONLY | O_CLOEXEC);
+  FILE *journal = fd == -1 ? NULL : fdopen(fd, "r");
+  if (journal == NULL) {
+    if (fd != -1)
+      close(fd);
+    fprintf(stderr, "ERROR: Could not read the keyword journal in %s%s\n", plan->dir_path, KEYWORD_JOURNAL_DIR);
+    return FAILURE;
+  }
+
+  size_t capacity = 0;
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t length;
+  int outcome = FAILURE;
+  if ((length = getline(&line, &line_size, journal)) > 0 && strcmp(line, KEYWORD_JOURNAL_MAGIC "\n") == 0)
+    outcome = SUCCESS;
+  while (outcome == SUCCESS && (length = getline(&line, &line_size, journal)) > 0) {
+    if (line[length - 1] == '\n')
+      line[length - 1] = '\0';
+    char *fields[3] = {line};
+    int field_count = 1;
+    for (char *tab; field_count < 3 && (tab = strchr(fields[field_count - 1], '\t')) != NULL;) {
+      *tab = '\0';
+      fields[field_count++] = tab + 1;
+    }
+    if (field_count == 2 && strcmp(fields[0], "to") == 0) {
+      snprintf(plan->to, MAX_KW_LEN, "%s", fields[1]);
+    } else if (field_count == 2 && strcmp(fields[0], "from") == 0 && plan->from_count < MAX_KEYS) {
+      snprintf(plan->from[plan->from_count++], MAX_KW_LEN, "%s", fields[1]);
+    } else if (field_count == 3 && strcmp(fields[0], "move") == 0) {
+      if (plan->count == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        KeywordMove *moves = realloc(plan->moves, capacity * sizeof(KeywordMove));
+        if (moves == NULL) {
+          outcome = FAILURE;
+          break;
+        }
+        plan->moves = moves;
+      }
+      KeywordMove *move = &plan->moves[plan->count++];
+      snprintf(move->old_name, MAX_PATH_LEN, "%s", fields[1]);
+      snprintf(move->new_name, MAX_PATH_LEN, "%s", fields[2]);
+      move->outcome = FAILURE;
+    } else {
+      outcome = FAILURE;
+    }
+  }
+  free(line);
+  fclose(journal);
+
+  if (outcome != SUCCESS)
+    fprintf(stderr, "ERROR: The keyword journal in %s%s is damaged.\n", plan->dir_path, KEYWORD_JOURNAL_DIR);
+  return outcome;
+}
+
+// Give `move` its new name as a second link to the old file. Used for
+// attachments and notes without frontmatter, which have no tags to rewrite,
+// so nothing is read or copied however large they are.
+static int link_move(int dir_fd, const KeywordMove *move, const struct stat *st) {
+  STATS_SYSCALL(SYS_RENAME, 1);
+  if (linkat(dir_fd, move->old_name, dir_fd, move->new_name, 0) == 0)
+    return SUCCESS;
+  // Linked by an interrupted run
+  struct stat linked;
+  STATS_SYSCALL(SYS_STAT, 1);
+  return errno == EEXIST && fstatat(dir_fd, move->new_name, &linked, 0) == 0 && linked.st_dev == st->st_dev &&
+                 linked.st_ino == st->st_ino
+             ? SUCCESS
+             : FAILURE;
+}
+
+// Write the note open on `fd` to its new name with its tags rewritten
+static int rewrite_move(const KeywordPlan *plan, int dir_fd, int journal_fd, const KeywordMove *move, int fd,
+                        const struct stat *st) {
+  size_t length = (size_t)st->st_size;
+  char *data = malloc(length ? length : 1);
+  char *rewritten = malloc(length + KEYWORD_TAGS_LINE_LEN);
+  size_t read_total = 0;
+  while (data != NULL && read_total < length) {
+    ssize_t n = read(fd, data + read_total, length - read_total);
+    STATS_SYSCALL(SYS_READ, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    read_total += (size_t)n;
+  }
+
+  int outcome = FAILURE;
+  size_t new_length = 0;
+  if (data != NULL && rewritten != NULL && read_total == length)
+    new_length = keyword_rewrite_tags(plan, data, length, rewritten, length + KEYWORD_TAGS_LINE_LEN);
+  if (new_length > 0 || length == 0) {
+    // Written beside the journal, flushed and renamed in, so the new name
+    // never holds half a note. A resumed run trusts whatever is there once
+    // the old note is in the journal.
+    char temp_name[MAX_PATH_LEN + sizeof(TEMP_SUFFIX)];
+    snprintf(temp_name, sizeof(temp_name), "%s%s", move->new_name, TEMP_SUFFIX);
+    int temp_fd = openat(journal_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st->st_mode & 07777);
+    STATS_SYSCALL(SYS_OPEN, 1);
+    if (temp_fd != -1) {
+      outcome = write_all(temp_fd, rewritten, new_length);
+      if (outcome == SUCCESS)
+        outcome = fsync(temp_fd) == 0 ? SUCCESS : FAILURE;
+      STATS_SYSCALL(SYS_FSYNC, 1);
+      close(temp_fd);
+    }
+    if (outcome == SUCCESS)
+      outcome = renameat(journal_fd, temp_name, dir_fd, move->new_name) == 0 ? SUCCESS : FAILURE;
+    STATS_SYSCALL(SYS_RENAME, 1);
+  }
+  free(data);
+  free(rewritten);
+  return outcome;
+}
+
+// Put one note or attachment under its new name, then move the old file
+// into the journal directory. Each step can be repeated, so a resumed run
+// picks up wherever the interrupted one stopped.
+static int apply_move(const KeywordPlan *plan, int dir_fd, int journal_fd, KeywordMove *move) {
+  struct stat st;
+  STATS_SYSCALL(SYS_STAT, 1);
+  if (fstatat(dir_fd, move->old_name, &st, 0) == -1) {
+    // Already moved aside by an earlier run
+    STATS_SYSCALL(SYS_STAT, 2);
+    if (errno == ENOENT && faccessat(journal_fd, move->old_name, F_OK, 0) == 0 &&
+        faccessat(dir_fd, move->new_name, F_OK, 0) == 0)
+      return SUCCESS;
+    fprintf(stderr, "ERROR: Could not find %s%s\n", plan->dir_path, move->old_name);
+    return FAILURE;
+  }
+
+  int outcome;
+  if (is_attachment(move->old_name)) {
+    outcome = link_move(dir_fd, move, &st);
+  } else {
+    int fd = openat(dir_fd, move->old_name, O_RDONLY | O_CLOEXEC);
+    STATS_SYSCALL(SYS_OPEN, 1);
+    if (fd == -1) {
+      fprintf(stderr, "ERROR: Could not open %s%s\n", plan->dir_path, move->old_name);
+      return FAILURE;
+    }
+    char start[4];
+    STATS_SYSCALL(SYS_READ, 1);
+    if (pread(fd, start, sizeof(start), 0) == sizeof(start) && memcmp(start, "---\n", 4) == 0)
+      outcome = rewrite_move(plan, dir_fd, journal_fd, move, fd, &st);
+    else
+      outcome = link_move(dir_fd, move, &st);
+    close(fd);
+  }
+
+  if (outcome == SUCCESS)
+    outcome = renameat(dir_fd, move->old_name, journal_fd, move->old_name) == 0 ? SUCCESS : FAILURE;
+  STATS_SYSCALL(SYS_RENAME, 1);
+  if (outcome != SUCCESS)
+    fprintf(stderr, "ERROR: Could not rename %s%s\n", plan->dir_path, move->old_name);
+  return outcome;
+}
+
+typedef struct {
+  KeywordPlan *plan;
+  size_t next;
+  pthread_mutex_t lock;
+  int dir_fd;
+  int journal_fd;
+} KeywordBatch;
+
+static void *keyword_worker(void *arg) {
+  KeywordBatch *batch = arg;
+  for (;;) {
+    pthread_mutex_lock(&batch->lock);
+    size_t i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if (i >= batch->plan->count)
+      break;
+    KeywordMove *move = &batch->plan->moves[i];
+    move->outcome = apply_move(batch->plan, batch->dir_fd, batch->journal_fd, move);
+  }
+  return NULL;
+}
+
+// Remove the journal once every note it lists is in its final state
+static void remove_journal(const KeywordPlan *plan, int dir_fd, int journal_fd) {
+  char temp_name[MAX_PATH_LEN + sizeof(TEMP_SUFFIX)];
+  for (size_t i = 0; i < plan->count; i++) {
+    snprintf(temp_name, sizeof(temp_name), "%s%s", plan->moves[i].new_name, TEMP_SUFFIX);
+    unlinkat(journal_fd, temp_name, 0);
+  }
+  unlinkat(journal_fd, KEYWORD_JOURNAL_FILE TEMP_SUFFIX, 0);
+  unlinkat(journal_fd, KEYWORD_JOURNAL_FILE, 0);
+  if (unlinkat(dir_fd, KEYWORD_JOURNAL_DIR, AT_REMOVEDIR) == -1)
+    fprintf(stderr, "ERROR: Could not remove %s%s\n", plan->dir_path, KEYWORD_JOURNAL_DIR);
+}
+
+// Apply every move of `plan` in parallel. Once all have succeeded the new
+// notes are flushed with one syncfs and the old ones dropped; otherwise the
+// journal is left for `keyword_resume` or `keyword_rollback`.
+static int run_moves(KeywordPlan *plan, int dir_fd, int journal_fd) {
+  KeywordBatch batch = {.plan = plan, .dir_fd = dir_fd, .journal_fd = journal_fd};
+  pthread_mutex_init(&batch.lock, NULL);
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int thread_count = cores > 0 ? (int)cores : 1;
+  if (thread_count > KEYWORD_MAX_THREADS)
+    thread_count = KEYWORD_MAX_THREADS;
+  pthread_t threads[KEYWORD_MAX_THREADS];
+  int started = 0;
+  for (int i = 0; i < thread_count && (size_t)i < plan->count; i++) {
+    if (pthread_create(&threads[i], NULL, keyword_worker, &batch) != 0)
+      break;
+    started++;
+  }
+  // Without threads, do the work here
+  if (started == 0)
+    keyword_worker(&batch);
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_mutex_destroy(&batch.lock);
+
+  size_t failed = 0;
+  for (size_t i = 0; i < plan->count; i++) {
+    failed += plan->moves[i].outcome != SUCCESS;
+  }
+  if (failed > 0) {
+    fprintf(stderr, "ERROR: %zu of %zu notes could not be renamed, run connote keyword resume or rollback.\n", failed,
+            plan->count);
+    return FAILURE;
+  }
+
+  STATS_SYSCALL(SYS_FSYNC, 1);
+  if (syncfs(dir_fd) == -1) {
+    fprintf(stderr, "ERROR: Could not flush %s, run connote keyword resume.\n", plan->dir_path);
+    return FAILURE;
+  }
+  for (size_t i = 0; i < plan->count; i++) {
+    unlinkat(journal_fd, plan->moves[i].old_name, 0);
+  }
+  remove_journal(plan, dir_fd, journal_fd);
+
+  return SUCCESS;
+}
+
+static int open_dir(const char *dir_path) {
+  int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1)
+    fprintf(stderr, "ERROR: Could not open %s\n", dir_path);
+  return dir_fd;
+}
+
+// Journal `plan` and carry it out
+int keyword_apply(KeywordPlan *plan) {
+  if (plan->count == 0)
+    return SUCCESS;
+
+  int dir_fd = open_dir(plan->dir_path);
+  if (dir_fd == -1)
+    return FAILURE;
+  int journal_fd = -1;
+  int outcome = write_journal(plan, dir_fd, &journal_fd);
+  if (outcome == SUCCESS)
+    outcome = run_moves(plan, dir_fd, journal_fd);
+
+  if (journal_fd != -1)
+    close(journal_fd);
+  close(dir_fd);
+  return outcome;
+}
+
+static int open_journal(const char *dir_path, int *dir_fd, int *journal_fd) {
+  *dir_fd = open_dir(dir_path);
+  if (*dir_fd == -1)
+    return FAILURE;
+  *journal_fd = openat(*dir_fd, KEYWORD_JOURNAL_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (*journal_fd == -1) {
+    fprintf(stderr, "ERROR: There is no unfinished keyword change in %s\n", dir_path);
+    close(*dir_fd);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+// Finish the keyword change journaled in `dir_path`
+int keyword_resume(const char *dir_path) {
+  int dir_fd, journal_fd;
+  if (open_journal(dir_path, &dir_fd, &journal_fd) != SUCCESS)
+    return FAILURE;
+
+  KeywordPlan plan;
+  int outcome = read_journal(&plan, dir_path, journal_fd);
+  if (outcome == SUCCESS)
+    outcome = run_moves(&plan, dir_fd, journal_fd);
+
+  keyword_plan_free(&plan);
+  close(journal_fd);
+  close(dir_fd);
+  return outcome;
+}
+
+// Undo the keyword change journaled in `dir_path`, putting every old note
+// back under its old name
+int keyword_rollback(const char *dir_path) {
+  int dir_fd, journal_fd;
+  if (open_journal(dir_path, &dir_fd, &journal_fd) != SUCCESS)
+    return FAILURE;
+
+  KeywordPlan plan;
+  int outcome = read_journal(&plan, dir_path, journal_fd);
+  for (size_t i = 0; i < plan.count && outcome == SUCCESS; i++) {
+    const KeywordMove *move = &plan.moves[i];
+    bool moved_aside = faccessat(journal_fd, move->old_name, F_OK, 0) == 0;
+    bool in_place = !moved_aside && faccessat(dir_fd, move->old_name, F_OK, 0) == 0;
+    STATS_SYSCALL(SYS_STAT, 2);
+    // Without the old note the new one is all there is, so it stays
+    if (!moved_aside && !in_place)
+      continue;
+    if (unlinkat(dir_fd, move->new_name, 0) == -1 && errno != ENOENT)
+      outcome = FAILURE;
+    if (outcome == SUCCESS && moved_aside)
+      outcome = renameat(journal_fd, move->old_name, dir_fd, move->old_name) == 0 ? SUCCESS : FAILURE;
+    STATS_SYSCALL(SYS_RENAME, 1);
+    if (outcome != SUCCESS)
+      fprintf(stderr, "ERROR: Could not restore %s%s\n", plan.dir_path, move->old_name);
+  }
+  if (outcome == SUCCESS)
+    remove_journal(&plan, dir_fd, journal_fd);
+
+  keyword_plan_free(&plan);
+  close(journal_fd);
+  close(dir_fd);
+  return outcome;
+}
@@ -0,0 +1,42 @@
+#ifndef KEYWORD_H_
+#define KEYWORD_H_
+
+#include <stddef.h>
+
+#include "index.h"
+#include "utils.h"
+
+// A keyword rename or merge is planned in full before anything is touched,
+// and recorded in a journal inside the vault while it is applied. Each note
+// is rewritten under its new name and the old file moved into the journal
+// directory, so the old files can be put back until the whole batch is done.
+#define KEYWORD_JOURNAL_DIR ".connote-journal"
+#define KEYWORD_JOURNAL_FILE "plan"
+#define KEYWORD_JOURNAL_MAGIC "connote-keyword-journal 1"
+#define KEYWORD_MAX_THREADS 16
+// Longest tags line `keyword_rewrite_tags` writes: "tags: [kw1, kw2]"
+#define KEYWORD_TAGS_LINE_LEN (8 + MAX_KEYS * (MAX_KW_LEN + 2))
+
+typedef struct {
+  char old_name[MAX_PATH_LEN]; // Basenames in the vault
+  char new_name[MAX_PATH_LEN];
+  int outcome;
+} KeywordMove;
+
+typedef struct {
+  char dir_path[MAX_PATH_LEN]; // With a trailing slash, as in a NoteIndex
+  char from[MAX_KEYS][MAX_KW_LEN];
+  size_t from_count;
+  char to[MAX_KW_LEN];
+  KeywordMove *moves;
+  size_t count;
+} KeywordPlan;
+
+int keyword_plan(KeywordPlan *plan, NoteIndex *index, char **from, size_t from_count, const char *to);
+int keyword_apply(KeywordPlan *plan);
+int keyword_resume(const char *dir_path);
+int keyword_rollback(const char *dir_path);
+void keyword_plan_free(KeywordPlan *plan);
+size_t keyword_rewrite_tags(const KeywordPlan *plan, const char *data, size_t length, char *dest, size_t dest_size);
+
+#endif // KEYWORD_H_
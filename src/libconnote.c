@@ -0,0 +1,275 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconnote.h"
+#include "utils.h"
+
+// The public sizes are promises about the core's buffers
+_Static_assert(CONNOTE_ID_LEN == ID_LEN, "CONNOTE_ID_LEN must match ID_LEN");
+_Static_assert(CONNOTE_MAX_KEYS == MAX_KEYS, "CONNOTE_MAX_KEYS must match MAX_KEYS");
+_Static_assert(CONNOTE_MAX_KW_LEN == MAX_KW_LEN, "CONNOTE_MAX_KW_LEN must match MAX_KW_LEN");
+_Static_assert(CONNOTE_MAX_TITLE_LEN == MAX_TITLE_LEN, "CONNOTE_MAX_TITLE_LEN must match MAX_TITLE_LEN");
+_Static_assert(CONNOTE_MAX_SIG_LEN == MAX_SIG_LEN, "CONNOTE_MAX_SIG_LEN must match MAX_SIG_LEN");
+_Static_assert(CONNOTE_MAX_PATH_LEN == MAX_PATH_LEN, "CONNOTE_MAX_PATH_LEN must match MAX_PATH_LEN");
+_Static_assert(CONNOTE_DATE_LEN == sizeof(((Frontmatter *)0)->date), "CONNOTE_DATE_LEN must match Frontmatter");
+_Static_assert((int)CONNOTE_FSYNC_NONE == FSYNC_NONE && (int)CONNOTE_FSYNC_FILE == FSYNC_FILE &&
+                   (int)CONNOTE_FSYNC_DIR == FSYNC_DIR,
+               "ConnoteFsync must match FsyncPolicy");
+
+// The components of a ConnoteNote copied into writable buffers, since the
+// core slugs its inputs in place
+typedef struct {
+  char id[ID_LEN + 1];
+  char sig[MAX_SIG_LEN];
+  char title[MAX_TITLE_LEN];
+  char keywords[MAX_KEYS][MAX_KW_LEN];
+  char *keyword_ptrs[MAX_KEYS];
+  size_t kw_count;
+} NoteCopy;
+
+static ConnoteStatus fail(ConnoteError *error, ConnoteStatus status, int sys_errno, const char *format, ...) {
+  if (error != NULL) {
+    error->status = status;
+    error->sys_errno = sys_errno;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error->message, CONNOTE_ERROR_LEN, format, args);
+    va_end(args);
+  }
+  return status;
+}
+
+// Fail with the reason in `errno`
+static ConnoteStatus fail_errno(ConnoteError *error, const char *what, const char *path) {
+  int saved_errno = errno;
+  char buffer[128];
+  const char *reason = strerror_r(saved_errno, buffer, sizeof(buffer));
+  return fail(error, CONNOTE_EIO, saved_errno, "%s %s: %s", what, path, reason);
+}
+
+static ConnoteStatus succeed(ConnoteError *error) {
+  if (error != NULL) {
+    error->status = CONNOTE_OK;
+    error->sys_errno = 0;
+    error->message[0] = '\0';
+  }
+  return CONNOTE_OK;
+}
+
+static bool is_valid_id(const char *id) { return id != NULL && strnlen(id, ID_LEN + 1) == ID_LEN && has_valid_id(id); }
+
+// Copy `src`, which may be NULL for an empty string, failing if it is too long
+static int copy_input(const char *src, char *dest, size_t dest_size) {
+  if (src == NULL) {
+    dest[0] = '\0';
+    return SUCCESS;
+  }
+  if (dest_size == 0)
+    return FAILURE;
+  return str_copy_slice(src, 0, strnlen(src, dest_size), dest, dest_size);
+}
+
+static ConnoteStatus copy_note(const ConnoteNote *note, NoteCopy *copy, ConnoteError *error) {
+  if (!is_valid_id(note->id))
+    return fail(error, CONNOTE_EINVAL, 0, "Identifier %s is not in YYYYMMDDTHHMMSS form", note->id ? note->id : "");
+  memcpy(copy->id, note->id, ID_LEN + 1);
+
+  if (copy_input(note->signature, copy->sig, MAX_SIG_LEN) != SUCCESS)
+    return fail(error, CONNOTE_ERANGE, 0, "Signature is longer than %d bytes", MAX_SIG_LEN - 1);
+  if (copy_input(note->title, copy->title, MAX_TITLE_LEN) != SUCCESS)
+    return fail(error, CONNOTE_ERANGE, 0, "Title is longer than %d bytes", MAX_TITLE_LEN - 1);
+  if (note->kw_count > MAX_KEYS)
+    return fail(error, CONNOTE_ERANGE, 0, "More than %d keywords", MAX_KEYS);
+  for (size_t i = 0; i < note->kw_count; i++) {
+    if (note->keywords[i] == NULL)
+      return fail(error, CONNOTE_EINVAL, 0, "Keyword %zu is missing", i);
+    if (copy_input(note->keywords[i], copy->keywords[i], MAX_KW_LEN) != SUCCESS)
+      return fail(error, CONNOTE_ERANGE, 0, "Keyword %s is longer than %d bytes", copy->keywords[i], MAX_KW_LEN - 1);
+    copy->keyword_ptrs[i] = copy->keywords[i];
+  }
+  copy->kw_count = note->kw_count;
+
+  return succeed(error);
+}
+
+ConnoteStatus connote_open(ConnoteContext *context, const char *dir_path, ConnoteFsync fsync, ConnoteError *error) {
+  context->dir_fd = -1;
+  context->dir_path[0] = '\0';
+  context->fsync = fsync;
+
+  size_t length = dir_path != NULL ? strlen(dir_path) : 0;
+  if (length == 0)
+    return fail(error, CONNOTE_EINVAL, 0, "No directory given");
+  if (length + 2 > MAX_PATH_LEN)
+    return fail(error, CONNOTE_ERANGE, 0, "Directory path is longer than %d bytes", MAX_PATH_LEN - 2);
+
+  int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1)
+    return fail_errno(error, "Could not open", dir_path);
+
+  memcpy(context->dir_path, dir_path, length);
+  if (dir_path[length - 1] != '/')
+    context->dir_path[length++] = '/';
+  context->dir_path[length] = '\0';
+  context->dir_fd = dir_fd;
+
+  return succeed(error);
+}
+
+void connote_close(ConnoteContext *context) {
+  if (context->dir_fd != -1)
+    close(context->dir_fd);
+  context->dir_fd = -1;
+}
+
+ConnoteStatus connote_slug(ConnoteSlugKind kind, const char *src, char *dest, size_t dest_size, ConnoteError *error) {
+  char slug[MAX_TITLE_LEN];
+  if (src == NULL || copy_input(src, slug, MAX_TITLE_LEN) != SUCCESS)
+    return fail(error, CONNOTE_ERANGE, 0, "Text to slug is longer than %d bytes", MAX_TITLE_LEN - 1);
+
+  switch (kind) {
+  case CONNOTE_SLUG_TITLE:
+    sluggify_title(slug);
+    break;
+  case CONNOTE_SLUG_SIGNATURE:
+    sluggify_signature(slug);
+    break;
+  case CONNOTE_SLUG_KEYWORD:
+    sluggify_keyword(slug);
+    break;
+  default:
+    return fail(error, CONNOTE_EINVAL, 0, "Unknown slug kind %d", (int)kind);
+  }
+
+  if (copy_input(slug, dest, dest_size) != SUCCESS)
+    return fail(error, CONNOTE_ERANGE, 0, "Slug does not fit in %zu bytes", dest_size);
+  return succeed(error);
+}
+
+// Write the file name of `note`, without a directory, to `dest`
+ConnoteStatus connote_format_name(const ConnoteNote *note, char *dest, size_t dest_size, ConnoteError *error) {
+  NoteCopy copy;
+  ConnoteStatus status = copy_note(note, &copy, error);
+  if (status != CONNOTE_OK)
+    return status;
+
+  // The ID was checked by `copy_note`, so the parts are always made
+  FileNameParts parts;
+  file_name_parts(&parts, "", copy.id, copy.sig, copy.title, copy.keyword_ptrs, copy.kw_count, ".md");
+  if (format_file_name_parts(&parts, dest, dest_size) != SUCCESS)
+    return fail(error, CONNOTE_ERANGE, 0, "File name does not fit in %zu bytes", dest_size);
+  return succeed(error);
+}
+
+// Read the components of `filename`, which may include directories
+ConnoteStatus connote_parse_name(const char *filename, ConnoteFields *fields, ConnoteError *error) {
+  memset(fields, 0, sizeof(*fields));
+  const char *name = strrchr(filename, '/');
+  name = name != NULL ? name + 1 : filename;
+
+  if (strnlen(name, ID_LEN) < ID_LEN || !has_valid_id(name))
+    return fail(error, CONNOTE_ENOTFOUND, 0, "%s does not start with an identifier", name);
+  read_id(name, fields->id);
+
+  size_t start, end;
+  if (find_filename_component(name, COMPONENT_TITLE, &start, &end) == SUCCESS &&
+      str_copy_slice(name, start, end, fields->title, MAX_TITLE_LEN) != SUCCESS)
+    return fail(error, CONNOTE_ERANGE, 0, "Title of %s is longer than %d bytes", name, MAX_TITLE_LEN - 1);
+  if (find_filename_component(name, COMPONENT_SIGNATURE, &start, &end) == SUCCESS &&
+      str_copy_slice(name, start, end, fields->signature, MAX_SIG_LEN) != SUCCESS)
+    return fail(error, CONNOTE_ERANGE, 0, "Signature of %s is longer than %d bytes", name, MAX_SIG_LEN - 1);
+
+  if (find_filename_component(name, COMPONENT_KEYWORDS, &start, &end) == SUCCESS) {
+    // Keywords are separated by single underscores
+    const char *keyword = name + start;
+    const char *stop = name + end;
+    while (keyword < stop) {
+      const char *separator = memchr(keyword, '_', stop - keyword);
+      const char *keyword_end = separator != NULL ? separator : stop;
+      if (keyword_end > keyword) {
+        if (fields->kw_count == MAX_KEYS)
+          return fail(error, CONNOTE_ERANGE, 0, "%s has more than %d keywords", name, MAX_KEYS);
+        if (str_copy_slice(keyword, 0, keyword_end - keyword, fields->keywords[fields->kw_count++], MAX_KW_LEN) !=
+            SUCCESS)
+          return fail(error, CONNOTE_ERANGE, 0, "A keyword of %s is longer than %d bytes", name, MAX_KW_LEN - 1);
+      }
+      keyword = keyword_end + 1;
+    }
+  }
+
+  // No component may contain a dot, so the first one starts the extension
+  const char *extension = strchr(name, '.');
+  if (extension != NULL && copy_input(extension, fields->extension, CONNOTE_MAX_EXT_LEN) != SUCCESS)
+    return fail(error, CONNOTE_ERANGE, 0, "Extension of %s is longer than %d bytes", name, CONNOTE_MAX_EXT_LEN - 1);
+
+  return succeed(error);
+}
+
+// Read the yaml frontmatter at the start of `data`, which need not be
+// null-terminated
+ConnoteStatus connote_parse_frontmatter(const char *data, size_t length, ConnoteFields *fields, ConnoteError *error) {
+  memset(fields, 0, sizeof(*fields));
+  Frontmatter frontmatter;
+  if (read_frontmatter(data, length, &frontmatter) != SUCCESS)
+    return fail(error, CONNOTE_ENOTFOUND, 0, "No frontmatter found");
+
+  memcpy(fields->id, frontmatter.identifier, ID_LEN + 1);
+  memcpy(fields->signature, frontmatter.signature, MAX_SIG_LEN);
+  memcpy(fields->title, frontmatter.title, MAX_TITLE_LEN);
+  memcpy(fields->keywords, frontmatter.tags, sizeof(frontmatter.tags));
+  fields->kw_count = frontmatter.tag_count;
+  memcpy(fields->date, frontmatter.date, CONNOTE_DATE_LEN);
+
+  return succeed(error);
+}
+
+// Create `note` in the context's directory with `body` after its
+// frontmatter, and write its file name to `dest`. The ID is advanced past
+// any notes created in the same second.
+ConnoteStatus connote_create(const ConnoteContext *context, const ConnoteNote *note, const char *body,
+                             size_t body_length, char *dest, size_t dest_size, ConnoteError *error) {
+  if (context == NULL || context->dir_fd == -1)
+    return fail(error, CONNOTE_EINVAL, 0, "No directory open");
+
+  char id[ID_LEN + 1];
+  if (note->id == NULL) {
+    time_t now = time(NULL);
+    struct tm local;
+    if (localtime_r(&now, &local) == NULL || strftime(id, ID_LEN + 1, ID_FORMAT, &local) != ID_LEN)
+      return fail(error, CONNOTE_EIO, errno, "Could not format the current time as an identifier");
+  } else if (is_valid_id(note->id)) {
+    memcpy(id, note->id, ID_LEN + 1);
+  } else {
+    return fail(error, CONNOTE_EINVAL, 0, "Identifier %s is not in YYYYMMDDTHHMMSS form", note->id);
+  }
+
+  // Check the name fits before anything is written. Advancing the ID to
+  // avoid a collision can't change its length.
+  ConnoteNote named = *note;
+  named.id = id;
+  ConnoteStatus status = connote_format_name(&named, dest, dest_size, error);
+  if (status != CONNOTE_OK)
+    return status;
+
+  // connote_file_at only changes `id`, copying the other components before
+  // it slugs them
+  char path[MAX_PATH_LEN];
+  if (connote_file_at(context->dir_fd, (char *)context->dir_path, id, (char *)note->signature, (char *)note->title,
+                      (char **)note->keywords, note->kw_count, ".md", body, body_length,
+                      (FsyncPolicy)context->fsync, path) != SUCCESS) {
+    if (errno == EEXIST)
+      return fail(error, CONNOTE_EEXIST, EEXIST, "No free ID found for %s", path);
+    return fail_errno(error, "Could not write", path);
+  }
+
+  if (context->fsync == CONNOTE_FSYNC_DIR && fsync(context->dir_fd) == -1)
+    return fail_errno(error, "Could not sync", context->dir_path);
+
+  str_copy_slice(path, strlen(context->dir_path), strlen(path), dest, dest_size);
+  return succeed(error);
+}
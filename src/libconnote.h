@@ -0,0 +1,92 @@
+#ifndef LIBCONNOTE_H_
+#define LIBCONNOTE_H_
+
+// The note naming and frontmatter core of connote, for programs that want to
+// parse or create notes in-process rather than run the CLI. Every function is
+// reentrant: state lives in the caller's context and error structs, inputs
+// are never modified, results go to caller buffers, nothing is allocated and
+// nothing is printed. Build it with `make lib`.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define CONNOTE_API __attribute__((visibility("default")))
+#else
+#define CONNOTE_API
+#endif
+
+// Sizes of the fixed buffers below, including the null terminator
+#define CONNOTE_ID_LEN 15
+#define CONNOTE_MAX_KEYS 16
+#define CONNOTE_MAX_KW_LEN 64
+#define CONNOTE_MAX_TITLE_LEN 512
+#define CONNOTE_MAX_SIG_LEN 64
+#define CONNOTE_MAX_PATH_LEN 2048
+#define CONNOTE_MAX_EXT_LEN 16
+#define CONNOTE_DATE_LEN 32
+#define CONNOTE_ERROR_LEN 256
+
+typedef enum {
+  CONNOTE_OK = 0,
+  CONNOTE_EINVAL,    // Malformed input, such as an ID not in "YYYYMMDDTHHMMSS" form
+  CONNOTE_ERANGE,    // A result did not fit in its buffer
+  CONNOTE_ENOTFOUND, // The name or data has no such component or frontmatter
+  CONNOTE_EEXIST,    // No free ID left for a new note
+  CONNOTE_EIO,       // A system call failed, see `sys_errno`
+} ConnoteStatus;
+
+typedef struct {
+  ConnoteStatus status;
+  int sys_errno;
+  char message[CONNOTE_ERROR_LEN];
+} ConnoteError;
+
+typedef enum { CONNOTE_FSYNC_NONE, CONNOTE_FSYNC_FILE, CONNOTE_FSYNC_DIR } ConnoteFsync;
+
+// An open notes directory. One context can be shared by several threads.
+typedef struct {
+  int dir_fd;
+  char dir_path[CONNOTE_MAX_PATH_LEN]; // With a trailing slash
+  ConnoteFsync fsync;
+} ConnoteContext;
+
+typedef enum { CONNOTE_SLUG_TITLE, CONNOTE_SLUG_SIGNATURE, CONNOTE_SLUG_KEYWORD } ConnoteSlugKind;
+
+// The components of a note to name or create. Only `id` is required, and
+// `connote_create` uses the current time when it is NULL.
+typedef struct {
+  const char *id;
+  const char *signature;
+  const char *title;
+  const char *const *keywords;
+  size_t kw_count;
+} ConnoteNote;
+
+// Components read back from a filename or a note's frontmatter. Components
+// that are missing are empty.
+typedef struct {
+  char id[CONNOTE_ID_LEN + 1];
+  char signature[CONNOTE_MAX_SIG_LEN];
+  char title[CONNOTE_MAX_TITLE_LEN];
+  char keywords[CONNOTE_MAX_KEYS][CONNOTE_MAX_KW_LEN];
+  size_t kw_count;
+  char extension[CONNOTE_MAX_EXT_LEN]; // Filenames only
+  char date[CONNOTE_DATE_LEN];         // Frontmatter only
+} ConnoteFields;
+
+CONNOTE_API ConnoteStatus connote_open(ConnoteContext *context, const char *dir_path, ConnoteFsync fsync,
+                                       ConnoteError *error);
+CONNOTE_API void connote_close(ConnoteContext *context);
+
+CONNOTE_API ConnoteStatus connote_slug(ConnoteSlugKind kind, const char *src, char *dest, size_t dest_size,
+                                       ConnoteError *error);
+CONNOTE_API ConnoteStatus connote_format_name(const ConnoteNote *note, char *dest, size_t dest_size,
+                                              ConnoteError *error);
+CONNOTE_API ConnoteStatus connote_parse_name(const char *filename, ConnoteFields *fields, ConnoteError *error);
+CONNOTE_API ConnoteStatus connote_parse_frontmatter(const char *data, size_t length, ConnoteFields *fields,
+                                                    ConnoteError *error);
+CONNOTE_API ConnoteStatus connote_create(const ConnoteContext *context, const ConnoteNote *note, const char *body,
+                                         size_t body_length, char *dest, size_t dest_size, ConnoteError *error);
+
+#endif // LIBCONNOTE_H_
@@ -0,0 +1,325 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "utils.h"
+
+// The fields of one note, whether read from the index or from a file name
+typedef struct {
+  const char *old_path; // NULL unless the note was renamed
+  const char *dir_path; // The path is `dir_path` followed by `name`
+  const char *name;
+  char id[ID_LEN + 1];
+  const char *sig;
+  const char *title;
+  const char *keywords[MAX_KEYS];
+  size_t kw_count;
+} OutputRecord;
+
+int parse_output_format(const char *str, OutputFormat *format) {
+  if (strcmp(str, "text") == 0) {
+    *format = FORMAT_TEXT;
+  } else if (strcmp(str, "json") == 0) {
+    *format = FORMAT_JSON;
+  } else if (strcmp(str, "tsv") == 0) {
+    *format = FORMAT_TSV;
+  } else if (strcmp(str, "nul") == 0) {
+    *format = FORMAT_NUL;
+  } else {
+    fprintf(stderr, "ERROR: Unknown format %s, expected text, json, tsv or nul.\n", str);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+void output_init(Output *out, int fd, OutputFormat format) {
+  out->fd = fd;
+  out->format = format;
+  out->failed = false;
+  out->length = 0;
+}
+
+static void write_all(Output *out, const char *data, size_t length) {
+  while (length > 0 && !out->failed) {
+    ssize_t n = write(out->fd, data, length);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      out->failed = true;
+      break;
+    }
+    data += n;
+    length -= (size_t)n;
+  }
+}
+
+int output_flush(Output *out) {
+  write_all(out, out->buffer, out->length);
+  out->length = 0;
+  return out->failed ? FAILURE : SUCCESS;
+}
+
+void output_write(Output *out, const char *data, size_t length) {
+  if (out->length + length > OUTPUT_BUFFER_SIZE) {
+    output_flush(out);
+    // Anything as large as the buffer goes straight out
+    if (length >= OUTPUT_BUFFER_SIZE) {
+      write_all(out, data, length);
+      return;
+    }
+  }
+  memcpy(out->buffer + out->length, data, length);
+  out->length += length;
+}
+
+static void output_str(Output *out, const char *str) { output_write(out, str, strlen(str)); }
+
+void output_printf(Output *out, const char *format, ...) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    size_t room = OUTPUT_BUFFER_SIZE - out->length;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(out->buffer + out->length, room, format, args);
+    va_end(args);
+    if (length < 0)
+      return;
+    if ((size_t)length < room) {
+      out->length += (size_t)length;
+      return;
+    }
+    output_flush(out);
+  }
+  // Longer than the whole buffer, so keep what fitted
+  out->length = OUTPUT_BUFFER_SIZE - 1;
+}
+
+// Write `str` as the inside of a JSON string
+static void json_chars(Output *out, const char *str) {
+  const char *run = str;
+  for (const char *c = str; *c != '\0'; c++) {
+    unsigned char ch = (unsigned char)*c;
+    if (ch != '"' && ch != '\\' && ch >= 0x20)
+      continue;
+    output_write(out, run, c - run);
+    char escape[8];
+    if (ch == '"' || ch == '\\') {
+      escape[0] = '\\';
+      escape[1] = (char)ch;
+      escape[2] = '\0';
+    } else if (ch == '\n') {
+      memcpy(escape, "\\n", 3);
+    } else if (ch == '\t') {
+      memcpy(escape, "\\t", 3);
+    } else {
+      snprintf(escape, sizeof(escape), "\\u%04x", ch);
+    }
+    output_str(out, escape);
+    run = c + 1;
+  }
+  output_str(out, run);
+}
+
+static void json_field(Output *out, const char *key, const char *value) {
+  output_str(out, ",\"");
+  output_str(out, key);
+  output_str(out, "\":\"");
+  json_chars(out, value);
+  output_write(out, "\"", 1);
+}
+
+// Write `str` as a TSV field, escaping the characters that would break it
+static void tsv_chars(Output *out, const char *str) {
+  const char *run = str;
+  for (const char *c = str; *c != '\0'; c++) {
+    const char *escape = *c == '\t' ? "\\t" : *c == '\n' ? "\\n" : *c == '\r' ? "\\r" : *c == '\\' ? "\\\\" : NULL;
+    if (escape == NULL)
+      continue;
+    output_write(out, run, c - run);
+    output_str(out, escape);
+    run = c + 1;
+  }
+  output_str(out, run);
+}
+
+static void output_record(Output *out, const OutputRecord *record) {
+  switch (out->format) {
+  case FORMAT_TEXT:
+    if (record->old_path != NULL) {
+      output_str(out, record->old_path);
+      output_str(out, " -> ");
+    }
+    output_str(out, record->dir_path);
+    output_str(out, record->name);
+    output_write(out, "\n", 1);
+    break;
+  case FORMAT_NUL:
+    output_str(out, record->dir_path);
+    output_str(out, record->name);
+    output_write(out, "", 1);
+    break;
+  case FORMAT_TSV:
+    tsv_chars(out, record->dir_path);
+    tsv_chars(out, record->name);
+    output_write(out, "\t", 1);
+    output_str(out, record->id);
+    output_write(out, "\t", 1);
+    tsv_chars(out, record->sig);
+    output_write(out, "\t", 1);
+    tsv_chars(out, record->title);
+    output_write(out, "\t", 1);
+    for (size_t i = 0; i < record->kw_count; i++) {
+      if (i > 0)
+        output_write(out, ",", 1);
+      tsv_chars(out, record->keywords[i]);
+    }
+    if (record->old_path != NULL) {
+      output_write(out, "\t", 1);
+      tsv_chars(out, record->old_path);
+    }
+    output_write(out, "\n", 1);
+    break;
+  case FORMAT_JSON:
+    output_str(out, "{\"path\":\"");
+    json_chars(out, record->dir_path);
+    json_chars(out, record->name);
+    output_write(out, "\"", 1);
+    json_field(out, "id", record->id);
+    json_field(out, "signature", record->sig);
+    json_field(out, "title", record->title);
+    output_str(out, ",\"keywords\":[");
+    for (size_t i = 0; i < record->kw_count; i++) {
+      output_str(out, i > 0 ? ",\"" : "\"");
+      json_chars(out, record->keywords[i]);
+      output_write(out, "\"", 1);
+    }
+    output_write(out, "]", 1);
+    if (record->old_path != NULL)
+      json_field(out, "old_path", record->old_path);
+    output_str(out, "}\n");
+    break;
+  }
+}
+
+// Write a note of the index, from the components it has already parsed
+void output_note(Output *out, const NoteIndex *index, const NoteRecord *note) {
+  OutputRecord record = {.dir_path = index->dir_path, .name = note->name, .sig = note->sig, .title = note->title};
+  if (out->format == FORMAT_JSON || out->format == FORMAT_TSV) {
+    u64_to_id(note->id, record.id);
+    record.kw_count = note->kw_count;
+    for (uint32_t i = 0; i < note->kw_count; i++) {
+      record.keywords[i] = index->keywords.names[note->kw[i]];
+    }
+  }
+  output_record(out, &record);
+}
+
+// Write the note at `path`, reading its components from the file name.
+// `old_path` is its name before a rename, or NULL.
+void output_file(Output *out, const char *old_path, const char *path) {
+  OutputRecord record = {.old_path = old_path, .dir_path = "", .name = path, .sig = "", .title = ""};
+  char sig[MAX_SIG_LEN] = {0};
+  char title[MAX_TITLE_LEN] = {0};
+  char keywords[MAX_KEYS * MAX_KW_LEN] = {0};
+
+  if (out->format == FORMAT_JSON || out->format == FORMAT_TSV) {
+    const char *name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+    if (name_has_valid_id(name))
+      read_id(name, record.id);
+
+    size_t start, end;
+    if (find_filename_component(name, COMPONENT_SIGNATURE, &start, &end) == SUCCESS)
+      str_copy_slice(name, start, end, sig, MAX_SIG_LEN);
+    if (find_filename_component(name, COMPONENT_TITLE, &start, &end) == SUCCESS)
+      str_copy_slice(name, start, end, title, MAX_TITLE_LEN);
+    record.sig = sig;
+    record.title = title;
+
+    // Keywords are separated by single underscores
+    if (find_filename_component(name, COMPONENT_KEYWORDS, &start, &end) == SUCCESS) {
+      str_copy_slice(name, start, end, keywords, sizeof(keywords));
+      char *keyword = keywords;
+      while (*keyword != '\0' && record.kw_count < MAX_KEYS) {
+        char *separator = strchr(keyword, '_');
+        if (separator != NULL)
+          *separator = '\0';
+        if (*keyword != '\0')
+          record.keywords[record.kw_count++] = keyword;
+        if (separator == NULL)
+          break;
+        keyword = separator + 1;
+      }
+    }
+  }
+
+  output_record(out, &record);
+}
+
+// Write two notes with identical bodies or bodies `similarity` percent alike
+void output_pair(Output *out, const char *first, const char *second, bool exact, uint32_t similarity) {
+  switch (out->format) {
+  case FORMAT_NUL:
+    output_str(out, first);
+    output_write(out, "", 1);
+    output_str(out, second);
+    output_write(out, "", 1);
+    break;
+  case FORMAT_JSON:
+    output_printf(out, "{\"kind\":\"%s\",\"similarity\":%u", exact ? "identical" : "similar", exact ? 100 : similarity);
+    json_field(out, "first", first);
+    json_field(out, "second", second);
+    output_str(out, "}\n");
+    break;
+  case FORMAT_TEXT:
+  case FORMAT_TSV:
+    output_printf(out, "%s\t%u\t", exact ? "identical" : "similar", exact ? 100 : similarity);
+    tsv_chars(out, first);
+    output_write(out, "\t", 1);
+    tsv_chars(out, second);
+    output_write(out, "\n", 1);
+    break;
+  }
+}
+
+// Write a change between two states of the vault. `kind` is A, D, R or M,
+// for an added, removed, renamed or modified note; `old_path` is the name
+// before a rename, or NULL.
+void output_change(Output *out, char kind, const char *old_path, const char *path) {
+  const char *kind_name = kind == 'A' ? "added" : kind == 'D' ? "removed" : kind == 'R' ? "renamed" : "modified";
+  switch (out->format) {
+  case FORMAT_TEXT:
+    output_write(out, &kind, 1);
+    output_write(out, " ", 1);
+    if (old_path != NULL) {
+      output_str(out, old_path);
+      output_str(out, " -> ");
+    }
+    output_str(out, path);
+    output_write(out, "\n", 1);
+    break;
+  case FORMAT_NUL:
+    output_str(out, path);
+    output_write(out, "", 1);
+    break;
+  case FORMAT_JSON:
+    output_printf(out, "{\"change\":\"%s\"", kind_name);
+    json_field(out, "path", path);
+    if (old_path != NULL)
+      json_field(out, "old_path", old_path);
+    output_str(out, "}\n");
+    break;
+  case FORMAT_TSV:
+    output_str(out, kind_name);
+    output_write(out, "\t", 1);
+    tsv_chars(out, path);
+    if (old_path != NULL) {
+      output_write(out, "\t", 1);
+      tsv_chars(out, old_path);
+    }
+    output_write(out, "\n", 1);
+    break;
+  }
+}
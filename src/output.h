@@ -0,0 +1,43 @@
+#ifndef OUTPUT_H_
+#define OUTPUT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "index.h"
+
+// Results are written through one buffer, flushed to the file descriptor
+// with write(2) when full and once the command is done, in the format chosen
+// with --format:
+//   text  paths, and "old -> new" for renames, one per line
+//   json  one object per line: path, id, signature, title and keywords, with
+//         old_path for renames
+//   tsv   the same fields tab separated, keywords comma separated, with
+//         \t, \n, \r and \\ escaped
+//   nul   paths each followed by a null byte, for xargs -0
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+typedef enum { FORMAT_TEXT, FORMAT_JSON, FORMAT_TSV, FORMAT_NUL } OutputFormat;
+
+typedef struct {
+  int fd;
+  OutputFormat format;
+  bool failed; // A write failed, so the rest is dropped
+  size_t length;
+  char buffer[OUTPUT_BUFFER_SIZE];
+} Output;
+
+int parse_output_format(const char *str, OutputFormat *format);
+
+void output_init(Output *out, int fd, OutputFormat format);
+int output_flush(Output *out);
+void output_write(Output *out, const char *data, size_t length);
+void output_printf(Output *out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void output_note(Output *out, const NoteIndex *index, const NoteRecord *note);
+void output_file(Output *out, const char *old_path, const char *path);
+void output_pair(Output *out, const char *first, const char *second, bool exact, uint32_t similarity);
+void output_change(Output *out, char kind, const char *old_path, const char *path);
+
+#endif // OUTPUT_H_
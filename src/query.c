@@ -0,0 +1,688 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "query.h"
+#include "signature.h"
+#include "stats.h"
+#include "utils.h"
+
+typedef enum { TOKEN_END, TOKEN_OPEN, TOKEN_CLOSE, TOKEN_AND, TOKEN_OR, TOKEN_NOT, TOKEN_TERM } TokenKind;
+
+typedef struct {
+  Query *query;
+  const char *text;
+  size_t pos;
+  int depth;
+  TokenKind token; // The token under the cursor
+  char term[MAX_TITLE_LEN];
+} Parser;
+
+// Positions of notes in the NoteIndex
+typedef struct {
+  size_t *items;
+  size_t count;
+  size_t capacity;
+  bool failed;
+} Positions;
+
+// Lexing
+
+// Read the next token. A term runs up to unquoted whitespace or a
+// parenthesis, and its quotes are dropped.
+static int advance(Parser *p) {
+  const char *text = p->text;
+  while (isspace((unsigned char)text[p->pos])) {
+    p->pos++;
+  }
+  char c = text[p->pos];
+  if (c == '\0') {
+    p->token = TOKEN_END;
+    return SUCCESS;
+  }
+  if (c == '(' || c == ')') {
+    p->token = c == '(' ? TOKEN_OPEN : TOKEN_CLOSE;
+    p->pos++;
+    return SUCCESS;
+  }
+  char next = text[p->pos + 1];
+  if (c == '-' && next != '\0' && !isspace((unsigned char)next) && next != ')') {
+    p->token = TOKEN_NOT;
+    p->pos++;
+    return SUCCESS;
+  }
+
+  size_t length = 0;
+  bool quoted = false, was_quoted = false;
+  for (; text[p->pos] != '\0'; p->pos++) {
+    c = text[p->pos];
+    if (!quoted && (isspace((unsigned char)c) || c == '(' || c == ')'))
+      break;
+    if (c == '"') {
+      quoted = !quoted;
+      was_quoted = true;
+      continue;
+    }
+    if (length + 1 >= sizeof(p->term)) {
+      fprintf(stderr, "ERROR: Query term is too long.\n");
+      return FAILURE;
+    }
+    p->term[length++] = c;
+  }
+  p->term[length] = '\0';
+  if (quoted) {
+    fprintf(stderr, "ERROR: Unterminated quote in query.\n");
+    return FAILURE;
+  }
+
+  p->token = TOKEN_TERM;
+  if (!was_quoted && strcmp(p->term, "AND") == 0) {
+    p->token = TOKEN_AND;
+  } else if (!was_quoted && strcmp(p->term, "OR") == 0) {
+    p->token = TOKEN_OR;
+  } else if (!was_quoted && strcmp(p->term, "NOT") == 0) {
+    p->token = TOKEN_NOT;
+  }
+  return SUCCESS;
+}
+
+// Building the tree
+
+static int new_node(Query *query, QueryKind kind) {
+  if (query->count == QUERY_MAX_NODES) {
+    fprintf(stderr, "ERROR: Query has more than %d conditions.\n", QUERY_MAX_NODES);
+    return -1;
+  }
+  QueryNode *node = &query->nodes[query->count];
+  memset(node, 0, sizeof(*node));
+  node->kind = kind;
+  node->first_child = -1;
+  node->next_sibling = -1;
+  return query->count++;
+}
+
+static void add_child(Query *query, int parent, int child) {
+  int *link = &query->nodes[parent].first_child;
+  while (*link != -1) {
+    link = &query->nodes[*link].next_sibling;
+  }
+  *link = child;
+}
+
+// Parse a day, month or year as "2024-09-15", "2024-09" or "2024" into
+// the first and last IDs it covers
+static int parse_date(const char *str, uint64_t *first, uint64_t *last) {
+  size_t length = strlen(str);
+  if (length != 4 && length != 7 && length != 10)
+    return FAILURE;
+  for (size_t i = 0; i < length; i++) {
+    bool separator = i == 4 || i == 7;
+    if (separator ? str[i] != '-' : !isdigit((unsigned char)str[i]))
+      return FAILURE;
+  }
+  uint64_t year = strtoull(str, NULL, 10);
+  uint64_t month = length >= 7 ? strtoull(str + 5, NULL, 10) : 0;
+  uint64_t day = length == 10 ? strtoull(str + 8, NULL, 10) : 0;
+  if ((length >= 7 && (month < 1 || month > 12)) || (length == 10 && (day < 1 || day > 31)))
+    return FAILURE;
+
+  // Months are taken to have 31 days, which only IDs that can't exist tell apart
+  *first = year * 10000000000ULL + (month ? month : 1) * 100000000ULL + (day ? day : 1) * 1000000ULL;
+  *last = year * 10000000000ULL + (month ? month : 12) * 100000000ULL + (day ? day : 31) * 1000000ULL + 235959;
+  return SUCCESS;
+}
+
+static int parse_id(const char *str, uint64_t *first, uint64_t *last) {
+  if (strlen(str) != ID_LEN || !has_valid_id(str))
+    return FAILURE;
+  *first = *last = id_to_u64(str);
+  return SUCCESS;
+}
+
+// Parse "<a>", "<a>..<b>", "<a>.." or "..<b>" into an inclusive ID range
+static int parse_range(const char *value, int (*parse)(const char *, uint64_t *, uint64_t *), uint64_t *low,
+                       uint64_t *high) {
+  uint64_t first, last;
+  const char *dots = strstr(value, "..");
+  if (dots == NULL)
+    return parse(value, low, high);
+
+  char from[MAX_TITLE_LEN];
+  snprintf(from, sizeof(from), "%.*s", (int)(dots - value), value);
+  *low = 0;
+  *high = UINT64_MAX;
+  if (from[0] != '\0') {
+    if (parse(from, &first, &last) != SUCCESS)
+      return FAILURE;
+    *low = first;
+  }
+  if (dots[2] != '\0') {
+    if (parse(dots + 2, &first, &last) != SUCCESS)
+      return FAILURE;
+    *high = last;
+  }
+  return from[0] != '\0' || dots[2] != '\0' ? SUCCESS : FAILURE;
+}
+
+// Strip a trailing `*`, returning whether there was one
+static bool strip_star(char *value) {
+  size_t length = strlen(value);
+  if (length == 0 || value[length - 1] != '*')
+    return false;
+  value[length - 1] = '\0';
+  return true;
+}
+
+// Make a node for the condition `field` `op` `value`, as in kw:ml
+static int condition_node(Query *query, const char *field, char op, const char *value) {
+  if (value[0] == '\0') {
+    fprintf(stderr, "ERROR: %s%c expects a value.\n", field, op);
+    return -1;
+  }
+  char copy[MAX_TITLE_LEN];
+  snprintf(copy, sizeof(copy), "%s", value);
+  QueryNode node = {.first_child = -1, .next_sibling = -1};
+  bool valid = true;
+
+  if (strcmp(field, "kw") == 0 && op == ':') {
+    node.kind = strip_star(copy) ? QUERY_KEYWORD_PREFIX : QUERY_KEYWORD;
+    sluggify_keyword(copy);
+  } else if (strcmp(field, "sig") == 0 && op == ':') {
+    node.kind = strip_star(copy) ? QUERY_SIGNATURE_TREE : QUERY_SIGNATURE;
+    copy[MAX_SIG_LEN - 1] = '\0';
+    sluggify_signature(copy);
+    signature_key(copy, node.key, &node.key_length);
+  } else if ((strcmp(field, "id") == 0 || strcmp(field, "date") == 0) && op == ':') {
+    node.kind = QUERY_ID_RANGE;
+    valid = parse_range(copy, field[0] == 'i' ? parse_id : parse_date, &node.low, &node.high) == SUCCESS;
+  } else if (strcmp(field, "title") == 0) {
+    node.kind = op == ':' ? QUERY_TITLE : QUERY_TITLE_CONTAINS;
+    sluggify_title(copy);
+  } else if (strcmp(field, "body") == 0 && op == '~') {
+    node.kind = QUERY_BODY_CONTAINS;
+    downcase(copy);
+  } else {
+    valid = false;
+  }
+  if (!valid) {
+    fprintf(stderr, "ERROR: Unknown query condition %s%c%s\n", field, op, value);
+    return -1;
+  }
+
+  int index = new_node(query, node.kind);
+  if (index == -1)
+    return -1;
+  snprintf(node.value, sizeof(node.value), "%s", copy);
+  query->nodes[index] = node;
+  return index;
+}
+
+// A term is a condition when it starts with a field name and : or ~, and a
+// plain search term otherwise
+static int term_node(Query *query, const char *term) {
+  static const char *fields[] = {"kw", "sig", "id", "date", "title", "body"};
+  size_t split = strcspn(term, ":~");
+  for (size_t i = 0; term[split] != '\0' && i < sizeof(fields) / sizeof(fields[0]); i++) {
+    if (strlen(fields[i]) == split && strncmp(term, fields[i], split) == 0)
+      return condition_node(query, fields[i], term[split], term + split + 1);
+  }
+
+  int index = new_node(query, QUERY_TEXT);
+  if (index == -1)
+    return -1;
+  snprintf(query->nodes[index].value, MAX_TITLE_LEN, "%s", term);
+  downcase(query->nodes[index].value);
+  return index;
+}
+
+static int parse_or(Parser *p);
+
+static int parse_unary(Parser *p) {
+  if (p->depth >= QUERY_MAX_DEPTH) {
+    fprintf(stderr, "ERROR: Query is nested too deeply.\n");
+    return -1;
+  }
+
+  int node = -1;
+  if (p->token == TOKEN_NOT) {
+    p->depth++;
+    int child = advance(p) == SUCCESS ? parse_unary(p) : -1;
+    p->depth--;
+    node = child != -1 ? new_node(p->query, QUERY_NOT) : -1;
+    if (node != -1)
+      add_child(p->query, node, child);
+  } else if (p->token == TOKEN_OPEN) {
+    p->depth++;
+    node = advance(p) == SUCCESS ? parse_or(p) : -1;
+    p->depth--;
+    if (node != -1 && p->token != TOKEN_CLOSE) {
+      fprintf(stderr, "ERROR: Missing ) in query.\n");
+      return -1;
+    }
+    if (node != -1 && advance(p) != SUCCESS)
+      return -1;
+  } else if (p->token == TOKEN_TERM) {
+    node = term_node(p->query, p->term);
+    if (node != -1 && advance(p) != SUCCESS)
+      return -1;
+  } else {
+    fprintf(stderr, "ERROR: Expected a condition in query at \"%s\".\n", p->text + p->pos);
+  }
+  return node;
+}
+
+// Conditions side by side are joined with AND
+static int parse_and(Parser *p) {
+  int left = parse_unary(p);
+  int node = left;
+  while (left != -1 &&
+         (p->token == TOKEN_AND || p->token == TOKEN_TERM || p->token == TOKEN_OPEN || p->token == TOKEN_NOT)) {
+    if (p->token == TOKEN_AND && advance(p) != SUCCESS)
+      return -1;
+    int right = parse_unary(p);
+    if (right == -1)
+      return -1;
+    if (node == left) {
+      node = new_node(p->query, QUERY_AND);
+      if (node == -1)
+        return -1;
+      add_child(p->query, node, left);
+    }
+    add_child(p->query, node, right);
+  }
+  return node;
+}
+
+static int parse_or(Parser *p) {
+  int left = parse_and(p);
+  int node = left;
+  while (left != -1 && p->token == TOKEN_OR) {
+    int right = advance(p) == SUCCESS ? parse_and(p) : -1;
+    if (right == -1)
+      return -1;
+    if (node == left) {
+      node = new_node(p->query, QUERY_OR);
+      if (node == -1)
+        return -1;
+      add_child(p->query, node, left);
+    }
+    add_child(p->query, node, right);
+  }
+  return node;
+}
+
+// Parse `text` into `query`. An empty query matches every note.
+int query_parse(Query *query, const char *text) {
+  query->count = 0;
+  query->root = -1;
+  Parser p = {.query = query, .text = text};
+  if (advance(&p) != SUCCESS)
+    return FAILURE;
+  if (p.token == TOKEN_END) {
+    query->root = new_node(query, QUERY_AND);
+    return SUCCESS;
+  }
+
+  query->root = parse_or(&p);
+  if (query->root == -1)
+    return FAILURE;
+  if (p.token != TOKEN_END) {
+    fprintf(stderr, "ERROR: Unexpected %s in query.\n", p.token == TOKEN_CLOSE ? ")" : "condition");
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+// Join the condition `field` `op` `value` to the query with AND
+int query_add(Query *query, const char *field, char op, const char *value) {
+  int node = condition_node(query, field, op, value);
+  if (node == -1)
+    return FAILURE;
+  if (query->nodes[query->root].kind != QUERY_AND) {
+    int root = new_node(query, QUERY_AND);
+    if (root == -1)
+      return FAILURE;
+    add_child(query, root, query->root);
+    query->root = root;
+  }
+  add_child(query, query->root, node);
+  return SUCCESS;
+}
+
+// Planning
+
+// How costly checking a condition against one note is: reading the note
+// last, after everything answered from the index
+static int check_cost(const Query *query, int node) {
+  const QueryNode *n = &query->nodes[node];
+  switch (n->kind) {
+  case QUERY_BODY_CONTAINS:
+    return 2;
+  case QUERY_TITLE:
+  case QUERY_TITLE_CONTAINS:
+  case QUERY_TEXT:
+  case QUERY_KEYWORD_PREFIX:
+    return 1;
+  case QUERY_AND:
+  case QUERY_OR:
+  case QUERY_NOT: {
+    int cost = 0;
+    for (int child = n->first_child; child != -1; child = query->nodes[child].next_sibling) {
+      int child_cost = check_cost(query, child);
+      cost = child_cost > cost ? child_cost : cost;
+    }
+    return cost;
+  }
+  default:
+    return 0;
+  }
+}
+
+static size_t id_range_count(const NoteIndex *index, uint64_t low, uint64_t high) {
+  if (low > high)
+    return 0;
+  size_t end = high == UINT64_MAX ? index->count : index_lower_bound(index, high + 1);
+  return end - index_lower_bound(index, low);
+}
+
+// Estimate the matches of `node` from the indexes, and order the children
+// of each AND and OR so the cheapest checks come first
+static size_t plan_node(Query *query, NoteIndex *index, const SignatureIndex *sigs, int node) {
+  QueryNode *n = &query->nodes[node];
+  const uint32_t *notes;
+  uint32_t handle;
+  size_t start, end;
+  switch (n->kind) {
+  case QUERY_KEYWORD:
+    n->estimate = keyword_lookup(&index->keywords, n->value, &handle) ? index_keyword_notes(index, handle, &notes) : 0;
+    break;
+  case QUERY_KEYWORD_PREFIX:
+    n->estimate = 0;
+    for (uint32_t k = 0; k < index->keywords.count; k++) {
+      if (strncmp(index->keywords.names[k], n->value, strlen(n->value)) == 0)
+        n->estimate += index_keyword_notes(index, k, &notes);
+    }
+    break;
+  case QUERY_SIGNATURE:
+  case QUERY_SIGNATURE_TREE:
+    n->estimate = QUERY_UNINDEXED;
+    if (sigs != NULL) {
+      signature_subtree(sigs, n->value, &start, &end);
+      n->estimate = end - start;
+    }
+    break;
+  case QUERY_ID_RANGE:
+    n->estimate = id_range_count(index, n->low, n->high);
+    break;
+  case QUERY_AND:
+  case QUERY_OR: {
+    // An AND is answered by its most selective child, an OR by all of them
+    bool and = n->kind == QUERY_AND;
+    n->estimate = and ? QUERY_UNINDEXED : 0;
+    if (n->first_child == -1)
+      break;
+    int children[QUERY_MAX_NODES];
+    int count = 0;
+    for (int child = n->first_child; child != -1; child = query->nodes[child].next_sibling) {
+      size_t estimate = plan_node(query, index, sigs, child);
+      if (and && estimate < n->estimate) {
+        n->estimate = estimate;
+      } else if (!and && (estimate == QUERY_UNINDEXED || n->estimate == QUERY_UNINDEXED)) {
+        n->estimate = QUERY_UNINDEXED;
+      } else if (!and) {
+        n->estimate += estimate;
+      }
+      // Insertion sort by cost, keeping the order of equals
+      int pos = count++;
+      while (pos > 0 && check_cost(query, children[pos - 1]) > check_cost(query, child)) {
+        children[pos] = children[pos - 1];
+        pos--;
+      }
+      children[pos] = child;
+    }
+    n->first_child = children[0];
+    for (int i = 0; i < count; i++) {
+      query->nodes[children[i]].next_sibling = i + 1 < count ? children[i + 1] : -1;
+    }
+    break;
+  }
+  default:
+    n->estimate = QUERY_UNINDEXED;
+  }
+  return n->estimate;
+}
+
+static void positions_add(Positions *positions, size_t position) {
+  if (positions->count == positions->capacity) {
+    size_t capacity = positions->capacity ? positions->capacity * 2 : 64;
+    size_t *items = realloc(positions->items, capacity * sizeof(size_t));
+    if (items == NULL) {
+      positions->failed = true;
+      return;
+    }
+    positions->items = items;
+    positions->capacity = capacity;
+  }
+  positions->items[positions->count++] = position;
+}
+
+static int compare_positions(const void *a, const void *b) {
+  size_t x = *(const size_t *)a;
+  size_t y = *(const size_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Add the notes the indexes give for `node`, a superset of its matches
+static void collect_node(const Query *query, NoteIndex *index, const SignatureIndex *sigs, int node,
+                         Positions *dest) {
+  const QueryNode *n = &query->nodes[node];
+  const uint32_t *notes;
+  uint32_t handle;
+  size_t count, start, end;
+  switch (n->kind) {
+  case QUERY_KEYWORD:
+    count = keyword_lookup(&index->keywords, n->value, &handle) ? index_keyword_notes(index, handle, &notes) : 0;
+    for (size_t i = 0; i < count; i++) {
+      positions_add(dest, notes[i]);
+    }
+    break;
+  case QUERY_KEYWORD_PREFIX:
+    for (uint32_t k = 0; k < index->keywords.count; k++) {
+      if (strncmp(index->keywords.names[k], n->value, strlen(n->value)) != 0)
+        continue;
+      count = index_keyword_notes(index, k, &notes);
+      for (size_t i = 0; i < count; i++) {
+        positions_add(dest, notes[i]);
+      }
+    }
+    break;
+  case QUERY_SIGNATURE:
+  case QUERY_SIGNATURE_TREE:
+    signature_subtree(sigs, n->value, &start, &end);
+    for (size_t i = start; i < end; i++) {
+      positions_add(dest, sigs->notes[i]);
+    }
+    break;
+  case QUERY_ID_RANGE:
+    if (n->low <= n->high) {
+      end = n->high == UINT64_MAX ? index->count : index_lower_bound(index, n->high + 1);
+      for (size_t i = index_lower_bound(index, n->low); i < end; i++) {
+        positions_add(dest, i);
+      }
+    }
+    break;
+  case QUERY_AND: {
+    int driver = -1;
+    for (int child = n->first_child; child != -1; child = query->nodes[child].next_sibling) {
+      if (driver == -1 || query->nodes[child].estimate < query->nodes[driver].estimate)
+        driver = child;
+    }
+    collect_node(query, index, sigs, driver, dest);
+    break;
+  }
+  case QUERY_OR:
+    for (int child = n->first_child; child != -1; child = query->nodes[child].next_sibling) {
+      collect_node(query, index, sigs, child, dest);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// Matching
+
+// Whether the file of `note` contains `needle`, which is lower case,
+// ignoring case
+static bool body_contains(const NoteIndex *index, const NoteRecord *note, const char *needle) {
+  if (is_attachment(note->name))
+    return false;
+  char path[2 * MAX_PATH_LEN];
+  index_note_path(index, note, path, sizeof(path));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return false;
+  struct stat st;
+  size_t needle_length = strlen(needle);
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < needle_length || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  size_t length = (size_t)st.st_size;
+  const char *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  // Read once front to back, so the kernel may read ahead and drop behind
+  madvise((void *)data, length, MADV_SEQUENTIAL);
+
+  bool found = false;
+  char first = needle[0];
+  char first_upper = (char)toupper((unsigned char)first);
+  for (size_t i = 0; !found && i + needle_length <= length; i++) {
+    if (data[i] != first && data[i] != first_upper)
+      continue;
+    size_t j = 1;
+    while (j < needle_length && tolower((unsigned char)data[i + j]) == (unsigned char)needle[j]) {
+      j++;
+    }
+    found = j == needle_length;
+  }
+  munmap((void *)data, length);
+  return found;
+}
+
+static bool signature_matches(const QueryNode *n, const NoteRecord *note) {
+  if (note->sig[0] == '\0')
+    return false;
+  uint8_t key[SIGNATURE_KEY_LEN];
+  size_t length;
+  signature_key(note->sig, key, &length);
+  if (n->kind == QUERY_SIGNATURE)
+    return length == n->key_length && memcmp(key, n->key, length) == 0;
+  // Levels carry their lengths, so a key prefix is a whole number of levels
+  return length >= n->key_length && memcmp(key, n->key, n->key_length) == 0;
+}
+
+static bool node_matches(const Query *query, const NoteIndex *index, const NoteRecord *note, int node) {
+  const QueryNode *n = &query->nodes[node];
+  uint32_t handle;
+  switch (n->kind) {
+  case QUERY_AND:
+    for (int child = n->first_child; child != -1; child = query->nodes[child].next_sibling) {
+      if (!node_matches(query, index, note, child))
+        return false;
+    }
+    return true;
+  case QUERY_OR:
+    for (int child = n->first_child; child != -1; child = query->nodes[child].next_sibling) {
+      if (node_matches(query, index, note, child))
+        return true;
+    }
+    return false;
+  case QUERY_NOT:
+    return !node_matches(query, index, note, n->first_child);
+  case QUERY_KEYWORD:
+    return keyword_lookup(&index->keywords, n->value, &handle) && note_has_keyword(note, handle);
+  case QUERY_KEYWORD_PREFIX:
+    for (uint32_t i = 0; i < note->kw_count; i++) {
+      if (strncmp(index->keywords.names[note->kw[i]], n->value, strlen(n->value)) == 0)
+        return true;
+    }
+    return false;
+  case QUERY_SIGNATURE:
+  case QUERY_SIGNATURE_TREE:
+    return signature_matches(n, note);
+  case QUERY_ID_RANGE:
+    return note->id >= n->low && note->id <= n->high;
+  case QUERY_TITLE:
+    return strcmp(note->title, n->value) == 0;
+  case QUERY_TITLE_CONTAINS:
+    return strstr(note->title, n->value) != NULL;
+  case QUERY_BODY_CONTAINS:
+    return body_contains(index, note, n->value);
+  case QUERY_TEXT: {
+    // Free text terms may match any component
+    bool found = strstr(note->title, n->value) != NULL || strstr(note->sig, n->value) != NULL ||
+                 strcasestr(note->full_title, n->value) != NULL;
+    for (uint32_t i = 0; !found && i < note->kw_count; i++) {
+      found = strstr(index->keywords.names[note->kw[i]], n->value) != NULL;
+    }
+    return found;
+  }
+  }
+  return false;
+}
+
+bool query_matches(const Query *query, const NoteIndex *index, const NoteRecord *note) {
+  return node_matches(query, index, note, query->root);
+}
+
+// Find the notes matching `query`, as positions in ID order. `sigs` is the
+// signature index of `index` if there is a current one, or NULL. The caller
+// frees `results`.
+int query_run(Query *query, NoteIndex *index, const SignatureIndex *sigs, size_t **results, size_t *count) {
+  *results = NULL;
+  *count = 0;
+  size_t estimate = plan_node(query, index, sigs, query->root);
+
+  Positions candidates = {0};
+  if (estimate == QUERY_UNINDEXED) {
+    debug_printf("Query plan: check all %zu notes.\n", index->count);
+    for (size_t i = 0; i < index->count; i++) {
+      if (query_matches(query, index, &index->notes[i]))
+        positions_add(&candidates, i);
+    }
+  } else {
+    collect_node(query, index, sigs, query->root, &candidates);
+    if (candidates.count > 1)
+      qsort(candidates.items, candidates.count, sizeof(size_t), compare_positions);
+    debug_printf("Query plan: check %zu of %zu notes found through the indexes.\n", candidates.count, index->count);
+    size_t kept = 0;
+    for (size_t i = 0; i < candidates.count; i++) {
+      if (i > 0 && candidates.items[i] == candidates.items[i - 1])
+        continue;
+      if (query_matches(query, index, &index->notes[candidates.items[i]]))
+        candidates.items[kept++] = candidates.items[i];
+    }
+    candidates.count = kept;
+  }
+
+  if (candidates.failed) {
+    free(candidates.items);
+    fprintf(stderr, "ERROR: Out of memory running query.\n");
+    return FAILURE;
+  }
+  *results = candidates.items;
+  *count = candidates.count;
+  return SUCCESS;
+}
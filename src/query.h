@@ -0,0 +1,74 @@
+#ifndef QUERY_H_
+#define QUERY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "index.h"
+#include "signature.h"
+#include "utils.h"
+
+// Search queries combine conditions on the filename components, the ID and
+// the note body:
+//   kw:project     has the keyword; kw:proj* has one starting with it
+//   sig:12a        has the signature; sig:12a* also its descendants
+//   id:<ID>        has the ID; id:<ID>..<ID> lies in the range
+//   date:2024-09   was created then: a year, a month or a day, or a range
+//                  of them as 2024-09..2024-12, 2024-09.. or ..2024
+//   title:meeting  has the title; title~meet has it anywhere in the title
+//   body~budget    has it in the body, ignoring case
+//   word           appears in any component, as a plain search term does
+// Conditions are joined with AND, which may be left out, OR and NOT, or a
+// leading -, and grouped with parentheses. Values with spaces are quoted.
+//
+// The planner answers the most selective condition it can from an index,
+// the keyword postings, the ID order of the notes or the signature index,
+// and only checks the notes it yields against the rest of the query, so
+// the work grows with the matches rather than the vault. Queries with no
+// such condition fall back to checking every note, body conditions last.
+#define QUERY_MAX_LEN 1024
+#define QUERY_MAX_NODES 64
+#define QUERY_MAX_DEPTH 32
+// Estimate of a condition no index can answer
+#define QUERY_UNINDEXED ((size_t)-1)
+
+typedef enum {
+  QUERY_AND,
+  QUERY_OR,
+  QUERY_NOT,
+  QUERY_KEYWORD,
+  QUERY_KEYWORD_PREFIX,
+  QUERY_SIGNATURE,
+  QUERY_SIGNATURE_TREE,
+  QUERY_ID_RANGE,
+  QUERY_TITLE,
+  QUERY_TITLE_CONTAINS,
+  QUERY_BODY_CONTAINS,
+  QUERY_TEXT,
+} QueryKind;
+
+typedef struct {
+  QueryKind kind;
+  int first_child; // Children of AND, OR and NOT, -1 for none
+  int next_sibling;
+  uint64_t low; // ID range, inclusive
+  uint64_t high;
+  char value[MAX_TITLE_LEN];
+  uint8_t key[SIGNATURE_KEY_LEN]; // Sort key of a signature
+  size_t key_length;
+  size_t estimate; // Matches the planner expects, or QUERY_UNINDEXED
+} QueryNode;
+
+typedef struct {
+  QueryNode nodes[QUERY_MAX_NODES];
+  int count;
+  int root;
+} Query;
+
+int query_parse(Query *query, const char *text);
+int query_add(Query *query, const char *field, char op, const char *value);
+int query_run(Query *query, NoteIndex *index, const SignatureIndex *sigs, size_t **results, size_t *count);
+bool query_matches(const Query *query, const NoteIndex *index, const NoteRecord *note);
+
+#endif // QUERY_H_
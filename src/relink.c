@@ -0,0 +1,310 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "relink.h"
+#include "stats.h"
+#include "utils.h"
+
+// A renamed note, looked up by the link key of its old name
+typedef struct {
+  uint64_t key;
+  const RelinkMove *move;
+} MoveKey;
+
+typedef struct {
+  const NoteIndex *index;
+  const MoveKey *keys;
+  size_t key_count;
+  const size_t *notes; // Positions of the notes linking to a renamed one
+  size_t count;
+  bool *changed;
+  int *outcomes;
+  size_t next;
+  pthread_mutex_t lock;
+  int dir_fd;
+  FsyncPolicy fsync_policy;
+} RelinkBatch;
+
+static int compare_move_keys(const void *a, const void *b) {
+  const MoveKey *x = a;
+  const MoveKey *y = b;
+  return (x->key > y->key) - (x->key < y->key);
+}
+
+// The move whose old name is `name`, or NULL
+static const RelinkMove *find_move(const RelinkBatch *batch, const char *name, size_t length) {
+  uint64_t key = link_name_key(name, length);
+  size_t lo = 0;
+  size_t hi = batch->key_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (batch->keys[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  // Names whose hashes collide are told apart here
+  for (size_t i = lo; i < batch->key_count && batch->keys[i].key == key; i++) {
+    if (strcmp(batch->keys[i].move->old_name, name) == 0)
+      return batch->keys[i].move;
+  }
+  return NULL;
+}
+
+static int add_slice(struct iovec **iov, size_t *count, size_t *capacity, const char *data, size_t length) {
+  if (length == 0)
+    return SUCCESS;
+  if (*count == *capacity) {
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    struct iovec *grown = realloc(*iov, new_capacity * sizeof(struct iovec));
+    if (grown == NULL)
+      return FAILURE;
+    *iov = grown;
+    *capacity = new_capacity;
+  }
+  (*iov)[*count].iov_base = (void *)data;
+  (*iov)[*count].iov_len = length;
+  (*count)++;
+  return SUCCESS;
+}
+
+// Write all of `iov`, at most IOV_MAX slices per call, picking up after
+// short writes
+static int writev_all(int fd, struct iovec *iov, size_t count) {
+  while (count > 0) {
+    int chunk = count > IOV_MAX ? IOV_MAX : (int)count;
+    ssize_t n = writev(fd, iov, chunk);
+    STATS_SYSCALL(SYS_WRITE, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FAILURE;
+    while (count > 0 && (size_t)n >= iov->iov_len) {
+      n -= (ssize_t)iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= (size_t)n;
+    }
+  }
+  return SUCCESS;
+}
+
+// Rewrite the links of `name` to renamed notes. The file is mapped and
+// written out as the slices between those links with the new names spliced
+// in, so nothing is copied in memory. Sets `changed` if a link was rewritten.
+static int relink_file(const RelinkBatch *batch, const char *name, bool *changed) {
+  *changed = false;
+  int fd = openat(batch->dir_fd, name, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+  struct stat st;
+  STATS_SYSCALL(SYS_STAT, 1);
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return FAILURE;
+  }
+  size_t length = (size_t)st.st_size;
+  if (length == 0) {
+    close(fd);
+    return SUCCESS;
+  }
+  char *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return FAILURE;
+
+  struct iovec *iov = NULL;
+  size_t iov_count = 0, iov_capacity = 0;
+  size_t cursor = 0, copied = 0, name_start, name_end;
+  char link_name[MAX_PATH_LEN];
+  int outcome = SUCCESS;
+  while (outcome == SUCCESS && next_file_link(data, length, &cursor, &name_start, &name_end)) {
+    size_t link_length = decode_link_name(data + name_start, name_end - name_start, link_name, MAX_PATH_LEN);
+    const RelinkMove *move = link_length > 0 ? find_move(batch, link_name, link_length) : NULL;
+    if (move == NULL)
+      continue;
+    outcome = add_slice(&iov, &iov_count, &iov_capacity, data + copied, name_start - copied);
+    if (outcome == SUCCESS)
+      outcome = add_slice(&iov, &iov_count, &iov_capacity, move->new_name, strlen(move->new_name));
+    copied = name_end;
+    *changed = true;
+  }
+  if (outcome == SUCCESS && *changed)
+    outcome = add_slice(&iov, &iov_count, &iov_capacity, data + copied, length - copied);
+
+  if (outcome == SUCCESS && *changed) {
+    char temp_name[sizeof(RELINK_TEMP_PREFIX) + MAX_PATH_LEN];
+    snprintf(temp_name, sizeof(temp_name), "%s%s", RELINK_TEMP_PREFIX, name);
+    fd = openat(batch->dir_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+    STATS_SYSCALL(SYS_OPEN, 1);
+    outcome = fd == -1 ? FAILURE : writev_all(fd, iov, iov_count);
+    if (outcome == SUCCESS && batch->fsync_policy != FSYNC_NONE) {
+      outcome = fsync(fd) == 0 ? SUCCESS : FAILURE;
+      STATS_SYSCALL(SYS_FSYNC, 1);
+    }
+    if (fd != -1 && close(fd) == -1)
+      outcome = FAILURE;
+    if (outcome == SUCCESS) {
+      outcome = renameat(batch->dir_fd, temp_name, batch->dir_fd, name) == 0 ? SUCCESS : FAILURE;
+      STATS_SYSCALL(SYS_RENAME, 1);
+    }
+    if (outcome != SUCCESS && fd != -1)
+      unlinkat(batch->dir_fd, temp_name, 0);
+  }
+
+  free(iov);
+  munmap(data, length);
+  return outcome;
+}
+
+static void *relink_worker(void *arg) {
+  RelinkBatch *batch = arg;
+  for (;;) {
+    pthread_mutex_lock(&batch->lock);
+    size_t i = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+    if (i >= batch->count)
+      break;
+    const NoteRecord *note = &batch->index->notes[batch->notes[i]];
+    batch->outcomes[i] = relink_file(batch, note->name, &batch->changed[i]);
+  }
+  return NULL;
+}
+
+// Rewrite the links to each of `moves` in the notes of `index`, which must
+// already know the notes under their new names, and bring the index up to
+// date with the rewritten notes. `rewritten` is set to how many there were.
+int relink_notes(NoteIndex *index, RelinkMove *moves, size_t count, FsyncPolicy fsync_policy, size_t *rewritten) {
+  *rewritten = 0;
+  if (count == 0 || index->count == 0)
+    return SUCCESS;
+
+  MoveKey *keys = malloc(count * sizeof(MoveKey));
+  size_t *found = malloc(index->count * sizeof(size_t));
+  size_t *notes = malloc(index->count * sizeof(size_t));
+  bool *linking = calloc(index->count, sizeof(bool));
+  if (keys == NULL || found == NULL || notes == NULL || linking == NULL) {
+    free(keys);
+    free(found);
+    free(notes);
+    free(linking);
+    return FAILURE;
+  }
+
+  // The notes linking to any old name, each once
+  for (size_t i = 0; i < count; i++) {
+    keys[i].key = link_name_key(moves[i].old_name, strlen(moves[i].old_name));
+    keys[i].move = &moves[i];
+    size_t found_count = index_backlinks(index, keys[i].key, found, index->count);
+    for (size_t j = 0; j < found_count; j++) {
+      linking[found[j]] = true;
+    }
+  }
+  qsort(keys, count, sizeof(MoveKey), compare_move_keys);
+  size_t note_count = 0;
+  for (size_t i = 0; i < index->count; i++) {
+    if (linking[i])
+      notes[note_count++] = i;
+  }
+  free(found);
+  free(linking);
+  if (note_count == 0) {
+    free(keys);
+    free(notes);
+    return SUCCESS;
+  }
+
+  int dir_fd = open(index->dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open %s\n", index->dir_path);
+    free(keys);
+    free(notes);
+    return FAILURE;
+  }
+
+  RelinkBatch batch = {
+      .index = index,
+      .keys = keys,
+      .key_count = count,
+      .notes = notes,
+      .count = note_count,
+      .changed = calloc(note_count, sizeof(bool)),
+      .outcomes = calloc(note_count, sizeof(int)),
+      .dir_fd = dir_fd,
+      .fsync_policy = fsync_policy,
+  };
+  int outcome = batch.changed != NULL && batch.outcomes != NULL ? SUCCESS : FAILURE;
+  if (outcome == SUCCESS) {
+    pthread_mutex_init(&batch.lock, NULL);
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = cores > 0 ? (int)cores : 1;
+    if (thread_count > RELINK_MAX_THREADS)
+      thread_count = RELINK_MAX_THREADS;
+    pthread_t threads[RELINK_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < thread_count && (size_t)i < note_count; i++) {
+      if (pthread_create(&threads[i], NULL, relink_worker, &batch) != 0)
+        break;
+      started++;
+    }
+    // Without threads, do the work here
+    if (started == 0)
+      relink_worker(&batch);
+    for (int i = 0; i < started; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&batch.lock);
+  }
+
+  // The index reads each rewritten note again. Names are copied first, since
+  // updating a note frees its old record.
+  char name[MAX_PATH_LEN];
+  for (size_t i = 0; outcome == SUCCESS && i < note_count; i++) {
+    const NoteRecord *note = &index->notes[notes[i]];
+    if (batch.outcomes[i] != SUCCESS) {
+      fprintf(stderr, "ERROR: Could not update links in %s%s\n", index->dir_path, note->name);
+      continue;
+    }
+    if (!batch.changed[i])
+      continue;
+    (*rewritten)++;
+    snprintf(name, sizeof(name), "%s", note->name);
+    index_update_note(index, name);
+  }
+  for (size_t i = 0; outcome == SUCCESS && i < note_count; i++) {
+    if (batch.outcomes[i] != SUCCESS)
+      outcome = FAILURE;
+  }
+
+  if (*rewritten > 0 && fsync_policy == FSYNC_DIR) {
+    STATS_SYSCALL(SYS_FSYNC, 1);
+    if (fsync(dir_fd) == -1) {
+      fprintf(stderr, "ERROR: Could not flush %s\n", index->dir_path);
+      outcome = FAILURE;
+    }
+  }
+
+  close(dir_fd);
+  free(batch.changed);
+  free(batch.outcomes);
+  free(keys);
+  free(notes);
+  return outcome;
+}
@@ -0,0 +1,25 @@
+#ifndef RELINK_H_
+#define RELINK_H_
+
+#include <stddef.h>
+
+#include "index.h"
+#include "utils.h"
+
+// After notes are renamed, the notes linking to them by file name are found
+// through the index's link graph and their links rewritten to the new names.
+// Each note is edited in one pass into a temporary file beside it, which is
+// then renamed over it, so a note is never left half rewritten. Notes are
+// rewritten in parallel. Readdir skips the temporary files, since their
+// names have no ID.
+#define RELINK_MAX_THREADS 16
+#define RELINK_TEMP_PREFIX ".connote-relink-"
+
+typedef struct {
+  char old_name[MAX_PATH_LEN]; // Basenames in the vault
+  char new_name[MAX_PATH_LEN];
+} RelinkMove;
+
+int relink_notes(NoteIndex *index, RelinkMove *moves, size_t count, FsyncPolicy fsync_policy, size_t *rewritten);
+
+#endif // RELINK_H_
@@ -0,0 +1,341 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+#include "signature.h"
+#include "utils.h"
+
+// Kinds of level, in the order they sort
+#define LEVEL_NUMBER 1
+#define LEVEL_LETTERS 2
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Write the sort key of `sig` into `key`, which must hold SIGNATURE_KEY_LEN
+// bytes, and its length into `length`. Returns the number of levels.
+int signature_key(const char *sig, uint8_t *key, size_t *length) {
+  size_t pos = 0;
+  int depth = 0;
+  const char *cursor = sig;
+  while (*cursor != '\0' && cursor - sig < MAX_SIG_LEN) {
+    if (*cursor == '=') {
+      cursor++;
+      continue;
+    }
+
+    const char *start = cursor;
+    bool number = is_digit(*cursor);
+    while (*cursor != '\0' && *cursor != '=' && is_digit(*cursor) == number && cursor - sig < MAX_SIG_LEN) {
+      cursor++;
+    }
+    if (number) {
+      while (start < cursor && *start == '0') {
+        start++;
+      }
+    }
+
+    key[pos++] = number ? LEVEL_NUMBER : LEVEL_LETTERS;
+    key[pos++] = (uint8_t)(cursor - start);
+    memcpy(key + pos, start, (size_t)(cursor - start));
+    pos += (size_t)(cursor - start);
+    depth++;
+  }
+
+  *length = pos;
+  return depth;
+}
+
+static int compare_keys(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len) {
+  int order = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  if (order != 0)
+    return order;
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+// Orders signatures as they appear in the sequence
+int signature_compare(const char *a, const char *b) {
+  uint8_t a_key[SIGNATURE_KEY_LEN], b_key[SIGNATURE_KEY_LEN];
+  size_t a_len, b_len;
+  signature_key(a, a_key, &a_len);
+  signature_key(b, b_key, &b_len);
+  return compare_keys(a_key, a_len, b_key, b_len);
+}
+
+// Length of the first `depth` levels of `key`
+static size_t key_prefix(const uint8_t *key, size_t depth) {
+  size_t pos = 0;
+  for (size_t level = 0; level < depth; level++) {
+    pos += 2 + key[pos + 1];
+  }
+  return pos;
+}
+
+typedef struct {
+  const uint8_t *keys;
+  const uint32_t *starts;
+} SortContext;
+
+static int compare_entries(const void *a, const void *b, void *ctx) {
+  const SortContext *sort = ctx;
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  int order = compare_keys(sort->keys + sort->starts[x], sort->starts[x + 1] - sort->starts[x],
+                           sort->keys + sort->starts[y], sort->starts[y + 1] - sort->starts[y]);
+  // Notes sharing a signature stay in ID order
+  return order != 0 ? order : (x > y) - (x < y);
+}
+
+int signature_index_build(SignatureIndex *sigs, const NoteIndex *index) {
+  memset(sigs, 0, sizeof(*sigs));
+  size_t count = 0;
+  for (size_t i = 0; i < index->count; i++) {
+    count += index->notes[i].sig[0] != '\0';
+  }
+
+  // Keys are made in ID order, then sorted through a permutation
+  uint32_t *order = malloc((count ? count : 1) * sizeof(uint32_t));
+  uint32_t *starts = malloc((count + 1) * sizeof(uint32_t));
+  uint8_t *keys = malloc((count ? count : 1) * SIGNATURE_KEY_LEN);
+  uint32_t *notes = malloc((count ? count : 1) * sizeof(uint32_t));
+  uint8_t *depths = malloc(count ? count : 1);
+  sigs->notes = malloc((count ? count : 1) * sizeof(uint32_t));
+  sigs->starts = malloc((count + 1) * sizeof(uint32_t));
+  sigs->depths = malloc(count ? count : 1);
+  if (order == NULL || starts == NULL || keys == NULL || notes == NULL || depths == NULL || sigs->notes == NULL ||
+      sigs->starts == NULL || sigs->depths == NULL)
+    goto fail;
+
+  size_t entry = 0;
+  size_t length = 0;
+  for (size_t i = 0; i < index->count; i++) {
+    if (index->notes[i].sig[0] == '\0')
+      continue;
+    size_t key_length;
+    int depth = signature_key(index->notes[i].sig, keys + length, &key_length);
+    if (depth == 0)
+      continue; // Nothing but separators
+    starts[entry] = (uint32_t)length;
+    depths[entry] = (uint8_t)depth;
+    notes[entry] = (uint32_t)i;
+    order[entry] = (uint32_t)entry;
+    length += key_length;
+    entry++;
+  }
+  count = entry;
+  starts[count] = (uint32_t)length;
+
+  SortContext sort = {.keys = keys, .starts = starts};
+  qsort_r(order, count, sizeof(uint32_t), compare_entries, &sort);
+
+  sigs->keys = malloc(length ? length : 1);
+  if (sigs->keys == NULL)
+    goto fail;
+  size_t pos = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint32_t from = order[i];
+    size_t key_length = starts[from + 1] - starts[from];
+    sigs->starts[i] = (uint32_t)pos;
+    memcpy(sigs->keys + pos, keys + starts[from], key_length);
+    pos += key_length;
+    sigs->notes[i] = notes[from];
+    sigs->depths[i] = depths[from];
+  }
+  sigs->starts[count] = (uint32_t)pos;
+  sigs->count = count;
+  sigs->source = index;
+  sigs->source_generation = index->generation;
+
+  free(order);
+  free(starts);
+  free(keys);
+  free(notes);
+  free(depths);
+  return SUCCESS;
+
+fail:
+  fprintf(stderr, "ERROR: Could not allocate the signature index.\n");
+  free(order);
+  free(starts);
+  free(keys);
+  free(notes);
+  free(depths);
+  signature_index_free(sigs);
+  return FAILURE;
+}
+
+// Returns true if `sigs` was built from `index` as it is now
+bool signature_index_current(const SignatureIndex *sigs, const NoteIndex *index) {
+  return sigs->source == index && sigs->source_generation == index->generation;
+}
+
+void signature_index_free(SignatureIndex *sigs) {
+  free(sigs->notes);
+  free(sigs->keys);
+  free(sigs->starts);
+  free(sigs->depths);
+  memset(sigs, 0, sizeof(*sigs));
+}
+
+static inline const uint8_t *entry_key(const SignatureIndex *sigs, size_t i, size_t *length) {
+  *length = sigs->starts[i + 1] - sigs->starts[i];
+  return sigs->keys + sigs->starts[i];
+}
+
+// First entry not before `key`
+static size_t lower_bound(const SignatureIndex *sigs, const uint8_t *key, size_t length) {
+  size_t lo = 0;
+  size_t hi = sigs->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    size_t mid_length;
+    const uint8_t *mid_key = entry_key(sigs, mid, &mid_length);
+    if (compare_keys(mid_key, mid_length, key, length) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// First entry after every key that starts with `key`, that is after the
+// subtree of `key`
+static size_t subtree_end(const SignatureIndex *sigs, const uint8_t *key, size_t length) {
+  size_t lo = 0;
+  size_t hi = sigs->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    size_t mid_length;
+    const uint8_t *mid_key = entry_key(sigs, mid, &mid_length);
+    bool inside = mid_length >= length && memcmp(mid_key, key, length) == 0;
+    if (inside || compare_keys(mid_key, mid_length, key, length) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// First note with exactly `key`, or NOT_FOUND
+static size_t find_key(const SignatureIndex *sigs, const uint8_t *key, size_t length) {
+  size_t pos = lower_bound(sigs, key, length);
+  size_t found_length;
+  if (pos < sigs->count) {
+    const uint8_t *found = entry_key(sigs, pos, &found_length);
+    if (compare_keys(found, found_length, key, length) == 0)
+      return pos;
+  }
+  return NOT_FOUND;
+}
+
+size_t signature_find(const SignatureIndex *sigs, const char *sig) {
+  uint8_t key[SIGNATURE_KEY_LEN];
+  size_t length;
+  signature_key(sig, key, &length);
+  return length > 0 ? find_key(sigs, key, length) : NOT_FOUND;
+}
+
+// The notes `sig` and its descendants, as the range [start, end)
+void signature_subtree(const SignatureIndex *sigs, const char *sig, size_t *start, size_t *end) {
+  uint8_t key[SIGNATURE_KEY_LEN];
+  size_t length;
+  signature_key(sig, key, &length);
+  *start = lower_bound(sigs, key, length);
+  *end = subtree_end(sigs, key, length);
+}
+
+// The closest ancestor of `pos` that is a note. Levels without a note of
+// their own are skipped, so "12a3" finds "12" when there is no "12a".
+size_t signature_parent(const SignatureIndex *sigs, size_t pos) {
+  size_t length;
+  const uint8_t *key = entry_key(sigs, pos, &length);
+  for (size_t depth = sigs->depths[pos]; depth > 1; depth--) {
+    size_t found = find_key(sigs, key, key_prefix(key, depth - 1));
+    if (found != NOT_FOUND)
+      return found;
+  }
+  return NOT_FOUND;
+}
+
+// The next note on the same level under the same parent. A level under the
+// parent with no note of its own, only descendants, is passed over.
+size_t signature_next_sibling(const SignatureIndex *sigs, size_t pos) {
+  size_t length;
+  const uint8_t *key = entry_key(sigs, pos, &length);
+  size_t depth = sigs->depths[pos];
+  size_t parent_end = subtree_end(sigs, key, key_prefix(key, depth - 1));
+
+  size_t next = subtree_end(sigs, key, length);
+  while (next < parent_end && sigs->depths[next] != depth) {
+    size_t next_length;
+    const uint8_t *next_key = entry_key(sigs, next, &next_length);
+    next = subtree_end(sigs, next_key, key_prefix(next_key, depth));
+  }
+  return next < parent_end ? next : NOT_FOUND;
+}
+
+// The previous note on the same level under the same parent, the first of
+// several sharing a signature
+size_t signature_prev_sibling(const SignatureIndex *sigs, size_t pos) {
+  size_t length;
+  const uint8_t *key = entry_key(sigs, pos, &length);
+  size_t depth = sigs->depths[pos];
+  size_t parent_length = key_prefix(key, depth - 1);
+
+  size_t before = lower_bound(sigs, key, length);
+  while (before > 0) {
+    size_t prev_length;
+    const uint8_t *prev_key = entry_key(sigs, before - 1, &prev_length);
+    // Stop at the parent, or at anything outside it
+    if (sigs->depths[before - 1] < depth || memcmp(prev_key, key, parent_length) != 0)
+      return NOT_FOUND;
+    // Otherwise it is the sibling or one of its descendants
+    size_t sibling_length = key_prefix(prev_key, depth);
+    size_t sibling = lower_bound(sigs, prev_key, sibling_length);
+    size_t found_length;
+    const uint8_t *found = entry_key(sigs, sibling, &found_length);
+    if (compare_keys(found, found_length, prev_key, sibling_length) == 0)
+      return sibling;
+    before = sibling;
+  }
+  return NOT_FOUND;
+}
+
+// Write the notes one level below `pos` into `dest` in sequence order and
+// return how many there are. Levels with no note of their own are skipped.
+size_t signature_children(const SignatureIndex *sigs, size_t pos, size_t *dest, size_t dest_size) {
+  size_t length;
+  const uint8_t *key = entry_key(sigs, pos, &length);
+  size_t depth = sigs->depths[pos];
+  size_t end = subtree_end(sigs, key, length);
+
+  size_t found = 0;
+  size_t child = pos + 1;
+  while (child < end) {
+    size_t child_length;
+    const uint8_t *child_key = entry_key(sigs, child, &child_length);
+    if (sigs->depths[child] == depth) {
+      child++; // Another note with the same signature
+      continue;
+    }
+    if (sigs->depths[child] == depth + 1) {
+      // Every note sharing the child's signature
+      size_t last = child;
+      for (; last < end; last++) {
+        size_t last_length;
+        const uint8_t *last_key = entry_key(sigs, last, &last_length);
+        if (compare_keys(last_key, last_length, child_key, child_length) != 0)
+          break;
+        if (found < dest_size)
+          dest[found] = last;
+        found++;
+      }
+    }
+    child = subtree_end(sigs, child_key, key_prefix(child_key, depth + 1));
+  }
+  return found;
+}
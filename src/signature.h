@@ -0,0 +1,49 @@
+#ifndef SIGNATURE_H_
+#define SIGNATURE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "index.h"
+
+// Signatures number notes in a folgezettel sequence: "12a3" is the third
+// note under "12a", which is the first under "12". Each run of digits or of
+// other characters is one level, and `=` also separates levels, so "12=a=3"
+// names the same note. Each level is written into a sort key as its kind,
+// its length and its characters, with leading zeros dropped from numbers.
+// Comparing keys bytewise then orders numbers numerically, shorter letter
+// runs first ("z" before "aa"), numbers before letters, and every note
+// before its descendants, so a subtree is a contiguous run of keys.
+#define SIGNATURE_KEY_LEN (3 * MAX_SIG_LEN)
+#define SIGNATURE_MAX_DEPTH MAX_SIG_LEN
+
+// The notes of a NoteIndex that have a signature, in sequence order. Like a
+// FuzzyIndex it refers to notes by position, so it must be rebuilt whenever
+// the NoteIndex generation changes.
+typedef struct {
+  const NoteIndex *source;
+  uint64_t source_generation; // Generation of `source` when built
+  size_t count;
+  uint32_t *notes;  // Positions of the notes in the NoteIndex
+  uint8_t *keys;    // Sort keys back to back
+  uint32_t *starts; // Key i is keys[starts[i]] up to keys[starts[i + 1]]
+  uint8_t *depths;  // Levels in each key
+} SignatureIndex;
+
+int signature_key(const char *sig, uint8_t *key, size_t *length);
+int signature_compare(const char *a, const char *b);
+
+int signature_index_build(SignatureIndex *sigs, const NoteIndex *index);
+bool signature_index_current(const SignatureIndex *sigs, const NoteIndex *index);
+void signature_index_free(SignatureIndex *sigs);
+
+// Lookups return positions in sequence order, or NOT_FOUND
+size_t signature_find(const SignatureIndex *sigs, const char *sig);
+void signature_subtree(const SignatureIndex *sigs, const char *sig, size_t *start, size_t *end);
+size_t signature_parent(const SignatureIndex *sigs, size_t pos);
+size_t signature_next_sibling(const SignatureIndex *sigs, size_t pos);
+size_t signature_prev_sibling(const SignatureIndex *sigs, size_t pos);
+size_t signature_children(const SignatureIndex *sigs, size_t pos, size_t *dest, size_t dest_size);
+
+#endif // SIGNATURE_H_
@@ -0,0 +1,466 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "duplicate.h"
+#include "index.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "store.h"
+#include "utils.h"
+
+// IDs divided by these give their year, month and day
+static const uint64_t level_divisors[SNAPSHOT_LEVELS] = {10000000000ULL, 100000000ULL, 1000000ULL};
+
+const char *snapshot_name(const Snapshot *snapshot, size_t leaf) {
+  return snapshot->names + snapshot->leaves[leaf].name_offset;
+}
+
+static int compare_leaves(const Snapshot *x, size_t a, const Snapshot *y, size_t b) {
+  if (x->leaves[a].id != y->leaves[b].id)
+    return (x->leaves[a].id > y->leaves[b].id) - (x->leaves[a].id < y->leaves[b].id);
+  return strcmp(snapshot_name(x, a), snapshot_name(y, b));
+}
+
+// The leaf of `snapshot` for the note `name` with `id`, or NOT_FOUND
+static size_t find_leaf(const Snapshot *snapshot, uint64_t id, const char *name) {
+  size_t lo = 0;
+  size_t hi = snapshot->leaf_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const SnapshotLeaf *leaf = &snapshot->leaves[mid];
+    int order = leaf->id != id ? (leaf->id > id) - (leaf->id < id) : strcmp(snapshot_name(snapshot, mid), name);
+    if (order == 0)
+      return mid;
+    if (order < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return NOT_FOUND;
+}
+
+// XXH64 of the contents of `name` in `dir_fd`
+static int hash_file(int dir_fd, const char *name, uint64_t size, uint64_t *hash) {
+  int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+  if (size == 0) {
+    close(fd);
+    *hash = xxh64("", 0, 0);
+    return SUCCESS;
+  }
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return FAILURE;
+  *hash = xxh64(data, size, 0);
+  munmap(data, size);
+  return SUCCESS;
+}
+
+static uint64_t leaf_hash(const SnapshotLeaf *leaf, const char *name) {
+  uint64_t fields[4] = {leaf->id, (uint64_t)leaf->mtime, leaf->size, leaf->content_hash};
+  return xxh64(name, leaf->name_length, xxh64(fields, sizeof(fields), 0));
+}
+
+// Group the leaves into days, the days into months and the months into
+// years, hashing each group over the hashes of its children
+static int build_levels(Snapshot *snapshot) {
+  for (int level = SNAPSHOT_LEVELS - 1; level >= 0; level--) {
+    bool leaves = level == SNAPSHOT_LEVELS - 1;
+    size_t child_count = leaves ? snapshot->leaf_count : snapshot->node_counts[level + 1];
+    snapshot->nodes[level] = malloc((child_count ? child_count : 1) * sizeof(SnapshotNode));
+    if (snapshot->nodes[level] == NULL)
+      return FAILURE;
+
+    size_t count = 0;
+    for (size_t i = 0; i < child_count; i++) {
+      uint64_t prefix, hash;
+      if (leaves) {
+        prefix = snapshot->leaves[i].id / level_divisors[level];
+        hash = snapshot->leaves[i].hash;
+      } else {
+        prefix = snapshot->nodes[level + 1][i].prefix / (level_divisors[level] / level_divisors[level + 1]);
+        hash = snapshot->nodes[level + 1][i].hash;
+      }
+      SnapshotNode *node = &snapshot->nodes[level][count > 0 ? count - 1 : 0];
+      if (count == 0 || node->prefix != prefix) {
+        node = &snapshot->nodes[level][count++];
+        *node = (SnapshotNode){.prefix = prefix, .hash = 0, .first = (uint32_t)i, .count = 0};
+      }
+      node->hash = xxh64(&hash, sizeof(hash), node->hash);
+      node->count++;
+    }
+    snapshot->node_counts[level] = count;
+  }
+
+  snapshot->root = 0;
+  for (size_t i = 0; i < snapshot->node_counts[0]; i++) {
+    snapshot->root = xxh64(&snapshot->nodes[0][i].hash, sizeof(uint64_t), snapshot->root);
+  }
+  return SUCCESS;
+}
+
+// Take a snapshot of the notes in `index`. The contents of a note are only
+// read if `previous`, which may be NULL, has no note of the same name,
+// modification time and size; `hashed` is set to how many were read.
+int snapshot_build(Snapshot *snapshot, const NoteIndex *index, const Snapshot *previous, size_t *hashed) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  *hashed = 0;
+  if (index->count > UINT32_MAX)
+    return FAILURE;
+
+  size_t names_length = 0;
+  for (size_t i = 0; i < index->count; i++) {
+    names_length += strlen(index->notes[i].name) + 1;
+  }
+  if (names_length > UINT32_MAX)
+    return FAILURE;
+  snapshot->leaves = malloc((index->count ? index->count : 1) * sizeof(SnapshotLeaf));
+  snapshot->names = malloc(names_length ? names_length : 1);
+  if (snapshot->leaves == NULL || snapshot->names == NULL) {
+    snapshot_free(snapshot);
+    return FAILURE;
+  }
+
+  int dir_fd = open(index->dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open %s\n", index->dir_path);
+    snapshot_free(snapshot);
+    return FAILURE;
+  }
+
+  // The index is sorted by ID and name already
+  int outcome = SUCCESS;
+  for (size_t i = 0; i < index->count && outcome == SUCCESS; i++) {
+    const NoteRecord *note = &index->notes[i];
+    SnapshotLeaf *leaf = &snapshot->leaves[snapshot->leaf_count];
+    *leaf = (SnapshotLeaf){.id = note->id,
+                           .mtime = (int64_t)note->mtime * 1000000000 + note->mtime_nsec,
+                           .size = note->size,
+                           .name_offset = (uint32_t)snapshot->names_length,
+                           .name_length = (uint32_t)strlen(note->name)};
+    memcpy(snapshot->names + snapshot->names_length, note->name, leaf->name_length + 1);
+
+    size_t known = previous != NULL ? find_leaf(previous, note->id, note->name) : NOT_FOUND;
+    if (known != NOT_FOUND && previous->leaves[known].mtime == leaf->mtime &&
+        previous->leaves[known].size == leaf->size) {
+      leaf->content_hash = previous->leaves[known].content_hash;
+    } else if (hash_file(dir_fd, note->name, note->size, &leaf->content_hash) == SUCCESS) {
+      (*hashed)++;
+    } else if (errno == ENOENT) {
+      // Removed since the index was read
+      continue;
+    } else {
+      fprintf(stderr, "ERROR: Could not read %s%s\n", index->dir_path, note->name);
+      outcome = FAILURE;
+      break;
+    }
+    leaf->hash = leaf_hash(leaf, note->name);
+    snapshot->names_length += leaf->name_length + 1;
+    snapshot->leaf_count++;
+  }
+  close(dir_fd);
+
+  if (outcome == SUCCESS)
+    outcome = build_levels(snapshot);
+  if (outcome != SUCCESS)
+    snapshot_free(snapshot);
+  return outcome;
+}
+
+// The parts of a snapshot file after its header, in order
+static int snapshot_iov(const Snapshot *snapshot, struct iovec *iov) {
+  int count = 0;
+  for (int level = 0; level < SNAPSHOT_LEVELS; level++) {
+    iov[count++] = (struct iovec){snapshot->nodes[level], snapshot->node_counts[level] * sizeof(SnapshotNode)};
+  }
+  iov[count++] = (struct iovec){snapshot->leaves, snapshot->leaf_count * sizeof(SnapshotLeaf)};
+  iov[count++] = (struct iovec){snapshot->names, snapshot->names_length};
+  return count;
+}
+
+// Save `snapshot` to `path`. It is written under a temporary name, flushed
+// and renamed into place, since a sync will trust it later.
+int snapshot_write(const Snapshot *snapshot, const char *path) {
+  SnapshotHeader header = {.version = SNAPSHOT_VERSION,
+                           .leaf_count = snapshot->leaf_count,
+                           .names_length = snapshot->names_length,
+                           .root = snapshot->root};
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  struct iovec iov[SNAPSHOT_LEVELS + 3];
+  iov[0] = (struct iovec){&header, sizeof(header)};
+  int iov_count = 1 + snapshot_iov(snapshot, iov + 1);
+  for (int level = 0; level < SNAPSHOT_LEVELS; level++) {
+    header.node_counts[level] = snapshot->node_counts[level];
+  }
+  for (int i = 1; i < iov_count; i++) {
+    header.crc = crc32c(header.crc, iov[i].iov_base, iov[i].iov_len);
+  }
+
+  char temp_path[MAX_PATH_LEN + 32];
+  snprintf(temp_path, sizeof(temp_path), "%s.%ld", path, (long)getpid());
+  int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1) {
+    fprintf(stderr, "ERROR: Could not write %s\n", path);
+    return FAILURE;
+  }
+
+  int outcome = SUCCESS;
+  struct iovec *rest = iov;
+  while (iov_count > 0 && outcome == SUCCESS) {
+    ssize_t n = writev(fd, rest, iov_count);
+    STATS_SYSCALL(SYS_WRITE, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      outcome = FAILURE;
+      break;
+    }
+    while (iov_count > 0 && (size_t)n >= rest->iov_len) {
+      n -= (ssize_t)rest->iov_len;
+      rest++;
+      iov_count--;
+    }
+    if (iov_count > 0) {
+      rest->iov_base = (char *)rest->iov_base + n;
+      rest->iov_len -= (size_t)n;
+    }
+  }
+  if (outcome == SUCCESS) {
+    outcome = fsync(fd) == 0 ? SUCCESS : FAILURE;
+    STATS_SYSCALL(SYS_FSYNC, 1);
+  }
+  if (close(fd) == -1)
+    outcome = FAILURE;
+  if (outcome == SUCCESS) {
+    outcome = rename(temp_path, path) == 0 ? SUCCESS : FAILURE;
+    STATS_SYSCALL(SYS_RENAME, 1);
+  }
+  if (outcome != SUCCESS) {
+    unlink(temp_path);
+    fprintf(stderr, "ERROR: Could not write %s\n", path);
+  }
+  return outcome;
+}
+
+// Check that each node's children lie within the level below, so a walk of
+// the tree never leaves the snapshot
+static bool levels_valid(const Snapshot *snapshot) {
+  for (int level = 0; level < SNAPSHOT_LEVELS; level++) {
+    size_t child_count = level == SNAPSHOT_LEVELS - 1 ? snapshot->leaf_count : snapshot->node_counts[level + 1];
+    for (size_t i = 0; i < snapshot->node_counts[level]; i++) {
+      const SnapshotNode *node = &snapshot->nodes[level][i];
+      if ((size_t)node->first + node->count > child_count)
+        return false;
+    }
+  }
+  for (size_t i = 0; i < snapshot->leaf_count; i++) {
+    const SnapshotLeaf *leaf = &snapshot->leaves[i];
+    if ((size_t)leaf->name_offset + leaf->name_length >= snapshot->names_length ||
+        snapshot->names[leaf->name_offset + leaf->name_length] != '\0')
+      return false;
+  }
+  return true;
+}
+
+// Read the snapshot saved at `path`
+int snapshot_read(Snapshot *snapshot, const char *path) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+
+  SnapshotHeader header;
+  int outcome = read(fd, &header, sizeof(header)) == sizeof(header) ? SUCCESS : FAILURE;
+  STATS_SYSCALL(SYS_READ, 1);
+  if (outcome == SUCCESS && (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+                             header.version != SNAPSHOT_VERSION || header.leaf_count > UINT32_MAX ||
+                             header.names_length > UINT32_MAX))
+    outcome = FAILURE;
+  for (int level = 0; level < SNAPSHOT_LEVELS && outcome == SUCCESS; level++) {
+    if (header.node_counts[level] > header.leaf_count)
+      outcome = FAILURE;
+  }
+  if (outcome != SUCCESS) {
+    close(fd);
+    return FAILURE;
+  }
+
+  snapshot->leaf_count = header.leaf_count;
+  snapshot->names_length = header.names_length;
+  snapshot->root = header.root;
+  bool allocated = true;
+  for (int level = 0; level < SNAPSHOT_LEVELS; level++) {
+    snapshot->node_counts[level] = header.node_counts[level];
+    snapshot->nodes[level] = malloc((header.node_counts[level] ? header.node_counts[level] : 1) * sizeof(SnapshotNode));
+    allocated &= snapshot->nodes[level] != NULL;
+  }
+  snapshot->leaves = malloc((header.leaf_count ? header.leaf_count : 1) * sizeof(SnapshotLeaf));
+  snapshot->names = malloc(header.names_length ? header.names_length : 1);
+  if (!allocated || snapshot->leaves == NULL || snapshot->names == NULL) {
+    close(fd);
+    snapshot_free(snapshot);
+    return FAILURE;
+  }
+
+  struct iovec iov[SNAPSHOT_LEVELS + 2];
+  int iov_count = snapshot_iov(snapshot, iov);
+  size_t expected = 0;
+  for (int i = 0; i < iov_count; i++) {
+    expected += iov[i].iov_len;
+  }
+  ssize_t n = readv(fd, iov, iov_count);
+  STATS_SYSCALL(SYS_READ, 1);
+  close(fd);
+  uint32_t crc = 0;
+  for (int i = 0; i < iov_count; i++) {
+    crc = crc32c(crc, iov[i].iov_base, iov[i].iov_len);
+  }
+  if (n < 0 || (size_t)n != expected || crc != header.crc || !levels_valid(snapshot)) {
+    snapshot_free(snapshot);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+void snapshot_free(Snapshot *snapshot) {
+  for (int level = 0; level < SNAPSHOT_LEVELS; level++) {
+    free(snapshot->nodes[level]);
+  }
+  free(snapshot->leaves);
+  free(snapshot->names);
+  memset(snapshot, 0, sizeof(*snapshot));
+}
+
+typedef struct {
+  const Snapshot *old;
+  const Snapshot *new;
+  SnapshotChange *changes;
+  size_t count;
+  size_t capacity;
+} DiffState;
+
+static void add_change(DiffState *state, ChangeKind kind, size_t old_leaf, size_t new_leaf) {
+  if (state->count == state->capacity) {
+    size_t capacity = state->capacity ? state->capacity * 2 : 64;
+    SnapshotChange *changes = realloc(state->changes, capacity * sizeof(SnapshotChange));
+    if (changes == NULL)
+      return;
+    state->changes = changes;
+    state->capacity = capacity;
+  }
+  state->changes[state->count++] = (SnapshotChange){.kind = kind, .old_leaf = old_leaf, .new_leaf = new_leaf};
+}
+
+// Compare the notes of one ID in both snapshots. Notes keeping their name
+// are matched first, and the rest of each side paired up in order as
+// renames. Both sides are sorted by name, so this is a merge.
+static void diff_id(DiffState *state, size_t old_first, size_t old_end, size_t new_first, size_t new_end) {
+  size_t *unmatched_old = malloc((old_end - old_first + 1) * sizeof(size_t));
+  size_t *unmatched_new = malloc((new_end - new_first + 1) * sizeof(size_t));
+  if (unmatched_old == NULL || unmatched_new == NULL) {
+    free(unmatched_old);
+    free(unmatched_new);
+    return;
+  }
+  size_t old_count = 0, new_count = 0;
+  size_t i = old_first, j = new_first;
+  while (i < old_end || j < new_end) {
+    int order = i >= old_end ? 1 : j >= new_end ? -1 : compare_leaves(state->old, i, state->new, j);
+    if (order < 0) {
+      unmatched_old[old_count++] = i++;
+    } else if (order > 0) {
+      unmatched_new[new_count++] = j++;
+    } else {
+      if (state->old->leaves[i].content_hash != state->new->leaves[j].content_hash)
+        add_change(state, CHANGE_MODIFIED, i, j);
+      i++;
+      j++;
+    }
+  }
+
+  size_t paired = old_count < new_count ? old_count : new_count;
+  for (size_t k = 0; k < paired; k++) {
+    add_change(state, CHANGE_RENAMED, unmatched_old[k], unmatched_new[k]);
+  }
+  for (size_t k = paired; k < old_count; k++) {
+    add_change(state, CHANGE_REMOVED, unmatched_old[k], 0);
+  }
+  for (size_t k = paired; k < new_count; k++) {
+    add_change(state, CHANGE_ADDED, 0, unmatched_new[k]);
+  }
+  free(unmatched_old);
+  free(unmatched_new);
+}
+
+static void diff_leaves(DiffState *state, size_t old_first, size_t old_end, size_t new_first, size_t new_end) {
+  size_t i = old_first, j = new_first;
+  while (i < old_end || j < new_end) {
+    uint64_t old_id = i < old_end ? state->old->leaves[i].id : UINT64_MAX;
+    uint64_t new_id = j < new_end ? state->new->leaves[j].id : UINT64_MAX;
+    uint64_t id = old_id < new_id ? old_id : new_id;
+    size_t old_run = i, new_run = j;
+    while (old_run < old_end && state->old->leaves[old_run].id == id) {
+      old_run++;
+    }
+    while (new_run < new_end && state->new->leaves[new_run].id == id) {
+      new_run++;
+    }
+    diff_id(state, i, old_run, j, new_run);
+    i = old_run;
+    j = new_run;
+  }
+}
+
+// Compare the nodes [old_first, old_end) and [new_first, new_end) of
+// `level`, skipping those whose hashes agree
+static void diff_level(DiffState *state, int level, size_t old_first, size_t old_end, size_t new_first,
+                       size_t new_end) {
+  if (level == SNAPSHOT_LEVELS) {
+    diff_leaves(state, old_first, old_end, new_first, new_end);
+    return;
+  }
+
+  const SnapshotNode *old_nodes = state->old->nodes[level];
+  const SnapshotNode *new_nodes = state->new->nodes[level];
+  size_t i = old_first, j = new_first;
+  while (i < old_end || j < new_end) {
+    bool in_old = i < old_end && (j >= new_end || old_nodes[i].prefix <= new_nodes[j].prefix);
+    bool in_new = j < new_end && (i >= old_end || new_nodes[j].prefix <= old_nodes[i].prefix);
+    if (in_old && in_new && old_nodes[i].hash == new_nodes[j].hash) {
+      i++;
+      j++;
+      continue;
+    }
+    // A node on only one side is walked against nothing
+    size_t old_child = in_old ? old_nodes[i].first : 0, old_child_end = in_old ? old_child + old_nodes[i].count : 0;
+    size_t new_child = in_new ? new_nodes[j].first : 0, new_child_end = in_new ? new_child + new_nodes[j].count : 0;
+    diff_level(state, level + 1, old_child, old_child_end, new_child, new_child_end);
+    i += in_old;
+    j += in_new;
+  }
+}
+
+// List the notes that differ from `old` to `new`, in order of ID. The
+// caller frees `changes`.
+size_t snapshot_diff(const Snapshot *old, const Snapshot *new, SnapshotChange **changes) {
+  DiffState state = {.old = old, .new = new};
+  if (old->root != new->root)
+    diff_level(&state, 0, 0, old->node_counts[0], 0, new->node_counts[0]);
+  *changes = state.changes;
+  return state.count;
+}
@@ -0,0 +1,75 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "index.h"
+
+// A snapshot summarises the vault as a Merkle tree, so that two states are
+// compared by descending only into the parts whose hashes differ. The vault
+// is one directory, so the levels of the tree follow the IDs instead: notes
+// are grouped by the day, days by the month and months by the year of their
+// IDs. Each note is hashed over its ID, name, modification time, size and
+// the XXH64 hash of its contents, and each group over its children.
+#define SNAPSHOT_MAGIC "CNSN"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_LEVELS 3
+
+typedef struct {
+  uint64_t id;
+  int64_t mtime; // In nanoseconds
+  uint64_t size;
+  uint64_t content_hash;
+  uint64_t hash;
+  uint32_t name_offset; // Into the names, which are NUL terminated
+  uint32_t name_length;
+} SnapshotLeaf;
+
+// A year, month or day of IDs
+typedef struct {
+  uint64_t prefix; // The ID divided down to the year, month or day
+  uint64_t hash;
+  uint32_t first; // First child, a node of the level below or a leaf
+  uint32_t count;
+} SnapshotNode;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t leaf_count;
+  uint64_t node_counts[SNAPSHOT_LEVELS];
+  uint64_t names_length;
+  uint64_t root; // Hash over the years
+  uint32_t crc;  // CRC32C of everything after the header
+  uint32_t reserved;
+} SnapshotHeader;
+
+// Leaves are sorted by ID and name, and the nodes of each level by prefix
+typedef struct {
+  SnapshotLeaf *leaves;
+  size_t leaf_count;
+  SnapshotNode *nodes[SNAPSHOT_LEVELS]; // Years, months, days
+  size_t node_counts[SNAPSHOT_LEVELS];
+  char *names;
+  size_t names_length;
+  uint64_t root;
+} Snapshot;
+
+typedef enum { CHANGE_ADDED, CHANGE_REMOVED, CHANGE_RENAMED, CHANGE_MODIFIED } ChangeKind;
+
+// A note that differs between two snapshots, by leaf position in each
+typedef struct {
+  ChangeKind kind;
+  size_t old_leaf; // Unset for added notes
+  size_t new_leaf; // Unset for removed notes
+} SnapshotChange;
+
+int snapshot_build(Snapshot *snapshot, const NoteIndex *index, const Snapshot *previous, size_t *hashed);
+int snapshot_write(const Snapshot *snapshot, const char *path);
+int snapshot_read(Snapshot *snapshot, const char *path);
+void snapshot_free(Snapshot *snapshot);
+size_t snapshot_diff(const Snapshot *old, const Snapshot *new, SnapshotChange **changes);
+const char *snapshot_name(const Snapshot *snapshot, size_t leaf);
+
+#endif // SNAPSHOT_H_
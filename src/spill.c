@@ -0,0 +1,328 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spill.h"
+#include "stats.h"
+#include "utils.h"
+
+// Gather records into `spill`, which sorts them with `compare` within
+// `budget` bytes of memory. Runs go into a directory made in `dir_path` when
+// the first one is written.
+void spill_init(Spill *spill, const char *dir_path, size_t budget, SpillCompare compare, void *arg) {
+  memset(spill, 0, sizeof(*spill));
+  size_t len = strlen(dir_path);
+  snprintf(spill->dir_path, MAX_PATH_LEN, "%s%s", dir_path, len > 0 && dir_path[len - 1] == '/' ? "" : "/");
+  spill->budget = budget;
+  spill->compare = compare;
+  spill->arg = arg;
+}
+
+static const uint8_t *record_at(const uint8_t *base, size_t offset, size_t *length) {
+  uint32_t value;
+  memcpy(&value, base + offset, sizeof(value));
+  *length = value;
+  return base + offset + sizeof(value);
+}
+
+static int compare_offsets(const void *a, const void *b, void *arg) {
+  const Spill *spill = arg;
+  size_t a_length, b_length;
+  const uint8_t *x = record_at(spill->arena, *(const size_t *)a, &a_length);
+  const uint8_t *y = record_at(spill->arena, *(const size_t *)b, &b_length);
+  return spill->compare(x, a_length, y, b_length, spill->arg);
+}
+
+static int write_all(int fd, const uint8_t *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    STATS_SYSCALL(SYS_WRITE, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FAILURE;
+    data += n;
+    length -= (size_t)n;
+  }
+  return SUCCESS;
+}
+
+static int run_name(const Spill *spill, size_t run, char *dest) {
+  int written = snprintf(dest, MAX_PATH_LEN, "%s/run-%zu", spill->run_dir, run);
+  return written >= 0 && written < MAX_PATH_LEN ? SUCCESS : FAILURE;
+}
+
+// Sort the records in memory and write them out as the next run
+static int write_run(Spill *spill) {
+  if (spill->run_dir[0] == '\0') {
+    int written = snprintf(spill->run_dir, MAX_PATH_LEN, "%s%sXXXXXX", spill->dir_path, SPILL_DIR_PREFIX);
+    if (written < 0 || written >= MAX_PATH_LEN || mkdtemp(spill->run_dir) == NULL) {
+      fprintf(stderr, "ERROR: Could not create a directory in %s for sorting.\n", spill->dir_path);
+      spill->run_dir[0] = '\0';
+      return FAILURE;
+    }
+  }
+  qsort_r(spill->offsets, spill->count, sizeof(size_t), compare_offsets, spill);
+
+  char path[MAX_PATH_LEN];
+  int fd = -1;
+  if (run_name(spill, spill->run_count, path) == SUCCESS)
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1) {
+    fprintf(stderr, "ERROR: Could not create %s\n", path);
+    return FAILURE;
+  }
+  spill->run_count++;
+
+  // The records go out in sorted order, gathered into writes of a fixed size
+  uint8_t buffer[SPILL_WRITE_BUFFER];
+  size_t used = 0;
+  int outcome = SUCCESS;
+  for (size_t i = 0; i < spill->count && outcome == SUCCESS; i++) {
+    size_t length;
+    const uint8_t *record = record_at(spill->arena, spill->offsets[i], &length);
+    const uint8_t *data = record - sizeof(uint32_t);
+    size_t remaining = length + sizeof(uint32_t);
+    while (remaining > 0 && outcome == SUCCESS) {
+      size_t take = remaining < sizeof(buffer) - used ? remaining : sizeof(buffer) - used;
+      memcpy(buffer + used, data, take);
+      used += take;
+      data += take;
+      remaining -= take;
+      if (used == sizeof(buffer)) {
+        outcome = write_all(fd, buffer, used);
+        used = 0;
+      }
+    }
+  }
+  if (outcome == SUCCESS && used > 0)
+    outcome = write_all(fd, buffer, used);
+  if (close(fd) != 0)
+    outcome = FAILURE;
+  if (outcome != SUCCESS)
+    fprintf(stderr, "ERROR: Could not write %s\n", path);
+
+  spill->arena_length = 0;
+  spill->count = 0;
+  return outcome;
+}
+
+// Grow `*data` to hold `needed` bytes, without going past `limit` unless
+// `needed` does
+static bool grow(void **data, size_t *capacity, size_t needed, size_t limit) {
+  if (needed <= *capacity)
+    return true;
+  size_t new_capacity = *capacity ? *capacity * 2 : 4096;
+  if (new_capacity > limit)
+    new_capacity = limit;
+  if (new_capacity < needed)
+    new_capacity = needed;
+  void *grown = realloc(*data, new_capacity);
+  if (grown == NULL)
+    return false;
+  *data = grown;
+  *capacity = new_capacity;
+  return true;
+}
+
+// Add a copy of `record`. When it would take the records in memory over the
+// budget, those are written out as a run first.
+int spill_add(Spill *spill, const void *record, size_t length) {
+  if (spill->failed || spill->sorted || length > UINT32_MAX)
+    return FAILURE;
+
+  size_t size = sizeof(uint32_t) + length;
+  size_t used = spill->arena_length + (spill->count + 1) * sizeof(size_t);
+  if (spill->count > 0 && used + size > spill->budget && write_run(spill) != SUCCESS) {
+    spill->failed = true;
+    return FAILURE;
+  }
+
+  size_t offsets_size = spill->offsets_capacity * sizeof(size_t);
+  if (!grow((void **)&spill->arena, &spill->arena_capacity, spill->arena_length + size, spill->budget) ||
+      !grow((void **)&spill->offsets, &offsets_size, (spill->count + 1) * sizeof(size_t), spill->budget)) {
+    fprintf(stderr, "ERROR: Out of memory sorting.\n");
+    spill->failed = true;
+    return FAILURE;
+  }
+  spill->offsets_capacity = offsets_size / sizeof(size_t);
+
+  uint32_t value = (uint32_t)length;
+  memcpy(spill->arena + spill->arena_length, &value, sizeof(value));
+  memcpy(spill->arena + spill->arena_length + sizeof(value), record, length);
+  spill->offsets[spill->count++] = spill->arena_length;
+  spill->arena_length += size;
+  return SUCCESS;
+}
+
+static const uint8_t *run_record(const SpillRun *run, size_t *length) { return record_at(run->map, run->pos, length); }
+
+static bool run_less(const Spill *spill, size_t a, size_t b) {
+  size_t a_length, b_length;
+  const uint8_t *x = run_record(&spill->runs[a], &a_length);
+  const uint8_t *y = run_record(&spill->runs[b], &b_length);
+  int order = spill->compare(x, a_length, y, b_length, spill->arg);
+  // Equal records come out in the order of their runs, as they went in
+  return order < 0 || (order == 0 && a < b);
+}
+
+static void sift_down(Spill *spill, size_t i) {
+  for (;;) {
+    size_t smallest = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < spill->heap_count && run_less(spill, spill->heap[left], spill->heap[smallest]))
+      smallest = left;
+    if (right < spill->heap_count && run_less(spill, spill->heap[right], spill->heap[smallest]))
+      smallest = right;
+    if (smallest == i)
+      return;
+    size_t swap = spill->heap[i];
+    spill->heap[i] = spill->heap[smallest];
+    spill->heap[smallest] = swap;
+    i = smallest;
+  }
+}
+
+// Map run `i` for reading. The file is removed at once, the mapping keeping
+// its contents until it is unmapped.
+static int open_run(Spill *spill, size_t i) {
+  char path[MAX_PATH_LEN];
+  if (run_name(spill, i, path) != SUCCESS)
+    return FAILURE;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+  struct stat st;
+  SpillRun *run = &spill->runs[i];
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return FAILURE;
+  }
+  run->size = (size_t)st.st_size;
+  if (run->size > 0) {
+    void *map = mmap(NULL, run->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      return FAILURE;
+    }
+    madvise(map, run->size, MADV_SEQUENTIAL);
+    run->map = map;
+  }
+  close(fd);
+  unlink(path);
+  return SUCCESS;
+}
+
+// Finish adding records and start reading them back in order
+int spill_sort(Spill *spill) {
+  if (spill->failed || spill->sorted)
+    return FAILURE;
+  spill->sorted = true;
+  if (spill->run_count == 0) {
+    qsort_r(spill->offsets, spill->count, sizeof(size_t), compare_offsets, spill);
+    return SUCCESS;
+  }
+
+  // Once anything has been spilled, the rest is a run like any other
+  if (spill->count > 0 && write_run(spill) != SUCCESS) {
+    spill->failed = true;
+    return FAILURE;
+  }
+  free(spill->arena);
+  free(spill->offsets);
+  spill->arena = NULL;
+  spill->offsets = NULL;
+  spill->arena_capacity = spill->offsets_capacity = 0;
+
+  spill->runs = calloc(spill->run_count, sizeof(SpillRun));
+  spill->heap = malloc(spill->run_count * sizeof(size_t));
+  if (spill->runs == NULL || spill->heap == NULL) {
+    spill->failed = true;
+    return FAILURE;
+  }
+  for (size_t i = 0; i < spill->run_count; i++) {
+    if (open_run(spill, i) != SUCCESS) {
+      fprintf(stderr, "ERROR: Could not read back a sorted run from %s\n", spill->run_dir);
+      spill->failed = true;
+      return FAILURE;
+    }
+    if (spill->runs[i].size > 0)
+      spill->heap[spill->heap_count++] = i;
+  }
+  rmdir(spill->run_dir);
+  spill->run_dir[0] = '\0';
+
+  for (size_t i = spill->heap_count; i-- > 0;) {
+    sift_down(spill, i);
+  }
+  return SUCCESS;
+}
+
+// Set `record` to the next record in order, returning false after the last.
+// The record stays valid until the next call.
+bool spill_next(Spill *spill, const void **record, size_t *length) {
+  if (!spill->sorted || spill->failed)
+    return false;
+  if (spill->runs == NULL) {
+    if (spill->next >= spill->count)
+      return false;
+    *record = record_at(spill->arena, spill->offsets[spill->next++], length);
+    return true;
+  }
+
+  // Move past the record returned last time
+  if (spill->returned && spill->heap_count > 0) {
+    SpillRun *run = &spill->runs[spill->heap[0]];
+    size_t previous;
+    run_record(run, &previous);
+    run->pos += sizeof(uint32_t) + previous;
+    if (run->pos - run->released >= SPILL_RELEASE_BYTES) {
+      size_t page = (size_t)sysconf(_SC_PAGESIZE);
+      size_t end = run->pos / page * page;
+      madvise((void *)(run->map + run->released), end - run->released, MADV_DONTNEED);
+      run->released = end;
+    }
+    if (run->pos + sizeof(uint32_t) > run->size)
+      spill->heap[0] = spill->heap[--spill->heap_count];
+    if (spill->heap_count > 0)
+      sift_down(spill, 0);
+  }
+  spill->returned = false;
+  if (spill->heap_count == 0)
+    return false;
+
+  *record = run_record(&spill->runs[spill->heap[0]], length);
+  spill->returned = true;
+  return true;
+}
+
+void spill_free(Spill *spill) {
+  for (size_t i = 0; spill->runs != NULL && i < spill->run_count; i++) {
+    if (spill->runs[i].map != NULL)
+      munmap((void *)spill->runs[i].map, spill->runs[i].size);
+  }
+  // Runs left behind by a failure
+  if (spill->run_dir[0] != '\0') {
+    char path[MAX_PATH_LEN];
+    for (size_t i = 0; i < spill->run_count; i++) {
+      if (run_name(spill, i, path) == SUCCESS)
+        unlink(path);
+    }
+    rmdir(spill->run_dir);
+  }
+  free(spill->arena);
+  free(spill->offsets);
+  free(spill->runs);
+  free(spill->heap);
+  memset(spill, 0, sizeof(*spill));
+}
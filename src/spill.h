@@ -0,0 +1,61 @@
+#ifndef SPILL_H_
+#define SPILL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "utils.h"
+
+// Sorting more records than fit in memory. Records are gathered until they
+// fill the memory budget, then sorted and written out as a run into a
+// temporary directory, and reading them back merges the runs. Each run is
+// mapped and read front to back, and the pages behind the reader are dropped
+// as it goes. Records that all fit are sorted in memory and never written.
+#define SPILL_DIR_PREFIX ".connote-spill-"
+// Pages of a run already merged are dropped each time this many more bytes
+// have been read
+#define SPILL_RELEASE_BYTES (1 << 20)
+#define SPILL_WRITE_BUFFER (64 * 1024)
+
+// Orders two records as strcmp does
+typedef int (*SpillCompare)(const void *a, size_t a_length, const void *b, size_t b_length, void *arg);
+
+typedef struct {
+  const uint8_t *map;
+  size_t size;
+  size_t pos;      // Next record, a 32 bit length followed by the bytes
+  size_t released; // Bytes before this have been dropped
+} SpillRun;
+
+typedef struct {
+  char dir_path[MAX_PATH_LEN]; // Where the temporary directory is made
+  char run_dir[MAX_PATH_LEN];  // The temporary directory, "" until the first run
+  size_t budget;
+  SpillCompare compare;
+  void *arg;
+  // Records held in memory, laid out as in the runs, and their offsets
+  uint8_t *arena;
+  size_t arena_length;
+  size_t arena_capacity;
+  size_t *offsets;
+  size_t count;
+  size_t offsets_capacity;
+  size_t run_count;
+  // Reading
+  SpillRun *runs;
+  size_t *heap; // Runs with records left, by their next record
+  size_t heap_count;
+  size_t next;    // Next record in memory when nothing was spilled
+  bool returned;  // Whether the record at the top of the heap was returned
+  bool sorted;
+  bool failed;
+} Spill;
+
+void spill_init(Spill *spill, const char *dir_path, size_t budget, SpillCompare compare, void *arg);
+int spill_add(Spill *spill, const void *record, size_t length);
+int spill_sort(Spill *spill);
+bool spill_next(Spill *spill, const void **record, size_t *length);
+void spill_free(Spill *spill);
+
+#endif // SPILL_H_
@@ -0,0 +1,163 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+#ifdef CONNOTE_STATS
+
+static const char *phase_names[PHASE_COUNT] = {"config", "dir_walk", "stat", "parse",
+                                               "slug",   "format",   "write", "rename"};
+static const char *syscall_names[SYS_COUNT] = {"open",    "read",   "write", "stat",
+                                               "readdir", "rename", "fsync", "io_uring_enter"};
+
+typedef struct {
+  uint8_t phase;
+  uint32_t tid;
+  uint64_t start; // ns
+  uint64_t duration;
+} StatsEvent;
+
+bool stats_enabled = false;
+
+static struct {
+  bool summary;
+  const char *trace_path;
+  uint64_t start;
+  _Atomic uint64_t phase_ns[PHASE_COUNT];
+  _Atomic uint64_t phase_calls[PHASE_COUNT];
+  _Atomic uint64_t syscalls[SYS_COUNT];
+  StatsEvent *events;
+  _Atomic size_t event_count;
+} stats;
+
+uint64_t stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void stats_record(StatsPhase phase, uint64_t start) {
+  uint64_t end = stats_now();
+  atomic_fetch_add_explicit(&stats.phase_ns[phase], end - start, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats.phase_calls[phase], 1, memory_order_relaxed);
+
+  if (stats.events == NULL)
+    return;
+  size_t i = atomic_fetch_add_explicit(&stats.event_count, 1, memory_order_relaxed);
+  if (i >= STATS_MAX_EVENTS)
+    return;
+  stats.events[i] = (StatsEvent){.phase = phase, .tid = (uint32_t)gettid(), .start = start, .duration = end - start};
+}
+
+void stats_count(StatsSyscall syscall_id, uint64_t n) {
+  atomic_fetch_add_explicit(&stats.syscalls[syscall_id], n, memory_order_relaxed);
+}
+
+void stats_start(bool summary, const char *trace_path) {
+  stats_finish();
+  memset(&stats, 0, sizeof(stats));
+  if (!summary && trace_path == NULL)
+    return;
+
+  stats.summary = summary;
+  stats.trace_path = trace_path;
+  if (trace_path != NULL) {
+    stats.events = malloc(STATS_MAX_EVENTS * sizeof(StatsEvent));
+    if (stats.events == NULL)
+      fprintf(stderr, "ERROR: Not enough memory to trace, only totals will be kept.\n");
+  }
+  stats.start = stats_now();
+  stats_enabled = true;
+}
+
+static long peak_rss_kb(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == -1)
+    return -1;
+  return usage.ru_maxrss;
+}
+
+static void print_summary(uint64_t wall_ns) {
+  fprintf(stderr, "%-16s %10s %12s %12s\n", "phase", "calls", "total_ms", "mean_us");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    uint64_t calls = stats.phase_calls[i];
+    if (calls == 0)
+      continue;
+    fprintf(stderr, "%-16s %10llu %12.3f %12.3f\n", phase_names[i], (unsigned long long)calls,
+            stats.phase_ns[i] / 1e6, stats.phase_ns[i] / 1e3 / calls);
+  }
+
+  fprintf(stderr, "%-16s %10s\n", "syscall", "count");
+  for (int i = 0; i < SYS_COUNT; i++) {
+    if (stats.syscalls[i] > 0)
+      fprintf(stderr, "%-16s %10llu\n", syscall_names[i], (unsigned long long)stats.syscalls[i]);
+  }
+
+  fprintf(stderr, "wall_ms          %10.3f\n", wall_ns / 1e6);
+  fprintf(stderr, "peak_rss_kb      %10ld\n", peak_rss_kb());
+}
+
+static void write_trace(uint64_t wall_ns) {
+  FILE *file = fopen(stats.trace_path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "ERROR: Could not write trace to %s\n", stats.trace_path);
+    return;
+  }
+
+  int pid = (int)getpid();
+  size_t count = stats.event_count < STATS_MAX_EVENTS ? stats.event_count : STATS_MAX_EVENTS;
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  fprintf(file, "{\"name\": \"connote\", \"ph\": \"X\", \"ts\": 0, \"dur\": %.3f, \"pid\": %d, \"tid\": %d}", wall_ns / 1e3,
+          pid, pid);
+  for (size_t i = 0; i < count; i++) {
+    StatsEvent *event = &stats.events[i];
+    fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %u}",
+            phase_names[event->phase], (event->start - stats.start) / 1e3, event->duration / 1e3, pid, event->tid);
+  }
+
+  // Counters go in a single event at the end of the trace
+  fprintf(file, ",\n{\"name\": \"syscalls\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %d, \"args\": {", wall_ns / 1e3, pid);
+  for (int i = 0; i < SYS_COUNT; i++) {
+    fprintf(file, "%s\"%s\": %llu", i > 0 ? ", " : "", syscall_names[i], (unsigned long long)stats.syscalls[i]);
+  }
+  fprintf(file, "}},\n{\"name\": \"memory\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %d, \"args\": {\"peak_rss_kb\": %ld}}",
+          wall_ns / 1e3, pid, peak_rss_kb());
+  fprintf(file, "\n]}\n");
+
+  if (stats.event_count > STATS_MAX_EVENTS)
+    fprintf(stderr, "WARNING: Trace truncated to its first %d events.\n", STATS_MAX_EVENTS);
+  fclose(file);
+}
+
+void stats_finish(void) {
+  if (!stats_enabled)
+    return;
+  stats_enabled = false;
+
+  uint64_t wall_ns = stats_now() - stats.start;
+  if (stats.summary)
+    print_summary(wall_ns);
+  if (stats.trace_path != NULL && stats.events != NULL)
+    write_trace(wall_ns);
+
+  free(stats.events);
+  stats.events = NULL;
+}
+
+#else
+
+void stats_start(bool summary, const char *trace_path) {
+  if (summary || trace_path != NULL)
+    fprintf(stderr, "ERROR: connote was built without statistics, rebuild with STATS=1.\n");
+}
+
+void stats_finish(void) {}
+
+#endif // CONNOTE_STATS
@@ -0,0 +1,74 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Phases timed by `--stats` and `--trace`. Phases nest: slugging happens
+// inside formatting, and parsing inside an index build's reads.
+typedef enum {
+  PHASE_CONFIG,
+  PHASE_DIR_WALK,
+  PHASE_STAT,
+  PHASE_PARSE,
+  PHASE_SLUG,
+  PHASE_FORMAT,
+  PHASE_WRITE,
+  PHASE_RENAME,
+  PHASE_COUNT
+} StatsPhase;
+
+// System calls made on the hot paths. Directory reads are counted per
+// readdir call, which batches the underlying getdents.
+typedef enum {
+  SYS_OPEN,
+  SYS_READ,
+  SYS_WRITE,
+  SYS_STAT,
+  SYS_READDIR,
+  SYS_RENAME,
+  SYS_FSYNC,
+  SYS_URING_ENTER,
+  SYS_COUNT
+} StatsSyscall;
+
+// Trace events beyond this many are dropped, the totals are still kept
+#define STATS_MAX_EVENTS (1 << 20)
+
+// Start collecting for one command. `summary` prints totals to stderr when
+// the command finishes, `trace_path`, if not NULL, is written as a Chrome
+// trace-event file.
+void stats_start(bool summary, const char *trace_path);
+void stats_finish(void);
+
+#ifdef CONNOTE_STATS
+
+extern bool stats_enabled;
+
+uint64_t stats_now(void);
+void stats_record(StatsPhase phase, uint64_t start);
+void stats_count(StatsSyscall syscall_id, uint64_t n);
+
+// Time the code between STATS_BEGIN(phase) and STATS_END(phase), which must
+// be in the same scope
+#define STATS_BEGIN(phase) uint64_t stats_begin_##phase = stats_enabled ? stats_now() : 0
+#define STATS_END(phase)                                                                                               \
+  do {                                                                                                                 \
+    if (stats_enabled)                                                                                                 \
+      stats_record(phase, stats_begin_##phase);                                                                        \
+  } while (0)
+#define STATS_SYSCALL(syscall_id, n)                                                                                   \
+  do {                                                                                                                 \
+    if (stats_enabled)                                                                                                 \
+      stats_count(syscall_id, n);                                                                                      \
+  } while (0)
+
+#else
+
+#define STATS_BEGIN(phase)
+#define STATS_END(phase)
+#define STATS_SYSCALL(syscall_id, n)
+
+#endif // CONNOTE_STATS
+
+#endif // STATS_H_
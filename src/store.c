@@ -0,0 +1,945 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "index.h"
+#include "spill.h"
+#include "stats.h"
+#include "store.h"
+#include "utils.h"
+
+// Castagnoli polynomial, reflected
+#define CRC32C_POLY 0x82f63b78u
+// Readers load bit packed fields 8 bytes at a time, so the bits are padded
+#define STORE_BIT_PADDING 8
+
+static uint32_t crc32c_table[256];
+
+static uint32_t crc32c_portable(uint32_t crc, const uint8_t *data, size_t length) {
+  if (crc32c_table[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t value = i;
+      for (int bit = 0; bit < 8; bit++) {
+        value = value & 1 ? (value >> 1) ^ CRC32C_POLY : value >> 1;
+      }
+      crc32c_table[i] = value;
+    }
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    crc = crc32c_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t length) {
+  uint64_t value = crc;
+  for (; length >= 8; data += 8, length -= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    value = _mm_crc32_u64(value, word);
+  }
+  for (; length > 0; data++, length--) {
+    value = _mm_crc32_u8((uint32_t)value, *data);
+  }
+  return (uint32_t)value;
+}
+#endif
+
+// Continue a CRC32C, starting from 0, over `length` bytes of `data`
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+  crc = ~crc;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2"))
+    return ~crc32c_sse42(crc, data, length);
+#endif
+  return ~crc32c_portable(crc, data, length);
+}
+
+static int store_path(const char *dir_path, const char *name, char *dest) {
+  size_t len = strlen(dir_path);
+  int written = snprintf(dest, MAX_PATH_LEN, "%s%s%s", dir_path, len > 0 && dir_path[len - 1] == '/' ? "" : "/", name);
+  return written >= 0 && written < MAX_PATH_LEN ? SUCCESS : FAILURE;
+}
+
+// Writing
+
+static bool get_varint(const uint8_t **pos, const uint8_t *end, uint64_t *value);
+
+static void sink_init(StoreSink *sink, int fd) {
+  memset(sink, 0, sizeof(*sink));
+  sink->fd = fd;
+}
+
+// Fold the bytes appended since the last call into the sink's CRC32C
+static void sink_checksum(StoreSink *sink) {
+  if (!sink->failed)
+    sink->crc = crc32c(sink->crc, sink->data + sink->checked, sink->length - sink->checked);
+  sink->checked = sink->length;
+}
+
+static int write_all(int fd, const uint8_t *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    STATS_SYSCALL(SYS_WRITE, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FAILURE;
+    data += n;
+    length -= (size_t)n;
+  }
+  return SUCCESS;
+}
+
+static void sink_flush(StoreSink *sink) {
+  sink_checksum(sink);
+  if (!sink->failed && sink->fd != -1 && write_all(sink->fd, sink->data, sink->length) != SUCCESS)
+    sink->failed = true;
+  sink->length = sink->checked = 0;
+}
+
+// Make room for `extra` more bytes, returns false when out of memory
+static bool sink_reserve(StoreSink *sink, size_t extra) {
+  if (sink->failed)
+    return false;
+  if (sink->length + extra <= sink->capacity)
+    return true;
+
+  size_t capacity = sink->capacity ? sink->capacity : 4096;
+  while (capacity < sink->length + extra) {
+    capacity *= 2;
+  }
+  uint8_t *data = realloc(sink->data, capacity);
+  if (data == NULL) {
+    sink->failed = true;
+    return false;
+  }
+  sink->data = data;
+  sink->capacity = capacity;
+  return true;
+}
+
+static void sink_append(StoreSink *sink, const void *data, size_t length) {
+  if (!sink_reserve(sink, length))
+    return;
+  memcpy(sink->data + sink->length, data, length);
+  sink->length += length;
+  sink->total += length;
+  if (sink->fd != -1 && sink->length >= STORE_SINK_FLUSH)
+    sink_flush(sink);
+}
+
+static void sink_put_u32(StoreSink *sink, uint32_t value) { sink_append(sink, &value, sizeof(value)); }
+
+static void sink_put_u64(StoreSink *sink, uint64_t value) { sink_append(sink, &value, sizeof(value)); }
+
+static void sink_put_zeros(StoreSink *sink, size_t length) {
+  static const uint8_t zeros[64];
+  while (length > 0) {
+    size_t take = length < sizeof(zeros) ? length : sizeof(zeros);
+    sink_append(sink, zeros, take);
+    length -= take;
+  }
+}
+
+static void sink_put_varint(StoreSink *sink, uint64_t value) {
+  uint8_t bytes[10];
+  size_t length = 0;
+  while (value >= 0x80) {
+    bytes[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[length++] = (uint8_t)value;
+  sink_append(sink, bytes, length);
+}
+
+// Drop the pages of the page aligned mapping `start` read up to `pos`
+static void release_behind(const uint8_t *start, size_t *released, size_t pos) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t end = pos / page * page;
+  if (end > *released) {
+    madvise((void *)(start + *released), end - *released, MADV_DONTNEED);
+    *released = end;
+  }
+}
+
+// Everything appended to `sink`, mapped back in when it spilled to a file.
+// Release it with `sink_unmap`.
+static const uint8_t *sink_contents(StoreSink *sink) {
+  if (sink->fd == -1 || sink->total == 0)
+    return sink->data;
+  sink_flush(sink);
+  if (sink->failed)
+    return NULL;
+  void *map = mmap(NULL, sink->total, PROT_READ, MAP_PRIVATE, sink->fd, 0);
+  if (map == MAP_FAILED) {
+    sink->failed = true;
+    return NULL;
+  }
+  madvise(map, sink->total, MADV_SEQUENTIAL);
+  return map;
+}
+
+static void sink_unmap(const StoreSink *sink, const uint8_t *contents) {
+  if (sink->fd != -1 && sink->total > 0 && contents != NULL)
+    munmap((void *)contents, sink->total);
+}
+
+// Append the whole of `from` to `to`, dropping pages read as it goes
+static void sink_copy(StoreSink *to, StoreSink *from) {
+  const uint8_t *data = sink_contents(from);
+  if (data == NULL && from->total > 0) {
+    to->failed = true;
+    return;
+  }
+  size_t released = 0;
+  for (uint64_t done = 0; done < from->total;) {
+    size_t take = from->total - done < STORE_RELEASE_BYTES ? from->total - done : STORE_RELEASE_BYTES;
+    sink_append(to, data + done, take);
+    done += take;
+    if (from->fd != -1)
+      release_behind(data, &released, done);
+  }
+  sink_unmap(from, data);
+}
+
+static void sink_free(StoreSink *sink) {
+  free(sink->data);
+  if (sink->fd != -1)
+    close(sink->fd);
+  memset(sink, 0, sizeof(*sink));
+  sink->fd = -1;
+}
+
+// Signed deltas are zigzag coded so small steps either way stay short
+static uint64_t zigzag(uint64_t delta) { return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63); }
+static uint64_t unzigzag(uint64_t value) { return (value >> 1) ^ (0 - (value & 1)); }
+
+typedef struct {
+  StoreSink *sink;
+  uint64_t bits; // Pending bits, lowest first
+  uint32_t pending;
+} BitWriter;
+
+static void bits_put(BitWriter *writer, uint64_t value, uint32_t width) {
+  writer->bits |= value << writer->pending;
+  writer->pending += width;
+  while (writer->pending >= 8) {
+    uint8_t byte = (uint8_t)writer->bits;
+    sink_append(writer->sink, &byte, 1);
+    writer->bits >>= 8;
+    writer->pending -= 8;
+  }
+}
+
+static void bits_flush(BitWriter *writer) {
+  if (writer->pending > 0) {
+    uint8_t byte = (uint8_t)writer->bits;
+    sink_append(writer->sink, &byte, 1);
+  }
+  sink_put_zeros(writer->sink, STORE_BIT_PADDING);
+}
+
+static size_t block_count(size_t count) { return (count + STORE_BLOCK_SIZE - 1) / STORE_BLOCK_SIZE; }
+
+static int64_t note_mtime_ns(const NoteRecord *note) { return (int64_t)note->mtime * 1000000000 + note->mtime_nsec; }
+
+static uint64_t column_value(const NoteRecord *note, StoreSectionKind kind) {
+  switch (kind) {
+  case STORE_IDS:
+    return note->id;
+  case STORE_MTIMES:
+    return (uint64_t)note_mtime_ns(note);
+  default:
+    return note->size;
+  }
+}
+
+static size_t common_prefix(const char *a, const char *b) {
+  size_t length = 0;
+  while (a[length] != '\0' && a[length] == b[length]) {
+    length++;
+  }
+  return length;
+}
+
+static uint32_t handle_width(uint32_t keyword_count) {
+  uint32_t width = 1;
+  while (width < 32 && (1u << width) < keyword_count) {
+    width++;
+  }
+  return width;
+}
+
+// Start a store. With `spill_dir`, its sections are gathered in unlinked
+// files there rather than in memory, so notes can be added without bound.
+int store_writer_init(StoreWriter *writer, const char *spill_dir) {
+  memset(writer, 0, sizeof(*writer));
+  for (int kind = 0; kind < STORE_SECTION_COUNT; kind++) {
+    sink_init(&writer->tables[kind], -1);
+    sink_init(&writer->data[kind], -1);
+  }
+  if (spill_dir == NULL)
+    return SUCCESS;
+
+  for (int kind = 0; kind < STORE_SECTION_COUNT; kind++) {
+    if (kind == STORE_KEYWORDS)
+      continue;
+    for (int part = 0; part < 2; part++) {
+      char path[MAX_PATH_LEN];
+      int fd = store_path(spill_dir, SPILL_DIR_PREFIX "XXXXXX", path) == SUCCESS ? mkostemp(path, O_CLOEXEC) : -1;
+      STATS_SYSCALL(SYS_OPEN, 1);
+      if (fd == -1) {
+        fprintf(stderr, "ERROR: Could not create a file in %s for the index.\n", spill_dir);
+        store_writer_free(writer);
+        return FAILURE;
+      }
+      unlink(path);
+      (part == 0 ? writer->tables : writer->data)[kind].fd = fd;
+    }
+  }
+  return SUCCESS;
+}
+
+// Add the next note. Notes must come in order of strictly ascending names,
+// which is also the order of their IDs. Every section but the keywords takes
+// its entry for the note now; the bit packed keyword handles are held as
+// varints until the number of keywords, and so their width, is known.
+int store_writer_add(StoreWriter *writer, const NoteRecord *note) {
+  size_t i = writer->count;
+  const char *name = note->name;
+  size_t shared = 0;
+  if (i % STORE_RESTART_INTERVAL == 0) {
+    sink_put_u32(&writer->tables[STORE_NAMES], (uint32_t)writer->data[STORE_NAMES].total);
+  } else {
+    // Lookups binary search the names, so they must be strictly ascending
+    if (strcmp(writer->previous_name, name) >= 0)
+      writer->failed = true;
+    shared = common_prefix(writer->previous_name, name);
+  }
+  size_t length = strlen(name);
+  if (length >= sizeof(writer->previous_name))
+    writer->failed = true;
+  if (writer->failed)
+    return FAILURE;
+  sink_put_varint(&writer->data[STORE_NAMES], shared);
+  sink_put_varint(&writer->data[STORE_NAMES], length - shared);
+  sink_append(&writer->data[STORE_NAMES], name + shared, length - shared);
+  memcpy(writer->previous_name, name, length + 1);
+
+  if (i % STORE_BLOCK_SIZE == 0) {
+    for (int kind = STORE_IDS; kind <= STORE_SIZES; kind++) {
+      sink_put_u32(&writer->tables[kind], (uint32_t)writer->data[kind].total);
+      writer->previous[kind] = 0;
+    }
+    sink_put_u64(&writer->tables[STORE_NOTE_KEYWORDS], writer->handles);
+    sink_put_u32(&writer->tables[STORE_LINKS], (uint32_t)writer->data[STORE_LINKS].total);
+  }
+  for (int kind = STORE_IDS; kind <= STORE_SIZES; kind++) {
+    uint64_t value = column_value(note, kind);
+    sink_put_varint(&writer->data[kind], zigzag(value - writer->previous[kind]));
+    writer->previous[kind] = value;
+  }
+
+  sink_put_varint(&writer->data[STORE_NOTE_KEYWORDS], note->kw_count);
+  for (uint32_t k = 0; k < note->kw_count; k++) {
+    sink_put_varint(&writer->data[STORE_NOTE_KEYWORDS], note->kw[k]);
+  }
+  writer->handles += note->kw_count;
+
+  sink_put_u32(&writer->tables[STORE_TITLES], (uint32_t)writer->data[STORE_TITLES].total);
+  sink_append(&writer->data[STORE_TITLES], note->full_title, strlen(note->full_title) + 1);
+
+  sink_put_varint(&writer->data[STORE_LINKS], note->link_count);
+  uint64_t previous = 0;
+  for (uint32_t j = 0; j < note->link_count; j++) {
+    sink_put_varint(&writer->data[STORE_LINKS], note->links[j] - previous);
+    previous = note->links[j];
+  }
+
+  writer->count++;
+  return SUCCESS;
+}
+
+// An offset for each keyword and one past the last, then the keywords
+static void write_keywords(StoreSink *out, const KeywordTable *keywords) {
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i <= keywords->count; i++) {
+    sink_put_u32(out, offset);
+    if (i < keywords->count)
+      offset += (uint32_t)strlen(keywords->names[i]) + 1;
+  }
+  for (uint32_t i = 0; i < keywords->count; i++) {
+    sink_append(out, keywords->names[i], strlen(keywords->names[i]) + 1);
+  }
+}
+
+// The bits per handle, a block count and the bit offset of each block, then
+// for each note its keyword count and handles. The offsets are worked out
+// from the handles before each block, and the handles repacked from varints.
+static void write_note_keywords(StoreSink *out, StoreWriter *writer, uint32_t keyword_count) {
+  uint32_t width = handle_width(keyword_count);
+  size_t blocks = block_count(writer->count);
+  sink_put_u32(out, width);
+  sink_put_u32(out, (uint32_t)blocks);
+
+  StoreSink *table = &writer->tables[STORE_NOTE_KEYWORDS];
+  const uint8_t *handles = sink_contents(table);
+  for (size_t b = 0; handles != NULL && b < blocks; b++) {
+    uint64_t before;
+    memcpy(&before, handles + b * sizeof(uint64_t), sizeof(before));
+    sink_put_u64(out, b * STORE_BLOCK_SIZE * STORE_KW_COUNT_BITS + before * width);
+  }
+  sink_unmap(table, handles);
+
+  StoreSink *data = &writer->data[STORE_NOTE_KEYWORDS];
+  const uint8_t *start = sink_contents(data);
+  const uint8_t *pos = start, *end = start + data->total;
+  size_t released = 0;
+  BitWriter bits = {.sink = out};
+  for (size_t i = 0; start != NULL && i < writer->count; i++) {
+    uint64_t count, handle;
+    if (!get_varint(&pos, end, &count)) {
+      out->failed = true;
+      break;
+    }
+    bits_put(&bits, count, STORE_KW_COUNT_BITS);
+    for (uint64_t k = 0; k < count && get_varint(&pos, end, &handle); k++) {
+      bits_put(&bits, handle, width);
+    }
+    if (data->fd != -1 && i % (STORE_BLOCK_SIZE * 1024) == 0)
+      release_behind(start, &released, (size_t)(pos - start));
+  }
+  bits_flush(&bits);
+  sink_unmap(data, start);
+  if ((handles == NULL && table->total > 0) || (start == NULL && data->total > 0))
+    out->failed = true;
+}
+
+// Join the sections into the store of `dir_path` with `keywords`, which may
+// have grown while notes were added. The file is written under a temporary
+// name and renamed into place, so readers see either the old store or the
+// new one. It is not fsynced: the store is only a cache, and one torn by a
+// crash fails its checksums and is rebuilt.
+int store_writer_finish(StoreWriter *writer, const char *dir_path, const KeywordTable *keywords) {
+  bool too_large = writer->count > UINT32_MAX || keywords->count >= (1u << 31);
+  for (int kind = 0; kind < STORE_SECTION_COUNT; kind++) {
+    too_large = too_large || writer->data[kind].total > UINT32_MAX;
+  }
+  char temp_path[MAX_PATH_LEN], path[MAX_PATH_LEN];
+  char temp_name[64];
+  snprintf(temp_name, sizeof(temp_name), "%s.%ld", STORE_FILE_NAME, (long)getpid());
+  if (writer->failed || too_large || store_path(dir_path, temp_name, temp_path) != SUCCESS ||
+      store_path(dir_path, STORE_FILE_NAME, path) != SUCCESS)
+    return FAILURE;
+
+  int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+
+  StoreSink out;
+  sink_init(&out, fd);
+  StoreHeader header = {.version = STORE_VERSION,
+                        .section_count = STORE_SECTION_COUNT,
+                        .note_count = (uint32_t)writer->count,
+                        .keyword_count = keywords->count};
+  memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+  StoreSection sections[STORE_SECTION_COUNT];
+  // The header and section table are filled in last
+  sink_put_zeros(&out, sizeof(header) + sizeof(sections));
+
+  size_t restarts = (writer->count + STORE_RESTART_INTERVAL - 1) / STORE_RESTART_INTERVAL;
+  for (uint32_t kind = 0; kind < STORE_SECTION_COUNT; kind++) {
+    sink_put_zeros(&out, (8 - out.total % 8) % 8);
+    sink_checksum(&out);
+    out.crc = 0;
+    uint64_t start = out.total;
+    switch (kind) {
+    case STORE_NAMES:
+      sink_put_u32(&out, (uint32_t)restarts);
+      break;
+    case STORE_IDS:
+    case STORE_MTIMES:
+    case STORE_SIZES:
+    case STORE_LINKS:
+      sink_put_u32(&out, (uint32_t)block_count(writer->count));
+      break;
+    default:
+      break;
+    }
+
+    if (kind == STORE_KEYWORDS) {
+      write_keywords(&out, keywords);
+    } else if (kind == STORE_NOTE_KEYWORDS) {
+      write_note_keywords(&out, writer, keywords->count);
+    } else {
+      sink_copy(&out, &writer->tables[kind]);
+      if (kind == STORE_TITLES)
+        sink_put_u32(&out, (uint32_t)writer->data[kind].total);
+      sink_copy(&out, &writer->data[kind]);
+    }
+    sink_checksum(&out);
+    sections[kind] = (StoreSection){.kind = kind, .crc = out.crc, .offset = start, .length = out.total - start};
+  }
+  sink_flush(&out);
+
+  int outcome = out.failed ? FAILURE : SUCCESS;
+  header.crc = crc32c(crc32c(0, &header, sizeof(header)), sections, sizeof(sections));
+  if (outcome == SUCCESS && (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+                             pwrite(fd, sections, sizeof(sections), sizeof(header)) != (ssize_t)sizeof(sections)))
+    outcome = FAILURE;
+  STATS_SYSCALL(SYS_WRITE, 2);
+  out.fd = -1;
+  sink_free(&out);
+  if (close(fd) != 0)
+    outcome = FAILURE;
+
+  if (outcome == SUCCESS) {
+    outcome = renameat(AT_FDCWD, temp_path, AT_FDCWD, path) == 0 ? SUCCESS : FAILURE;
+    STATS_SYSCALL(SYS_RENAME, 1);
+  }
+  if (outcome != SUCCESS)
+    unlink(temp_path);
+
+  return outcome;
+}
+
+void store_writer_free(StoreWriter *writer) {
+  for (int kind = 0; kind < STORE_SECTION_COUNT; kind++) {
+    sink_free(&writer->tables[kind]);
+    sink_free(&writer->data[kind]);
+  }
+}
+
+// Save `index` as the store of its directory
+int store_write(const NoteIndex *index) {
+  StoreWriter writer;
+  store_writer_init(&writer, NULL);
+  int outcome = SUCCESS;
+  for (size_t i = 0; i < index->count && outcome == SUCCESS; i++) {
+    outcome = store_writer_add(&writer, &index->notes[i]);
+  }
+  if (outcome == SUCCESS)
+    outcome = store_writer_finish(&writer, index->dir_path, &index->keywords);
+  store_writer_free(&writer);
+  return outcome;
+}
+
+// Reading
+
+static bool get_varint(const uint8_t **pos, const uint8_t *end, uint64_t *value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *pos < end; shift += 7) {
+    uint8_t byte = *(*pos)++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t get_bits(const uint8_t *bits, const uint8_t *end, uint64_t bit, uint32_t width) {
+  if (bits + bit / 8 + 8 > end)
+    return 0;
+  uint64_t word;
+  memcpy(&word, bits + bit / 8, sizeof(word));
+  return (word >> (bit % 8)) & ((1ull << width) - 1);
+}
+
+// Point `*table` at `entries` values of `entry_size` bytes at `*pos`, and
+// move past them
+static bool take_table(const uint8_t **pos, const uint8_t *end, size_t entries, size_t entry_size,
+                       const void **table) {
+  if ((size_t)(end - *pos) / entry_size < entries)
+    return false;
+  *table = *pos;
+  *pos += entries * entry_size;
+  return true;
+}
+
+static bool take_u32(const uint8_t **pos, const uint8_t *end, uint32_t *value) {
+  if (end - *pos < (ptrdiff_t)sizeof(uint32_t))
+    return false;
+  memcpy(value, *pos, sizeof(uint32_t));
+  *pos += sizeof(uint32_t);
+  return true;
+}
+
+// Offsets of a table must stay within the data that follows it
+static bool offsets_valid(const uint32_t *offsets, size_t count, size_t data_length) {
+  for (size_t i = 0; i < count; i++) {
+    if (offsets[i] > data_length)
+      return false;
+  }
+  return true;
+}
+
+static bool open_column(StoreColumn *column, const uint8_t *pos, const uint8_t *end, size_t count) {
+  uint32_t blocks;
+  if (!take_u32(&pos, end, &blocks) || blocks != block_count(count) ||
+      !take_table(&pos, end, blocks, sizeof(uint32_t), (const void **)&column->blocks))
+    return false;
+  column->data = pos;
+  column->end = end;
+  return offsets_valid(column->blocks, blocks, (size_t)(end - pos));
+}
+
+// String tables end with a NUL, so every string in them is terminated
+static bool open_strings(const uint32_t **offsets, const char **strings, const uint8_t *pos, const uint8_t *end,
+                         size_t count) {
+  if (!take_table(&pos, end, count + 1, sizeof(uint32_t), (const void **)offsets))
+    return false;
+  *strings = (const char *)pos;
+  size_t length = (size_t)(end - pos);
+  return (*offsets)[count] == length && (length == 0 || pos[length - 1] == '\0') &&
+         offsets_valid(*offsets, count, length);
+}
+
+static bool open_sections(Store *store, const StoreSection *sections) {
+  const uint8_t *start[STORE_SECTION_COUNT], *end[STORE_SECTION_COUNT];
+  for (uint32_t kind = 0; kind < STORE_SECTION_COUNT; kind++) {
+    const StoreSection *section = &sections[kind];
+    if (section->kind != kind || section->offset % 8 != 0 || section->offset > store->map_size ||
+        section->length > store->map_size - section->offset)
+      return false;
+    start[kind] = store->map + section->offset;
+    end[kind] = start[kind] + section->length;
+    if (crc32c(0, start[kind], section->length) != section->crc)
+      return false;
+  }
+
+  const uint8_t *pos = start[STORE_NAMES];
+  uint32_t restarts;
+  if (!take_u32(&pos, end[STORE_NAMES], &restarts) ||
+      restarts != (store->count + STORE_RESTART_INTERVAL - 1) / STORE_RESTART_INTERVAL ||
+      !take_table(&pos, end[STORE_NAMES], restarts, sizeof(uint32_t), (const void **)&store->restarts))
+    return false;
+  store->names = pos;
+  store->names_end = end[STORE_NAMES];
+  if (!offsets_valid(store->restarts, restarts, (size_t)(store->names_end - pos)))
+    return false;
+
+  for (int kind = STORE_IDS; kind <= STORE_SIZES; kind++) {
+    if (!open_column(&store->columns[kind], start[kind], end[kind], store->count))
+      return false;
+  }
+  if (!open_strings(&store->keyword_offsets, &store->keywords, start[STORE_KEYWORDS], end[STORE_KEYWORDS],
+                    store->keyword_count) ||
+      !open_strings(&store->title_offsets, &store->titles, start[STORE_TITLES], end[STORE_TITLES], store->count))
+    return false;
+
+  pos = start[STORE_NOTE_KEYWORDS];
+  uint32_t blocks;
+  if (!take_u32(&pos, end[STORE_NOTE_KEYWORDS], &store->kw_width) || store->kw_width == 0 ||
+      store->kw_width > 32 || !take_u32(&pos, end[STORE_NOTE_KEYWORDS], &blocks) ||
+      blocks != block_count(store->count) ||
+      !take_table(&pos, end[STORE_NOTE_KEYWORDS], blocks, sizeof(uint64_t), (const void **)&store->kw_blocks))
+    return false;
+  store->kw_bits = pos;
+  store->kw_bits_end = end[STORE_NOTE_KEYWORDS];
+
+  return open_column(&store->links, start[STORE_LINKS], end[STORE_LINKS], store->count);
+}
+
+// Map the store of `dir_path` and check its header and every section.
+// Returns FAILURE when there is no usable store.
+int store_open(Store *store, const char *dir_path) {
+  memset(store, 0, sizeof(*store));
+  char path[MAX_PATH_LEN];
+  if (store_path(dir_path, STORE_FILE_NAME, path) != SUCCESS)
+    return FAILURE;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1)
+    return FAILURE;
+  struct stat st;
+  size_t table_end = sizeof(StoreHeader) + STORE_SECTION_COUNT * sizeof(StoreSection);
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < table_end) {
+    close(fd);
+    return FAILURE;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return FAILURE;
+  store->map = map;
+  store->map_size = (size_t)st.st_size;
+  store->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+  StoreHeader header;
+  memcpy(&header, store->map, sizeof(header));
+  uint32_t crc = header.crc;
+  header.crc = 0;
+  bool valid = memcmp(header.magic, STORE_MAGIC, sizeof(header.magic)) == 0 && header.version == STORE_VERSION &&
+               header.section_count == STORE_SECTION_COUNT &&
+               crc32c(crc32c(0, &header, sizeof(header)), store->map + sizeof(header), table_end - sizeof(header)) ==
+                   crc;
+  if (valid) {
+    store->count = header.note_count;
+    store->keyword_count = header.keyword_count;
+    valid = open_sections(store, (const StoreSection *)(store->map + sizeof(header)));
+  }
+  if (!valid) {
+    store_close(store);
+    return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+void store_close(Store *store) {
+  if (store->map != NULL)
+    munmap((void *)store->map, store->map_size);
+  memset(store, 0, sizeof(*store));
+}
+
+// Decode the name at `*pos` over the previous name in `dest`, whose length
+// is `*length`
+static bool next_name(const uint8_t **pos, const uint8_t *end, char *dest, size_t dest_size, size_t *length) {
+  uint64_t shared, rest;
+  if (!get_varint(pos, end, &shared) || !get_varint(pos, end, &rest) || shared > *length ||
+      rest >= dest_size - shared || rest > (uint64_t)(end - *pos))
+    return false;
+  memcpy(dest + shared, *pos, rest);
+  *pos += rest;
+  *length = shared + rest;
+  dest[*length] = '\0';
+  return true;
+}
+
+int store_name(const Store *store, size_t i, char *dest, size_t dest_size) {
+  if (i >= store->count || dest_size == 0)
+    return FAILURE;
+
+  const uint8_t *pos = store->names + store->restarts[i / STORE_RESTART_INTERVAL];
+  size_t length = 0;
+  for (size_t j = 0; j <= i % STORE_RESTART_INTERVAL; j++) {
+    if (!next_name(&pos, store->names_end, dest, dest_size, &length))
+      return FAILURE;
+  }
+  return SUCCESS;
+}
+
+// Compare the whole name stored at restart `r` with `name`
+static int compare_restart(const Store *store, size_t r, const char *name) {
+  const uint8_t *pos = store->names + store->restarts[r];
+  uint64_t shared, length;
+  if (!get_varint(&pos, store->names_end, &shared) || !get_varint(&pos, store->names_end, &length) ||
+      length > (uint64_t)(store->names_end - pos))
+    return 1;
+
+  size_t name_len = strlen(name);
+  int order = memcmp(pos, name, length < name_len ? length : name_len);
+  if (order != 0)
+    return order;
+  return (length > name_len) - (length < name_len);
+}
+
+// Returns the position of `name` in the store, or NOT_FOUND
+size_t store_find_name(const Store *store, const char *name) {
+  size_t restarts = (store->count + STORE_RESTART_INTERVAL - 1) / STORE_RESTART_INTERVAL;
+  // Last restart not after `name`
+  size_t lo = 0;
+  size_t hi = restarts;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (compare_restart(store, mid, name) <= 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0)
+    return NOT_FOUND;
+
+  size_t first = (lo - 1) * STORE_RESTART_INTERVAL;
+  const uint8_t *pos = store->names + store->restarts[lo - 1];
+  char current[MAX_PATH_LEN];
+  size_t length = 0;
+  for (size_t i = first; i < store->count && i < first + STORE_RESTART_INTERVAL; i++) {
+    if (!next_name(&pos, store->names_end, current, sizeof(current), &length))
+      return NOT_FOUND;
+    int order = strcmp(current, name);
+    if (order == 0)
+      return i;
+    if (order > 0)
+      break;
+  }
+  return NOT_FOUND;
+}
+
+static uint64_t column_get(const StoreColumn *column, size_t i) {
+  const uint8_t *pos = column->data + column->blocks[i / STORE_BLOCK_SIZE];
+  uint64_t value = 0;
+  for (size_t j = 0; j <= i % STORE_BLOCK_SIZE; j++) {
+    uint64_t delta;
+    if (!get_varint(&pos, column->end, &delta))
+      return 0;
+    value += unzigzag(delta);
+  }
+  return value;
+}
+
+uint64_t store_id(const Store *store, size_t i) {
+  return i < store->count ? column_get(&store->columns[STORE_IDS], i) : 0;
+}
+
+const char *store_full_title(const Store *store, size_t i) {
+  return i < store->count ? store->titles + store->title_offsets[i] : NULL;
+}
+
+const char *store_keyword(const Store *store, uint32_t handle) {
+  return handle < store->keyword_count ? store->keywords + store->keyword_offsets[handle] : NULL;
+}
+
+// Read the handles of one note at `*bit`, dropping any that are out of range
+static uint32_t next_keywords(const Store *store, uint64_t *bit, uint32_t *dest) {
+  uint32_t count = (uint32_t)get_bits(store->kw_bits, store->kw_bits_end, *bit, STORE_KW_COUNT_BITS);
+  *bit += STORE_KW_COUNT_BITS;
+  uint32_t kept = 0;
+  for (uint32_t k = 0; k < count; k++) {
+    uint32_t handle = (uint32_t)get_bits(store->kw_bits, store->kw_bits_end, *bit, store->kw_width);
+    *bit += store->kw_width;
+    if (handle < store->keyword_count && kept < MAX_KEYS)
+      dest[kept++] = handle;
+  }
+  return kept;
+}
+
+// Write the keyword handles of note `i`, at most MAX_KEYS, into `dest`
+uint32_t store_note_keywords(const Store *store, size_t i, uint32_t *dest) {
+  if (i >= store->count)
+    return 0;
+
+  uint64_t bit = store->kw_blocks[i / STORE_BLOCK_SIZE];
+  for (size_t j = 0; j < i % STORE_BLOCK_SIZE; j++) {
+    uint64_t count = get_bits(store->kw_bits, store->kw_bits_end, bit, STORE_KW_COUNT_BITS);
+    bit += STORE_KW_COUNT_BITS + count * store->kw_width;
+  }
+  return next_keywords(store, &bit, dest);
+}
+
+// Skip the links of one note, returning false if they are malformed
+static bool skip_links(const uint8_t **pos, const uint8_t *end) {
+  uint64_t count, delta;
+  if (!get_varint(pos, end, &count))
+    return false;
+  for (uint64_t j = 0; j < count; j++) {
+    if (!get_varint(pos, end, &delta))
+      return false;
+  }
+  return true;
+}
+
+// Write up to `dest_size` links of note `i` into `dest` and return how many
+// the note has
+uint32_t store_links(const Store *store, size_t i, uint64_t *dest, uint32_t dest_size) {
+  if (i >= store->count)
+    return 0;
+
+  const uint8_t *pos = store->links.data + store->links.blocks[i / STORE_BLOCK_SIZE];
+  for (size_t j = 0; j < i % STORE_BLOCK_SIZE; j++) {
+    if (!skip_links(&pos, store->links.end))
+      return 0;
+  }
+
+  uint64_t count, value = 0;
+  if (!get_varint(&pos, store->links.end, &count) || count > UINT32_MAX)
+    return 0;
+  for (uint32_t j = 0; j < count && j < dest_size; j++) {
+    uint64_t delta;
+    if (!get_varint(&pos, store->links.end, &delta))
+      return j;
+    value += delta;
+    dest[j] = value;
+  }
+  return (uint32_t)count;
+}
+
+void store_cursor_init(StoreCursor *cursor, const Store *store) {
+  memset(cursor, 0, sizeof(*cursor));
+  cursor->store = store;
+  cursor->position = NOT_FOUND;
+}
+
+// Move to the next note, returning false at the end or on malformed data
+bool store_cursor_next(StoreCursor *cursor) {
+  const Store *store = cursor->store;
+  size_t i = cursor->position + 1;
+  cursor->position = store->count;
+  if (i >= store->count)
+    return false;
+
+  if (i % STORE_RESTART_INTERVAL == 0)
+    cursor->name_pos = store->names + store->restarts[i / STORE_RESTART_INTERVAL];
+  if (i % STORE_BLOCK_SIZE == 0) {
+    size_t block = i / STORE_BLOCK_SIZE;
+    for (int kind = STORE_IDS; kind <= STORE_SIZES; kind++) {
+      cursor->column_pos[kind] = store->columns[kind].data + store->columns[kind].blocks[block];
+      cursor->column_value[kind] = 0;
+    }
+    cursor->link_pos = store->links.data + store->links.blocks[block];
+    cursor->kw_bit = store->kw_blocks[block];
+  }
+
+  size_t length = strlen(cursor->name);
+  if (!next_name(&cursor->name_pos, store->names_end, cursor->name, sizeof(cursor->name), &length))
+    return false;
+  for (int kind = STORE_IDS; kind <= STORE_SIZES; kind++) {
+    uint64_t delta;
+    if (!get_varint(&cursor->column_pos[kind], store->columns[kind].end, &delta))
+      return false;
+    cursor->column_value[kind] += unzigzag(delta);
+  }
+  cursor->id = cursor->column_value[STORE_IDS];
+  cursor->mtime_ns = (int64_t)cursor->column_value[STORE_MTIMES];
+  cursor->size = cursor->column_value[STORE_SIZES];
+  cursor->kw_count = next_keywords(store, &cursor->kw_bit, cursor->kw);
+
+  uint64_t count, value = 0;
+  // Every link takes at least a byte, which bounds the count before allocating
+  if (!get_varint(&cursor->link_pos, store->links.end, &count) ||
+      count > (uint64_t)(store->links.end - cursor->link_pos))
+    return false;
+  if (count > cursor->link_capacity) {
+    uint64_t *links = realloc(cursor->links, count * sizeof(uint64_t));
+    if (links == NULL)
+      return false;
+    cursor->links = links;
+    cursor->link_capacity = (uint32_t)count;
+  }
+  for (uint32_t j = 0; j < count; j++) {
+    uint64_t delta;
+    if (!get_varint(&cursor->link_pos, store->links.end, &delta))
+      return false;
+    value += delta;
+    cursor->links[j] = value;
+  }
+  cursor->link_count = (uint32_t)count;
+
+  cursor->position = i;
+  return true;
+}
+
+void store_cursor_free(StoreCursor *cursor) {
+  free(cursor->links);
+  cursor->links = NULL;
+  cursor->link_capacity = 0;
+}
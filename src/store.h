@@ -0,0 +1,167 @@
+#ifndef STORE_H_
+#define STORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "index.h"
+
+// A NoteIndex saved in the vault so the next build only reads the notes that
+// changed. Readdir skips the file, since its name has no ID.
+#define STORE_FILE_NAME ".connote-index"
+#define STORE_MAGIC "CNDX"
+// Version 2 keeps links to files by name along with `denote:` links
+#define STORE_VERSION 2
+// Every this many names, one is stored whole rather than front coded
+#define STORE_RESTART_INTERVAL 16
+// Notes per block of the delta coded columns, and of the keyword and link
+// sections. Reading one note decodes at most one block.
+#define STORE_BLOCK_SIZE 64
+// Bits holding the number of keywords of a note
+#define STORE_KW_COUNT_BITS 5
+
+// Sections of a store being written are gathered in buffers of this size,
+// and with a memory budget flushed to temporary files from them
+#define STORE_SINK_FLUSH (64 * 1024)
+// Pages of a large section read sequentially are dropped behind the reader
+// each time this many more bytes have been read
+#define STORE_RELEASE_BYTES (1 << 20)
+
+// The store is a header, a table of sections and the sections themselves.
+// Sections start on 8 byte boundaries and hold, after their own small
+// tables, only the data described next to each kind below. Integers are in
+// host byte order; a store from a host of the other order fails the version
+// check and is rebuilt.
+typedef enum {
+  STORE_NAMES,         // Sorted filenames, front coded between restarts
+  STORE_IDS,           // Note IDs, delta coded
+  STORE_MTIMES,        // Modification times in nanoseconds, delta coded
+  STORE_SIZES,         // File sizes, delta coded
+  STORE_KEYWORDS,      // Keyword strings, NUL terminated, by handle
+  STORE_NOTE_KEYWORDS, // Keyword handles of each note, bit packed
+  STORE_TITLES,        // Frontmatter titles, NUL terminated, by note
+  STORE_LINKS,         // Linked IDs of each note, delta coded
+  STORE_SECTION_COUNT
+} StoreSectionKind;
+
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint16_t section_count;
+  uint32_t note_count;
+  uint32_t keyword_count;
+  uint32_t crc; // CRC32C of the header, with this field zero, and the section table
+  uint32_t reserved;
+} StoreHeader;
+
+typedef struct {
+  uint32_t kind;
+  uint32_t crc; // CRC32C of the section
+  uint64_t offset;
+  uint64_t length;
+} StoreSection;
+
+// Delta coded column of 64 bit values. Each block starts from zero, so any
+// value is found by decoding from the start of its block.
+typedef struct {
+  const uint32_t *blocks; // Offsets of the blocks into `data`
+  const uint8_t *data;
+  const uint8_t *end;
+} StoreColumn;
+
+// A store mapped read only. Every accessor reads straight from the mapping.
+typedef struct {
+  const uint8_t *map;
+  size_t map_size;
+  int64_t mtime_ns; // When the store was written
+  size_t count;
+  uint32_t keyword_count;
+  // STORE_NAMES
+  const uint32_t *restarts; // Offsets of every STORE_RESTART_INTERVAL-th name into `names`
+  const uint8_t *names;
+  const uint8_t *names_end;
+  StoreColumn columns[STORE_SIZES + 1]; // By section kind
+  // STORE_KEYWORDS and STORE_TITLES
+  const uint32_t *keyword_offsets;
+  const char *keywords;
+  const uint32_t *title_offsets;
+  const char *titles;
+  // STORE_NOTE_KEYWORDS
+  uint32_t kw_width;        // Bits per handle
+  const uint64_t *kw_blocks; // Bit offsets of the blocks into `kw_bits`
+  const uint8_t *kw_bits;
+  const uint8_t *kw_bits_end;
+  // STORE_LINKS
+  StoreColumn links;
+} Store;
+
+// Walks the notes of a store in order, decoding each note once
+typedef struct {
+  const Store *store;
+  size_t position; // Note the cursor is on, NOT_FOUND before the first step and `count` after the last
+  char name[MAX_PATH_LEN];
+  uint64_t id;
+  int64_t mtime_ns;
+  uint64_t size;
+  uint32_t kw[MAX_KEYS];
+  uint32_t kw_count;
+  uint64_t *links; // Owned by the cursor, valid until the next step
+  uint32_t link_count;
+  uint32_t link_capacity;
+  // Decoding state
+  const uint8_t *name_pos;
+  const uint8_t *column_pos[STORE_SIZES + 1];
+  uint64_t column_value[STORE_SIZES + 1];
+  const uint8_t *link_pos;
+  uint64_t kw_bit;
+} StoreCursor;
+
+// Bytes of one part of a section being written
+typedef struct {
+  uint8_t *data;
+  size_t length;
+  size_t capacity;
+  int fd;         // Temporary file the bytes are flushed to, -1 to hold them all in memory
+  uint64_t total; // Bytes appended, including those flushed
+  uint32_t crc;   // CRC32C of the bytes before `checked`
+  size_t checked;
+  bool failed;
+} StoreSink;
+
+// Builds a store a note at a time, so it never needs the whole index
+typedef struct {
+  StoreSink tables[STORE_SECTION_COUNT]; // Per block or per note offsets, by section kind
+  StoreSink data[STORE_SECTION_COUNT];
+  size_t count;
+  char previous_name[MAX_PATH_LEN];
+  uint64_t previous[STORE_SIZES + 1]; // Last value of each column
+  uint64_t handles;                   // Keyword handles added
+  bool failed;
+} StoreWriter;
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+int store_writer_init(StoreWriter *writer, const char *spill_dir);
+int store_writer_add(StoreWriter *writer, const NoteRecord *note);
+int store_writer_finish(StoreWriter *writer, const char *dir_path, const KeywordTable *keywords);
+void store_writer_free(StoreWriter *writer);
+int store_write(const NoteIndex *index);
+int store_open(Store *store, const char *dir_path);
+void store_close(Store *store);
+
+// Random access
+int store_name(const Store *store, size_t i, char *dest, size_t dest_size);
+size_t store_find_name(const Store *store, const char *name);
+uint64_t store_id(const Store *store, size_t i);
+const char *store_full_title(const Store *store, size_t i);
+const char *store_keyword(const Store *store, uint32_t handle);
+uint32_t store_note_keywords(const Store *store, size_t i, uint32_t *dest);
+uint32_t store_links(const Store *store, size_t i, uint64_t *dest, uint32_t dest_size);
+
+// Sequential access
+void store_cursor_init(StoreCursor *cursor, const Store *store);
+bool store_cursor_next(StoreCursor *cursor);
+void store_cursor_free(StoreCursor *cursor);
+
+#endif // STORE_H_
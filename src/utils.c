@@ -1,16 +1,35 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <regex.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "stats.h"
 #include "utils.h"
 
+bool connote_verbose = false;
+
+// Print to standard error, only with -v
+void debug_printf(const char *format, ...) {
+  if (!connote_verbose)
+    return;
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+}
+
 // Function to check if directory exists and create it if it doesn't
 int make_directory_if_not_exists(const char *path) {
   struct stat st = {0};
@@ -22,10 +41,10 @@ int make_directory_if_not_exists(const char *path) {
       fprintf(stderr, "ERROR: Making connote directory failed.\n");
       return FAILURE;
     } else {
-      printf("Directory created: %s\n", path);
+      debug_printf("Directory created: %s\n", path);
     }
   } else {
-    printf("Directory already exists: %s\n", path);
+    debug_printf("Directory already exists: %s\n", path);
   }
 
   return SUCCESS;
@@ -34,23 +53,22 @@ int make_directory_if_not_exists(const char *path) {
 // Function to trim a string
 void trim_string(char *str) {
   size_t start = 0;
-  size_t end = strlen(str) - 1;
+  size_t end = strlen(str);
 
   // Remove leading whitespace
-  while (isspace(str[start])) {
+  while (isspace((unsigned char)str[start])) {
     start++;
   }
 
-  // Remove trailing whitespace
-  while (end > start && isspace(str[end])) {
+  // Remove trailing whitespace, `end` is one past the last kept character
+  while (end > start && isspace((unsigned char)str[end - 1])) {
     end--;
   }
 
   // If the string was trimmed, adjust the null terminator
-  if (start > 0 || end < (strlen(str) - 1)) {
-    memmove(str, str + start, end - start + 1);
-    str[end - start + 1] = '\0';
-  }
+  if (start > 0)
+    memmove(str, str + start, end - start);
+  str[end - start] = '\0';
 }
 
 // Function to remove unwanted characters from a string. The predicate function
@@ -74,9 +92,10 @@ bool file_exists(const char *filename) {
 }
 
 // Replace spaces and underscores with `s` in `str`.
+// Tabs and newlines separate words just as spaces do
 void replace_spaces_and_underscores(char *str, char s) {
   for (int i = 0; str[i]; i++) {
-    if (str[i] == ' ') {
+    if (isspace((unsigned char)str[i])) {
       str[i] = s;
     } else if (str[i] == '_') {
       str[i] = s;
@@ -134,21 +153,22 @@ int file_creation_timestamp(const char *file_path, char *dest) {
   }
 
   // Convert the st_ctime (metadata change time) to local time
-  struct tm *t = localtime(&file_stat.st_ctime);
+  struct tm t;
+  localtime_r(&file_stat.st_ctime, &t);
 
   // Returns the number of characters in the array, not counting the string
   // termination.
-  assert(strftime(dest, ID_LEN + 1, ID_FORMAT, t) == ID_LEN);
+  assert(strftime(dest, ID_LEN + 1, ID_FORMAT, &t) == ID_LEN);
 
   return SUCCESS;
 }
 
 // Puts the current date and time into `dest`
 int generate_timestamp_now(char *dest) {
-  struct tm *local;
+  struct tm local;
   time_t t = time(NULL);
-  local = localtime(&t);
-  if (strftime(dest, ID_LEN + 1, ID_FORMAT, local) == 0) {
+  localtime_r(&t, &local);
+  if (strftime(dest, ID_LEN + 1, ID_FORMAT, &local) == 0) {
     fprintf(stderr, "ERROR: Failed to format time when generating new timestamp.\n");
     return FAILURE;
   };
@@ -177,6 +197,7 @@ int match_pattern_against_str(char *str, char *pattern, size_t *start, size_t *e
     // As defined, all regex expressions contain the match in index 1
     *start = (size_t)matches[1].rm_so;
     *end = (size_t)matches[1].rm_eo;
+    regfree(&regex);
     return SUCCESS;
   }
 
@@ -204,11 +225,12 @@ int str_copy_slice(const char *src, size_t start, size_t end, char *dest, size_t
     overflow = true;
   }
 
-  // Copy the slice into the destination string
-  strncpy(dest, src + start, length);
+  // Copy the slice, stopping early at the end of `src` as strncpy would
+  size_t copied = strnlen(src + start, length);
+  memcpy(dest, src + start, copied);
 
   // Add null terminator to the destination string
-  dest[length] = '\0';
+  dest[copied] = '\0';
 
   return overflow ? FAILURE : SUCCESS;
 }
@@ -218,181 +240,572 @@ int str_append_slice(const char *src, size_t start, size_t end, char *dest, size
   size_t length = end - start;
   bool overflow = false;
 
+  // A full destination can't take anything more
+  if (*current_pos >= dest_size)
+    return FAILURE;
+
   // Ensure we don't append more than the remaining buffer can hold
   if (*current_pos + length >= dest_size) {
     length = dest_size - *current_pos - 1; // Leave space for null terminator
     overflow = true;
   }
 
-  // Append the slice using snprintf and update the current position
-  snprintf(dest + *current_pos, dest_size - *current_pos, "%.*s", (int)length, src + start);
+  // Copy up to the end of the slice or of `src`, whichever comes first, but
+  // advance by the full slice length as callers expect
+  size_t copied = strnlen(src + start, length);
+  memcpy(dest + *current_pos, src + start, copied);
+  dest[*current_pos + copied] = '\0';
   *current_pos += length; // Update the current position
 
   return overflow ? FAILURE : SUCCESS;
 }
 
-// In denote this takes an extra parameter: `dir_path`
-int format_file_name(char *dir_path, char *id, char *sig, char *title, char **keywords, size_t kw_count,
-                     char *extension, char *dest_filename) {
-  size_t max_len_without_ext = MAX_PATH_LEN - strlen(extension) - 1;
-  size_t current_pos = 0;
-
-  // If there is no ID, we cannot construct a filename
-  if (id == NULL || id[0] == '\0') {
-    fprintf(stderr, "ERROR: No ID passed to format_file_name.\n");
+// Sluggify the components of a filename in place and gather them, with their
+// lengths, into `parts`. `dir_path` may be empty. Nothing is copied, so the
+// strings must outlive `parts`.
+int file_name_parts(FileNameParts *parts, const char *dir_path, const char *id, char *sig, char *title,
+                    char **keywords, size_t kw_count, const char *extension) {
+  if (id == NULL || strnlen(id, ID_LEN + 1) != ID_LEN) {
+    fprintf(stderr, "ERROR: No valid ID passed to format_file_name.\n");
     return FAILURE;
   }
+  parts->id = id;
+  parts->dir = (Slice){dir_path, dir_path != NULL ? strlen(dir_path) : 0};
+
+  STATS_BEGIN(PHASE_SLUG);
+  parts->sig = (Slice){sig, 0};
+  // Empty components are skipped, as they may be read-only literals
+  if (sig != NULL && sig[0] != '\0') {
+    sluggify_signature(sig);
+    parts->sig.length = strlen(sig);
+  }
+  parts->title = (Slice){title, 0};
+  if (title != NULL && title[0] != '\0') {
+    sluggify_title(title);
+    parts->title.length = strlen(title);
+  }
+  parts->kw_count = kw_count < MAX_KEYS ? kw_count : MAX_KEYS;
+  for (size_t i = 0; i < parts->kw_count; i++) {
+    if (keywords[i][0] != '\0')
+      sluggify_keyword(keywords[i]);
+    parts->keywords[i] = (Slice){keywords[i], strlen(keywords[i])};
+  }
+  STATS_END(PHASE_SLUG);
+
+  // An extension without its dot is left out
+  parts->extension = (Slice){extension, extension != NULL && extension[0] == '.' ? strlen(extension) : 0};
+  return SUCCESS;
+}
+
+// Length of the filename made of `parts`, without the null terminator
+size_t file_name_length(const FileNameParts *parts) {
+  size_t length = parts->dir.length + ID_LEN + parts->extension.length;
+  if (parts->sig.length > 0)
+    length += 2 + parts->sig.length;
+  if (parts->title.length > 0)
+    length += 2 + parts->title.length;
+  if (parts->kw_count > 0)
+    length += 1 + parts->kw_count;
+  for (size_t i = 0; i < parts->kw_count; i++) {
+    length += parts->keywords[i].length;
+  }
+  return length;
+}
+
+// Filenames by the optional components they have. Each shape gets its own
+// copy of `fill_file_name`, with the tests for the components it lacks folded
+// away, and the ID copied at its fixed length.
+#define NAME_SIG 1
+#define NAME_TITLE 2
+#define NAME_KEYWORDS 4
+#define NAME_SHAPES 8
+
+static inline __attribute__((always_inline)) void fill_file_name(const FileNameParts *parts, char *out, int shape) {
+  memcpy(out, parts->dir.data, parts->dir.length);
+  out += parts->dir.length;
+  memcpy(out, parts->id, ID_LEN);
+  out += ID_LEN;
+  if (shape & NAME_SIG) {
+    memcpy(out, "==", 2);
+    memcpy(out + 2, parts->sig.data, parts->sig.length);
+    out += 2 + parts->sig.length;
+  }
+  if (shape & NAME_TITLE) {
+    memcpy(out, "--", 2);
+    memcpy(out + 2, parts->title.data, parts->title.length);
+    out += 2 + parts->title.length;
+  }
+  if (shape & NAME_KEYWORDS) {
+    *out++ = '_';
+    for (size_t i = 0; i < parts->kw_count; i++) {
+      *out++ = '_';
+      memcpy(out, parts->keywords[i].data, parts->keywords[i].length);
+      out += parts->keywords[i].length;
+    }
+  }
+  memcpy(out, parts->extension.data, parts->extension.length);
+  out[parts->extension.length] = '\0';
+}
+
+#define FILL_FILE_NAME(shape)                                                                                          \
+  static void fill_file_name_##shape(const FileNameParts *parts, char *out) { fill_file_name(parts, out, shape); }
+FILL_FILE_NAME(0)
+FILL_FILE_NAME(1)
+FILL_FILE_NAME(2)
+FILL_FILE_NAME(3)
+FILL_FILE_NAME(4)
+FILL_FILE_NAME(5)
+FILL_FILE_NAME(6)
+FILL_FILE_NAME(7)
+
+static void (*const fill_file_name_shapes[NAME_SHAPES])(const FileNameParts *, char *) = {
+    fill_file_name_0, fill_file_name_1, fill_file_name_2, fill_file_name_3,
+    fill_file_name_4, fill_file_name_5, fill_file_name_6, fill_file_name_7,
+};
+
+// Write the filename made of `parts` to `dest`. The length is worked out
+// first, so the name is either written whole or, if it doesn't fit in
+// `dest_size` bytes, not at all.
+int format_file_name_parts(const FileNameParts *parts, char *dest, size_t dest_size) {
+  if (file_name_length(parts) >= dest_size)
+    return FAILURE;
 
+  int shape = (parts->sig.length > 0 ? NAME_SIG : 0) | (parts->title.length > 0 ? NAME_TITLE : 0) |
+              (parts->kw_count > 0 ? NAME_KEYWORDS : 0);
+  fill_file_name_shapes[shape](parts, dest);
+  return SUCCESS;
+}
+
+// In denote this takes an extra parameter: `dir_path`. The components are
+// sluggified in place.
+int format_file_name(char *dir_path, char *id, char *sig, char *title, char **keywords, size_t kw_count,
+                     char *extension, char *dest_filename) {
   // If there is no directory we cannot format the file path
   if (dir_path == NULL || dir_path[0] == '\0') {
     fprintf(stderr, "ERROR: No directory path passed to format_file_name.\n");
     return FAILURE;
   }
 
-  str_append_slice(dir_path, 0, strlen(dir_path), dest_filename, max_len_without_ext, &current_pos);
+  STATS_BEGIN(PHASE_FORMAT);
+  FileNameParts parts;
+  int outcome = file_name_parts(&parts, dir_path, id, sig, title, keywords, kw_count, extension);
+  if (outcome == SUCCESS && format_file_name_parts(&parts, dest_filename, MAX_PATH_LEN) != SUCCESS) {
+    fprintf(stderr, "ERROR: File name for %s is longer than %d bytes.\n", id, MAX_PATH_LEN - 1);
+    outcome = FAILURE;
+  }
+  STATS_END(PHASE_FORMAT);
 
-  assert(strlen(id) == ID_LEN);
-  str_append_slice(id, 0, strlen(id), dest_filename, max_len_without_ext, &current_pos);
+  return outcome;
+}
 
-  if (sig != NULL && sig[0] != '\0') {
-    str_append_slice("==", 0, 2, dest_filename, max_len_without_ext, &current_pos);
-    // Sluggify signature
-    sluggify_signature(sig);
-    str_append_slice(sig, 0, strlen(sig), dest_filename, max_len_without_ext, &current_pos);
-  }
+// Write the date of `id`, "YYYYMMDDTHHMMSS", to `dest` as
+// "YYYY-MM-DDTHH:MM:SS". `dest` must hold DATE_LEN + 1 bytes.
+void date_from_id(const char *id, char *dest) {
+  memcpy(dest, id, 4);
+  dest[4] = '-';
+  memcpy(dest + 5, id + 4, 2);
+  dest[7] = '-';
+  memcpy(dest + 8, id + 6, 2);
+  dest[10] = 'T';
+  memcpy(dest + 11, id + 9, 2);
+  dest[13] = ':';
+  memcpy(dest + 14, id + 11, 2);
+  dest[16] = ':';
+  memcpy(dest + 17, id + 13, 2);
+  dest[DATE_LEN] = '\0';
+}
 
-  if (title != NULL && title[0] != '\0') {
-    str_append_slice("--", 0, 2, dest_filename, max_len_without_ext, &current_pos);
-    // Sluggify title
-    sluggify_title(title);
-    str_append_slice(title, 0, strlen(title), dest_filename, max_len_without_ext, &current_pos);
+static void push_iov(struct iovec *iov, int *count, const char *str, size_t length) {
+  if (length == 0)
+    return;
+  iov[*count].iov_base = (void *)str;
+  iov[*count].iov_len = length;
+  (*count)++;
+}
+
+#define PUSH_LITERAL(iov, count, literal) push_iov(iov, count, literal, sizeof(literal) - 1)
+
+// Describe the frontmatter for the given components as a list of slices in
+// `iov`, which must have room for FRONTMATTER_MAX_IOV entries. The slices
+// point at static literals, the inputs themselves, and `scratch` for the
+// derived date and signature, so all of them must outlive `iov`. Returns the
+// number of entries used.
+int frontmatter_iov(struct iovec *iov, FrontmatterScratch *scratch, const char *id, const char *sig,
+                    const char *title, char **keywords, size_t kw_count) {
+  int count = 0;
+  if (kw_count > MAX_KEYS)
+    kw_count = MAX_KEYS;
+
+  PUSH_LITERAL(iov, &count, "---\ntitle: ");
+  if (title != NULL)
+    push_iov(iov, &count, title, strlen(title));
+
+  date_from_id(id, scratch->date);
+  PUSH_LITERAL(iov, &count, "\ndate: ");
+  push_iov(iov, &count, scratch->date, DATE_LEN);
+
+  // I like to call keywords tags
+  PUSH_LITERAL(iov, &count, "\ntags: [");
+  for (size_t i = 0; i < kw_count; i++) {
+    if (i > 0)
+      PUSH_LITERAL(iov, &count, ", ");
+    push_iov(iov, &count, keywords[i], strlen(keywords[i]));
   }
 
-  if (kw_count > 0) {
-    str_append_slice("_", 0, 1, dest_filename, max_len_without_ext, &current_pos);
-    for (size_t i = 0; i < kw_count; i++) {
-      str_append_slice("_", 0, 1, dest_filename, max_len_without_ext, &current_pos);
-      // Sluggify keyword
-      sluggify_keyword(keywords[i]);
-      str_append_slice(keywords[i], 0, strlen(keywords[i]), dest_filename, max_len_without_ext, &current_pos);
+  PUSH_LITERAL(iov, &count, "]\nidentifier: ");
+  push_iov(iov, &count, id, ID_LEN);
+
+  // Replace '=' with '.' in the signature
+  size_t sig_len = 0;
+  if (sig != NULL) {
+    for (; sig[sig_len] != '\0' && sig_len < MAX_SIG_LEN - 1; sig_len++) {
+      scratch->signature[sig_len] = sig[sig_len] == '=' ? '.' : sig[sig_len];
     }
   }
+  PUSH_LITERAL(iov, &count, "\nsignature: ");
+  push_iov(iov, &count, scratch->signature, sig_len);
+
+  PUSH_LITERAL(iov, &count, "\naliases: [");
+  push_iov(iov, &count, id, ID_LEN);
+  PUSH_LITERAL(iov, &count, "]\n---");
+
+  return count;
+}
 
-  if (extension != NULL && extension[0] == '.') {
-    str_append_slice(extension, 0, strlen(extension), dest_filename, max_len_without_ext, &current_pos);
+// Write the frontmatter to `buffer`, truncating it if it doesn't fit. Returns
+// the number of bytes written, not counting the null terminator.
+size_t write_frontmatter_to_buffer(char *buffer, size_t buffer_size, char *id, char *sig, char *title,
+                                   char **keywords, size_t kw_count) {
+  if (buffer_size == 0)
+    return 0;
+
+  struct iovec iov[FRONTMATTER_MAX_IOV];
+  FrontmatterScratch scratch;
+  int count = frontmatter_iov(iov, &scratch, id, sig, title, keywords, kw_count);
+
+  size_t written = 0;
+  for (int i = 0; i < count && written < buffer_size - 1; i++) {
+    size_t length = iov[i].iov_len;
+    if (length > buffer_size - 1 - written)
+      length = buffer_size - 1 - written;
+    memcpy(buffer + written, iov[i].iov_base, length);
+    written += length;
   }
+  buffer[written] = '\0';
 
+  return written;
+}
+
+// Copy the yaml value in [start, end) to `dest`, dropping surrounding
+// whitespace and quotes
+static void copy_frontmatter_value(const char *start, const char *end, char *dest, size_t dest_size) {
+  while (start < end && isspace((unsigned char)*start)) {
+    start++;
+  }
+  while (end > start && isspace((unsigned char)end[-1])) {
+    end--;
+  }
+  if (end - start >= 2 && (*start == '"' || *start == '\'') && end[-1] == *start) {
+    start++;
+    end--;
+  }
+  str_copy_slice(start, 0, end - start, dest, dest_size);
+}
+
+// Read the yaml frontmatter at the start of `data`, as written by
+// `write_frontmatter_to_buffer`. `data` need not be null-terminated. Returns
+// FAILURE if there is no frontmatter, in which case all fields are empty.
+int read_frontmatter(const char *data, size_t length, Frontmatter *frontmatter) {
+  memset(frontmatter, 0, sizeof(*frontmatter));
+
+  const char *end = data + length;
+  if (length < 4 || strncmp(data, "---\n", 4) != 0)
+    return FAILURE;
+
+  const char *line = data + 4;
+  while (line < end) {
+    const char *line_end = memchr(line, '\n', end - line);
+    if (line_end == NULL)
+      line_end = end;
+
+    // Closing delimiter
+    if (line_end - line >= 3 && strncmp(line, "---", 3) == 0)
+      return SUCCESS;
+
+    const char *colon = memchr(line, ':', line_end - line);
+    if (colon != NULL) {
+      size_t key_len = colon - line;
+      const char *value = colon + 1;
+
+      if (key_len == 5 && strncmp(line, "title", 5) == 0) {
+        copy_frontmatter_value(value, line_end, frontmatter->title, MAX_TITLE_LEN);
+      } else if (key_len == 4 && strncmp(line, "date", 4) == 0) {
+        copy_frontmatter_value(value, line_end, frontmatter->date, sizeof(frontmatter->date));
+      } else if (key_len == 10 && strncmp(line, "identifier", 10) == 0) {
+        copy_frontmatter_value(value, line_end, frontmatter->identifier, ID_LEN + 1);
+      } else if (key_len == 9 && strncmp(line, "signature", 9) == 0) {
+        copy_frontmatter_value(value, line_end, frontmatter->signature, MAX_SIG_LEN);
+      } else if (key_len == 4 && strncmp(line, "tags", 4) == 0) {
+        // Tags are written as a flow sequence: [kw1, kw2]
+        const char *open = memchr(value, '[', line_end - value);
+        const char *close = open ? memchr(open, ']', line_end - open) : NULL;
+        if (open != NULL && close != NULL) {
+          const char *tag = open + 1;
+          while (tag < close && frontmatter->tag_count < MAX_KEYS) {
+            const char *comma = memchr(tag, ',', close - tag);
+            const char *tag_end = comma ? comma : close;
+            copy_frontmatter_value(tag, tag_end, frontmatter->tags[frontmatter->tag_count], MAX_KW_LEN);
+            if (frontmatter->tags[frontmatter->tag_count][0] != '\0')
+              frontmatter->tag_count++;
+            tag = tag_end + 1;
+          }
+        }
+      }
+    }
+
+    line = line_end + 1;
+  }
+
+  // Unterminated frontmatter still yields whatever fields were read
   return SUCCESS;
 }
 
-void date_from_id(char *id, char *dest) {
+// Advance the ID in `id` by one second, carrying into the minutes, hours and
+// date as needed
+int increment_id(char *id) {
   struct tm t = {0};
-  // Parse the input string "YYYYMMDDTHHMMSS"
-  sscanf(id, "%4d%2d%2dT%2d%2d%2d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec);
-  // Adjust the values for tm structure
-  t.tm_year -= 1900; // tm_year is years since 1900
-  t.tm_mon -= 1;     // tm_mon is 0-11
-  // Format the time into the desired output format
-  strftime(dest, 32, "%Y-%m-%dT%H:%M:%S", &t);
-}
-
-// Function to write frontmatter to a buffer instead of a file
-void write_frontmatter_to_buffer(char *buffer, size_t buffer_size, char *id, char *sig, char *title, char **keywords,
-                                 size_t kw_count) {
-  char *buf_ptr = buffer;
-  size_t remaining_size = buffer_size;
-
-  // Use snprintf to write to the buffer instead of fprintf
-  int written = snprintf(buf_ptr, remaining_size, "---\n");
-  buf_ptr += written;
-  remaining_size -= written;
-
-  // TITLE
-  written = snprintf(buf_ptr, remaining_size, "title: %s\n", title ? title : "");
-  buf_ptr += written;
-  remaining_size -= written;
-
-  // DATE
-  // Get date from ID
-  char date[20]; // Buffer to hold the formatted time
-  date_from_id(id, date);
-
-  // Write the formatted date to the buffer
-  written = snprintf(buf_ptr, remaining_size, "date: %s\n", date);
-  buf_ptr += written;
-  remaining_size -= written;
-
-  // KEYWORDS
-  // I like to call keywords tags
-  written = snprintf(buf_ptr, remaining_size, "tags: [");
-  buf_ptr += written;
-  remaining_size -= written;
+  if (sscanf(id, "%4d%2d%2dT%2d%2d%2d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) != 6)
+    return FAILURE;
+  t.tm_year -= 1900;
+  t.tm_mon -= 1;
+
+  // Do the arithmetic in UTC so daylight saving transitions can't skip or
+  // repeat an ID
+  time_t seconds = timegm(&t) + 1;
+  gmtime_r(&seconds, &t);
+  if (strftime(id, ID_LEN + 1, ID_FORMAT, &t) != ID_LEN)
+    return FAILURE;
 
-  // Iterate through the keywords and print
-  for (size_t i = 0; i < kw_count; i++) {
-    written = snprintf(buf_ptr, remaining_size, "%s", keywords[i]);
-    buf_ptr += written;
-    remaining_size -= written;
-
-    if (i < kw_count - 1) {
-      written = snprintf(buf_ptr, remaining_size, ", ");
-      buf_ptr += written;
-      remaining_size -= written;
+  return SUCCESS;
+}
+
+int parse_fsync_policy(const char *str, FsyncPolicy *policy) {
+  if (str == NULL || strcmp(str, "dir") == 0) {
+    *policy = FSYNC_DIR;
+  } else if (strcmp(str, "file") == 0) {
+    *policy = FSYNC_FILE;
+  } else if (strcmp(str, "none") == 0) {
+    *policy = FSYNC_NONE;
+  } else {
+    fprintf(stderr, "ERROR: Unknown fsync policy %s, expected none, file or dir.\n", str);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+// Parse a byte count like "512M", with an optional K, M or G suffix
+int parse_size(const char *str, size_t *size) {
+  char *end;
+  errno = 0;
+  unsigned long long value = strtoull(str, &end, 10);
+  int shift = 0;
+  switch (*end) {
+  case 'k':
+  case 'K':
+    shift = 10;
+    break;
+  case 'm':
+  case 'M':
+    shift = 20;
+    break;
+  case 'g':
+  case 'G':
+    shift = 30;
+    break;
+  default:
+    break;
+  }
+  if (shift > 0)
+    end++;
+  if (end == str || *end != '\0' || errno != 0 || str[0] == '-' || value > (SIZE_MAX >> shift)) {
+    fprintf(stderr, "ERROR: Invalid size %s, expected bytes with an optional K, M or G.\n", str);
+    return FAILURE;
+  }
+  *size = (size_t)value << shift;
+  return SUCCESS;
+}
+
+// Create `name` in `dir_fd` holding the concatenation of `iov`, failing with
+// EEXIST rather than truncating a file that is already there
+static int create_file_exclusive(int dir_fd, const char *name, struct iovec *iov, int iov_count,
+                                 FsyncPolicy fsync_policy) {
+  STATS_BEGIN(PHASE_WRITE);
+  int fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  STATS_SYSCALL(SYS_OPEN, 1);
+  if (fd == -1) {
+    STATS_END(PHASE_WRITE);
+    return FAILURE;
+  }
+
+  // Normally a single writev, looping only on short writes
+  bool ok = true;
+  while (iov_count > 0) {
+    ssize_t n = writev(fd, iov, iov_count);
+    STATS_SYSCALL(SYS_WRITE, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      ok = false;
+      break;
+    }
+    while (iov_count > 0 && (size_t)n >= iov->iov_len) {
+      n -= (ssize_t)iov->iov_len;
+      iov++;
+      iov_count--;
+    }
+    if (iov_count > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= (size_t)n;
     }
   }
 
-  written = snprintf(buf_ptr, remaining_size, "]\n");
-  buf_ptr += written;
-  remaining_size -= written;
+  if (ok && fsync_policy != FSYNC_NONE) {
+    ok = fsync(fd) == 0;
+    STATS_SYSCALL(SYS_FSYNC, 1);
+  }
+  int saved_errno = errno;
+  if (close(fd) == -1)
+    ok = false;
 
-  // ID
-  written = snprintf(buf_ptr, remaining_size, "identifier: %s\n", id);
-  buf_ptr += written;
-  remaining_size -= written;
+  STATS_END(PHASE_WRITE);
 
-  // SIGNATURE
-  // Replace '=' with '.' in the signature
-  char new_sig[MAX_SIG_LEN];
-  replace_ch1_with_ch2_in_dest(sig, new_sig, '=', '.', MAX_SIG_LEN);
+  if (!ok) {
+    // Don't leave a partial note behind
+    unlinkat(dir_fd, name, 0);
+    errno = saved_errno == EEXIST ? EIO : saved_errno;
+    return FAILURE;
+  }
+
+  return SUCCESS;
+}
+
+// Create a note in the directory `dir_fd`, which is `dir_path`, with the
+// frontmatter for the given components followed by `body`, if any. The file
+// is created exclusively: if a note with the same name already exists, the
+// seconds of `id` are advanced until the name is free. Safe to call from
+// several threads at once. Prints nothing: on failure `errno` says why, and
+// `connote_file_error` reports it.
+int connote_file_at(int dir_fd, char *dir_path, char *id, char *sig, char *title, char **keywords, size_t kw_count,
+                    char *extension, const char *body, size_t body_length, FsyncPolicy fsync_policy,
+                    char *dest_filename) {
+  if (strcmp(extension, ".md") != 0) {
+    errno = ENOTSUP;
+    return FAILURE;
+  }
+  if (id == NULL || strlen(id) != ID_LEN || dir_path == NULL || dir_path[0] == '\0') {
+    errno = EINVAL;
+    return FAILURE;
+  }
+
+  // format_file_name sluggifies its inputs in place, but the frontmatter has
+  // to be rewritten with the original values whenever the ID changes
+  char slug_sig[MAX_SIG_LEN] = {0};
+  char slug_title[MAX_TITLE_LEN] = {0};
+  char slug_keywords_array[MAX_KEYS][MAX_KW_LEN];
+  char *slug_keywords[MAX_KEYS];
+  if (kw_count > MAX_KEYS)
+    kw_count = MAX_KEYS;
+  for (size_t i = 0; i < kw_count; i++) {
+    str_copy_slice(keywords[i], 0, strlen(keywords[i]), slug_keywords_array[i], MAX_KW_LEN);
+    slug_keywords[i] = slug_keywords_array[i];
+  }
+  if (sig != NULL)
+    str_copy_slice(sig, 0, strlen(sig), slug_sig, MAX_SIG_LEN);
+  if (title != NULL)
+    str_copy_slice(title, 0, strlen(title), slug_title, MAX_TITLE_LEN);
+
+  // The components are sluggified once, and `increment_id` changes the ID in
+  // place, so every attempt only has to copy them
+  FileNameParts parts;
+  if (file_name_parts(&parts, dir_path, id, slug_sig, slug_title, slug_keywords, kw_count, extension) != SUCCESS) {
+    errno = EINVAL;
+    return FAILURE;
+  }
 
-  written = snprintf(buf_ptr, remaining_size, "signature: %s\n", sig ? new_sig : "");
-  buf_ptr += written;
-  remaining_size -= written;
+  for (int attempt = 0; attempt < MAX_ID_COLLISIONS; attempt++) {
+    // Write the full title to the frontmatter as provided by the user
+    struct iovec iov[FRONTMATTER_MAX_IOV + 2];
+    FrontmatterScratch scratch;
+    int iov_count = frontmatter_iov(iov, &scratch, id, sig, title, keywords, kw_count);
+    if (body_length > 0) {
+      iov[iov_count++] = (struct iovec){.iov_base = "\n\n", .iov_len = 2};
+      iov[iov_count++] = (struct iovec){.iov_base = (void *)body, .iov_len = body_length};
+    }
 
-  // ALIASES
-  written = snprintf(buf_ptr, remaining_size, "aliases: [%s]\n", id);
-  buf_ptr += written;
-  remaining_size -= written;
+    STATS_BEGIN(PHASE_FORMAT);
+    int formatted = format_file_name_parts(&parts, dest_filename, MAX_PATH_LEN);
+    STATS_END(PHASE_FORMAT);
+    if (formatted != SUCCESS) {
+      errno = ENAMETOOLONG;
+      return FAILURE;
+    }
+    const char *name = dest_filename + parts.dir.length;
+    if (create_file_exclusive(dir_fd, name, iov, iov_count, fsync_policy) == SUCCESS)
+      return SUCCESS;
+    if (errno != EEXIST)
+      return FAILURE;
 
-  // Finalize frontmatter
-  written = snprintf(buf_ptr, remaining_size, "---");
+    // Another note was created with this ID in the same second
+    if (increment_id(id) != SUCCESS) {
+      errno = EINVAL;
+      return FAILURE;
+    }
+  }
+
+  // Every ID within MAX_ID_COLLISIONS seconds is taken
+  errno = EEXIST;
+  return FAILURE;
+}
+
+// Report why `connote_file_at` failed to create `dest_filename`
+void connote_file_error(const char *dest_filename) {
+  if (errno == ENOTSUP) {
+    fprintf(stderr, "ERROR: Only markdown files with yaml frontmatter are currently supported.\n");
+  } else if (errno == EEXIST) {
+    fprintf(stderr, "ERROR: No free ID found for %s\n", dest_filename);
+  } else {
+    fprintf(stderr, "ERROR: Could not write %s: %s\n", dest_filename, strerror(errno));
+  }
 }
 
 int connote_file(char *dir_path, char *id, char *sig, char *title, char **keywords, size_t kw_count, char *extension,
-                 char *dest_filename) {
+                 FsyncPolicy fsync_policy, char *dest_filename) {
   // Write a new file and (1) provide it with a denote-compliant filename from
   // the data passed in and save this to `dest_filename`, and (2) write the
   // associated frontmatter to the beginning of the file.
 
-  char buffer[2048];
-  // Write the full title to the frontmatter as provided by the user
-  write_frontmatter_to_buffer(buffer, sizeof(buffer), id, sig, title, keywords, kw_count);
-
-  if (strcmp(extension, ".md") != 0) {
-    fprintf(stderr, "ERROR: Only markdown files with yaml frontmatter are currently supported.\n");
+  int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd == -1) {
+    fprintf(stderr, "ERROR: Could not open directory %s\n", dir_path);
     return FAILURE;
   }
 
-  format_file_name(dir_path, id, sig, title, keywords, kw_count, extension, dest_filename);
-  printf("dest_filename: %s\n", dest_filename);
+  int outcome = connote_file_at(dir_fd, dir_path, id, sig, title, keywords, kw_count, extension, NULL, 0, fsync_policy,
+                                dest_filename);
+  if (outcome == SUCCESS) {
+    debug_printf("dest_filename: %s\n", dest_filename);
+  } else {
+    connote_file_error(dest_filename);
+  }
 
-  FILE *f = fopen(dest_filename, "w");
-  if (f) {
-    fprintf(f, "%s", buffer);
-    fclose(f);
+  // Make the new directory entry durable too
+  if (outcome == SUCCESS && fsync_policy == FSYNC_DIR && fsync(dir_fd) == -1) {
+    fprintf(stderr, "ERROR: Could not sync directory %s\n", dir_path);
+    outcome = FAILURE;
   }
+  close(dir_fd);
 
-  return SUCCESS;
+  return outcome;
 }
 
 void downcase(char *str) {
@@ -507,7 +920,7 @@ void sluggify_signature(char *str) {
 }
 
 void sluggify_keyword(char *str) {
-  const char *unwanted_chars = "[]{}!@#$%^&*()+'\"?,.\\|;:~`‘’“”/_ -=";
+  const char *unwanted_chars = "[]{}!@#$%^&*()+'\"?,.\\|;:~`‘’“”/_ \t\n\v\f\r-=";
   // Start by removing whitespace characters at beginning and end
   trim_string(str);
   // Remove unwanted characters from the string
@@ -553,13 +966,106 @@ void read_id(const char *filename, char *id) {
   id[ID_LEN] = '\0';
 }
 
+// The extension of `filename`, "" if it has none. In a denote name it is
+// everything from the first dot after the ID, as EXT_REGEX matches it, so
+// "20240101T120000--scan.tar.gz" keeps ".tar.gz". Any other name only
+// keeps what follows its last dot, as in "report v1.2.pdf".
+const char *file_extension(const char *filename) {
+  const char *name = strrchr(filename, '/');
+  name = name != NULL ? name + 1 : filename;
+  const char *dot = NULL;
+  if (strnlen(name, ID_LEN) == ID_LEN && has_valid_id(name)) {
+    dot = strchr(name + ID_LEN, '.');
+  } else if (name[0] != '\0') {
+    // A leading dot marks a hidden file rather than an extension
+    dot = strrchr(name + 1, '.');
+  }
+  return dot != NULL ? dot : name + strlen(name);
+}
+
+// True if `filename` is not a note, going by its extension. Files without
+// one are taken to be notes.
+bool is_attachment(const char *filename) {
+  static const char *note_extensions[] = {NOTE_EXTENSIONS};
+  const char *extension = file_extension(filename);
+  if (extension[0] == '\0')
+    return false;
+  for (size_t i = 0; i < sizeof(note_extensions) / sizeof(note_extensions[0]); i++) {
+    if (strcasecmp(extension, note_extensions[i]) == 0)
+      return false;
+  }
+  return true;
+}
+
+// The characters that end each component, as excluded by the bracket
+// expressions of TITLE_REGEX, SIG_REGEX and KW_REGEX. Inside a bracket
+// expression the backslash is a literal character.
+static const char *component_prefixes[] = {"--", "==", "__"};
+static const char *component_stops[] = {"=|\\._@", "-|\\._@", "-|\\.=@"};
+
+// True if `str` can follow a component: another component, an extension or
+// an "@@<ID>" at the very end of the name
+static bool is_component_suffix(const char *str, FilenameComponent component) {
+  if (str[0] == '.')
+    return true;
+  if (str[0] == '_' && str[1] == '_')
+    return true;
+  // The title can be followed by a signature, the others by a title
+  char other = component == COMPONENT_TITLE ? '=' : '-';
+  if (str[0] == other && str[1] == other)
+    return true;
+  if (str[0] == '@' && str[1] == '@')
+    return strnlen(str + 2, ID_LEN + 1) == ID_LEN && has_valid_id(str + 2);
+  return false;
+}
+
+// Find `component` in `filename` without compiling a regex. The result is
+// the same slice that the component's regex captures: the match starts at
+// the leftmost prefix that can begin a match, and the component is the
+// longest run after it that is followed by a valid suffix.
+int find_filename_component(const char *filename, FilenameComponent component, size_t *start, size_t *end) {
+  const char *prefix = component_prefixes[component];
+  const char *stops = component_stops[component];
+
+  for (const char *match = strstr(filename, prefix); match != NULL; match = strstr(match + 1, prefix)) {
+    const char *begin = match + 2;
+    const char *limit = begin + strcspn(begin, stops);
+    for (const char *cursor = limit; cursor >= begin; cursor--) {
+      if (is_component_suffix(cursor, component)) {
+        *start = begin - filename;
+        *end = cursor - filename;
+        return SUCCESS;
+      }
+    }
+  }
+
+  return FAILURE;
+}
+
+// Maps the component regexes onto their hand-written parsers
+static bool component_for_regex(const char *regex, FilenameComponent *component) {
+  if (strcmp(regex, TITLE_REGEX) == 0) {
+    *component = COMPONENT_TITLE;
+  } else if (strcmp(regex, SIG_REGEX) == 0) {
+    *component = COMPONENT_SIGNATURE;
+  } else if (strcmp(regex, KW_REGEX) == 0) {
+    *component = COMPONENT_KEYWORDS;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 // Try and match the `regex` pattern against the filename. If there is a match,
-// write the match to `component` and return SUCCESS, otherwise return FAILURE
+// write the match to `component` and return SUCCESS, otherwise return FAILURE.
+// The filename component regexes are matched without compiling them.
 int try_match_and_write_component(char *filename, char *component, char *regex, size_t component_len) {
   size_t start = 0;
   size_t end = 0;
 
-  int outcome = match_pattern_against_str(filename, regex, &start, &end);
+  FilenameComponent which;
+  int outcome = component_for_regex(regex, &which) ? find_filename_component(filename, which, &start, &end)
+                                                   : match_pattern_against_str(filename, regex, &start, &end);
   if (outcome == SUCCESS) {
     str_copy_slice(filename, start, end, component, component_len);
     return SUCCESS;
@@ -574,16 +1080,15 @@ int split_at_char(char *str, char ch, char **array, size_t array_size, size_t ma
   }
 
   size_t count = 0; // Tracks how many substrings are found
-  char *start = str;
-  char *end = NULL;
-
-  while ((end = strchr(start, ch)) != NULL) {
+  const char *start = str;
+  for (;;) {
     if (count >= array_size) {
       return -1; // Error: Array size is too small
     }
 
-    // Get the length of the current substring
-    size_t length = end - start;
+    // The last part runs to the end of the string
+    const char *end = strchr(start, ch);
+    size_t length = end != NULL ? (size_t)(end - start) : strlen(start);
 
     // Limit the length to max_str_len - 1 to ensure space for the null
     // terminator
@@ -591,34 +1096,20 @@ int split_at_char(char *str, char ch, char **array, size_t array_size, size_t ma
       length = max_str_len - 1;
     }
 
-    // Copy the substring into the pre-allocated buffer
-    strncpy(array[count], start, length);
-    array[count][length] = '\0'; // Null-terminate the substring
+    memcpy(array[count], start, length);
+    array[count][length] = '\0';
     count++;
 
+    if (end == NULL)
+      break;
     start = end + 1; // Move past the delimiter
   }
 
-  // Add the last part after the final delimiter
-  if (count < array_size) {
-    // Limit the length of the final substring
-    size_t length = strlen(start);
-    if (length >= max_str_len) {
-      length = max_str_len - 1;
-    }
-
-    strncpy(array[count], start, length);
-    array[count][length] = '\0'; // Null-terminate the substring
-    count++;
-  } else {
-    return -1; // Error: Array size is too small
-  }
-
   return count; // Return the number of substrings
 }
 
 int last_slash_pos(char *path) {
-  char last_slash = -1;
+  int last_slash = -1;
   for (int i = 0; path[i]; i++) {
     if (path[i] == '/') {
       last_slash = i;
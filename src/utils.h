@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/uio.h>
 
 // Macros
 #define MAX_KEYS 16
@@ -19,9 +20,63 @@
 #define SIG_REGEX "==([^-|\\.|_|@]*)(--.*|__.*|@@" ID_REGEX "|\\..*)$"
 #define KW_REGEX "__([^-|\\.|=|@]*)(--.*|__.*|@@" ID_REGEX "|\\..*)$"
 #define EXT_REGEX "(\\..*)"
+// Notes are text files with these extensions. Any other file, such as a PDF
+// or an image, is an attachment: named like a note but never read as one.
+#define NOTE_EXTENSIONS ".md", ".org", ".txt"
+// Length of a frontmatter date, "YYYY-MM-DDTHH:MM:SS"
+#define DATE_LEN 19
+// Slices needed to describe the largest frontmatter
+#define FRONTMATTER_MAX_IOV (12 + 2 * MAX_KEYS)
+// How many times `connote_file` advances a colliding ID before giving up
+#define MAX_ID_COLLISIONS 3600
 
 enum ErrorCode { SUCCESS = 0, FAILURE = -1 };
 
+// What to flush to disk when creating a note
+typedef enum { FSYNC_NONE, FSYNC_FILE, FSYNC_DIR } FsyncPolicy;
+
+// Fields read back from a note's yaml frontmatter
+typedef struct {
+  char title[MAX_TITLE_LEN];
+  char date[32];
+  char identifier[ID_LEN + 1];
+  char signature[MAX_SIG_LEN];
+  char tags[MAX_KEYS][MAX_KW_LEN];
+  size_t tag_count;
+} Frontmatter;
+
+// Components of a denote filename, matched by TITLE_REGEX, SIG_REGEX and
+// KW_REGEX respectively
+typedef enum { COMPONENT_TITLE, COMPONENT_SIGNATURE, COMPONENT_KEYWORDS } FilenameComponent;
+
+// The parts of written frontmatter that are derived rather than borrowed
+typedef struct {
+  char date[DATE_LEN + 1];
+  char signature[MAX_SIG_LEN];
+} FrontmatterScratch;
+
+// A component of a filename, already sluggified, and its length
+typedef struct {
+  const char *data;
+  size_t length;
+} Slice;
+
+// Everything a filename is made of. Components that are absent or empty
+// have length 0 and are left out along with their separators.
+typedef struct {
+  Slice dir;      // Including the trailing slash, if any
+  const char *id; // ID_LEN characters
+  Slice sig;
+  Slice title;
+  Slice keywords[MAX_KEYS];
+  size_t kw_count;
+  Slice extension; // Including the dot
+} FileNameParts;
+
+// Set by -v to print what connote is doing to standard error
+extern bool connote_verbose;
+void debug_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
 // string operations
 void remove_unwanted_chars(char *str, const char *unwanted_chars);
 void replace_spaces_and_underscores(char *str, char s);
@@ -46,12 +101,27 @@ int make_directory_if_not_exists(const char *path);
 int file_creation_timestamp(const char *file_path, char *dest);
 bool file_exists(const char *filename);
 int generate_timestamp_now(char *dest);
+int file_name_parts(FileNameParts *parts, const char *dir_path, const char *id, char *sig, char *title,
+                    char **keywords, size_t kw_count, const char *extension);
+size_t file_name_length(const FileNameParts *parts);
+int format_file_name_parts(const FileNameParts *parts, char *dest, size_t dest_size);
 int format_file_name(char *dir_path, char *id, char *sig, char *title, char **keywords, size_t kw_count,
                      char *extension, char *dest_filename);
+int increment_id(char *id);
+int parse_fsync_policy(const char *str, FsyncPolicy *policy);
+int parse_size(const char *str, size_t *size);
+int connote_file_at(int dir_fd, char *dir_path, char *id, char *sig, char *title, char **keywords, size_t kw_count,
+                    char *extension, const char *body, size_t body_length, FsyncPolicy fsync_policy,
+                    char *dest_filename);
+void connote_file_error(const char *dest_filename);
 int connote_file(char *dir_path, char *id, char *sig, char *title, char **keywords, size_t kw_count, char *extension,
-                 char *dest_filename);
-void write_frontmatter_to_buffer(char *buffer, size_t buffer_size, char *id, char *sig, char *title, char **keywords,
-                                 size_t kw_count);
+                 FsyncPolicy fsync_policy, char *dest_filename);
+void date_from_id(const char *id, char *dest);
+int frontmatter_iov(struct iovec *iov, FrontmatterScratch *scratch, const char *id, const char *sig,
+                    const char *title, char **keywords, size_t kw_count);
+size_t write_frontmatter_to_buffer(char *buffer, size_t buffer_size, char *id, char *sig, char *title,
+                                   char **keywords, size_t kw_count);
+int read_frontmatter(const char *data, size_t length, Frontmatter *frontmatter);
 
 // Component sluggification
 void slug_hyphenate(char *str);
@@ -64,5 +134,8 @@ void sluggify_keywords(char **keywords, size_t kw_count);
 // Reading filename
 bool has_valid_id(const char *str);
 void read_id(const char *filename, char *id);
+const char *file_extension(const char *filename);
+bool is_attachment(const char *filename);
+int find_filename_component(const char *filename, FilenameComponent component, size_t *start, size_t *end);
 int try_match_and_write_component(char *filename, char *component, char *regex, size_t component_len);
 #endif // UTILS_H_
@@ -0,0 +1,98 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/attach.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+static void write_file(const char *dir, const char *name, char fill, size_t size) {
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+  FILE *f = fopen(path, "w");
+  assert(f != NULL);
+  for (size_t i = 0; i < size; i++) {
+    fputc(i % 4096 == 0 ? fill : (char)(i % 251), f);
+  }
+  fclose(f);
+}
+
+void test_file_extension() {
+  assert(strcmp(file_extension("notes/20240101T120000--scan__pdf.tar.gz"), ".tar.gz") == 0);
+  assert(strcmp(file_extension("report v1.2.PDF"), ".PDF") == 0);
+  assert(strcmp(file_extension("dir.d/.hidden"), "") == 0);
+  assert(strcmp(file_extension("20240101T120000--plain"), "") == 0);
+
+  assert(is_attachment("20240101T120000--scan.pdf") && is_attachment("photo.JPG"));
+  assert(!is_attachment("20240101T120000--note.md") && !is_attachment("a.ORG") && !is_attachment("README"));
+
+  printf("All tests passed for file_extension and is_attachment.\n");
+}
+
+void test_attach_dedupe() {
+  char dir[] = "/tmp/connote_test_attach_XXXXXX";
+  make_vault(dir);
+  write_file(dir, "20240101T000001--a.pdf", 'a', ATTACH_MIN_SIZE + 100);
+  write_file(dir, "20240101T000002--copy-of-a.pdf", 'a', ATTACH_MIN_SIZE + 100);
+  write_file(dir, "20240101T000003--b.pdf", 'b', ATTACH_MIN_SIZE + 100);
+  write_file(dir, "20240101T000004--small.png", 'a', 100);
+
+  int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+  assert(dir_fd != -1 && mkdirat(dir_fd, ATTACH_STORE_DIR, 0755) == 0);
+  int store_fd = openat(dir_fd, ATTACH_STORE_DIR, O_RDONLY | O_DIRECTORY);
+  assert(store_fd != -1);
+
+  AttachOutcome outcome;
+  uint64_t size;
+  assert(attach_dedupe(dir_fd, store_fd, "20240101T000001--a.pdf", &outcome, &size) == SUCCESS);
+  assert(outcome == ATTACH_STORED && size == ATTACH_MIN_SIZE + 100);
+  assert(attach_dedupe(dir_fd, store_fd, "20240101T000002--copy-of-a.pdf", &outcome, &size) == SUCCESS);
+  assert(outcome == ATTACH_CLONED || outcome == ATTACH_LINKED);
+  // Different contents of the same size get their own object
+  assert(attach_dedupe(dir_fd, store_fd, "20240101T000003--b.pdf", &outcome, &size) == SUCCESS);
+  assert(outcome == ATTACH_STORED);
+  assert(attach_dedupe(dir_fd, store_fd, "20240101T000004--small.png", &outcome, &size) == SUCCESS);
+  assert(outcome == ATTACH_SKIPPED);
+
+  // Nothing is done twice
+  assert(attach_dedupe(dir_fd, store_fd, "20240101T000001--a.pdf", &outcome, &size) == SUCCESS);
+  assert(outcome == ATTACH_SHARED);
+  assert(attach_dedupe(dir_fd, store_fd, "20240101T000002--copy-of-a.pdf", &outcome, &size) == SUCCESS);
+  assert(outcome == ATTACH_SHARED);
+
+  // The replaced copy reads as it did
+  char path[MAX_PATH_LEN], data[8];
+  snprintf(path, MAX_PATH_LEN, "%s/20240101T000002--copy-of-a.pdf", dir);
+  FILE *f = fopen(path, "r");
+  assert(f != NULL && fread(data, 1, 2, f) == 2 && data[0] == 'a' && data[1] == 1);
+  fclose(f);
+
+  // A store object linked to an attachment that was truncated in place no
+  // longer matches its copies, and is not read past its end
+  write_file(dir, "20240101T000005--c.pdf", 'c', ATTACH_MIN_SIZE + 100);
+  write_file(dir, "20240101T000006--copy-of-c.pdf", 'c', ATTACH_MIN_SIZE + 100);
+  assert(attach_dedupe(dir_fd, store_fd, "20240101T000005--c.pdf", &outcome, &size) == SUCCESS);
+  assert(outcome == ATTACH_STORED);
+  snprintf(path, MAX_PATH_LEN, "%s/20240101T000005--c.pdf", dir);
+  assert(truncate(path, ATTACH_MIN_SIZE / 2) == 0);
+  assert(attach_dedupe(dir_fd, store_fd, "20240101T000006--copy-of-c.pdf", &outcome, &size) == SUCCESS);
+  struct stat st;
+  snprintf(path, MAX_PATH_LEN, "%s/20240101T000006--copy-of-c.pdf", dir);
+  assert(stat(path, &st) == 0 && st.st_size == ATTACH_MIN_SIZE + 100);
+
+  close(store_fd);
+  close(dir_fd);
+  remove_vault(dir);
+  printf("All tests passed for attach_dedupe.\n");
+}
+
+int main() {
+  test_file_extension();
+  test_attach_dedupe();
+
+  return 0;
+}
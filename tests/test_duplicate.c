@@ -0,0 +1,132 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/duplicate.h"
+#include "../src/index.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+#define BODY                                                                                                           \
+  "The quick brown fox jumps over the lazy dog while the farmer sleeps under an old oak tree, dreaming of rain "     \
+  "and of a harvest that would finally pay for the new roof on the barn before the winter storms arrive.\n"
+
+void test_xxh64() {
+  assert(xxh64("", 0, 0) == 0xef46db3751d8e999ULL);
+  assert(xxh64("a", 1, 0) == 0xd24ec4f1a98c6e5bULL);
+  assert(xxh64("abc", 3, 0) == 0x44bc2cf5ad770999ULL);
+
+  printf("All tests passed for xxh64.\n");
+}
+
+void test_minhash() {
+  uint32_t a[SKETCH_MINHASHES], b[SKETCH_MINHASHES];
+  uint32_t shingles, other_shingles;
+  minhash(BODY, strlen(BODY), a, &shingles);
+  assert(shingles >= SKETCH_MIN_SHINGLES);
+  // Case and spacing are ignored
+  const char *reflowed = "THE quick brown fox\n  jumps over the lazy dog while the farmer sleeps under an old oak tree, "
+                         "dreaming of rain and of a harvest that would finally pay for the new roof on the barn "
+                         "before the winter storms arrive.";
+  minhash(reflowed, strlen(reflowed), b, &other_shingles);
+  assert(memcmp(a, b, sizeof(a)) == 0 && other_shingles == shingles);
+  minhash("two words", 9, a, &shingles);
+  assert(shingles == 0);
+
+  size_t length;
+  const char *note = "---\ntitle: X\nidentifier: 1\n---\nbody\n";
+  assert(strcmp(note_body(note, strlen(note), &length), "body\n") == 0 && length == 5);
+  assert(note_body("no frontmatter", 14, &length)[0] == 'n' && length == 14);
+
+  printf("All tests passed for minhash.\n");
+}
+
+typedef struct {
+  DuplicatePair pairs[16];
+  size_t count;
+} PairList;
+
+static int collect_pair(void *ctx, const DuplicatePair *pair) {
+  PairList *list = ctx;
+  assert(list->count < 16);
+  list->pairs[list->count++] = *pair;
+  return SUCCESS;
+}
+
+void test_find_duplicates() {
+  char dir[] = "/tmp/connote_test_duplicate_XXXXXX";
+  make_vault(dir);
+  write_old_note(dir, "20240101T000001--original.md", "---\ntitle: Original\n---\n" BODY);
+  write_old_note(dir, "20240101T000002--copy.md", "---\ntitle: Copy\nidentifier: 20240101T000002\n---\n" BODY);
+  write_old_note(dir, "20240101T000003--edited.md",
+                 "---\ntitle: Edited\n---\n"
+                 "The quick brown fox jumps over the lazy dog while the farmer sleeps under an old oak tree, dreaming "
+                 "of rain and of a harvest that would finally pay for the new roof on the barn before the first "
+                 "winter storms arrive.\n");
+  write_old_note(dir, "20240101T000004--unrelated.md",
+                 "---\ntitle: Unrelated\n---\nCompilers translate source code into machine instructions through a "
+                 "series of passes that parse, check and optimise the program before emitting an object file.\n");
+  write_old_note(dir, "20240101T000005--empty.md", "---\ntitle: Empty\n---\n");
+  write_old_note(dir, "20240101T000006--empty-too.md", "---\ntitle: Empty too\n---\n");
+
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  NoteSketch sketches[6];
+  size_t hashed;
+  assert(sketch_notes(&index, sketches, &hashed) == SUCCESS && hashed == 6);
+  assert(sketches[0].hash == sketches[1].hash && sketches[0].hash != sketches[2].hash);
+
+  DuplicatePair *pairs;
+  size_t found = find_duplicates(sketches, index.count, &pairs);
+  assert(found >= 2);
+  assert(pairs[0].exact && pairs[0].first == 0 && pairs[0].second == 1);
+  for (size_t i = 1; i < found; i++) {
+    assert(!pairs[i].exact && pairs[i].similarity >= SKETCH_NEAR_MATCHES * 100 / SKETCH_MINHASHES);
+    assert(pairs[i].second == 2 && pairs[i].first < 2);
+  }
+
+  // Streamed a note or two at a time, the same pairs come out in the same
+  // order, and the sketches from the cache
+  PairList list = {0};
+  assert(find_duplicates_bounded(dir, 3 * INDEX_NOTE_BYTES, collect_pair, &list, &hashed) == SUCCESS);
+  assert(hashed == 0 && list.count == found);
+  for (size_t i = 0; i < found; i++) {
+    assert(list.pairs[i].first == pairs[i].first && list.pairs[i].second == pairs[i].second);
+    assert(list.pairs[i].exact == pairs[i].exact && list.pairs[i].similarity == pairs[i].similarity);
+  }
+  free(pairs);
+
+  // Unchanged notes come from the cache on the next run
+  write_old_note(dir, "20240101T000004--unrelated.md", "---\ntitle: Unrelated\n---\nNow changed.\n");
+  NoteSketch again[6];
+  assert(sketch_notes(&index, again, &hashed) == SUCCESS && hashed == 1);
+  assert(memcmp(again, sketches, 3 * sizeof(NoteSketch)) == 0);
+  assert(again[3].hash != sketches[3].hash);
+  list.count = 0;
+  assert(find_duplicates_bounded(dir, 3 * INDEX_NOTE_BYTES, collect_pair, &list, &hashed) == SUCCESS);
+  assert(hashed == 0 && list.count == found);
+
+  // A bounded run rewrites the cache it had to read notes for
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, SKETCH_FILE_NAME);
+  assert(unlink(path) == 0);
+  list.count = 0;
+  assert(find_duplicates_bounded(dir, 3 * INDEX_NOTE_BYTES, collect_pair, &list, &hashed) == SUCCESS);
+  assert(hashed == 6);
+  assert(sketch_notes(&index, again, &hashed) == SUCCESS && hashed == 0);
+
+  index_free(&index);
+  remove_vault(dir);
+  printf("All tests passed for find_duplicates.\n");
+}
+
+int main() {
+  test_xxh64();
+  test_minhash();
+  test_find_duplicates();
+
+  return 0;
+}
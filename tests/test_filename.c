@@ -1,8 +1,12 @@
 #include <assert.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "../src/utils.h"
+#include "vault_fixture.h"
 
 void test_format_file_name() {
   char filename[MAX_PATH_LEN];
@@ -28,6 +32,47 @@ void test_format_file_name() {
   format_file_name(dir_path, "20230903T123456", "", "", keywords2, 0, ".md", filename);
   assert(strcmp(filename, "/tmp/connote/20230903T123456.md") == 0);
 
+  // Every combination of components, from slices that are already slugs
+  const char *expected[] = {"20230903T123456.md",
+                            "20230903T123456==1a.md",
+                            "20230903T123456--a-title.md",
+                            "20230903T123456==1a--a-title.md",
+                            "20230903T123456__kw1_kw2.md",
+                            "20230903T123456==1a__kw1_kw2.md",
+                            "20230903T123456--a-title__kw1_kw2.md",
+                            "20230903T123456==1a--a-title__kw1_kw2.md"};
+  for (int shape = 0; shape < 8; shape++) {
+    FileNameParts parts = {.dir = {"", 0},
+                           .id = "20230903T123456",
+                           .sig = {"1a", shape & 1 ? 2 : 0},
+                           .title = {"a-title", shape & 2 ? 7 : 0},
+                           .keywords = {{"kw1", 3}, {"kw2", 3}},
+                           .kw_count = shape & 4 ? 2 : 0,
+                           .extension = {".md", 3}};
+    assert(file_name_length(&parts) == strlen(expected[shape]));
+    assert(format_file_name_parts(&parts, filename, MAX_PATH_LEN) == SUCCESS);
+    assert(strcmp(filename, expected[shape]) == 0);
+
+    // A name that doesn't fit is not written at all
+    strcpy(filename, "untouched");
+    assert(format_file_name_parts(&parts, filename, strlen(expected[shape])) == FAILURE);
+    assert(strcmp(filename, "untouched") == 0);
+    assert(format_file_name_parts(&parts, filename, strlen(expected[shape]) + 1) == SUCCESS);
+  }
+
+  // Components are sluggified once, and ones left empty are dropped along
+  // with their separators, as is an extension without its dot
+  FileNameParts parts;
+  char messy_sig[8] = "!!";
+  char messy_title[32] = "Hello, World!";
+  char messy_kw[32] = "Machine Learning";
+  char *messy_keywords[] = {messy_kw};
+  assert(file_name_parts(&parts, "/notes/", "20230903T123456", messy_sig, messy_title, messy_keywords, 1, "org") ==
+         SUCCESS);
+  assert(format_file_name_parts(&parts, filename, MAX_PATH_LEN) == SUCCESS);
+  assert(strcmp(filename, "/notes/20230903T123456--hello-world__machinelearning") == 0);
+  assert(file_name_parts(&parts, "/notes/", "2023", NULL, NULL, NULL, 0, ".md") == FAILURE);
+
   printf("All tests passed for format_file_name.\n");
 }
 
@@ -53,9 +98,117 @@ void test_write_frontmatter_to_buffer() {
                         "aliases: [20240903T123456]\n"
                         "---") == 0);
 
+  char date[DATE_LEN + 1];
+  date_from_id(id, date);
+  assert(strcmp(date, "2024-09-03T12:34:56") == 0);
+
+  // Small buffers truncate rather than overrun
+  char small[16];
+  memset(small, 'x', sizeof(small));
+  assert(write_frontmatter_to_buffer(small, 12, id, sig, title, keywords, kw_count) == 11);
+  assert(strcmp(small, "---\ntitle: ") == 0);
+  assert(small[12] == 'x');
+
+  // Missing components and the most keywords allowed
+  char *many[MAX_KEYS];
+  for (size_t i = 0; i < MAX_KEYS; i++) {
+    many[i] = kw1;
+  }
+  struct iovec iov[FRONTMATTER_MAX_IOV];
+  FrontmatterScratch scratch;
+  int count = frontmatter_iov(iov, &scratch, id, NULL, NULL, many, MAX_KEYS);
+  assert(count <= FRONTMATTER_MAX_IOV);
+  size_t length = write_frontmatter_to_buffer(buffer, sizeof(buffer), id, NULL, NULL, many, MAX_KEYS);
+  size_t total = 0;
+  for (int i = 0; i < count; i++) {
+    total += iov[i].iov_len;
+  }
+  assert(length == total);
+  assert(strncmp(buffer, "---\ntitle: \ndate: ", 18) == 0);
+  assert(strstr(buffer, "\nsignature: \naliases: ") != NULL);
+
   printf("All tests passed for write_frontmatter_to_buffer.\n");
 }
 
+void test_read_frontmatter() {
+  char buffer[2048];
+  char id[16] = "20240903T123456";
+  char sig[32] = "12a=1";
+  char title[64] = "Sample: Title";
+  char kw1[32] = "keyword1";
+  char kw2[32] = "keyword2";
+  char *keywords[] = {kw1, kw2};
+
+  // Frontmatter we write must read back
+  write_frontmatter_to_buffer(buffer, sizeof(buffer), id, sig, title, keywords, 2);
+  Frontmatter frontmatter;
+  assert(read_frontmatter(buffer, strlen(buffer), &frontmatter) == SUCCESS);
+  assert(strcmp(frontmatter.title, "Sample: Title") == 0);
+  assert(strcmp(frontmatter.date, "2024-09-03T12:34:56") == 0);
+  assert(strcmp(frontmatter.identifier, "20240903T123456") == 0);
+  assert(strcmp(frontmatter.signature, "12a.1") == 0);
+  assert(frontmatter.tag_count == 2);
+  assert(strcmp(frontmatter.tags[1], "keyword2") == 0);
+
+  // Quotes are removed and input need not be null-terminated
+  const char *quoted = "---\ntitle: \"Quoted\"\ntags: []\n---\nbody";
+  assert(read_frontmatter(quoted, 22, &frontmatter) == SUCCESS);
+  assert(strcmp(frontmatter.title, "Quoted") == 0);
+  assert(frontmatter.tag_count == 0);
+
+  assert(read_frontmatter("no frontmatter", 14, &frontmatter) == FAILURE);
+  assert(frontmatter.title[0] == '\0');
+
+  printf("All tests passed for read_frontmatter.\n");
+}
+
+void test_connote_file() {
+  char id[ID_LEN + 1] = "20241231T235959";
+  assert(increment_id(id) == SUCCESS);
+  assert(strcmp(id, "20250101T000000") == 0);
+
+  char dir[] = "/tmp/connote_test_file_XXXXXX";
+  make_vault(dir);
+  char dir_path[MAX_PATH_LEN];
+  snprintf(dir_path, MAX_PATH_LEN, "%s/", dir);
+
+  char kw[16] = "Kw1";
+  char *keywords[] = {kw};
+  char first[MAX_PATH_LEN];
+  char second[MAX_PATH_LEN];
+  char title[32] = "Same Title";
+
+  // A second note with the same ID must not clobber the first
+  strcpy(id, "20240903T123459");
+  assert(connote_file(dir_path, id, NULL, title, keywords, 1, ".md", FSYNC_DIR, first) == SUCCESS);
+  strcpy(id, "20240903T123459");
+  assert(connote_file(dir_path, id, NULL, title, keywords, 1, ".md", FSYNC_NONE, second) == SUCCESS);
+  assert(strcmp(id, "20240903T123500") == 0);
+  assert(strcmp(first + strlen(dir_path), "20240903T123459--same-title__kw1.md") == 0);
+  assert(strcmp(second + strlen(dir_path), "20240903T123500--same-title__kw1.md") == 0);
+
+  // The frontmatter keeps the unsluggified values and the bumped ID
+  char buffer[2048] = {0};
+  FILE *f = fopen(second, "r");
+  assert(f != NULL);
+  size_t length = fread(buffer, 1, sizeof(buffer) - 1, f);
+  fclose(f);
+  Frontmatter frontmatter;
+  assert(read_frontmatter(buffer, length, &frontmatter) == SUCCESS);
+  assert(strcmp(frontmatter.title, "Same Title") == 0);
+  assert(strcmp(frontmatter.identifier, "20240903T123500") == 0);
+  assert(strcmp(frontmatter.tags[0], "Kw1") == 0);
+
+  FsyncPolicy policy;
+  assert(parse_fsync_policy(NULL, &policy) == SUCCESS && policy == FSYNC_DIR);
+  assert(parse_fsync_policy("file", &policy) == SUCCESS && policy == FSYNC_FILE);
+  assert(parse_fsync_policy("always", &policy) == FAILURE);
+
+  remove_vault(dir);
+
+  printf("All tests passed for connote_file.\n");
+}
+
 void test_sluggify_functions() {
   /* char test_str1[32] = "..@#H*έl/lo!!!, --test- "; */
   char test_str1[32] = "12a=1";
@@ -128,6 +281,8 @@ void test_regex_functions() {
 int main() {
   test_format_file_name();
   test_write_frontmatter_to_buffer();
+  test_read_frontmatter();
+  test_connote_file();
   test_sluggify_functions();
   test_regex_functions();
 
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/fuzzy.h"
+#include "../src/utils.h"
+
+static const char *titles[] = {
+    "team-meeting-notes", "meeting", "notes-on-the-quarterly-review", "reading-list", "mtg-notes", "weekly-plan",
+    "project-connote-ideas", "meetup",
+};
+#define TITLE_COUNT (sizeof(titles) / sizeof(titles[0]))
+
+void test_fuzzy_score() {
+  assert(fuzzy_score("meeting", 7, "mtg", 3) > fuzzy_score("meeting", 7, "xyz", 3));
+  assert(fuzzy_score("meeting", 7, "gm", 2) == INT32_MIN);
+  // Consecutive matches and word starts score higher than scattered ones
+  assert(fuzzy_score("team-meeting", 12, "mee", 3) > fuzzy_score("mxexe", 5, "mee", 3));
+  assert(fuzzy_score("weekly-plan", 11, "wp", 2) > fuzzy_score("swamp", 5, "wp", 2));
+
+  printf("All tests passed for fuzzy_score.\n");
+}
+
+// The best `limit` matches, found the slow way
+static size_t brute_force(const char *query, FuzzyMatch *results, size_t limit) {
+  char copy[FUZZY_MAX_QUERY_LEN];
+  snprintf(copy, sizeof(copy), "%s", query);
+  char *words[FUZZY_MAX_WORDS];
+  size_t word_count = 0;
+  for (char *word = strtok(copy, " "); word != NULL; word = strtok(NULL, " ")) {
+    words[word_count++] = word;
+  }
+
+  size_t found = 0;
+  for (size_t i = 0; i < TITLE_COUNT; i++) {
+    int32_t score = 0;
+    bool matched = true;
+    for (size_t w = 0; w < word_count; w++) {
+      int32_t word_score = fuzzy_score(titles[i], strlen(titles[i]), words[w], strlen(words[w]));
+      // Words with trigrams must contain every one of them
+      for (size_t j = 0; j + 3 <= strlen(words[w]); j++) {
+        char trigram[4] = {words[w][j], words[w][j + 1], words[w][j + 2], '\0'};
+        if (strstr(titles[i], trigram) == NULL)
+          word_score = INT32_MIN;
+      }
+      matched = matched && word_score != INT32_MIN;
+      score += matched ? word_score : 0;
+    }
+    if (matched && found < limit)
+      results[found++] = (FuzzyMatch){.note = (uint32_t)i, .score = score};
+  }
+  return found;
+}
+
+static bool contains(const FuzzyMatch *results, size_t count, uint32_t note) {
+  for (size_t i = 0; i < count; i++) {
+    if (results[i].note == note)
+      return true;
+  }
+  return false;
+}
+
+void test_fuzzy_search() {
+  FuzzyIndex fuzzy;
+  assert(fuzzy_index_build_titles(&fuzzy, titles, TITLE_COUNT) == SUCCESS);
+  FuzzySession session;
+  fuzzy_session_init(&session);
+
+  FuzzyMatch results[TITLE_COUNT];
+  size_t total;
+  size_t found = fuzzy_search(&session, &fuzzy, "Meeting", results, TITLE_COUNT, &total);
+  assert(found == 2 && total == 2);
+  // The exact title ranks first
+  assert(results[0].note == 1 && results[1].note == 0);
+
+  // Short words are matched as subsequences, longer ones need their trigrams
+  found = fuzzy_search(&session, &fuzzy, "mt", results, TITLE_COUNT, NULL);
+  assert(contains(results, found, 4) && contains(results, found, 0));
+  found = fuzzy_search(&session, &fuzzy, "mtg", results, TITLE_COUNT, NULL);
+  assert(found == 1 && results[0].note == 4);
+
+  // Words may match in any order
+  found = fuzzy_search(&session, &fuzzy, "notes team", results, TITLE_COUNT, NULL);
+  assert(found == 1 && results[0].note == 0);
+
+  // The limit keeps the best matches
+  found = fuzzy_search(&session, &fuzzy, "e", results, 2, &total);
+  assert(found == 2 && total == TITLE_COUNT);
+  assert(results[0].score >= results[1].score);
+
+  // With no query the newest notes come first
+  found = fuzzy_search(&session, &fuzzy, "  ", results, 3, &total);
+  assert(found == 3 && total == TITLE_COUNT && results[0].note == TITLE_COUNT - 1);
+
+  fuzzy_session_free(&session);
+  fuzzy_index_free(&fuzzy);
+  printf("All tests passed for fuzzy_search.\n");
+}
+
+// Typing and deleting one character at a time must find exactly what a
+// fresh search finds
+void test_fuzzy_session() {
+  FuzzyIndex fuzzy;
+  assert(fuzzy_index_build_titles(&fuzzy, titles, TITLE_COUNT) == SUCCESS);
+  FuzzySession session;
+  fuzzy_session_init(&session);
+
+  const char *typed = "meeting no";
+  char query[FUZZY_MAX_QUERY_LEN];
+  size_t length = strlen(typed);
+  for (size_t step = 1; step <= 2 * length; step++) {
+    size_t prefix = step <= length ? step : 2 * length - step;
+    memcpy(query, typed, prefix);
+    query[prefix] = '\0';
+
+    FuzzyMatch incremental[TITLE_COUNT], expected[TITLE_COUNT];
+    size_t found = fuzzy_search(&session, &fuzzy, query, incremental, TITLE_COUNT, NULL);
+    size_t expected_found = prefix > 0 ? brute_force(query, expected, TITLE_COUNT) : TITLE_COUNT;
+    assert(found == expected_found);
+    for (size_t i = 0; prefix > 0 && i < expected_found; i++) {
+      assert(contains(incremental, found, expected[i].note));
+    }
+  }
+
+  // A rebuilt index starts a new history
+  FuzzyIndex rebuilt;
+  assert(fuzzy_index_build_titles(&rebuilt, titles, 2) == SUCCESS);
+  FuzzyMatch results[TITLE_COUNT];
+  assert(fuzzy_search(&session, &rebuilt, "meeting", results, TITLE_COUNT, NULL) == 2);
+  assert(fuzzy_search(&session, &rebuilt, "meeting no", results, TITLE_COUNT, NULL) == 1);
+
+  fuzzy_session_free(&session);
+  fuzzy_index_free(&rebuilt);
+  fuzzy_index_free(&fuzzy);
+  printf("All tests passed for fuzzy sessions.\n");
+}
+
+int main() {
+  test_fuzzy_score();
+  test_fuzzy_search();
+  test_fuzzy_session();
+
+  return 0;
+}
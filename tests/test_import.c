@@ -0,0 +1,185 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/import.h"
+#include "../src/index.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+void test_date_to_id() {
+  char id[ID_LEN + 1];
+  assert(date_to_id("20240916T101500", id) == SUCCESS && strcmp(id, "20240916T101500") == 0);
+  assert(date_to_id("2024-09-16", id) == SUCCESS && strcmp(id, "20240916T000000") == 0);
+  assert(date_to_id("2024-09-16 10:15", id) == SUCCESS && strcmp(id, "20240916T101500") == 0);
+  assert(date_to_id("2024-09-16T10:15:30", id) == SUCCESS && strcmp(id, "20240916T101530") == 0);
+  assert(date_to_id("2024-13-01", id) == FAILURE);
+  assert(date_to_id("yesterday", id) == FAILURE);
+
+  printf("All tests passed for date_to_id.\n");
+}
+
+void test_parse_manifest_line() {
+  ImportEntry entry = {0};
+
+  assert(parse_manifest_line("{\"title\": \"Caf\\u00e9 \\\"notes\\\"\", \"keywords\": [\"kw1\", \"kw2\"], "
+                             "\"signature\": \"1a\", \"draft\": true, \"date\": \"2024-09-16\", \"body\": \"b.txt\"}",
+                             &entry) == SUCCESS);
+  assert(strcmp(entry.title, "Café \"notes\"") == 0);
+  assert(entry.kw_count == 2 && strcmp(entry.keywords[1], "kw2") == 0);
+  assert(strcmp(entry.sig, "1a") == 0);
+  assert(strcmp(entry.date, "2024-09-16") == 0);
+  assert(strcmp(entry.body_path, "b.txt") == 0);
+
+  assert(parse_manifest_line("{\"title\": \"Tags\", \"keywords\": \"kw1, kw2 kw3\"}", &entry) == SUCCESS);
+  assert(entry.kw_count == 3 && strcmp(entry.keywords[2], "kw3") == 0);
+  assert(entry.sig[0] == '\0' && entry.body_path[0] == '\0');
+
+  assert(parse_manifest_line("{\"title\": \"Unterminated}", &entry) == FAILURE);
+
+  assert(parse_manifest_line("A title\tkw1,kw2\t\t2024-09-16\n", &entry) == SUCCESS);
+  assert(strcmp(entry.title, "A title") == 0);
+  assert(entry.kw_count == 2);
+  assert(entry.sig[0] == '\0');
+  assert(strcmp(entry.date, "2024-09-16") == 0);
+  assert(entry.body_path[0] == '\0');
+
+  printf("All tests passed for parse_manifest_line.\n");
+}
+
+void test_allocate_id() {
+  IdSet used = {0};
+  assert(id_set_add(&used, 20240916000000ULL) == SUCCESS);
+
+  char sequence[ID_LEN + 1] = "20240916T235959";
+  char id[ID_LEN + 1];
+
+  // Dated notes skip past IDs that are taken
+  assert(allocate_id(&used, "2024-09-16", sequence, id) == SUCCESS);
+  assert(strcmp(id, "20240916T000001") == 0);
+  assert(allocate_id(&used, "2024-09-16", sequence, id) == SUCCESS);
+  assert(strcmp(id, "20240916T000002") == 0);
+
+  // Undated notes count up from the sequence
+  assert(allocate_id(&used, "", sequence, id) == SUCCESS);
+  assert(strcmp(id, "20240916T235959") == 0);
+  assert(allocate_id(&used, NULL, sequence, id) == SUCCESS);
+  assert(strcmp(id, "20240917T000000") == 0);
+
+  for (uint64_t i = 0; i < 5000; i++) {
+    assert(id_set_add(&used, 20200101000000ULL + i) == SUCCESS);
+  }
+  assert(id_set_contains(&used, 20200101004999ULL));
+  assert(id_set_contains(&used, 20240916000002ULL));
+  assert(!id_set_contains(&used, 20240916000003ULL));
+
+  id_set_free(&used);
+
+  printf("All tests passed for allocate_id.\n");
+}
+
+void test_import_notes() {
+  char dir[] = "/tmp/connote_test_import_XXXXXX";
+  make_vault(dir);
+
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/body.txt", dir);
+  FILE *body = fopen(path, "w");
+  assert(body != NULL);
+  fputs("Body text\n", body);
+  fclose(body);
+
+  // A note already in the directory takes the first ID
+  snprintf(path, MAX_PATH_LEN, "%s/20240916T000000--existing.md", dir);
+  FILE *existing = fopen(path, "w");
+  assert(existing != NULL);
+  fclose(existing);
+
+  char manifest_path[MAX_PATH_LEN];
+  snprintf(manifest_path, MAX_PATH_LEN, "%s/manifest", dir);
+  FILE *manifest = fopen(manifest_path, "w");
+  assert(manifest != NULL);
+  fprintf(manifest, "# comment\n\n");
+  fprintf(manifest, "{\"title\": \"First\", \"keywords\": [\"kw1\"], \"date\": \"2024-09-16\", \"body\": \"%s/body.txt\"}\n",
+          dir);
+  fprintf(manifest, "Second\tkw1 kw2\t1a\t2024-09-16\n");
+  fclose(manifest);
+
+  manifest = fopen(manifest_path, "r");
+  assert(manifest != NULL);
+  char dir_path[MAX_PATH_LEN];
+  snprintf(dir_path, MAX_PATH_LEN, "%s/", dir);
+  size_t imported;
+  assert(import_notes(manifest, dir_path, FSYNC_NONE, NULL, &imported) == SUCCESS);
+  fclose(manifest);
+  assert(imported == 2);
+
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  assert(index.count == 3);
+  assert(strcmp(index.notes[1].name, "20240916T000001--first__kw1.md") == 0);
+  assert(strcmp(index.notes[2].name, "20240916T000002==1a--second__kw1_kw2.md") == 0);
+  assert(strcmp(index.notes[2].full_title, "Second") == 0);
+  index_free(&index);
+
+  snprintf(path, MAX_PATH_LEN, "%s/20240916T000001--first__kw1.md", dir);
+  FILE *note = fopen(path, "r");
+  assert(note != NULL);
+  char contents[512];
+  size_t length = fread(contents, 1, sizeof(contents) - 1, note);
+  contents[length] = '\0';
+  fclose(note);
+  assert(strstr(contents, "title: First\n") != NULL);
+  assert(strstr(contents, "\n\nBody text\n") != NULL);
+
+  // A missing body fails that line only
+  manifest = fopen(manifest_path, "w");
+  fprintf(manifest, "Third\n{\"title\": \"Fourth\", \"body\": \"%s/missing.txt\"}\n", dir);
+  fclose(manifest);
+  manifest = fopen(manifest_path, "r");
+  assert(import_notes(manifest, dir_path, FSYNC_NONE, NULL, &imported) == FAILURE);
+  fclose(manifest);
+  assert(imported == 1);
+
+  // A line over the limit is rejected whole, not read as two entries
+  manifest = fopen(manifest_path, "w");
+  fputs("Long", manifest);
+  for (size_t i = 0; i < MAX_MANIFEST_LINE_LEN; i++) {
+    fputc('x', manifest);
+  }
+  fputs("\nFifth\n", manifest);
+  fclose(manifest);
+  manifest = fopen(manifest_path, "r");
+  assert(import_notes(manifest, dir_path, FSYNC_NONE, NULL, &imported) == FAILURE);
+  fclose(manifest);
+  assert(imported == 1);
+
+  // Bad lines are skipped, and every later line is still imported, in this
+  // batch and the next
+  manifest = fopen(manifest_path, "w");
+  fputs("Sixth\t\t\tnot-a-date\n", manifest);
+  for (size_t i = 0; i < IMPORT_BATCH_SIZE; i++) {
+    fprintf(manifest, "Bulk %zu\n", i);
+  }
+  fclose(manifest);
+  manifest = fopen(manifest_path, "r");
+  assert(import_notes(manifest, dir_path, FSYNC_NONE, NULL, &imported) == FAILURE);
+  fclose(manifest);
+  assert(imported == IMPORT_BATCH_SIZE);
+
+  remove_vault(dir);
+
+  printf("All tests passed for import_notes.\n");
+}
+
+int main() {
+  test_date_to_id();
+  test_parse_manifest_line();
+  test_allocate_id();
+  test_import_notes();
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/index.h"
+#include "../src/io.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+void test_ids() {
+  char id[ID_LEN + 1];
+  assert(id_to_u64("20240908T123445") == 20240908123445ULL);
+  u64_to_id(20240908123445ULL, id);
+  assert(strcmp(id, "20240908T123445") == 0);
+
+  assert(name_has_valid_id("20240908T123445--title.md"));
+  assert(!name_has_valid_id("2024"));
+  assert(!name_has_valid_id("notes.md"));
+
+  printf("All tests passed for IDs.\n");
+}
+
+void test_keyword_table() {
+  KeywordTable table = {0};
+  uint32_t a, b, handle;
+  assert(keyword_intern(&table, "alpha", &a) == SUCCESS);
+  assert(keyword_intern(&table, "beta", &b) == SUCCESS);
+  assert(a != b);
+  assert(keyword_intern(&table, "alpha", &handle) == SUCCESS && handle == a);
+
+  // Force the table to grow and check handles survive rehashing
+  char keyword[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(keyword, sizeof(keyword), "kw%d", i);
+    assert(keyword_intern(&table, keyword, &handle) == SUCCESS);
+  }
+  assert(keyword_lookup(&table, "beta", &handle) && handle == b);
+  assert(keyword_lookup(&table, "kw999", &handle));
+  assert(!keyword_lookup(&table, "gamma", &handle));
+
+  printf("All tests passed for keyword table.\n");
+}
+
+typedef struct {
+  size_t seen;
+  size_t lengths[5];
+  int errors[5];
+  uint64_t sizes[5];
+  char last[5];
+} IoResults;
+
+void record_io_result(void *ctx, size_t i, const IoFileInfo *info, const char *data, size_t length, int error) {
+  IoResults *results = ctx;
+  results->seen++;
+  results->lengths[i] = length;
+  results->errors[i] = error;
+  results->sizes[i] = error == 0 ? info->size : 0;
+  results->last[i] = error == 0 && length > 0 ? data[length - 1] : '\0';
+  if (error == 0 && length >= 3)
+    assert(strncmp(data, "---", 3) == 0);
+}
+
+void test_io_engine() {
+  char dir[] = "/tmp/connote_test_io_XXXXXX";
+  make_vault(dir);
+
+  write_note(dir, "small.md", "---\ntitle: Small\n---\n");
+  write_note(dir, "empty.md", "");
+  // Files longer than a buffer are read whole, up to IO_MAX_READ_SIZE
+  size_t huge_size = IO_MAX_READ_SIZE + IO_READ_SIZE;
+  char *large = malloc(huge_size + 1);
+  memset(large, 'x', huge_size);
+  memcpy(large, "---", 3);
+  large[IO_READ_SIZE * 2 - 1] = 'y';
+  large[IO_READ_SIZE * 2] = '\0';
+  write_note(dir, "large.md", large);
+  large[IO_READ_SIZE * 2] = 'x';
+  large[huge_size] = '\0';
+  write_note(dir, "huge.md", large);
+  free(large);
+
+  char *names[] = {"small.md", "missing.md", "empty.md", "large.md", "huge.md"};
+
+  // Both backends must behave identically
+  const char *backends[] = {"uring", "threads"};
+  for (int b = 0; b < 2; b++) {
+    setenv("CONNOTE_IO", backends[b], 1);
+    IoEngine engine;
+    assert(io_engine_init(&engine, dir) == SUCCESS);
+
+    IoResults results = {0};
+    assert(io_engine_read(&engine, names, 5, record_io_result, &results) == SUCCESS);
+    assert(results.seen == 5);
+    assert(results.errors[0] == 0 && results.lengths[0] == 21 && results.sizes[0] == 21);
+    assert(results.errors[1] < 0);
+    assert(results.errors[2] == 0 && results.lengths[2] == 0);
+    assert(results.errors[3] == 0 && results.lengths[3] == IO_READ_SIZE * 2 && results.sizes[3] == IO_READ_SIZE * 2);
+    assert(results.last[3] == 'y');
+    assert(results.errors[4] == 0 && results.lengths[4] == IO_MAX_READ_SIZE && results.sizes[4] == huge_size);
+
+    io_engine_free(&engine);
+  }
+  unsetenv("CONNOTE_IO");
+
+  remove_vault(dir);
+
+  printf("All tests passed for I/O engine.\n");
+}
+
+void test_index_build() {
+  char dir[] = "/tmp/connote_test_index_XXXXXX";
+  make_vault(dir);
+
+  write_note(dir, "20240101T090000--first-note__kw1_kw2.md", "---\ntitle: First Note\ntags: [kw1, kw2]\n---\n");
+  write_note(dir, "20240102T090000==1a--second__kw2.md", "See [[denote:20240101T090000]].\n");
+  write_note(dir, "20240103T090000--third.md", "denote:20240101T090000 and denote:20240102T090000\n");
+  write_note(dir, "not-a-note.md", "denote:20240101T090000\n");
+
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  assert(index.count == 3);
+  assert(index.notes[0].id == 20240101090000ULL);
+  assert(strcmp(index.notes[0].title, "first-note") == 0);
+  assert(strcmp(index.notes[0].full_title, "First Note") == 0);
+  assert(strcmp(index.notes[1].full_title, "") == 0);
+  assert(index.notes[0].kw_count == 2);
+  assert(strcmp(index.notes[1].sig, "1a") == 0);
+
+  uint32_t kw2;
+  assert(keyword_lookup(&index.keywords, "kw2", &kw2));
+  assert(note_has_keyword(&index.notes[0], kw2) && note_has_keyword(&index.notes[1], kw2));
+  assert(!note_has_keyword(&index.notes[2], kw2));
+
+  size_t results[8];
+  assert(index_backlinks(&index, 20240101090000ULL, results, 8) == 2);
+  assert(index_backlinks(&index, 20240102090000ULL, results, 8) == 1);
+  assert(results[0] == 2);
+
+  // Incremental updates keep the index sorted and the link graph current
+  write_note(dir, "20231231T090000--earlier.md", "denote:20240103T090000\n");
+  assert(index_update_note(&index, "20231231T090000--earlier.md") == SUCCESS);
+  assert(index.count == 4);
+  assert(index.notes[0].id == 20231231090000ULL);
+  assert(index_backlinks(&index, 20240103090000ULL, results, 8) == 1);
+  assert(index_find_name(&index, "20240103T090000--third.md") == 3);
+
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/20240103T090000--third.md", dir);
+  unlink(path);
+  assert(index_update_note(&index, "20240103T090000--third.md") == FAILURE);
+  assert(index.count == 3);
+  assert(index_backlinks(&index, 20240101090000ULL, results, 8) == 1);
+
+  index_free(&index);
+
+  remove_vault(dir);
+
+  printf("All tests passed for index build.\n");
+}
+
+void test_index_duplicate_ids() {
+  char dir[] = "/tmp/connote_test_index_XXXXXX";
+  make_vault(dir);
+  write_note(dir, "20240101T090000--target.md", "---\ntitle: Target\n---\n");
+  // Both notes with the same ID link to the target, and each must be found
+  write_note(dir, "20240102T090000--copy-a.md", "denote:20240101T090000\n");
+  write_note(dir, "20240102T090000--copy-b.md", "denote:20240101T090000\n");
+
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  assert(index.count == 3);
+  size_t results[8];
+  assert(index_backlinks(&index, 20240101090000ULL, results, 8) == 2);
+  assert(results[0] != results[1]);
+  assert(strcmp(index.notes[results[0]].name, "20240102T090000--copy-a.md") == 0 ||
+         strcmp(index.notes[results[1]].name, "20240102T090000--copy-a.md") == 0);
+  assert(strcmp(index.notes[results[0]].name, "20240102T090000--copy-b.md") == 0 ||
+         strcmp(index.notes[results[1]].name, "20240102T090000--copy-b.md") == 0);
+  index_free(&index);
+
+  remove_vault(dir);
+  printf("All tests passed for duplicate IDs.\n");
+}
+
+void test_index_large_notes() {
+  // A link past the first buffer's worth of a note is found by both backends
+  char *body = malloc(IO_READ_SIZE * 2 + 1);
+  memset(body, 'x', IO_READ_SIZE * 2);
+  body[IO_READ_SIZE * 2] = '\0';
+  memcpy(body + IO_READ_SIZE + 16, "denote:20240101T090000\n", 24);
+
+  const char *backends[] = {"uring", "threads"};
+  for (int b = 0; b < 2; b++) {
+    setenv("CONNOTE_IO", backends[b], 1);
+    char dir[] = "/tmp/connote_test_index_XXXXXX";
+    make_vault(dir);
+    write_note(dir, "20240101T090000--target.md", "---\ntitle: Target\n---\n");
+    write_note(dir, "20240102T090000--large.md", body);
+
+    NoteIndex index;
+    assert(index_build(&index, dir) == SUCCESS);
+    assert(index.count == 2 && index.notes[1].size == strlen(body));
+    size_t results[8];
+    assert(index_backlinks(&index, 20240101090000ULL, results, 8) == 1 && results[0] == 1);
+    index_free(&index);
+
+    remove_vault(dir);
+  }
+  unsetenv("CONNOTE_IO");
+  free(body);
+
+  printf("All tests passed for large notes.\n");
+}
+
+void test_index_attachments() {
+  char dir[] = "/tmp/connote_test_index_XXXXXX";
+  make_vault(dir);
+  write_note(dir, "20240101T090000--note.md", "---\ntitle: Note\n---\n");
+  // Contents that would read as frontmatter and a link if parsed as a note
+  const char *scan = "---\ntitle: Not a title\n---\ndenote:20240101T090000\n";
+  write_note(dir, "20240102T090000--scan__pdf.pdf", scan);
+
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  assert(index.count == 2);
+  const NoteRecord *attachment = &index.notes[1];
+  assert(strcmp(attachment->name, "20240102T090000--scan__pdf.pdf") == 0);
+  assert(strcmp(attachment->title, "scan") == 0 && strcmp(attachment->full_title, "") == 0);
+  assert(attachment->link_count == 0 && attachment->kw_count == 1 && attachment->size == strlen(scan));
+  size_t results[8];
+  assert(index_backlinks(&index, 20240101090000ULL, results, 8) == 0);
+  index_free(&index);
+
+  remove_vault(dir);
+  printf("All tests passed for index attachments.\n");
+}
+
+int main() {
+  test_ids();
+  test_keyword_table();
+  test_io_engine();
+  test_index_build();
+  test_index_duplicate_ids();
+  test_index_large_notes();
+  test_index_attachments();
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/index.h"
+#include "../src/keyword.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+static bool note_exists(const char *dir, const char *name) {
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+  return access(path, F_OK) == 0;
+}
+
+static void assert_note_body(const char *dir, const char *name, const char *body) {
+  char path[MAX_PATH_LEN], data[256] = {0};
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+  FILE *f = fopen(path, "r");
+  assert(f != NULL);
+  assert(fread(data, 1, sizeof(data) - 1, f) == strlen(body));
+  fclose(f);
+  assert(strcmp(data, body) == 0);
+}
+
+static void make_tagged_vault(char *dir) {
+  make_vault(dir);
+  write_note(dir, "20240101T000001--a__ideas_ml.md", "---\ntitle: A\ntags: [ideas, ml]\n---\nbody\n");
+  write_note(dir, "20240101T000002==1a--b__ai_ml.md", "---\ntitle: B\ntags: [ai, ml]\n---\n");
+  write_note(dir, "20240101T000003--c__other.md", "---\ntitle: C\ntags: [other]\n---\n");
+}
+
+void test_keyword_rewrite_tags() {
+  KeywordPlan plan = {.from = {"ml", "ai"}, .from_count = 2, .to = "learning"};
+  char dest[256 + KEYWORD_TAGS_LINE_LEN];
+
+  const char *note = "---\ntitle: X\ntags: [ai, notes, ml]\n---\ntags: [ml]\n";
+  size_t length = keyword_rewrite_tags(&plan, note, strlen(note), dest, sizeof(dest));
+  const char *expected = "---\ntitle: X\ntags: [learning, notes]\n---\ntags: [ml]\n";
+  assert(length == strlen(expected) && memcmp(dest, expected, length) == 0);
+
+  // Tags are kept as they were typed, but still match by their slug
+  const char *typed = "---\ntitle: X\ntags: [ML, Ideas, Learning]\n---\n";
+  length = keyword_rewrite_tags(&plan, typed, strlen(typed), dest, sizeof(dest));
+  expected = "---\ntitle: X\ntags: [learning, Ideas]\n---\n";
+  assert(length == strlen(expected) && memcmp(dest, expected, length) == 0);
+
+  // Notes without tags in their frontmatter are left alone
+  const char *untagged = "---\ntitle: X\n---\ntags: [ml]\n";
+  length = keyword_rewrite_tags(&plan, untagged, strlen(untagged), dest, sizeof(dest));
+  assert(length == strlen(untagged) && memcmp(dest, untagged, length) == 0);
+
+  printf("All tests passed for keyword_rewrite_tags.\n");
+}
+
+void test_keyword_plan() {
+  char dir[] = "/tmp/connote_test_keyword_XXXXXX";
+  make_tagged_vault(dir);
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+
+  const uint32_t *notes;
+  uint32_t handle;
+  assert(keyword_lookup(&index.keywords, "ml", &handle));
+  assert(index_keyword_notes(&index, handle, &notes) == 2 && notes[0] == 0 && notes[1] == 1);
+
+  KeywordPlan plan;
+  char *from[] = {"ML", "ai"};
+  assert(keyword_plan(&plan, &index, from, 2, "learning") == SUCCESS);
+  assert(plan.count == 2);
+  assert(strcmp(plan.moves[0].new_name, "20240101T000001--a__ideas_learning.md") == 0);
+  assert(strcmp(plan.moves[1].new_name, "20240101T000002==1a--b__learning.md") == 0);
+  keyword_plan_free(&plan);
+
+  // A new name that is already taken stops the whole plan
+  write_note(dir, "20240101T000003--c__ideas.md", "");
+  index_free(&index);
+  assert(index_build(&index, dir) == SUCCESS);
+  char *other[] = {"other"};
+  assert(keyword_plan(&plan, &index, other, 1, "ideas") == FAILURE);
+  keyword_plan_free(&plan);
+
+  index_free(&index);
+  remove_vault(dir);
+  printf("All tests passed for keyword_plan.\n");
+}
+
+void test_keyword_journal() {
+  char dir[] = "/tmp/connote_test_keyword_XXXXXX";
+  make_tagged_vault(dir);
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  KeywordPlan plan;
+  char *from[] = {"ml"};
+  assert(keyword_plan(&plan, &index, from, 1, "ai") == SUCCESS);
+  assert(plan.count == 2);
+
+  // A note that vanishes after planning leaves the change unfinished
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/20240101T000002==1a--b__ai_ml.md", dir);
+  assert(rename(path, "/tmp/connote_test_keyword_moved") == 0);
+  assert(keyword_apply(&plan) == FAILURE);
+  assert(note_exists(dir, "20240101T000001--a__ideas_ai.md") && !note_exists(dir, "20240101T000001--a__ideas_ml.md"));
+  keyword_plan_free(&plan);
+  // and blocks any other until it is resumed or rolled back
+  assert(keyword_plan(&plan, &index, from, 1, "ai") == SUCCESS && keyword_apply(&plan) == FAILURE);
+  keyword_plan_free(&plan);
+
+  // Rolling back puts the old notes back
+  assert(keyword_rollback(dir) == SUCCESS);
+  assert(!note_exists(dir, "20240101T000001--a__ideas_ai.md"));
+  assert_note_body(dir, "20240101T000001--a__ideas_ml.md", "---\ntitle: A\ntags: [ideas, ml]\n---\nbody\n");
+  assert(!note_exists(dir, KEYWORD_JOURNAL_DIR));
+  assert(keyword_rollback(dir) == FAILURE);
+
+  // Resuming finishes the change once the note is back
+  assert(keyword_plan(&plan, &index, from, 1, "ai") == SUCCESS);
+  assert(keyword_apply(&plan) == FAILURE);
+  keyword_plan_free(&plan);
+  assert(rename("/tmp/connote_test_keyword_moved", path) == 0);
+  assert(keyword_resume(dir) == SUCCESS);
+  assert(!note_exists(dir, KEYWORD_JOURNAL_DIR));
+  assert_note_body(dir, "20240101T000001--a__ideas_ai.md", "---\ntitle: A\ntags: [ideas, ai]\n---\nbody\n");
+  assert_note_body(dir, "20240101T000002==1a--b__ai.md", "---\ntitle: B\ntags: [ai]\n---\n");
+  assert(!note_exists(dir, "20240101T000002==1a--b__ai_ml.md"));
+
+  index_free(&index);
+  remove_vault(dir);
+  printf("All tests passed for keyword journals.\n");
+}
+
+static ino_t note_inode(const char *dir, const char *name) {
+  char path[MAX_PATH_LEN];
+  struct stat st;
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+  assert(stat(path, &st) == 0);
+  return st.st_ino;
+}
+
+void test_keyword_links() {
+  char dir[] = "/tmp/connote_test_keyword_XXXXXX";
+  make_tagged_vault(dir);
+  write_note(dir, "20240101T000004--scan__ml.pdf", "%PDF-1.4 ---\ntags: [ml]\n");
+  write_note(dir, "20240101T000005--plain__ml.md", "no frontmatter\n");
+  ino_t scan = note_inode(dir, "20240101T000004--scan__ml.pdf");
+  ino_t plain = note_inode(dir, "20240101T000005--plain__ml.md");
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  KeywordPlan plan;
+  char *from[] = {"ml"};
+  assert(keyword_plan(&plan, &index, from, 1, "ai") == SUCCESS);
+  assert(plan.count == 4 && keyword_apply(&plan) == SUCCESS);
+
+  // Attachments and notes without frontmatter are renamed, not rewritten
+  assert(note_inode(dir, "20240101T000004--scan__ai.pdf") == scan);
+  assert_note_body(dir, "20240101T000004--scan__ai.pdf", "%PDF-1.4 ---\ntags: [ml]\n");
+  assert(note_inode(dir, "20240101T000005--plain__ai.md") == plain);
+  assert_note_body(dir, "20240101T000005--plain__ai.md", "no frontmatter\n");
+  assert(!note_exists(dir, "20240101T000004--scan__ml.pdf") && !note_exists(dir, "20240101T000005--plain__ml.md"));
+  assert_note_body(dir, "20240101T000002==1a--b__ai.md", "---\ntitle: B\ntags: [ai]\n---\n");
+  keyword_plan_free(&plan);
+
+  index_free(&index);
+  remove_vault(dir);
+  printf("All tests passed for keyword links.\n");
+}
+
+int main() {
+  test_keyword_rewrite_tags();
+  test_keyword_plan();
+  test_keyword_journal();
+  test_keyword_links();
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/libconnote.h"
+#include "vault_fixture.h"
+
+#define THREADS 4
+#define ROUNDS 2000
+
+void test_connote_format_name() {
+  ConnoteError error;
+  const char *keywords[] = {"Machine Learning", "ai"};
+  char title[] = "  Hello, World!  ";
+  ConnoteNote note = {.id = "20240101T120000", .signature = "1a", .title = title, .keywords = keywords, .kw_count = 2};
+
+  char name[CONNOTE_MAX_PATH_LEN];
+  assert(connote_format_name(&note, name, sizeof(name), &error) == CONNOTE_OK && error.status == CONNOTE_OK);
+  assert(strcmp(name, "20240101T120000==1a--hello-world__machinelearning_ai.md") == 0);
+  // The inputs are left as they were
+  assert(strcmp(title, "  Hello, World!  ") == 0 && strcmp(keywords[0], "Machine Learning") == 0);
+
+  char small[16];
+  assert(connote_format_name(&note, small, sizeof(small), &error) == CONNOTE_ERANGE && error.status == CONNOTE_ERANGE);
+  note.id = "2024-01-01";
+  assert(connote_format_name(&note, name, sizeof(name), &error) == CONNOTE_EINVAL);
+  assert(strstr(error.message, "2024-01-01") != NULL);
+
+  char slug[8];
+  assert(connote_slug(CONNOTE_SLUG_TITLE, "A Title", slug, sizeof(slug), NULL) == CONNOTE_OK);
+  assert(strcmp(slug, "a-title") == 0);
+  assert(connote_slug(CONNOTE_SLUG_SIGNATURE, "a long signature", slug, sizeof(slug), &error) == CONNOTE_ERANGE);
+
+  printf("All tests passed for connote_format_name.\n");
+}
+
+void test_connote_parse() {
+  ConnoteError error;
+  ConnoteFields fields;
+  assert(connote_parse_name("/notes/20240101T120000==1a--hello-world__ml_ai.md", &fields, &error) == CONNOTE_OK);
+  assert(strcmp(fields.id, "20240101T120000") == 0 && strcmp(fields.signature, "1a") == 0);
+  assert(strcmp(fields.title, "hello-world") == 0 && strcmp(fields.extension, ".md") == 0);
+  assert(fields.kw_count == 2 && strcmp(fields.keywords[0], "ml") == 0 && strcmp(fields.keywords[1], "ai") == 0);
+
+  assert(connote_parse_name("20240101T120000.org", &fields, &error) == CONNOTE_OK);
+  assert(fields.title[0] == '\0' && fields.kw_count == 0 && strcmp(fields.extension, ".org") == 0);
+  assert(connote_parse_name("notes.md", &fields, &error) == CONNOTE_ENOTFOUND);
+
+  const char *data = "---\ntitle: Hello, World!\ndate: 2024-01-01T12:00:00\ntags: [ml, ai]\n"
+                     "identifier: 20240101T120000\n---\nbody";
+  assert(connote_parse_frontmatter(data, strlen(data), &fields, &error) == CONNOTE_OK);
+  assert(strcmp(fields.title, "Hello, World!") == 0 && strcmp(fields.date, "2024-01-01T12:00:00") == 0);
+  assert(fields.kw_count == 2 && strcmp(fields.id, "20240101T120000") == 0);
+  assert(connote_parse_frontmatter("body", 4, &fields, &error) == CONNOTE_ENOTFOUND);
+
+  printf("All tests passed for connote_parse_name and connote_parse_frontmatter.\n");
+}
+
+// Each thread formats and parses its own names, which must never see
+// another thread's state
+static void *format_and_parse(void *arg) {
+  long thread = (long)arg;
+  char title[32], name[CONNOTE_MAX_PATH_LEN], expected[64];
+  const char *keywords[] = {"shared"};
+  ConnoteError error;
+  ConnoteFields fields;
+  for (int i = 0; i < ROUNDS; i++) {
+    snprintf(title, sizeof(title), "Thread %ld Note %d", thread, i);
+    ConnoteNote note = {.id = "20240101T120000", .title = title, .keywords = keywords, .kw_count = 1};
+    if (connote_format_name(&note, name, sizeof(name), &error) != CONNOTE_OK ||
+        connote_parse_name(name, &fields, &error) != CONNOTE_OK)
+      return (void *)1;
+    snprintf(expected, sizeof(expected), "thread-%ld-note-%d", thread, i);
+    if (strcmp(fields.title, expected) != 0 || fields.kw_count != 1)
+      return (void *)1;
+  }
+  return NULL;
+}
+
+void test_connote_threads() {
+  pthread_t threads[THREADS];
+  for (long i = 0; i < THREADS; i++) {
+    assert(pthread_create(&threads[i], NULL, format_and_parse, (void *)i) == 0);
+  }
+  for (int i = 0; i < THREADS; i++) {
+    void *result;
+    assert(pthread_join(threads[i], &result) == 0 && result == NULL);
+  }
+
+  printf("All tests passed for concurrent use.\n");
+}
+
+void test_connote_create() {
+  char dir[] = "/tmp/connote_test_libconnote_XXXXXX";
+  make_vault(dir);
+  ConnoteError error;
+  ConnoteContext context;
+  assert(connote_open(&context, "/tmp/connote_test_libconnote_missing", CONNOTE_FSYNC_NONE, &error) == CONNOTE_EIO);
+  assert(error.sys_errno == ENOENT);
+  assert(connote_open(&context, dir, CONNOTE_FSYNC_DIR, &error) == CONNOTE_OK);
+  assert(context.dir_path[strlen(context.dir_path) - 1] == '/');
+
+  // Nothing is printed, even when a note can't be created
+  fflush(stdout);
+  fflush(stderr);
+  char output[] = "/tmp/connote_test_libconnote_output_XXXXXX";
+  int output_fd = mkstemp(output);
+  int saved_stdout = dup(STDOUT_FILENO), saved_stderr = dup(STDERR_FILENO);
+  dup2(output_fd, STDOUT_FILENO);
+  dup2(output_fd, STDERR_FILENO);
+
+  const char *keywords[] = {"ml"};
+  ConnoteNote note = {.id = "20240101T120000", .title = "Hello", .keywords = keywords, .kw_count = 1};
+  char first[CONNOTE_MAX_PATH_LEN], second[CONNOTE_MAX_PATH_LEN], third[CONNOTE_MAX_PATH_LEN];
+  ConnoteStatus created = connote_create(&context, &note, "body\n", 5, first, sizeof(first), &error);
+  ConnoteStatus collided = connote_create(&context, &note, NULL, 0, second, sizeof(second), &error);
+  chmod(dir, 0500);
+  ConnoteStatus denied = connote_create(&context, &note, NULL, 0, third, sizeof(third), &error);
+  chmod(dir, 0700);
+
+  fflush(stdout);
+  fflush(stderr);
+  dup2(saved_stdout, STDOUT_FILENO);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stdout);
+  close(saved_stderr);
+  struct stat st;
+  assert(fstat(output_fd, &st) == 0 && st.st_size == 0);
+  close(output_fd);
+  unlink(output);
+
+  assert(created == CONNOTE_OK && strcmp(first, "20240101T120000--hello__ml.md") == 0);
+  // A collision advances the ID
+  assert(collided == CONNOTE_OK && strcmp(second, "20240101T120001--hello__ml.md") == 0);
+  // Root ignores directory permissions
+  assert(denied == CONNOTE_OK || (denied == CONNOTE_EIO && error.sys_errno == EACCES));
+
+  char path[2 * CONNOTE_MAX_PATH_LEN], data[256] = {0};
+  snprintf(path, sizeof(path), "%s%s", context.dir_path, first);
+  FILE *f = fopen(path, "r");
+  assert(f != NULL && fread(data, 1, sizeof(data) - 1, f) > 0);
+  fclose(f);
+  ConnoteFields fields;
+  assert(connote_parse_frontmatter(data, strlen(data), &fields, &error) == CONNOTE_OK);
+  assert(strcmp(fields.title, "Hello") == 0 && strcmp(fields.id, "20240101T120000") == 0);
+  assert(strcmp(data + strlen(data) - 6, "\nbody\n") == 0);
+
+  note.id = NULL;
+  assert(connote_create(&context, &note, NULL, 0, path, sizeof(path), &error) == CONNOTE_OK);
+  assert(connote_parse_name(path, &fields, &error) == CONNOTE_OK && strcmp(fields.title, "hello") == 0);
+
+  connote_close(&context);
+  remove_vault(dir);
+  printf("All tests passed for connote_create.\n");
+}
+
+int main() {
+  test_connote_format_name();
+  test_connote_parse();
+  test_connote_threads();
+  test_connote_create();
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/output.h"
+#include "../src/utils.h"
+
+static Output out;
+
+// Run the writes in `write_records` in `format` and compare what reaches the
+// file descriptor with `expected`, which may contain null bytes
+static void assert_output(OutputFormat format, void (*write_records)(Output *), const char *expected,
+                          size_t expected_length) {
+  FILE *f = tmpfile();
+  assert(f != NULL);
+  output_init(&out, fileno(f), format);
+  write_records(&out);
+  assert(output_flush(&out) == SUCCESS);
+
+  char data[1024];
+  rewind(f);
+  size_t length = fread(data, 1, sizeof(data), f);
+  fclose(f);
+  assert(length == expected_length && memcmp(data, expected, length) == 0);
+}
+
+static void write_files(Output *out) {
+  output_file(out, NULL, "notes/20240101T120000==1a--hello__ml_ai.md");
+  output_file(out, "old\tname.md", "20240101T120001--q.md");
+}
+
+static void write_quoted(Output *out) { output_file(out, NULL, "dir \"x\"\\/20240101T120000--a\x01.md"); }
+
+static void write_pair(Output *out) { output_pair(out, "a.md", "b.md", false, 81); }
+
+static void write_changes(Output *out) {
+  output_change(out, 'R', "a.md", "b.md");
+  output_change(out, 'D', NULL, "c.md");
+}
+
+void test_output_formats() {
+  const char *text = "notes/20240101T120000==1a--hello__ml_ai.md\nold\tname.md -> 20240101T120001--q.md\n";
+  assert_output(FORMAT_TEXT, write_files, text, strlen(text));
+  const char *tsv = "notes/20240101T120000==1a--hello__ml_ai.md\t20240101T120000\t1a\thello\tml,ai\n"
+                    "20240101T120001--q.md\t20240101T120001\t\tq\t\told\\tname.md\n";
+  assert_output(FORMAT_TSV, write_files, tsv, strlen(tsv));
+  const char *json = "{\"path\":\"notes/20240101T120000==1a--hello__ml_ai.md\",\"id\":\"20240101T120000\","
+                     "\"signature\":\"1a\",\"title\":\"hello\",\"keywords\":[\"ml\",\"ai\"]}\n"
+                     "{\"path\":\"20240101T120001--q.md\",\"id\":\"20240101T120001\",\"signature\":\"\","
+                     "\"title\":\"q\",\"keywords\":[],\"old_path\":\"old\\tname.md\"}\n";
+  assert_output(FORMAT_JSON, write_files, json, strlen(json));
+  const char nul[] = "notes/20240101T120000==1a--hello__ml_ai.md\0"
+                    "20240101T120001--q.md";
+  assert_output(FORMAT_NUL, write_files, nul, sizeof(nul));
+
+  const char *quoted = "{\"path\":\"dir \\\"x\\\"\\\\/20240101T120000--a\\u0001.md\",\"id\":\"20240101T120000\","
+                       "\"signature\":\"\",\"title\":\"a\\u0001\",\"keywords\":[]}\n";
+  assert_output(FORMAT_JSON, write_quoted, quoted, strlen(quoted));
+  const char *pair = "{\"kind\":\"similar\",\"similarity\":81,\"first\":\"a.md\",\"second\":\"b.md\"}\n";
+  assert_output(FORMAT_JSON, write_pair, pair, strlen(pair));
+  assert_output(FORMAT_TSV, write_pair, "similar\t81\ta.md\tb.md\n", strlen("similar\t81\ta.md\tb.md\n"));
+
+  const char *changes = "R a.md -> b.md\nD c.md\n";
+  assert_output(FORMAT_TEXT, write_changes, changes, strlen(changes));
+  const char *json_changes = "{\"change\":\"renamed\",\"path\":\"b.md\",\"old_path\":\"a.md\"}\n"
+                             "{\"change\":\"removed\",\"path\":\"c.md\"}\n";
+  assert_output(FORMAT_JSON, write_changes, json_changes, strlen(json_changes));
+
+  printf("All tests passed for output formats.\n");
+}
+
+static void write_many(Output *out) {
+  char line[100];
+  memset(line, 'x', sizeof(line));
+  for (int i = 0; i < 1000; i++) {
+    output_write(out, line, sizeof(line));
+  }
+}
+
+void test_output_buffer() {
+  FILE *f = tmpfile();
+  assert(f != NULL);
+  output_init(&out, fileno(f), FORMAT_TEXT);
+  write_many(&out);
+  // Full buffers are written as they fill
+  struct stat st;
+  assert(fstat(fileno(f), &st) == 0 && st.st_size > 0 && st.st_size == 100000 - (off_t)out.length);
+  assert(output_flush(&out) == SUCCESS);
+  assert(fstat(fileno(f), &st) == 0 && st.st_size == 100000);
+  fclose(f);
+
+  // Writes to a closed descriptor fail once flushed
+  output_init(&out, -1, FORMAT_TEXT);
+  output_printf(&out, "%d\n", 1);
+  assert(output_flush(&out) == FAILURE);
+
+  printf("All tests passed for output buffering.\n");
+}
+
+int main() {
+  test_output_formats();
+  test_output_buffer();
+
+  return 0;
+}
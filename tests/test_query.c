@@ -0,0 +1,139 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/index.h"
+#include "../src/query.h"
+#include "../src/signature.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+// Run `text` and return the matches as the concatenated first letters of
+// their titles, in ID order
+static const char *run(NoteIndex *index, const SignatureIndex *sigs, const char *text, size_t *estimate) {
+  static char letters[64];
+  Query query;
+  assert(query_parse(&query, text) == SUCCESS);
+  size_t *results, count;
+  assert(query_run(&query, index, sigs, &results, &count) == SUCCESS);
+  assert(count < sizeof(letters));
+  for (size_t i = 0; i < count; i++) {
+    letters[i] = index->notes[results[i]].title[0];
+  }
+  letters[count] = '\0';
+  if (estimate != NULL)
+    *estimate = query.nodes[query.root].estimate;
+  free(results);
+  return letters;
+}
+
+void test_query_parse() {
+  Query query;
+  assert(query_parse(&query, "") == SUCCESS);
+  assert(query.nodes[query.root].kind == QUERY_AND && query.nodes[query.root].first_child == -1);
+
+  // AND binds tighter than OR, and NOT tighter than both
+  assert(query_parse(&query, "kw:a b OR NOT title:c") == SUCCESS);
+  const QueryNode *root = &query.nodes[query.root];
+  assert(root->kind == QUERY_OR);
+  assert(query.nodes[root->first_child].kind == QUERY_AND);
+  const QueryNode *right = &query.nodes[query.nodes[root->first_child].next_sibling];
+  assert(right->kind == QUERY_NOT && query.nodes[right->first_child].kind == QUERY_TITLE);
+
+  assert(query_parse(&query, "-(kw:a OR kw:b)") == SUCCESS);
+  assert(query.nodes[query.root].kind == QUERY_NOT);
+
+  // Values are normalised like filename components
+  assert(query_parse(&query, "kw:Project_X sig:12=A* title:\"Weekly Meeting\"") == SUCCESS);
+  int child = query.nodes[query.root].first_child;
+  assert(query.nodes[child].kind == QUERY_KEYWORD && strcmp(query.nodes[child].value, "projectx") == 0);
+  child = query.nodes[child].next_sibling;
+  assert(query.nodes[child].kind == QUERY_SIGNATURE_TREE && strcmp(query.nodes[child].value, "12=a") == 0);
+  child = query.nodes[child].next_sibling;
+  assert(query.nodes[child].kind == QUERY_TITLE && strcmp(query.nodes[child].value, "weekly-meeting") == 0);
+
+  assert(query_parse(&query, "date:2024-09..2024-10") == SUCCESS);
+  assert(query.nodes[query.root].low == 20240901000000ULL && query.nodes[query.root].high == 20241031235959ULL);
+  assert(query_parse(&query, "date:..2023") == SUCCESS);
+  assert(query.nodes[query.root].low == 0 && query.nodes[query.root].high == 20231231235959ULL);
+
+  // Unknown fields are plain search terms
+  assert(query_parse(&query, "http://example") == SUCCESS && query.nodes[query.root].kind == QUERY_TEXT);
+
+  assert(query_parse(&query, "(kw:a") == FAILURE);
+  assert(query_parse(&query, "kw:a)") == FAILURE);
+  assert(query_parse(&query, "kw:a OR") == FAILURE);
+  assert(query_parse(&query, "kw:") == FAILURE);
+  assert(query_parse(&query, "date:2024-13") == FAILURE);
+  assert(query_parse(&query, "date:..") == FAILURE);
+  assert(query_parse(&query, "id:2024") == FAILURE);
+  assert(query_parse(&query, "body:x") == FAILURE);
+  assert(query_parse(&query, "\"open") == FAILURE);
+
+  char deep[2 * QUERY_MAX_DEPTH + 8];
+  memset(deep, '(', sizeof(deep) - 1);
+  deep[sizeof(deep) - 1] = '\0';
+  assert(query_parse(&query, deep) == FAILURE);
+  printf("All tests passed for query_parse.\n");
+}
+
+void test_query_run() {
+  char dir[] = "/tmp/connote_test_query_XXXXXX";
+  make_vault(dir);
+  write_note(dir, "20230105T090000--alpha__ml.md", "Budget for the year\n");
+  write_note(dir, "20240901T100000==12--beta__ml_project.md", "notes\n");
+  write_note(dir, "20240915T100000==12a--gamma__project.md", "the BUDGET again\n");
+  write_note(dir, "20240920T100000==12a1--delta__projects.md", "nothing\n");
+  write_note(dir, "20241001T100000==13--epsilon.md", "nothing\n");
+
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  SignatureIndex sigs;
+  assert(signature_index_build(&sigs, &index) == SUCCESS);
+  size_t estimate;
+
+  assert(strcmp(run(&index, NULL, "", NULL), "abgde") == 0);
+  assert(strcmp(run(&index, NULL, "kw:project", &estimate), "bg") == 0 && estimate == 2);
+  assert(strcmp(run(&index, NULL, "kw:proj*", &estimate), "bgd") == 0 && estimate == 3);
+  assert(strcmp(run(&index, NULL, "date:2024-09", &estimate), "bgd") == 0 && estimate == 3);
+  assert(strcmp(run(&index, NULL, "date:2024-09-15..", NULL), "gde") == 0);
+  assert(strcmp(run(&index, NULL, "id:20240901T100000", NULL), "b") == 0);
+
+  // The smallest index drives an AND, and the rest is checked
+  assert(strcmp(run(&index, NULL, "kw:ml AND date:2024..", &estimate), "b") == 0 && estimate == 2);
+  assert(strcmp(run(&index, NULL, "kw:project -kw:ml", NULL), "g") == 0);
+  assert(strcmp(run(&index, NULL, "kw:ml OR sig:13", &estimate), "abe") == 0 && estimate == QUERY_UNINDEXED);
+  assert(strcmp(run(&index, &sigs, "kw:ml OR sig:13", &estimate), "abe") == 0 && estimate == 3);
+
+  // Signature subtrees follow the levels, so 12a* holds 12a1 but not 12
+  assert(strcmp(run(&index, &sigs, "sig:12a*", &estimate), "gd") == 0 && estimate == 2);
+  assert(strcmp(run(&index, NULL, "sig:12a*", NULL), "gd") == 0);
+  assert(strcmp(run(&index, &sigs, "sig:12", NULL), "b") == 0);
+  assert(strcmp(run(&index, &sigs, "sig:1*", NULL), "") == 0);
+
+  assert(strcmp(run(&index, NULL, "title~ta", NULL), "bd") == 0);
+  assert(strcmp(run(&index, NULL, "title:beta", NULL), "b") == 0);
+  assert(strcmp(run(&index, NULL, "body~budget", NULL), "ag") == 0);
+  assert(strcmp(run(&index, NULL, "project body~budget", NULL), "g") == 0);
+  assert(strcmp(run(&index, NULL, "NOT (kw:ml OR kw:project)", NULL), "de") == 0);
+
+  Query query;
+  assert(query_parse(&query, "date:2024") == SUCCESS);
+  assert(query_add(&query, "kw", ':', "ml") == SUCCESS);
+  assert(query_add(&query, "title", '~', "Bet") == SUCCESS);
+  assert(query_matches(&query, &index, &index.notes[1]));
+  assert(!query_matches(&query, &index, &index.notes[0]));
+
+  signature_index_free(&sigs);
+  index_free(&index);
+  remove_vault(dir);
+  printf("All tests passed for query_run.\n");
+}
+
+int main() {
+  test_query_parse();
+  test_query_run();
+
+  return 0;
+}
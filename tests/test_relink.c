@@ -0,0 +1,102 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/index.h"
+#include "../src/relink.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+static void assert_note_body(const char *dir, const char *name, const char *body) {
+  char path[MAX_PATH_LEN], data[512] = {0};
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+  FILE *f = fopen(path, "r");
+  assert(f != NULL);
+  assert(fread(data, 1, sizeof(data) - 1, f) == strlen(body));
+  fclose(f);
+  assert(strcmp(data, body) == 0);
+}
+
+// The names of the file links in `data`, separated by spaces
+static void link_names(const char *data, char *dest, size_t dest_size) {
+  size_t cursor = 0, start, end, used = 0;
+  dest[0] = '\0';
+  while (next_file_link(data, strlen(data), &cursor, &start, &end)) {
+    used += snprintf(dest + used, dest_size - used, "%s%.*s", used > 0 ? " " : "", (int)(end - start), data + start);
+  }
+}
+
+void test_next_file_link() {
+  char names[256];
+  link_names("[a](x.md) [b](<dir/my note.md>) [c](../y.md#part \"Title\") [d](z.md \"t\")", names, sizeof(names));
+  assert(strcmp(names, "x.md my note.md y.md z.md") == 0);
+  link_names("[[file:a.org][A]] [[file:sub/b.org::*Heading]] [[file:c.org]]", names, sizeof(names));
+  assert(strcmp(names, "a.org b.org c.org") == 0);
+  // URLs, denote: links, directories and unterminated links are not files
+  link_names("[u](https://x/a.md) [[denote:20240101T000001]] [d](dir/) [e](x.md", names, sizeof(names));
+  assert(strcmp(names, "") == 0);
+
+  char decoded[16];
+  assert(decode_link_name("my%20note.md", 12, decoded, sizeof(decoded)) == 10 && strcmp(decoded, "my note.md") == 0);
+  assert(decode_link_name("a-very-long-name.md", 19, decoded, sizeof(decoded)) == 0);
+  assert(link_name_key("x.md", 4) & LINK_NAME_FLAG);
+
+  printf("All tests passed for next_file_link.\n");
+}
+
+void test_relink_notes() {
+  char dir[] = "/tmp/connote_test_relink_XXXXXX";
+  make_vault(dir);
+  const char *a = "see [b](20240101T000002--b.md), [again](./20240101T000002--b.md#x) and [c](20240101T000003--c.md)\n"
+                  "[web](https://example.com/20240101T000002--b.md) denote:20240101T000002\n";
+  write_note(dir, "20240101T000001--a.md", a);
+  write_note(dir, "20240101T000002--b.md", "self [b](20240101T000002--b.md)\n");
+  write_note(dir, "20240101T000003--c.md", "#+title: c\n[[file:20240101T000002--b.md][B]] [x](x.md)\n");
+  write_note(dir, "20240101T000004--d.md", "no links to b\n");
+
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  size_t backlinks[4];
+  assert(index_backlinks(&index, link_name_key("20240101T000002--b.md", 21), backlinks, 4) == 3);
+
+  // Rename b and c, then tell the index
+  RelinkMove moves[] = {{"20240101T000002--b.md", "20240101T000002--new-b.md"},
+                        {"20240101T000003--c.md", "20240101T000003--new-c__x.md"}};
+  char old_path[2 * MAX_PATH_LEN], new_path[2 * MAX_PATH_LEN];
+  for (size_t i = 0; i < 2; i++) {
+    snprintf(old_path, sizeof(old_path), "%s/%s", dir, moves[i].old_name);
+    snprintf(new_path, sizeof(new_path), "%s/%s", dir, moves[i].new_name);
+    assert(rename(old_path, new_path) == 0);
+    index_remove_note(&index, moves[i].old_name);
+    index_update_note(&index, moves[i].new_name);
+  }
+
+  size_t rewritten;
+  assert(relink_notes(&index, moves, 2, FSYNC_DIR, &rewritten) == SUCCESS && rewritten == 3);
+  assert_note_body(dir, "20240101T000001--a.md",
+                   "see [b](20240101T000002--new-b.md), [again](./20240101T000002--new-b.md#x) and "
+                   "[c](20240101T000003--new-c__x.md)\n"
+                   "[web](https://example.com/20240101T000002--b.md) denote:20240101T000002\n");
+  assert_note_body(dir, "20240101T000002--new-b.md", "self [b](20240101T000002--new-b.md)\n");
+  assert_note_body(dir, "20240101T000003--new-c__x.md",
+                   "#+title: c\n[[file:20240101T000002--new-b.md][B]] [x](x.md)\n");
+  assert_note_body(dir, "20240101T000004--d.md", "no links to b\n");
+
+  // The index follows the rewritten links, and nothing is left to rewrite
+  assert(index_backlinks(&index, link_name_key("20240101T000002--b.md", 21), backlinks, 4) == 0);
+  assert(index_backlinks(&index, link_name_key("20240101T000002--new-b.md", 25), backlinks, 4) == 3);
+  assert(relink_notes(&index, moves, 2, FSYNC_NONE, &rewritten) == SUCCESS && rewritten == 0);
+
+  index_free(&index);
+  remove_vault(dir);
+  printf("All tests passed for relink_notes.\n");
+}
+
+int main() {
+  test_next_file_link();
+  test_relink_notes();
+
+  return 0;
+}
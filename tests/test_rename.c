@@ -0,0 +1,69 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+// Run `connote rename` in-process, with a home that has no connote directory
+static int run_rename(const char *home, const char *args) {
+  char command[4 * MAX_PATH_LEN];
+  int written = snprintf(command, sizeof(command),
+                         "HOME=%s CONNOTE_NO_DAEMON=1 ./bin/connote rename %s >/dev/null 2>&1", home, args);
+  assert(written > 0 && (size_t)written < sizeof(command));
+  return system(command);
+}
+
+static void assert_body(const char *path, const char *body) {
+  char data[64] = {0};
+  FILE *f = fopen(path, "r");
+  assert(f != NULL);
+  assert(fread(data, 1, sizeof(data) - 1, f) == strlen(body));
+  fclose(f);
+  assert(strcmp(data, body) == 0);
+}
+
+void test_rename_too_long() {
+  char dir[] = "/tmp/connote_test_rename_XXXXXX";
+  make_vault(dir);
+
+  // A directory deep enough that a long title takes the name past
+  // MAX_PATH_LEN
+  char deep[MAX_PATH_LEN];
+  size_t length = snprintf(deep, sizeof(deep), "%s", dir);
+  char component[201];
+  memset(component, 'd', 200);
+  component[200] = '\0';
+  while (length + 201 < MAX_PATH_LEN - 300) {
+    length += snprintf(deep + length, sizeof(deep) - length, "/%s", component);
+    assert(mkdir(deep, 0700) == 0);
+  }
+  write_note(deep, "20240101T000001--a.md", "A\n");
+  write_note(deep, "20240101T000002--b.md", "B\n");
+
+  char title[301];
+  memset(title, 't', 300);
+  title[300] = '\0';
+  char args[4 * MAX_PATH_LEN - 128];
+  snprintf(args, sizeof(args), "-t %s %s/20240101T000001--a.md %s/20240101T000002--b.md", title, deep, deep);
+  assert(run_rename(dir, args) != 0);
+
+  // Neither note was renamed, nor one onto the other
+  char path[MAX_PATH_LEN + 32];
+  snprintf(path, sizeof(path), "%s/20240101T000001--a.md", deep);
+  assert_body(path, "A\n");
+  snprintf(path, sizeof(path), "%s/20240101T000002--b.md", deep);
+  assert_body(path, "B\n");
+
+  remove_vault(dir);
+  printf("All tests passed for rename of names too long.\n");
+}
+
+int main() {
+  test_rename_too_long();
+
+  return 0;
+}
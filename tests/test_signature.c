@@ -0,0 +1,101 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/index.h"
+#include "../src/signature.h"
+#include "../src/utils.h"
+
+// In ID order, as a NoteIndex holds them
+static char *sigs_by_id[] = {"12a", "1",   "12",  "2",  "",   "12a1", "12b", "12a10", "12a2",
+                             "3b",  "12a", "12=c", "10", "1a", "12aa", "12z", "2b1"};
+#define NOTE_COUNT (sizeof(sigs_by_id) / sizeof(sigs_by_id[0]))
+
+static void make_index(NoteIndex *index, NoteRecord *notes) {
+  index_init(index, "/tmp");
+  for (size_t i = 0; i < NOTE_COUNT; i++) {
+    notes[i] = (NoteRecord){.id = i, .sig = sigs_by_id[i]};
+  }
+  index->notes = notes;
+  index->count = NOTE_COUNT;
+  index->generation = 1;
+}
+
+static const char *sig_at(const NoteIndex *index, const SignatureIndex *sigs, size_t pos) {
+  return pos == NOT_FOUND ? "(none)" : index->notes[sigs->notes[pos]].sig;
+}
+
+void test_signature_compare() {
+  assert(signature_compare("2", "10") < 0);
+  assert(signature_compare("12a", "12a1") < 0);
+  assert(signature_compare("12a9", "12a10") < 0);
+  assert(signature_compare("12z", "12aa") < 0);
+  assert(signature_compare("12=3", "12a") < 0);
+  assert(signature_compare("12a=1", "12a1") == 0);
+  assert(signature_compare("012", "12") == 0);
+  assert(signature_compare("1a", "12") < 0);
+
+  printf("All tests passed for signature_compare.\n");
+}
+
+void test_signature_index() {
+  NoteIndex index;
+  NoteRecord notes[NOTE_COUNT];
+  make_index(&index, notes);
+  SignatureIndex sigs;
+  assert(signature_index_build(&sigs, &index) == SUCCESS);
+  assert(sigs.count == NOTE_COUNT - 1);
+  assert(signature_index_current(&sigs, &index));
+
+  // Sequence order, notes sharing a signature in ID order
+  const char *order[] = {"1",    "1a",   "2",     "2b1", "3b",   "10",  "12",  "12a",
+                         "12a", "12a1", "12a2", "12a10", "12b", "12=c", "12z", "12aa"};
+  for (size_t i = 0; i < sigs.count; i++) {
+    assert(strcmp(sig_at(&index, &sigs, i), order[i]) == 0);
+  }
+  assert(sigs.notes[7] == 0 && sigs.notes[8] == 10);
+
+  size_t a = signature_find(&sigs, "12a");
+  assert(a == 7);
+  assert(strcmp(sig_at(&index, &sigs, signature_parent(&sigs, a)), "12") == 0);
+  assert(signature_parent(&sigs, signature_find(&sigs, "12")) == NOT_FOUND);
+  assert(strcmp(sig_at(&index, &sigs, signature_next_sibling(&sigs, a)), "12b") == 0);
+  assert(strcmp(sig_at(&index, &sigs, signature_prev_sibling(&sigs, signature_find(&sigs, "12b"))), "12a") == 0);
+  assert(signature_prev_sibling(&sigs, a) == NOT_FOUND);
+  assert(signature_next_sibling(&sigs, signature_find(&sigs, "12aa")) == NOT_FOUND);
+  // Levels without a note of their own are passed over
+  assert(strcmp(sig_at(&index, &sigs, signature_parent(&sigs, signature_find(&sigs, "2b1"))), "2") == 0);
+  assert(signature_parent(&sigs, signature_find(&sigs, "3b")) == NOT_FOUND);
+  assert(signature_next_sibling(&sigs, signature_find(&sigs, "3b")) == NOT_FOUND);
+  assert(strcmp(sig_at(&index, &sigs, signature_next_sibling(&sigs, signature_find(&sigs, "2"))), "10") == 0);
+
+  size_t children[8];
+  assert(signature_children(&sigs, a, children, 8) == 3);
+  assert(strcmp(sig_at(&index, &sigs, children[0]), "12a1") == 0);
+  assert(strcmp(sig_at(&index, &sigs, children[2]), "12a10") == 0);
+  assert(signature_children(&sigs, signature_find(&sigs, "12"), children, 8) == 6);
+  assert(signature_children(&sigs, signature_find(&sigs, "1"), children, 8) == 1);
+  assert(signature_children(&sigs, signature_find(&sigs, "2"), children, 8) == 0);
+
+  size_t start, end;
+  signature_subtree(&sigs, "12a", &start, &end);
+  assert(start == 7 && end == 12);
+  signature_subtree(&sigs, "4", &start, &end);
+  assert(start == end);
+
+  // Any change to the notes means a rebuild
+  index.generation++;
+  assert(!signature_index_current(&sigs, &index));
+  signature_index_free(&sigs);
+
+  printf("All tests passed for signature index.\n");
+}
+
+int main() {
+  test_signature_compare();
+  test_signature_index();
+
+  return 0;
+}
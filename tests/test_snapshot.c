@@ -0,0 +1,90 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/index.h"
+#include "../src/snapshot.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+static void take_snapshot(const char *dir, const Snapshot *previous, Snapshot *snapshot, size_t *hashed) {
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  assert(snapshot_build(snapshot, &index, previous, hashed) == SUCCESS);
+  index_free(&index);
+}
+
+void test_snapshot_diff() {
+  char dir[] = "/tmp/connote_test_snapshot_XXXXXX";
+  make_vault(dir);
+  write_note(dir, "20230505T000000--old.md", "old\n");
+  write_note(dir, "20240101T000000--a.md", "a\n");
+  write_note(dir, "20240101T000001--b.md", "b\n");
+  write_note(dir, "20240202T000000--c.md", "c\n");
+
+  Snapshot first, read, second;
+  size_t hashed;
+  take_snapshot(dir, NULL, &first, &hashed);
+  assert(hashed == 4 && first.leaf_count == 4);
+  // Two years, three months and three days
+  assert(first.node_counts[0] == 2 && first.node_counts[1] == 3 && first.node_counts[2] == 3);
+
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s.snapshot", dir);
+  assert(snapshot_write(&first, path) == SUCCESS);
+  assert(snapshot_read(&read, path) == SUCCESS);
+  assert(read.root == first.root && read.leaf_count == 4);
+  assert(strcmp(snapshot_name(&read, 3), "20240202T000000--c.md") == 0);
+
+  // Nothing changed, so nothing is read and nothing differs
+  SnapshotChange *changes;
+  take_snapshot(dir, &read, &second, &hashed);
+  assert(hashed == 0 && second.root == read.root);
+  assert(snapshot_diff(&read, &second, &changes) == 0);
+  free(changes);
+  snapshot_free(&second);
+
+  char old_path[MAX_PATH_LEN], new_path[MAX_PATH_LEN];
+  snprintf(old_path, MAX_PATH_LEN, "%s/20240101T000001--b.md", dir);
+  snprintf(new_path, MAX_PATH_LEN, "%s/20240101T000001--b__renamed.md", dir);
+  assert(rename(old_path, new_path) == 0);
+  snprintf(old_path, MAX_PATH_LEN, "%s/20230505T000000--old.md", dir);
+  assert(unlink(old_path) == 0);
+  write_note(dir, "20240202T000000--c.md", "c, changed\n");
+  write_note(dir, "20250101T000000--new.md", "new\n");
+
+  take_snapshot(dir, &read, &second, &hashed);
+  size_t count = snapshot_diff(&read, &second, &changes);
+  assert(count == 4);
+  assert(changes[0].kind == CHANGE_REMOVED &&
+         strcmp(snapshot_name(&read, changes[0].old_leaf), "20230505T000000--old.md") == 0);
+  assert(changes[1].kind == CHANGE_RENAMED &&
+         strcmp(snapshot_name(&second, changes[1].new_leaf), "20240101T000001--b__renamed.md") == 0);
+  assert(changes[2].kind == CHANGE_MODIFIED &&
+         strcmp(snapshot_name(&second, changes[2].new_leaf), "20240202T000000--c.md") == 0);
+  assert(changes[3].kind == CHANGE_ADDED &&
+         strcmp(snapshot_name(&second, changes[3].new_leaf), "20250101T000000--new.md") == 0);
+  free(changes);
+
+  // A damaged snapshot is refused
+  FILE *f = fopen(path, "r+");
+  assert(f != NULL && fseek(f, -2, SEEK_END) == 0 && fputc('x', f) != EOF);
+  fclose(f);
+  Snapshot damaged;
+  assert(snapshot_read(&damaged, path) == FAILURE);
+
+  snapshot_free(&first);
+  snapshot_free(&read);
+  snapshot_free(&second);
+  unlink(path);
+  remove_vault(dir);
+  printf("All tests passed for snapshot_diff.\n");
+}
+
+int main() {
+  test_snapshot_diff();
+
+  return 0;
+}
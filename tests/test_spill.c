@@ -0,0 +1,106 @@
+#include <assert.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/spill.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+#define RECORD_COUNT 5000
+
+typedef struct {
+  uint32_t key;
+  uint32_t sequence;
+} Record;
+
+// Orders by key alone, so records with equal keys tie
+static int compare_records(const void *a, size_t a_length, const void *b, size_t b_length, void *arg) {
+  Record x, y;
+  memcpy(&x, a, sizeof(x));
+  memcpy(&y, b, sizeof(y));
+  return (x.key > y.key) - (x.key < y.key);
+}
+
+static size_t entries(const char *dir) {
+  DIR *d = opendir(dir);
+  assert(d != NULL);
+  size_t count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    count += entry->d_name[0] != '.' || strncmp(entry->d_name, SPILL_DIR_PREFIX, strlen(SPILL_DIR_PREFIX)) == 0;
+  }
+  closedir(d);
+  return count;
+}
+
+// Sort RECORD_COUNT records in `budget` bytes and check they come back in
+// order, equal keys in the order they were added
+static void sort_records(const char *dir, size_t budget, bool expect_runs) {
+  Spill spill;
+  spill_init(&spill, dir, budget, compare_records, NULL);
+  srand(7);
+  for (uint32_t i = 0; i < RECORD_COUNT; i++) {
+    Record record = {.key = (uint32_t)rand() % 100, .sequence = i};
+    assert(spill_add(&spill, &record, sizeof(record)) == SUCCESS);
+  }
+  assert((spill.run_count > 1) == expect_runs);
+  assert(spill_sort(&spill) == SUCCESS);
+  // Runs are removed as soon as they are mapped
+  assert(entries(dir) == 0);
+
+  Record previous = {0};
+  const void *data;
+  size_t length, count = 0;
+  while (spill_next(&spill, &data, &length)) {
+    Record record;
+    assert(length == sizeof(record));
+    memcpy(&record, data, sizeof(record));
+    assert(count == 0 || previous.key < record.key ||
+           (previous.key == record.key && previous.sequence < record.sequence));
+    previous = record;
+    count++;
+  }
+  assert(count == RECORD_COUNT);
+  assert(!spill_next(&spill, &data, &length));
+  spill_free(&spill);
+}
+
+void test_spill() {
+  char dir[] = "/tmp/connote_test_spill_XXXXXX";
+  make_vault(dir);
+
+  sort_records(dir, 1 << 20, false);
+  sort_records(dir, 4096, true);
+  // A budget smaller than one record still sorts, one record per run
+  sort_records(dir, 1, true);
+
+  // Nothing is left behind when the records are never read back
+  Spill spill;
+  spill_init(&spill, dir, 64, compare_records, NULL);
+  for (uint32_t i = 0; i < 100; i++) {
+    Record record = {.key = i, .sequence = i};
+    assert(spill_add(&spill, &record, sizeof(record)) == SUCCESS);
+  }
+  assert(entries(dir) == 1);
+  spill_free(&spill);
+  assert(entries(dir) == 0);
+
+  spill_init(&spill, dir, 64, compare_records, NULL);
+  const void *data;
+  size_t length;
+  assert(spill_sort(&spill) == SUCCESS && !spill_next(&spill, &data, &length));
+  spill_free(&spill);
+
+  assert(rmdir(dir) == 0);
+  printf("All tests passed for spill.\n");
+}
+
+int main() {
+  test_spill();
+
+  return 0;
+}
@@ -0,0 +1,54 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/stats.h"
+
+void test_trace() {
+  char path[] = "/tmp/connote_test_trace_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd != -1);
+  close(fd);
+
+  stats_start(false, path);
+  for (int i = 0; i < 3; i++) {
+    STATS_BEGIN(PHASE_PARSE);
+    STATS_SYSCALL(SYS_READ, 2);
+    STATS_END(PHASE_PARSE);
+  }
+  stats_finish();
+
+  FILE *file = fopen(path, "r");
+  assert(file != NULL);
+  char contents[4096];
+  size_t length = fread(contents, 1, sizeof(contents) - 1, file);
+  contents[length] = '\0';
+  fclose(file);
+  unlink(path);
+
+#ifdef CONNOTE_STATS
+  assert(strncmp(contents, "{\"displayTimeUnit\"", 18) == 0);
+  size_t parse_events = 0;
+  for (char *event = strstr(contents, "\"name\": \"parse\""); event != NULL;
+       event = strstr(event + 1, "\"name\": \"parse\"")) {
+    parse_events++;
+  }
+  assert(parse_events == 3);
+  assert(strstr(contents, "\"read\": 6") != NULL);
+  assert(strstr(contents, "\"peak_rss_kb\"") != NULL);
+#else
+  // Without statistics nothing is written
+  assert(length == 0);
+#endif
+
+  printf("All tests passed for trace.\n");
+}
+
+int main() {
+  test_trace();
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/index.h"
+#include "../src/store.h"
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+#define NOTE_COUNT 150
+
+static void make_linked_vault(char *dir) {
+  make_vault(dir);
+  for (int i = 0; i < NOTE_COUNT; i++) {
+    char name[MAX_PATH_LEN], body[256];
+    snprintf(name, sizeof(name), "20240101T%06d%s--note-%d__kw%d_common.md", i, i % 7 == 0 ? "==1a" : "", i, i % 5);
+    snprintf(body, sizeof(body), "---\ntitle: Note %d\n---\ndenote:20240101T%06d denote:20240101T000000\n", i,
+             (i * 37) % NOTE_COUNT);
+    write_old_note(dir, name, body);
+  }
+}
+
+static void assert_same_note(const NoteIndex *a, const NoteRecord *x, const NoteIndex *b, const NoteRecord *y) {
+  assert(x->id == y->id && strcmp(x->name, y->name) == 0 && strcmp(x->sig, y->sig) == 0);
+  assert(strcmp(x->title, y->title) == 0 && strcmp(x->full_title, y->full_title) == 0);
+  assert(x->mtime == y->mtime && x->mtime_nsec == y->mtime_nsec && x->size == y->size);
+  assert(x->kw_count == y->kw_count);
+  for (uint32_t k = 0; k < x->kw_count; k++) {
+    assert(strcmp(a->keywords.names[x->kw[k]], b->keywords.names[y->kw[k]]) == 0);
+  }
+  assert(x->link_count == y->link_count);
+  assert(x->link_count == 0 || memcmp(x->links, y->links, x->link_count * sizeof(uint64_t)) == 0);
+}
+
+static void assert_same_notes(const NoteIndex *a, const NoteIndex *b) {
+  assert(a->count == b->count);
+  for (size_t i = 0; i < a->count; i++) {
+    assert_same_note(a, &a->notes[i], b, &b->notes[i]);
+  }
+}
+
+static char *read_store(const char *dir, size_t *length) {
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, STORE_FILE_NAME);
+  FILE *f = fopen(path, "rb");
+  assert(f != NULL);
+  char *data = malloc(1 << 20);
+  *length = fread(data, 1, 1 << 20, f);
+  fclose(f);
+  return data;
+}
+
+typedef struct {
+  const NoteIndex *expected;
+  size_t visited;
+  size_t chunks;
+} StreamCheck;
+
+static int check_chunk(void *ctx, NoteIndex *chunk, size_t first) {
+  StreamCheck *check = ctx;
+  assert(first == check->visited);
+  for (size_t i = 0; i < chunk->count; i++) {
+    assert_same_note(check->expected, &check->expected->notes[first + i], chunk, &chunk->notes[i]);
+  }
+  check->visited += chunk->count;
+  check->chunks++;
+  return SUCCESS;
+}
+
+void test_crc32c() {
+  assert(crc32c(0, "123456789", 9) == 0xe3069283);
+  assert(crc32c(crc32c(0, "1234", 4), "56789", 5) == 0xe3069283);
+  assert(crc32c(0, "", 0) == 0);
+
+  printf("All tests passed for crc32c.\n");
+}
+
+void test_store_read() {
+  char dir[] = "/tmp/connote_test_store_XXXXXX";
+  make_linked_vault(dir);
+
+  NoteIndex index;
+  assert(index_build(&index, dir) == SUCCESS);
+  Store store;
+  assert(store_open(&store, dir) == SUCCESS);
+  assert(store.count == NOTE_COUNT);
+
+  // Every accessor agrees with the index it was written from
+  StoreCursor cursor;
+  store_cursor_init(&cursor, &store);
+  for (size_t i = 0; i < index.count; i++) {
+    const NoteRecord *note = &index.notes[i];
+    char name[MAX_PATH_LEN];
+    assert(store_name(&store, i, name, sizeof(name)) == SUCCESS && strcmp(name, note->name) == 0);
+    assert(store_find_name(&store, note->name) == i);
+    assert(store_id(&store, i) == note->id);
+    assert(strcmp(store_full_title(&store, i), note->full_title) == 0);
+
+    uint32_t kw[MAX_KEYS];
+    assert(store_note_keywords(&store, i, kw) == note->kw_count);
+    for (uint32_t k = 0; k < note->kw_count; k++) {
+      assert(strcmp(store_keyword(&store, kw[k]), index.keywords.names[note->kw[k]]) == 0);
+    }
+    uint64_t links[8];
+    assert(store_links(&store, i, links, 8) == note->link_count);
+    assert(memcmp(links, note->links, note->link_count * sizeof(uint64_t)) == 0);
+
+    assert(store_cursor_next(&cursor) && cursor.position == i && strcmp(cursor.name, note->name) == 0);
+    assert(cursor.size == note->size && cursor.link_count == note->link_count);
+  }
+  assert(!store_cursor_next(&cursor));
+  assert(store_find_name(&store, "20240101T000000--missing.md") == NOT_FOUND);
+  assert(store_find_name(&store, "00000000T000000--first.md") == NOT_FOUND);
+  assert(store_find_name(&store, "99999999T000000--last.md") == NOT_FOUND);
+  store_cursor_free(&cursor);
+  store_close(&store);
+
+  index_free(&index);
+  remove_vault(dir);
+  printf("All tests passed for store reads.\n");
+}
+
+void test_store_rebuild() {
+  char dir[] = "/tmp/connote_test_store_XXXXXX";
+  make_linked_vault(dir);
+
+  NoteIndex cold, warm;
+  assert(index_build(&cold, dir) == SUCCESS);
+  assert(index_build(&warm, dir) == SUCCESS);
+  assert_same_notes(&cold, &warm);
+  index_free(&warm);
+
+  // Notes are restored from the store while their size and mtime match
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, cold.notes[5].name);
+  struct stat st;
+  assert(stat(path, &st) == 0);
+  const char *edits[] = {"---\ntitle: Nope 5", "---\ntitle: Note 5"};
+  for (int e = 0; e < 2; e++) {
+    FILE *f = fopen(path, "r+");
+    assert(f != NULL);
+    fputs(edits[e], f);
+    fclose(f);
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    assert(utimensat(AT_FDCWD, path, times, 0) == 0);
+    assert(index_build(&warm, dir) == SUCCESS);
+    assert(strcmp(warm.notes[5].full_title, "Note 5") == 0);
+    index_free(&warm);
+  }
+
+  // Changed, added and removed notes are picked up
+  write_old_note(dir, "20240101T000003--note-3__kw3_common.md", "---\ntitle: Changed\n---\n");
+  write_old_note(dir, "20250101T000000--added__new.md", "---\ntitle: Added\n---\n");
+  snprintf(path, MAX_PATH_LEN, "%s/20240101T000004--note-4__kw4_common.md", dir);
+  unlink(path);
+  index_free(&cold);
+  assert(index_build(&warm, dir) == SUCCESS);
+  assert(warm.count == NOTE_COUNT);
+  assert(strcmp(warm.notes[3].full_title, "Changed") == 0 && warm.notes[3].link_count == 0);
+  assert(strcmp(warm.notes[NOTE_COUNT - 1].full_title, "Added") == 0);
+  assert(index_find_name(&warm, "20240101T000004--note-4__kw4_common.md") == NOT_FOUND);
+
+  // A damaged store is ignored and replaced
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, STORE_FILE_NAME);
+  int fd = open(path, O_RDWR);
+  assert(fd != -1);
+  assert(fstat(fd, &st) == 0);
+  char byte;
+  assert(pread(fd, &byte, 1, st.st_size / 2) == 1);
+  byte ^= 0x10;
+  assert(pwrite(fd, &byte, 1, st.st_size / 2) == 1);
+  close(fd);
+  Store store;
+  assert(store_open(&store, dir) == FAILURE);
+
+  assert(index_build(&cold, dir) == SUCCESS);
+  assert_same_notes(&cold, &warm);
+  assert(store_open(&store, dir) == SUCCESS);
+  store_close(&store);
+
+  index_free(&cold);
+  index_free(&warm);
+  remove_vault(dir);
+  printf("All tests passed for store rebuilds.\n");
+}
+
+void test_store_stream() {
+  char dir[] = "/tmp/connote_test_store_XXXXXX";
+  make_linked_vault(dir);
+  NoteIndex index, again;
+  assert(index_build(&index, dir) == SUCCESS);
+
+  // Sections gathered in files give the same bytes as in memory
+  size_t length, spilled_length;
+  char *in_memory = read_store(dir, &length);
+  StoreWriter writer;
+  assert(store_writer_init(&writer, dir) == SUCCESS);
+  for (size_t i = 0; i < index.count; i++) {
+    assert(store_writer_add(&writer, &index.notes[i]) == SUCCESS);
+  }
+  assert(store_writer_finish(&writer, dir, &index.keywords) == SUCCESS);
+  store_writer_free(&writer);
+  char *spilled = read_store(dir, &spilled_length);
+  assert(spilled_length == length && memcmp(spilled, in_memory, length) == 0);
+  free(spilled);
+  free(in_memory);
+
+  // Out of order names are refused
+  assert(store_writer_init(&writer, NULL) == SUCCESS);
+  assert(store_writer_add(&writer, &index.notes[1]) == SUCCESS);
+  assert(store_writer_add(&writer, &index.notes[0]) == FAILURE);
+  store_writer_free(&writer);
+
+  // A few notes at a time, from the store and then from the notes themselves
+  for (int pass = 0; pass < 2; pass++) {
+    StreamCheck check = {.expected = &index};
+    assert(index_stream(dir, 4 * INDEX_NOTE_BYTES, check_chunk, &check) == SUCCESS);
+    assert(check.visited == NOTE_COUNT && check.chunks == NOTE_COUNT / 2 + NOTE_COUNT % 2);
+
+    char path[MAX_PATH_LEN];
+    snprintf(path, MAX_PATH_LEN, "%s/%s", dir, STORE_FILE_NAME);
+    assert(unlink(path) == 0);
+  }
+  // The store written as the notes streamed past serves the next build
+  StreamCheck check = {.expected = &index};
+  assert(index_stream(dir, 1 << 20, check_chunk, &check) == SUCCESS && check.chunks == 1);
+  Store store;
+  assert(store_open(&store, dir) == SUCCESS && store.count == NOTE_COUNT);
+  store_close(&store);
+  assert(index_build(&again, dir) == SUCCESS);
+  assert_same_notes(&index, &again);
+
+  index_free(&again);
+  index_free(&index);
+  remove_vault(dir);
+  printf("All tests passed for store streams.\n");
+}
+
+int main() {
+  test_crc32c();
+  test_store_read();
+  test_store_rebuild();
+  test_store_stream();
+
+  return 0;
+}
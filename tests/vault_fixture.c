@@ -0,0 +1,38 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../src/utils.h"
+#include "vault_fixture.h"
+
+void make_vault(char *dir) { assert(mkdtemp(dir) != NULL); }
+
+void remove_vault(const char *dir) {
+  char command[MAX_PATH_LEN + 16];
+  snprintf(command, sizeof(command), "rm -rf '%s'", dir);
+  assert(system(command) == 0);
+}
+
+void write_note(const char *dir, const char *name, const char *body) {
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+  FILE *f = fopen(path, "w");
+  assert(f != NULL);
+  fputs(body, f);
+  fclose(f);
+}
+
+void write_old_note(const char *dir, const char *name, const char *body) {
+  write_note(dir, name, body);
+
+  char path[MAX_PATH_LEN];
+  snprintf(path, MAX_PATH_LEN, "%s/%s", dir, name);
+  struct timespec times[2];
+  clock_gettime(CLOCK_REALTIME, &times[0]);
+  times[0].tv_sec -= 3600;
+  times[1] = times[0];
+  assert(utimensat(AT_FDCWD, path, times, 0) == 0);
+}
@@ -0,0 +1,15 @@
+#ifndef VAULT_FIXTURE_H_
+#define VAULT_FIXTURE_H_
+
+// Temporary vaults for the tests. Each helper asserts that it succeeded.
+
+// Create a directory from the mkdtemp template `dir`, which is overwritten
+// with its name
+void make_vault(char *dir);
+// Remove `dir` and everything in it
+void remove_vault(const char *dir);
+void write_note(const char *dir, const char *name, const char *body);
+// Write a note dated an hour ago, so caches never see it as racy
+void write_old_note(const char *dir, const char *name, const char *body);
+
+#endif // VAULT_FIXTURE_H_